@@ -5,10 +5,24 @@
  * \author Martin Matysiak
  */
 
-#include <avr/sleep.h>
 #include "global.h"
+#include "modules/compress.h"
+#include "modules/nmea.h"
 #include "modules/nofs.h"
 #include "modules/gps.h"
+#include "modules/gsv.h"
+#include "modules/latency.h"
+#include "modules/power.h"
+#include "modules/profiler.h"
+#include "modules/session.h"
+#include "modules/stack.h"
+#include "modules/supply.h"
+#include "modules/telemetry.h"
+#include "modules/trace.h"
+#include "modules/track.h"
+#include "modules/warmstart.h"
+
+#include <avr/wdt.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 // Change these constants in order to alter the logging behaviour
@@ -20,24 +34,338 @@
 #define FREQUENCY 1
 
 /**
- * Indicates which messages to record per message packet
- * Valid values for the ST22 are:
- * [GPS_NMEA_GGA, GPS_NMEA_GSA, GPS_NMEA_GSV, GPS_NMEA_GLL, GPS_NMEA_RMC,
- *  GPS_NMEA_VTG, GPS_NMEA_ZDA]
- * Several message types can be combined using ORs.
+ * Indicates how often each message type shall be recorded, in message
+ * packets (i.e. 1 = every packet, FREQUENCY * 5 = every five seconds, at
+ * most 255). Set to 0 in order to disable a message type.
+ */
+#define INTERVAL_GGA 1
+#define INTERVAL_GSA 0
+#define INTERVAL_GSV 0
+#define INTERVAL_GLL 0
+#define INTERVAL_RMC 1
+#define INTERVAL_VTG 1
+#define INTERVAL_ZDA 0
+
+/**
+ * Maximum deviation (in meters) between the track predicted from the last
+ * written fixes and the actual position. Fixes which deviate less are not
+ * written onto the card. Set to 0 in order to write every fix.
+ */
+#define TRACK_THRESHOLD 0
+
+/**
+ * If the track filter is active, a fix will be written at least every
+ * TRACK_INTERVAL seconds (max. 65), even if it has been predicted correctly
  */
-#define MESSAGES GPS_NMEA_GGA | GPS_NMEA_RMC | GPS_NMEA_VTG
+#define TRACK_INTERVAL 30
+
+/**
+ * If set to TRUE, every complete group of GSV sentences is replaced by a
+ * single $PGLGSV summary sentence (see gsv.h). Only built if GSV sentences
+ * are recorded at all.
+ */
+#define GSV_SUMMARY (INTERVAL_GSV != 0)
+
+/**
+ * Interval (in seconds) in which the last fix is stored in the EEPROM in
+ * order to be handed to the GPS-module at the next power-up (see
+ * warmstart.h). Set to 0 in order to disable the warm start assistance
+ * (the default on MCUs with 1 KB of SRAM, it needs about 40 bytes).
+ */
+#define WARMSTART_INTERVAL (MCU_SMALL_SRAM ? 0 : 600)
+
+/**
+ * Interval (in minutes) in which the SRAM usage and the high-watermark of the
+ * stack are written onto the card (see stack.h). The figures are also
+ * written once behind the version sentence. Set to 0 in order to write them
+ * only at power-up.
+ */
+#define STACK_REPORT_INTERVAL 10
+
+/**
+ * Every TELEMETRY_INTERVAL-th RMC sentence of the first receiver is sent as
+ * binary frame on the TX line of TELEMETRY_PORT (see telemetry.h), which is
+ * otherwise idle after the initialization. Set to 0 in order to disable the
+ * telemetry.
+ */
+#define TELEMETRY_INTERVAL 0
+#define TELEMETRY_PORT UART_0
+
+/**
+ * Highest update rate (in Hz) at which the GPS-modules are switched into
+ * their power save mode between the fixes (see power.h). Set to 0 in order
+ * to keep them tracking continuously.
+ */
+#define POWER_SAVE_FREQUENCY 1
+
+/**
+ * Maximum age (in seconds) of data which is only kept in the sector buffer.
+ * Older data is committed onto the card, the partial sector is rewritten in
+ * place later on (see nofs_age). The age is timed by Timer0 (the timebase of
+ * the flight recorder, see TRACE in trace.h), so it advances while the
+ * receivers are silent as well. Set to 0 in order to write full sectors
+ * only (the default without TRACE, e.g. on MCUs with 1 KB of SRAM). See
+ * NOFS_COMMIT_BYTES (nofs.h) for a limit in bytes and SUPPLY_MONITOR
+ * (supply.h) for a commit when the power is cut.
+ */
+#define COMMIT_AGE (TRACE ? 30 : 0)
+
+/**
+ * Interval (in minutes) in which the sector writes of each kind are written
+ * onto the card ($PGLCMT, see nofs_report), e.g. in order to check the write
+ * amplification of the commit policy. Set to 0 in order to write no reports.
+ */
+#define COMMIT_REPORT_INTERVAL 10
 
 // No changes needed after this point
 ////////////////////////////////////////////////////////////////////////////////
 
-/// Number of set bits in the MESSAGES field (ugly code, but it serves its purpose)
-#define NUM_MESSAGES (((MESSAGES) & 1) + (((MESSAGES) >> 1) & 1) + (((MESSAGES) >> 2) & 1) + (((MESSAGES) >> 3) & 1) + (((MESSAGES) >> 4) & 1) + (((MESSAGES) >> 5) & 1) + (((MESSAGES) >> 6) & 1) + (((MESSAGES) >> 7) & 1))
+/// Number of sentences per minute produced by a message type with the given interval
+#define PER_MINUTE(pInterval, pSentences) ((pInterval) ? 60 * FREQUENCY * (pSentences) / (pInterval) : 0)
+
+/// Sentences per minute of an entry of GPS_NMEA_TABLE (a GSV group consists of about 3 sentences)
+#define MESSAGE_PER_MINUTE(pName, pBit, pFirst, pSecond, pThird, pToken, pCheck, pEquality, pSentences, ...) \
+    + PER_MINUTE(INTERVAL_##pName, pSentences)
+
+/// Number of sentences per minute of all receivers
+#define MESSAGES_PER_MINUTE (UART_PORTS * (0 GPS_NMEA_TABLE(MESSAGE_PER_MINUTE)))
+
+/// The configured interval of an entry of GPS_NMEA_TABLE
+#define MESSAGE_INTERVAL(pName, ...) INTERVAL_##pName,
+
+/// The bit of an entry of GPS_NMEA_TABLE if the message type is configured
+#define MESSAGE_CONFIGURED(pName, pBit, ...) | ((INTERVAL_##pName) ? (pBit) : 0)
+
+#if (0 GPS_NMEA_TABLE(MESSAGE_CONFIGURED)) & ~(GPS_NMEA_ENABLED)
+    #error "A configured message type is not recognized, see NMEA_TYPES in the Makefile"
+#endif
+
+// The fix quality thresholds are checked in the sentences which carry them
+// (a configured type is recognized, see above)
+#if (GPS_MAX_PDOP || GPS_MIN_FIX) && !INTERVAL_GSA
+    #error "GPS_MAX_PDOP and GPS_MIN_FIX need GSA sentences, see INTERVAL_GSA"
+#endif
+
+#if GPS_MIN_SATELLITES && !INTERVAL_GGA
+    #error "GPS_MIN_SATELLITES needs GGA sentences, see INTERVAL_GGA"
+#endif
+
+#if GPS_MAX_HDOP && !INTERVAL_GGA && !INTERVAL_GSA
+    #error "GPS_MAX_HDOP needs GGA or GSA sentences, see INTERVAL_GGA"
+#endif
+
+/// Highest update rate the UART ring sustains with one sector buffer while
+/// the card collects garbage (gc:2,250,32, see tools/bufferbench). Measured
+/// on a GGA/RMC/VTG capture: 128 bytes (ATmega88/168) 2 Hz, 512 bytes
+/// (ATmega328P) 10 Hz, 1024 bytes (ATmega644P) 16 Hz, 2048 bytes
+/// (ATmega1284P) 20 Hz and more. The ST22 stops at 10 Hz.
+#if UART_INPUT_BUFFER_SIZE >= 512
+    #define MAX_FREQUENCY 10
+#elif UART_INPUT_BUFFER_SIZE >= 256
+    #define MAX_FREQUENCY 4
+#else
+    #define MAX_FREQUENCY 2
+#endif
+
+#if FREQUENCY > MAX_FREQUENCY
+    #error "FREQUENCY is too high for the UART ring of this MCU, see make variants"
+#endif
+
+// The compressor has to keep up with every receiver sending continuously at
+// GPS_BAUDRATE_HIGHSPEED with half of the CPU, it then does so at every
+// FREQUENCY the UART ring allows (it needs at most 42 % at 7.3728 MHz with
+// two receivers, see compress.h)
+#if NOFS_COMPRESSION && (COMPRESS_CYCLES_PER_BYTE * (GPS_BAUDRATE_HIGHSPEED / 10) * UART_PORTS > F_CPU / 2)
+    #error "NOFS_COMPRESSION is too slow for the receivers at this F_CPU"
+#endif
+
+// The state of the compressor (161 bytes) doesn't fit beside the sector
+// buffer and the UART ring (about 900 bytes of static data)
+#if NOFS_COMPRESSION && MCU_SMALL_SRAM
+    #error "NOFS_COMPRESSION needs more than 1 KB of SRAM"
+#endif
+
+#if COMPRESS_BENCHMARK && SDMMC_BENCHMARK
+    #error "COMPRESS_BENCHMARK and SDMMC_BENCHMARK share nmeaBuf, enable one at a time"
+#endif
+
+/// The LED will blink every LED_THRESHOLD messages (i.e. roughly once a second)
+#if MESSAGES_PER_MINUTE >= 90
+    #define LED_THRESHOLD ((MESSAGES_PER_MINUTE + 30) / 60)
+#else
+    #define LED_THRESHOLD 1
+#endif
+
+#if STACK_REPORT_INTERVAL
+    /// Number of processed sentences between two SRAM usage reports
+    #define STACK_REPORT_MESSAGES (STACK_REPORT_INTERVAL * 1UL * MESSAGES_PER_MINUTE)
+
+    #if STACK_REPORT_MESSAGES > 0xFFFF
+        #error "STACK_REPORT_INTERVAL is too long for the configured message rate"
+    #endif
+
+/// Number of sentences processed since the last SRAM usage report
+static uint16_t fStackCount = 0;
+#endif
+
+#if COMMIT_REPORT_INTERVAL
+    /// Number of processed sentences between two reports of the sector writes
+    #define COMMIT_REPORT_MESSAGES (COMMIT_REPORT_INTERVAL * 1UL * MESSAGES_PER_MINUTE)
+
+    #if COMMIT_REPORT_MESSAGES > 0xFFFF
+        #error "COMMIT_REPORT_INTERVAL is too long for the configured message rate"
+    #endif
+
+/// Number of sentences processed since the last report of the sector writes
+static uint16_t fCommitReportCount = 0;
+#endif
+
+#if COMMIT_AGE
+    #if !TRACE
+        #error "COMMIT_AGE needs the timebase of the flight recorder (TRACE)"
+    #endif
+
+    /// COMMIT_AGE in ticks of the timebase (see trace_now)
+    #define COMMIT_TICKS (COMMIT_AGE * 1UL * TRACE_TICKS_PER_SECOND)
+#endif
+
+#if TELEMETRY_INTERVAL && !INTERVAL_RMC
+    #error "The telemetry needs RMC sentences"
+#endif
+
+#if TELEMETRY_INTERVAL && (TELEMETRY_PORT >= UART_PORTS)
+    #error "TELEMETRY_PORT is not in use, see RECEIVERS in the Makefile"
+#endif
+
+#if WARMSTART_INTERVAL && !INTERVAL_RMC
+    #error "The warm start assistance needs RMC sentences"
+#endif
 
-/// The LED will blink every LED_THRESHOLD messages
-#define LED_THRESHOLD NUM_MESSAGES * FREQUENCY
+#if TRACK_THRESHOLD > 0
+    /// Asks the track filter if the sentence is worth being written
+    #define TRACK_FILTER(pSentence, pType) track_filter(pSentence, pType)
+#else
+    /// Track filter disabled, every valid sentence will be written
+    #define TRACK_FILTER(pSentence, pType) TRUE
+#endif
 
-char nmeaBuf[128];
+#if UART_PORTS > 1
+/// Source tags (NMEA 4.10 tag blocks) which precede the sentences of each receiver
+static char fTags[UART_PORTS][13] = {"\\s:GPS1*3C\\", "\\s:GPS2*3F\\"};
+#endif
+
+/// One sentence buffer per receiver
+char nmeaBuf[UART_PORTS][128];
+
+/**
+ * \brief Checks and writes a sentence the receiver has sent
+ *
+ * GSV summaries, the track filter and the latency instrumentation only cover
+ * the first receiver (their state exists only once).
+ *
+ * \param pPort The receiver (UART port) the sentence has been received from
+ * \param pSentence The sentence, may be replaced (e.g. by a GSV summary)
+ * \param pType The return value of gps_pollNMEA
+ */
+static void logger_process(uint8_t pPort, char* pSentence, uint8_t pType) {
+#if LATENCY
+    if (pPort == UART_0) {
+        latency_validated();
+    }
+#endif
+
+#if WARMSTART_INTERVAL
+    uint8_t firstFix = (pPort == UART_0) && warmstart_update(pSentence, pType, WARMSTART_INTERVAL);
+#endif
+
+#if GSV_SUMMARY
+    // Only a complete GSV group results in a (summary) sentence
+    if ((pPort == UART_0) && ((pType & GPS_NMEA_TYPEMASK) == GPS_NMEA_GSV)) {
+        if (gsv_add(pSentence)) {
+            gsv_summary(pSentence);
+        } else {
+            pType = GPS_NMEA_GSV | GPS_NMEA_INVALID;
+        }
+    }
+#endif
+
+    // We'll write the data only if it contains a valid position which is
+    // not considered redundant by the track filter
+    if ((pType & GPS_NMEA_VALID) && ((pPort != UART_0) || TRACK_FILTER(pSentence, pType))) {
+#if NOFS_SECTOR_HEADER
+        // Let the sector header know when the data has been recorded
+        if (pType & (GPS_NMEA_GGA | GPS_NMEA_RMC | GPS_NMEA_ZDA)) {
+            nofs_setTime(nmea_parseTime(nmea_getToken(pSentence, 1)));
+        }
+#endif
+
+#if NOFS_INDEX
+        // Only RMC and ZDA contain the date needed for the time index
+        if (pType & (GPS_NMEA_RMC | GPS_NMEA_ZDA)) {
+            nofs_setDateTime(nmea_parseDateTime(pSentence));
+        }
+#endif
+
+#if UART_PORTS > 1
+        nofs_writeString(fTags[pPort]);
+#endif
+        nofs_writeString(pSentence);
+
+#if NOFS_DIRECTORY
+        // The session directory summarizes the first receiver
+        if (pPort == UART_0) {
+            session_update(pSentence, pType);
+        }
+#endif
+
+#if LATENCY
+        if (pPort == UART_0) {
+            latency_written();
+        }
+#endif
+    }
+
+#if TELEMETRY_INTERVAL
+    // Only after the sentence has been written, the UART is never waited for
+    if (pPort == UART_0) {
+        telemetry_update(TELEMETRY_PORT, pSentence, pType, TELEMETRY_INTERVAL);
+    }
+#endif
+
+#if WARMSTART_INTERVAL
+    // The time to first fix is logged once, behind the first fix
+    if (firstFix) {
+        warmstart_report(pSentence, INTERVAL_RMC * 10 / FREQUENCY);
+        nofs_writeString(pSentence);
+    }
+#endif
+
+#if LATENCY
+    // The report sentences reuse the buffer of the sentence just written
+    if ((pPort == UART_0) && latency_due()) {
+        for (uint8_t i = 0; i < LATENCY_HISTOGRAMS; i++) {
+            latency_report(pSentence, i);
+            nofs_writeString(pSentence);
+        }
+    }
+#endif
+
+#if STACK_REPORT_INTERVAL
+    if (++fStackCount >= STACK_REPORT_MESSAGES) {
+        stack_report(pSentence);
+        nofs_writeString(pSentence);
+        fStackCount = 0;
+    }
+#endif
+
+#if COMMIT_REPORT_INTERVAL
+    if (++fCommitReportCount >= COMMIT_REPORT_MESSAGES) {
+        nofs_report(pSentence);
+        nofs_writeString(pSentence);
+        fCommitReportCount = 0;
+    }
+#endif
+}
 
 /**
  * \brief Main method of the project
@@ -59,27 +387,145 @@ int main (void) {
 	IO_CONF |= (1 << LED_STAT);
     LEDCODE_ON();
 
-    // Disable unneccesary modules
-    PRR |= (1 << PRTWI) | (1 << PRTIM2) | (1 << PRTIM0) | (1 << PRTIM1) | (1 << PRADC);
+    // Disable unneccesary modules (Timer0 is the timebase of the flight
+    // recorder, Timer1 the one of the latency instrumentation, Timer2 the
+    // one of the profiler)
+    PRR |= (1 << PRTWI) | (1 << PRADC)
+#if !TRACE
+        | (1 << PRTIM0)
+#endif
+#if !LATENCY
+        | (1 << PRTIM1)
+#endif
+#if !PROFILER
+        | (1 << PRTIM2)
+#endif
+        ;
+
+#if TRACE
+    // The initialization of the card is recorded as well
+    trace_init();
+#endif
+
+    // The watchdog of error keeps running after its reset until the reset
+    // flags are cleared (trace_init has recorded them)
+    MCUSR = 0;
+    wdt_disable();
+
+#if PROFILER
+    // The initialization is sampled as well
+    profiler_init();
+#endif
 
     _delay_ms(100);
 
+#if COMPRESS_BENCHMARK
+    // Resets the compressor, nofs_init then sets it up for the current sector
+    compress_benchmark(nmeaBuf[UART_0]);
+#endif
+
     // Initialize the necessary modules (these methods may lock the processor
     // in an endless loop if an error occurs!)
     nofs_init();
-    gps_init(FREQUENCY, MESSAGES);
+#if NOFS_DIRECTORY
+    session_init();
+#endif
+#if SUPPLY_MONITOR
+    supply_init();
+#endif
+
+    const uint8_t intervals[GPS_NMEA_COUNT] = {GPS_NMEA_TABLE(MESSAGE_INTERVAL)};
+#if WARMSTART_INTERVAL
+    // Hand the last fix to the module before it is configured
+    warmstart_restore(UART_0);
+#endif
+
+    for (uint8_t port = 0; port < UART_PORTS; port++) {
+        gps_init(port, FREQUENCY, intervals);
+        power_init(port, FREQUENCY, POWER_SAVE_FREQUENCY);
+    }
+
+#if TRACK_THRESHOLD > 0
+    track_init(TRACK_THRESHOLD, TRACK_INTERVAL);
+#endif
+
+#if SDMMC_BENCHMARK
+    // Needs Timer1 before the latency instrumentation takes it over
+    sdmmc_benchmark(nmeaBuf[UART_0]);
+#endif
+
+#if LATENCY
+    gps_enable1PPS(UART_0);
+    latency_init();
+#endif
 
     // Write a short information string containing the firmware version (NMEA compliant)
     nofs_writeString("\r\n$PGLGVER,1.6\r\n");
 
+#if SDMMC_BENCHMARK
+    // Followed by the cycles of the SPI loops with and without CRC
+    nofs_writeString(nmeaBuf[UART_0]);
+#endif
+
+#if COMPRESS_BENCHMARK
+    // or the cycles of the worst cases of the compressor
+    nofs_writeString(nmeaBuf[UART_0]);
+#endif
+
+#if SDMMC_CALIBRATE
+    // and the SPI clock the card has been calibrated to
+    sdmmc_report(nmeaBuf[UART_0]);
+    nofs_writeString(nmeaBuf[UART_0]);
+#endif
+
+    // Followed by the SRAM usage after the initialization
+    stack_report(nmeaBuf[UART_0]);
+    nofs_writeString(nmeaBuf[UART_0]);
+
     // Keep track of received messages
     uint8_t messageCount = 0;
     LEDCODE_OFF();
 
+    // Number of characters received so far of the current sentences
+    uint8_t lengths[UART_PORTS] = {0};
+
+#if COMMIT_AGE
+    // Time the age of the buffered data has been advanced last
+    uint16_t commitTime = trace_now();
+#endif
+
     while(1) {
-        // We'll write the data only if it contains a valid position
-        if (gps_getNMEA(nmeaBuf, 128) & GPS_NMEA_VALID) {
-            nofs_writeString(nmeaBuf);
+        // Neither receiver may block the other (nor the commit age), so the
+        // receivers are polled. Each one has its own ring buffer and
+        // sentence buffer.
+        uint8_t received = FALSE;
+
+        for (uint8_t port = 0; port < UART_PORTS; port++) {
+            uint8_t type = gps_pollNMEA(port, nmeaBuf[port], 128, &lengths[port]);
+            if (type != GPS_NMEA_NONE) {
+                logger_process(port, nmeaBuf[port], type);
+                received = TRUE;
+            }
+        }
+
+#if COMMIT_AGE
+        // Timer0 wakes the MCU up 28 times per second, so the age advances
+        // while the receivers are silent as well
+        uint16_t now = trace_now();
+        nofs_age(now - commitTime, COMMIT_TICKS);
+        commitTime = now;
+#endif
+
+        if (!received) {
+#if SUPPLY_MONITOR
+            // The buffer may be committed by the supply monitor meanwhile
+            supply_setIdle(TRUE);
+            power_sleep();
+            supply_setIdle(FALSE);
+#else
+            power_sleep();
+#endif
+            continue;
         }
 
         // Makes sure that the LED is blinking only roughly once a second
@@ -90,8 +536,6 @@ int main (void) {
             LEDCODE_BLINK();
             messageCount = 0;
         }        
-        
-        sleep_mode();
     }
 
     // Will never be reached
@@ -5,6 +5,11 @@
  */
 
 #include "global.h"
+#include "modules/trace.h"
+#include "modules/nofs.h"
+
+#ifdef __AVR__
+#include <avr/wdt.h>
 
 void _delay_s(uint8_t pSeconds) {
     for(pSeconds = pSeconds * 4; pSeconds > 0; pSeconds--) {
@@ -13,7 +18,23 @@ void _delay_s(uint8_t pSeconds) {
 }
 
 void error(uint8_t pCode) {
+#if TRACE
+    // The events in front of the error are dumped right away if the card has
+    // a trace region (i.e. after nofs_init), otherwise they are saved and
+    // the next run dumps them. A saved ring of an earlier error is kept.
+    if (!trace_saved()) {
+        trace_fatal(pCode);
+        if (nofs_writeTrace(pCode)) {
+            trace_release();
+        }
+    }
+#endif
+
     LEDCODE_OFF();
+
+#if ERROR_RESET_CYCLES
+    uint8_t cycles = 0;
+#endif
     
     while (TRUE) {
         for (uint8_t i = 0; i < pCode; i++) {
@@ -25,8 +46,37 @@ void error(uint8_t pCode) {
         
         _delay_ms(250);
         _delay_ms(150);
+
+#if ERROR_RESET_CYCLES
+        // The next run retries (e.g. once a card has been inserted) and
+        // writes a saved ring onto the card
+        if (++cycles == ERROR_RESET_CYCLES) {
+            wdt_enable(WDTO_15MS);
+            while (TRUE);
+        }
+#endif
     }
 }
+#else
+#include <stdio.h>
+
+/// Delays added up by hostDelay
+static double fDelayed = 0;
+
+void error(uint8_t pCode) {
+    // There is no LED on the host, the code is used as exit status instead
+    fprintf(stderr, "error %d\n", pCode);
+    exit(pCode);
+}
+
+void hostDelay(double pMilliseconds) {
+    fDelayed += pMilliseconds;
+}
+
+double hostDelayed() {
+    return fDelayed;
+}
+#endif
 
 uint8_t strStartsWith(const char *pString, char *pPattern) {
     uint8_t i = 0;
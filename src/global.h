@@ -13,6 +13,13 @@
         #define F_CPU 7372800UL
     #endif
 
+    #if defined(__AVR_ATmega644P__) || defined(__AVR_ATmega644PA__) || defined(__AVR_ATmega1284P__)
+        /// The 40 pin MCUs with two USARTs (SPI and ICP1 are on other pins)
+        #define MCU_40PIN TRUE
+    #else
+        #define MCU_40PIN FALSE
+    #endif
+
     /// Port to which input/output devices (LEDs etc.) are connected
     #define IO_PORT PORTC
     /// Direction register for the input/output port
@@ -45,11 +52,69 @@
     /// Error code for a generic error in the GPS library
     #define ERROR_GPS 4
 
+    #ifndef ERROR_RESET_CYCLES
+        /// Flashing sequences of error until the watchdog resets the MCU,
+        /// which retries the initialization (0 flashes forever)
+        #define ERROR_RESET_CYCLES 10
+    #endif
+
     #include <stdint.h>
     #include <stdlib.h>
-    #include <avr/io.h>
-    #include <avr/interrupt.h>
-    #include <util/delay.h>
+
+    #ifdef __AVR__
+        #include <avr/io.h>
+        #include <avr/interrupt.h>
+        #include <avr/pgmspace.h>
+        #include <util/delay.h>
+
+        #if defined(PRR0) && !defined(PRR)
+            /// MCUs with several power reduction registers call the first one PRR0
+            #define PRR PRR0
+        #endif
+
+        #if RAMEND <= 0x4FF
+            /// The MCUs with 1 KB of SRAM (ATmega88/168): the sector buffer
+            /// takes half of it, so the optional modules which need SRAM are
+            /// disabled by default (see TRACE, NOFS_DIRECTORY, gLogger.c)
+            #define MCU_SMALL_SRAM TRUE
+        #else
+            #define MCU_SMALL_SRAM FALSE
+        #endif
+    #else
+        #define MCU_SMALL_SRAM FALSE
+
+        // Host builds (see tools/) only use the hardware independent parts of
+        // the firmware. Flash-resident data simply lives in regular memory.
+        #define PROGMEM
+        #define PSTR(pString) (pString)
+        #define pgm_read_byte(pAddress) (*(const uint8_t*)(pAddress))
+        #define pgm_read_word(pAddress) (*(const uint16_t*)(pAddress))
+        // Delays don't wait, they are only added up (see hostDelayed)
+        #define _delay_ms(pMilliseconds) hostDelay(pMilliseconds)
+
+        /**
+         * \brief Adds a delay to the simulated time of a host build
+         * \param pMilliseconds The time the firmware would have waited
+         */
+        void hostDelay(double pMilliseconds);
+
+        /**
+         * \brief Returns the delays of a host build added up so far
+         *
+         * Includes the simulated latencies of the memory card (see
+         * tools/sdmmc_host.h), i.e. the time the main loop would have been
+         * blocked.
+         *
+         * \return The simulated time in milliseconds
+         */
+        double hostDelayed();
+
+        #ifdef HOST_IO
+            // Tools which run hardware dependent modules provide the registers
+            // these use (e.g. tools/spi_host.h)
+            #include HOST_IO
+        #endif
+    #endif
 
     /** 
      * \brief Perform a break for a specified time of seconds
@@ -65,12 +130,13 @@
     void _delay_s(uint8_t pSeconds);
     
     /**
-     * \brief Indicates an error using the LED. !LOOPS FOREVER!
+     * \brief Indicates an error using the LED. !NEVER RETURNS!
      *
      * Once the error method is called, there is no way back. The code 
      * influences the flashing sequence of the LED. In general, the LED 
      * flashes pCode times with a break of 100ms between each flash, then 
      * the LED is 500ms off and then the whole sequence repeats itself.
+     * After ERROR_RESET_CYCLES sequences, the watchdog resets the MCU.
      *
      * \param code The error code which shall be displayed. Note: a parameter
      * value of 1 should not be used in order to prevent confusion with the
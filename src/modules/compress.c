@@ -0,0 +1,245 @@
+/**
+ * \file compress.c
+ * \brief Small-window streaming compressor for NMEA text
+ * \author Martin Matysiak
+ */
+
+#include "modules/compress.h"
+
+#if COMPRESS_BENCHMARK
+    #include "modules/nmea.h"
+#endif
+
+/// Sentence prefixes which can be referenced with a single byte
+static const char fDictionary[] PROGMEM = COMPRESS_DICTIONARY;
+/// Initial window content of every block
+static const char fPreset[COMPRESS_WINDOW_SIZE] PROGMEM = COMPRESS_PRESET;
+
+/// The last COMPRESS_WINDOW_SIZE uncompressed bytes (ring buffer)
+static char fWindow[COMPRESS_WINDOW_SIZE];
+/// Index in fWindow at which the next byte will be written
+static uint8_t fWindowPos = 0;
+/// Most recent window position of every (hashed) pair of characters
+static uint8_t fHead[COMPRESS_HASH_SIZE];
+
+/// Hash function for a pair of characters
+#define COMPRESS_HASH(pFirst, pSecond) ((((pFirst) << 2) ^ (pSecond)) & (COMPRESS_HASH_SIZE - 1))
+/// Wraps an index into the window
+#define COMPRESS_WRAP(pIndex) ((pIndex) & (COMPRESS_WINDOW_SIZE - 1))
+
+/**
+ * \brief Appends an uncompressed byte to the window
+ */
+static void compress_push(char pByte) {
+    // The pair which ends with this byte starts at the previous position
+    uint8_t previous = COMPRESS_WRAP(fWindowPos - 1);
+    fHead[COMPRESS_HASH(fWindow[previous], pByte)] = previous;
+
+    fWindow[fWindowPos] = pByte;
+    fWindowPos = COMPRESS_WRAP(fWindowPos + 1);
+}
+
+/**
+ * \brief Checks if the given text starts with a dictionary entry
+ * \return The index of the entry or COMPRESS_DICTIONARY_SIZE if none matches
+ */
+static uint8_t compress_findPrefix(const char* pInput) {
+    for (uint8_t entry = 0; entry < COMPRESS_DICTIONARY_SIZE; entry++) {
+        const char* prefix = fDictionary + entry * COMPRESS_DICTIONARY_ENTRY;
+        uint8_t i = 0;
+
+        while ((i < COMPRESS_DICTIONARY_ENTRY) && (pInput[i] == pgm_read_byte(&prefix[i]))) {
+            i++;
+        }
+
+        if (i == COMPRESS_DICTIONARY_ENTRY) {
+            return entry;
+        }
+    }
+
+    return COMPRESS_DICTIONARY_SIZE;
+}
+
+void compress_reset() {
+    for (uint8_t i = 0; i < COMPRESS_WINDOW_SIZE; i++) {
+        fWindow[i] = pgm_read_byte(&fPreset[i]);
+    }
+
+    // Fill the hash table with the preset content as well (the first pair
+    // is skipped as it would wrap around the window)
+    for (uint8_t i = 1; i < COMPRESS_WINDOW_SIZE; i++) {
+        fHead[COMPRESS_HASH(fWindow[i - 1], fWindow[i])] = i - 1;
+    }
+
+    fWindowPos = 0;
+}
+
+void compress_replay(const char* pData, uint16_t pLength) {
+    for (uint16_t i = 0; i < pLength; i++) {
+        uint8_t token = pData[i];
+
+        if (!(token & COMPRESS_TOKEN)) {
+            compress_push(token);
+        } else if (token & COMPRESS_TOKEN_DICTIONARY) {
+            const char* prefix = fDictionary + (token & 0x3F) * COMPRESS_DICTIONARY_ENTRY;
+            for (uint8_t j = 0; j < COMPRESS_DICTIONARY_ENTRY; j++) {
+                compress_push(pgm_read_byte(&prefix[j]));
+            }
+        } else if (++i < pLength) {
+            uint8_t length = (token & 0x3F) + COMPRESS_MIN_MATCH;
+            uint8_t distance = (pData[i] & 0x7F) + 1;
+
+            while (length--) {
+                compress_push(fWindow[COMPRESS_WRAP(fWindowPos - distance)]);
+            }
+        }
+    }
+}
+
+uint8_t compress_token(const char* pInput, uint16_t pRoom, char* pToken,
+    uint8_t* pConsumed) {
+
+    // Sentence prefixes are taken from the dictionary
+    if (pInput[0] == '$') {
+        uint8_t entry = compress_findPrefix(pInput);
+
+        if (entry < COMPRESS_DICTIONARY_SIZE) {
+            for (uint8_t i = 0; i < COMPRESS_DICTIONARY_ENTRY; i++) {
+                compress_push(pInput[i]);
+            }
+
+            pToken[0] = COMPRESS_TOKEN | COMPRESS_TOKEN_DICTIONARY | entry;
+            *pConsumed = COMPRESS_DICTIONARY_ENTRY;
+            return 1;
+        }
+    }
+
+    uint8_t length = 0;
+    uint8_t distance = 0;
+
+    // Look for a back reference at the most recent position of the first
+    // two characters. A stale entry simply results in a shorter match.
+    if ((pRoom >= 2) && pInput[1]) {
+        uint8_t candidate = fHead[COMPRESS_HASH(pInput[0], pInput[1])];
+        distance = COMPRESS_WRAP(fWindowPos - candidate);
+        if (distance == 0) {
+            distance = COMPRESS_WINDOW_SIZE;
+        }
+
+        // Bytes beyond the current position are the ones being matched
+        // right now (this allows to encode runs like "0000"). A match never
+        // covers the beginning of another sentence.
+        while ((length < COMPRESS_MAX_MATCH) && pInput[length]
+            && ((length == 0) || (pInput[length] != '$')) && (pInput[length] ==
+            (length < distance ? fWindow[COMPRESS_WRAP(candidate + length)] : pInput[length - distance]))) {
+            length++;
+        }
+    }
+
+    if (length < COMPRESS_MIN_MATCH) {
+        compress_push(pInput[0]);
+        pToken[0] = pInput[0];
+        *pConsumed = 1;
+        return 1;
+    }
+
+    for (uint8_t i = 0; i < length; i++) {
+        compress_push(pInput[i]);
+    }
+
+    pToken[0] = COMPRESS_TOKEN | (length - COMPRESS_MIN_MATCH);
+    pToken[1] = COMPRESS_TOKEN | (distance - 1);
+    *pConsumed = length;
+    return 2;
+}
+
+uint16_t compress_decode(const char* pData, uint16_t pLength, char* pOutput) {
+    uint16_t output = 0;
+
+    for (uint16_t i = 0; (i < pLength) && (pData[i] != ETX); i++) {
+        uint8_t token = pData[i];
+
+        if (!(token & COMPRESS_TOKEN)) {
+            pOutput[output++] = token;
+        } else if (token & COMPRESS_TOKEN_DICTIONARY) {
+            const char* prefix = fDictionary + (token & 0x3F) * COMPRESS_DICTIONARY_ENTRY;
+            for (uint8_t j = 0; j < COMPRESS_DICTIONARY_ENTRY; j++) {
+                pOutput[output++] = pgm_read_byte(&prefix[j]);
+            }
+        } else if (++i < pLength) {
+            uint8_t length = (token & 0x3F) + COMPRESS_MIN_MATCH;
+            uint8_t distance = (pData[i] & 0x7F) + 1;
+
+            // Back references before the beginning of the block point into
+            // the preset window
+            while (length--) {
+                pOutput[output] = output >= distance ? pOutput[output - distance]
+                    : pgm_read_byte(&fPreset[COMPRESS_WINDOW_SIZE + output - distance]);
+                output++;
+            }
+        }
+    }
+
+    return output;
+}
+
+#if COMPRESS_BENCHMARK
+void compress_benchmark(char* pOutput) {
+    uint8_t prr = PRR;
+    uint16_t cycles[3] = {0, 0, 0};
+    char token[2];
+    uint8_t consumed;
+
+    // Timer1 counts the CPU cycles
+    PRR &= ~(1 << PRTIM1);
+    TCCR1A = 0;
+    TCCR1B = (1 << CS10);
+
+    // A run of zeros: the last pair of zeros in the preset ends its sentence,
+    // so the first zeros are literals behind a match which is too short.
+    // The rest of the run references itself.
+    for (uint8_t i = 0; i < COMPRESS_BENCHMARK_LENGTH - 1; i++) {
+        pOutput[i] = '0';
+    }
+    pOutput[COMPRESS_BENCHMARK_LENGTH - 1] = '\0';
+
+    compress_reset();
+    char* input = pOutput;
+    while (*input) {
+        TCNT1 = 0;
+        uint8_t length = compress_token(input, COMPRESS_BENCHMARK_LENGTH, token, &consumed);
+        uint16_t elapsed = TCNT1;
+
+        if (elapsed > cycles[length - 1]) {
+            cycles[length - 1] = elapsed;
+        }
+        input += consumed;
+    }
+
+    // The slowest prefix which isn't in the dictionary: it only differs from
+    // an entry in its last byte, several others share its beginning
+    const char* prefix = PSTR("$GPGSA0");
+    for (uint8_t i = 0; i <= COMPRESS_DICTIONARY_ENTRY; i++) {
+        pOutput[i] = pgm_read_byte(&prefix[i]);
+    }
+
+    compress_reset();
+    TCNT1 = 0;
+    compress_token(pOutput, COMPRESS_BENCHMARK_LENGTH, token, &consumed);
+    cycles[2] = TCNT1;
+
+    TCCR1B = 0;
+    PRR = prr;
+    compress_reset();
+
+    char* output = nmea_writePrefix(pOutput, PSTR("$PGLCMP"));
+
+    for (uint8_t i = 0; i < 3; i++) {
+        *output++ = ',';
+        output = nmea_writeNumber(output, cycles[i]);
+    }
+
+    *output = '\0';
+    nmea_appendChecksum(pOutput);
+}
+#endif
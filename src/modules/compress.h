@@ -0,0 +1,144 @@
+/**
+ * \file compress.h
+ * \brief Small-window streaming compressor for NMEA text
+ * \author Martin Matysiak
+ *
+ * The compressed stream is a sequence of tokens:
+ * - Bytes below 0x80 are literals and represent themselves. Uncompressed
+ *   NMEA text is therefore a valid compressed stream as well.
+ * - 0b11xxxxxx represents entry xxxxxx of the static prefix dictionary
+ *   (e.g. "$GPGGA,").
+ * - 0b10llllll 0b1ddddddd is a back reference: copy llllll + 3 bytes from
+ *   ddddddd + 1 bytes before the current position.
+ *
+ * None of the bytes can become a NOFS_TERMINAL. A '$' (i.e. the beginning
+ * of a sentence) always starts a new token. Back references may reach
+ * up to COMPRESS_WINDOW_SIZE bytes back. At the beginning of a sector, the
+ * window is preset with COMPRESS_PRESET, so that even the first sentences
+ * of a sector can be compressed while every sector can still be decoded
+ * on its own (i.e. in parallel on the host).
+ *
+ * The compressor state takes COMPRESS_WINDOW_SIZE + COMPRESS_HASH_SIZE + 1
+ * bytes of SRAM. Every token needs a single hash lookup and one comparison
+ * per represented byte (plus one), so the time spent is linear in the length
+ * of the text and does not depend on its content.
+ *
+ * Cycles of compress_token on an ATmega88 (compiled with the AVR backend of
+ * LLVM at -Os and simulated, the output matches compress.c byte for byte):
+ * 166 per byte on average on a GGA/RMC/VTG capture, 246 for the slowest
+ * literal, up to 881 for a '$' which isn't in the dictionary and 5975 for
+ * the longest back reference (90 per byte). A sentence of 10 bytes or more
+ * therefore never takes more than 310 cycles per byte. COMPRESS_BENCHMARK
+ * measures the worst cases on the target.
+ */
+
+#ifndef COMPRESS_H
+    #define COMPRESS_H
+
+    #include "global.h"
+
+    /// Size of the window (back references reach at most this far back)
+    #define COMPRESS_WINDOW_SIZE 128
+    /// Number of entries in the hash table which is used to find matches
+    #define COMPRESS_HASH_SIZE 32
+    /// Shortest back reference (shorter matches are written as literals)
+    #define COMPRESS_MIN_MATCH 3
+    /// Longest back reference
+    #define COMPRESS_MAX_MATCH (COMPRESS_MIN_MATCH + 0x3F)
+    /// Length of a dictionary entry
+    #define COMPRESS_DICTIONARY_ENTRY 7
+    /// Number of dictionary entries
+    #define COMPRESS_DICTIONARY_SIZE 7
+
+    /// Bit which marks a token (i.e. a byte which is not a literal)
+    #define COMPRESS_TOKEN 0x80
+    /// Bit which marks a dictionary entry (in combination with COMPRESS_TOKEN)
+    #define COMPRESS_TOKEN_DICTIONARY 0x40
+
+    /// Worst case of compress_token per input byte (see above) with a margin
+    /// for the code of avr-gcc, bounds F_CPU (see gLogger.c)
+    #define COMPRESS_CYCLES_PER_BYTE 400
+
+    /// Set to TRUE in order to log the cycles of the worst cases of
+    /// compress_token at power-up (see compress_benchmark, uses Timer1)
+    #ifndef COMPRESS_BENCHMARK
+        #define COMPRESS_BENCHMARK FALSE
+    #endif
+
+    /// Minimum size of the buffer passed to compress_benchmark
+    #define COMPRESS_BENCHMARK_LENGTH (COMPRESS_MAX_MATCH + 3)
+
+    /// The dictionary of sentence prefixes, each COMPRESS_DICTIONARY_ENTRY long
+    #define COMPRESS_DICTIONARY "$GPGGA,$GPGSA,$GPGSV,$GPGLL,$GPRMC,$GPVTG,$GPZDA,"
+
+    /// Initial content of the window (exactly COMPRESS_WINDOW_SIZE bytes)
+    #define COMPRESS_PRESET \
+        "0000.0000,N,00000.0000,E,1,00,0.0,00.0,M,00.0,M,,0000*00\r\n" \
+        "$GPRMC,000000.000,A,0000.0000,N,00000.0000,E,0.0,000.0,000000,,,A*00\r\n"
+
+    /**
+     * \brief Resets the compressor, i.e. starts a new independent block
+     */
+    void compress_reset();
+
+    /**
+     * \brief Feeds already compressed data into the compressor
+     *
+     * This restores the state of the compressor after the block has been
+     * interrupted (e.g. after a restart the compression continues in the
+     * middle of a partially written sector). The compressor has to be reset
+     * before.
+     *
+     * \param pData The compressed data of the current block
+     * \param pLength The length of the compressed data
+     */
+    void compress_replay(const char* pData, uint16_t pLength);
+
+    /**
+     * \brief Compresses the beginning of the given text into a single token
+     *
+     * \param pInput A null-terminated string which should be compressed. It
+     * may only contain 7-bit characters.
+     * \param pRoom The number of bytes available for the token. If it is
+     * less than 2, only a literal or a dictionary token will be returned.
+     * \param pToken A buffer (at least 2 bytes) which receives the token
+     * \param pConsumed Receives the number of input characters which are
+     * represented by the token
+     * \return The length of the token (1 or 2)
+     */
+    uint8_t compress_token(const char* pInput, uint16_t pRoom, char* pToken,
+        uint8_t* pConsumed);
+
+    /**
+     * \brief Decompresses an independent block of compressed data
+     *
+     * This method has no state and may be used by several threads at once.
+     *
+     * \param pData The compressed data
+     * \param pLength The length of the compressed data. Decoding stops
+     * earlier if a NOFS_TERMINAL is found.
+     * \param pOutput A buffer which receives the decompressed text. It has to
+     * be large enough for pLength * COMPRESS_MAX_MATCH / 2 bytes.
+     * \return The number of decompressed bytes
+     */
+    uint16_t compress_decode(const char* pData, uint16_t pLength, char* pOutput);
+
+#if COMPRESS_BENCHMARK
+    /**
+     * \brief Measures the cycles of the worst cases of compress_token
+     *
+     * A run of zeros (a literal which starts a match that is too short,
+     * then the longest back reference) and a sentence prefix which isn't in
+     * the dictionary are compressed. The slowest call of each kind is
+     * written as sentence:
+     *
+     * $PGLCMP,<literal>,<back reference>,<prefix>*hh
+     *
+     * The compressor is reset afterwards, i.e. this has to be called before
+     * nofs_init. Only available if COMPRESS_BENCHMARK is enabled.
+     *
+     * \param pOutput A buffer of at least COMPRESS_BENCHMARK_LENGTH bytes
+     */
+    void compress_benchmark(char* pOutput);
+#endif
+#endif
@@ -6,10 +6,18 @@
 
 #include "modules/gps.h"
 
-void gps_init(uint8_t pFrequency, uint8_t pMessages) {
+#if GPS_QUALITY
+/// Fix quality figures extracted by gps_checkNMEA
+enum {
+    GPS_QUALITY_HDOP, GPS_QUALITY_PDOP, GPS_QUALITY_SATELLITES, GPS_QUALITY_FIX,
+    GPS_QUALITY_FIGURES
+};
+#endif
+
+void gps_init(uint8_t pPort, uint8_t pFrequency, const uint8_t* pIntervals) {
 
     // initializes UART interface
-    uart_init(UART_CONFIGURE(UART_ASYNC, UART_8BIT, UART_1STOP, UART_NOPAR), 
+    uart_init(pPort, UART_CONFIGURE(UART_ASYNC, UART_8BIT, UART_1STOP, UART_NOPAR), 
     UART_CALCULATE_BAUD(F_CPU, GPS_BAUDRATE));
 
     _delay_ms(100);
@@ -17,22 +25,19 @@ void gps_init(uint8_t pFrequency, uint8_t pMessages) {
     // The datasheet recommends a higher baudrate for frequencies
     // above or equal 4 Hz
     if (pFrequency >= 4) {
-        gps_highspeed();
+        gps_highspeed(pPort);
         _delay_ms(100);
     }
 
-    // perform basic configuration using the given parameters
-    unsigned char commands[8] = {
-        pMessages & GPS_NMEA_GGA ? 1 : 0,
-        pMessages & GPS_NMEA_GSA ? 1 : 0,
-        pMessages & GPS_NMEA_GSV ? 1 : 0,
-        pMessages & GPS_NMEA_GLL ? 1 : 0,
-        pMessages & GPS_NMEA_RMC ? 1 : 0,
-        pMessages & GPS_NMEA_VTG ? 1 : 0,
-        pMessages & GPS_NMEA_ZDA ? 1 : 0,
-        0x00}; // in SRAM
+    // perform basic configuration using the given parameters, the module
+    // expects an interval for each message type (0 disables the message)
+    unsigned char commands[GPS_NMEA_COUNT + 1];
+    for (uint8_t i = 0; i < GPS_NMEA_COUNT; i++) {
+        commands[i] = pIntervals[i];
+    }
+    commands[GPS_NMEA_COUNT] = 0x00; // in SRAM
 
-    gps_setParam(GPS_SET_NMEA, commands, 8);
+    gps_setParam(pPort, GPS_SET_NMEA, commands, GPS_NMEA_COUNT + 1);
 
     _delay_ms(50);
 
@@ -40,22 +45,48 @@ void gps_init(uint8_t pFrequency, uint8_t pMessages) {
         pFrequency, // pFrequency Hertz
         0x00}; // In SRAM
 
-    gps_setParam(GPS_SET_UPDATE_RATE, rate, 2);
+    gps_setParam(pPort, GPS_SET_UPDATE_RATE, rate, 2);
 
     _delay_ms(50);
 }
 
-void gps_highspeed() {
+void gps_restart(uint8_t pPort, unsigned char* pPayload) {
+    uart_init(pPort, UART_CONFIGURE(UART_ASYNC, UART_8BIT, UART_1STOP, UART_NOPAR),
+    UART_CALCULATE_BAUD(F_CPU, GPS_BAUDRATE));
+
+    gps_setParam(pPort, GPS_RESTART, pPayload, GPS_RESTART_LENGTH);
+
+    // give the module some time to restart
+    _delay_ms(250);
+}
+
+void gps_enable1PPS(uint8_t pPort) {
+    unsigned char pps[2] = {
+        0x01,  // output the pulse when a 3D fix is available
+        0x00}; // in SRAM
+
+    gps_setParam(pPort, GPS_SET_1PPS, pps, 2);
+}
+
+void gps_setPower(uint8_t pPort, uint8_t pMode) {
+    unsigned char power[2] = {
+        pMode,
+        0x00}; // in SRAM
+
+    gps_setParam(pPort, GPS_SET_POWER, power, 2);
+}
+
+void gps_highspeed(uint8_t pPort) {
     // prompt gps to change baudrate
     unsigned char baudrate[3] = {
         0x00,  // COM1
         0x03,  // 38400 baud
         0x00}; // in SRAM
 
-    gps_setParam(GPS_SET_BAUDRATE, baudrate, 3);
+    gps_setParam(pPort, GPS_SET_BAUDRATE, baudrate, 3);
 
     // change internal baudrate
-    uart_changeBaud(UART_CALCULATE_BAUD(F_CPU, GPS_BAUDRATE_HIGHSPEED));
+    uart_changeBaud(pPort, UART_CALCULATE_BAUD(F_CPU, GPS_BAUDRATE_HIGHSPEED));
 }
 
 unsigned char gps_calculateCS(const unsigned char* pPayload, uint16_t pLength) {
@@ -66,136 +97,189 @@ unsigned char gps_calculateCS(const unsigned char* pPayload, uint16_t pLength) {
     return checkSum;
 }
 
-unsigned char gps_setParam(unsigned char pCommand, unsigned char* pData, uint16_t pLength) {
+unsigned char gps_setParam(uint8_t pPort, unsigned char pCommand, unsigned char* pData, uint16_t pLength) {
     // start sequence (2 byte)
-    uart_setChar(0xA0);
-    uart_setChar(0xA1);
+    uart_setChar(pPort, 0xA0);
+    uart_setChar(pPort, 0xA1);
 
     // payload length (2 byte) == pLength + 1 because of message ID byte
-    uart_setChar(((pLength+1) & 0xFF00) >> 8);
-    uart_setChar((pLength+1) & 0x00FF);
+    uart_setChar(pPort, ((pLength+1) & 0xFF00) >> 8);
+    uart_setChar(pPort, (pLength+1) & 0x00FF);
 
     // payload
 
     // message ID (1 byte)
-    uart_setChar(pCommand);
+    uart_setChar(pPort, pCommand);
 
     // data (pLength byte)
     for(uint8_t i = 0; i < pLength; i++) {
-        uart_setChar(pData[i]);
+        uart_setChar(pPort, pData[i]);
     }
 
     // checksum (1 byte)
-    uart_setChar(gps_calculateCS(pData, pLength) ^ pCommand);
+    uart_setChar(pPort, gps_calculateCS(pData, pLength) ^ pCommand);
 
     // stop sequence (2 byte)
-    uart_setChar(CR);
-    uart_setChar(LF);
+    uart_setChar(pPort, CR);
+    uart_setChar(pPort, LF);
 
     return GPS_ACK;
 }
 
-uint8_t gps_checkNMEA(const char* pSentence, uint8_t pMessageType, char* pPrefix, 
-    uint8_t pValidityToken, char* pValidityCheck, uint8_t pCheckEquality) {
+/**
+ * \brief Calculates the checksum and checks the validity token of a sentence
+ *
+ * The type is already known, so neither the prefix nor the validity string
+ * have to be compared. The sentence is swept once, the checksum covers the
+ * characters between '$' and '*'. It is inlined into a checker per type (see
+ * GPS_NMEA_CHECKER), so the arguments are constants and the comparisons of
+ * the tokens a type doesn't contain are dropped from the sweep. Every
+ * enabled type takes a copy of the sweep in the flash (see NMEA_TYPES).
+ *
+ * \param pSentence The sentence which shall be checked
+ * \param pMessageType The GPS_NMEA_<TYPE> bit
+ * \param pValidityToken The index of the validity token (0: always valid)
+ * \param pValidityCheck The character the validity token is compared to
+ * \param pCheckEquality If TRUE, the sentence is valid if the token consists of
+ * pValidityCheck only, otherwise if it doesn't
+ * \param pHdopToken, pPdopToken, pSatellitesToken, pFixToken The indices of
+ * the fix quality tokens (0: not contained)
+ * \return The same as gps_classifyNMEA
+ */
+static inline __attribute__((always_inline)) uint8_t gps_checkNMEA(const char* pSentence,
+    uint8_t pMessageType, uint8_t pValidityToken, char pValidityCheck, uint8_t pCheckEquality,
+    uint8_t pHdopToken, uint8_t pPdopToken, uint8_t pSatellitesToken, uint8_t pFixToken) {
 
-    // Counter variables for the different strings which have to be checked
-    uint8_t sentenceCounter = 0;
-    uint8_t prefixCounter = 0;
-    uint8_t validityCounter = 0;
-    
-    // Counter to count the current token (only used when validityToken is set)
-    uint8_t tokenCounter = 0;
-    
-    // Variable which will contain the validity state of the sentence, defaults
-    // to VALID
-    uint8_t messageValidity = GPS_NMEA_VALID;
-    
-    // Checksum is calculated by XORing every character between the '$' and '*'
-    // We set its initial value to '$' so that the loop does not have to 
-    // differentiate between the first and other characters (initial '$' xor
-    // first character '$' == 0).
-    char checksum = '$';
-    
-    do {
-        // Prefix check is done if the prefixCounter points to the end of the
-        // given prefix
-        if (pPrefix[prefixCounter] != '\0') {
-            // return instantl if the prefixes do not match
-            if (pSentence[sentenceCounter] != pPrefix[prefixCounter]) {
-                return GPS_NMEA_UNKNOWN;
+    const char* position = pSentence + 1;
+    char checksum = 0;
+
+    // Token which is currently swept and the validity token found in it
+    uint8_t token = 0;
+    uint8_t tokenLength = 0;
+    char tokenChar = '\0';
+
+#if GPS_QUALITY
+    // Fix quality figures in 1/10, the one in the current token and the
+    // number of its digits behind the decimal point (0xFF: none yet)
+    uint16_t figures[GPS_QUALITY_FIGURES] = {0};
+    uint8_t figure = GPS_QUALITY_FIGURES;
+    uint8_t decimals = 0xFF;
+#endif
+
+    while (*position && (*position != '*')) {
+        checksum ^= *position;
+
+        if (*position == ',') {
+            token++;
+
+#if GPS_QUALITY
+            // Integers (satellites, fix type) are scaled like the DOPs
+            if ((figure < GPS_QUALITY_FIGURES) && (decimals == 0xFF)) {
+                figures[figure] *= 10;
             }
-            
-            prefixCounter++;
-        }
-        
-        // Calculate checksum
-        checksum ^= pSentence[sentenceCounter];
-        
-        // Perform a validity check only if a validityToken was specified
-        if (pValidityToken) {
-            if (pSentence[sentenceCounter] == ',') {
-                tokenCounter++;
-            } else { // check non-comma characters only
-                if (tokenCounter == pValidityToken) {
-                    // Catch if token is too long
-                    if (pValidityCheck[validityCounter] == '\0') {
-                        messageValidity = GPS_NMEA_INVALID;
-                    } else {
-                        // Check if tokens differ
-                        if (pSentence[sentenceCounter] != pValidityCheck[validityCounter++]) {
-                            messageValidity = GPS_NMEA_INVALID;   
-                        }
-                    }
-                }
+
+            figure = (token == pHdopToken) ? GPS_QUALITY_HDOP
+                : (token == pPdopToken) ? GPS_QUALITY_PDOP
+                : (token == pSatellitesToken) ? GPS_QUALITY_SATELLITES
+                : (token == pFixToken) ? GPS_QUALITY_FIX : GPS_QUALITY_FIGURES;
+            decimals = 0xFF;
+#endif
+        } else {
+            if ((token == pValidityToken) && (tokenLength++ == 0)) {
+                tokenChar = *position;
             }
-        }
-    } while (pSentence[++sentenceCounter] != '\0');
-    
-    
-    // If a validityToken was specified, perform some final checks
-    if (pValidityToken != 0) {
-        // Check if token was too short (i.e. validityCounter still points to a
-        // not-null character)
-        if (pValidityCheck[validityCounter] != '\0') {
-            messageValidity = GPS_NMEA_INVALID;
-        }
-            
-        // If a validityToken was specified, messageValidity currently holds _VALID
-        // if the token was equal to the given one and _INVALID otherwise. Check, if
-        // checkEquality was set to FALSE. In this case, negate the messageValidity
-        // variable
-        if (pCheckEquality == FALSE) {
-            if (messageValidity == GPS_NMEA_VALID) {
-                messageValidity = GPS_NMEA_INVALID;
-            } else {
-                messageValidity = GPS_NMEA_VALID;
+
+#if GPS_QUALITY
+            if (figure < GPS_QUALITY_FIGURES) {
+                if (*position == '.') {
+                    decimals = 0;
+                } else if (decimals == 0xFF) {
+                    figures[figure] = figures[figure] * 10 + (*position - '0');
+                } else if (decimals++ == 0) {
+                    figures[figure] = figures[figure] * 10 + (*position - '0');
+                }
             }
+#endif
         }
+
+        position++;
     }
-    
-    // If a checksum was given, xor the last three characters again (to remove
-    // them from our calculation) and compare the calculation to the given
-    // checksum
-    if (pSentence[sentenceCounter - 3] == '*') {
-        checksum = checksum ^ '*' ^ pSentence[sentenceCounter - 2] ^ pSentence[sentenceCounter - 1];
-        
-        // convert hex-string to uint8_t
-        uint8_t givenChecksum = (hexCharToInt(pSentence[sentenceCounter - 2]) << 4)
-            + hexCharToInt(pSentence[sentenceCounter - 1]);
-        
-        // on checksum mismatch, the message is not only invalid, but completely 
-        // corrupt, therefore GPS_NMEA_UNKNOWN will be returned.
-        if (checksum != givenChecksum) {
+
+#if GPS_QUALITY
+    if ((figure < GPS_QUALITY_FIGURES) && (decimals == 0xFF)) {
+        figures[figure] *= 10;
+    }
+#endif
+
+    // On checksum mismatch, the message is not only invalid, but completely
+    // corrupt, therefore GPS_NMEA_UNKNOWN will be returned (sentences without
+    // checksum are accepted)
+    if ((position[0] == '*') && position[1] && position[2]) {
+        uint8_t givenChecksum = (hexCharToInt(position[1]) << 4) + hexCharToInt(position[2]);
+
+        if ((uint8_t)checksum != givenChecksum) {
             return GPS_NMEA_UNKNOWN;
         }
     }
-    
-    return pMessageType | messageValidity;
+
+    if (pValidityToken == 0) {
+        return pMessageType | GPS_NMEA_VALID;
+    }
+
+    uint8_t equal = (tokenLength == 1) && (tokenChar == pValidityCheck);
+    if (equal != pCheckEquality) {
+        return pMessageType | GPS_NMEA_INVALID;
+    }
+
+#if GPS_QUALITY
+    // An empty field (0) only fails the minimums
+    if ((GPS_MAX_HDOP && pHdopToken && (figures[GPS_QUALITY_HDOP] > GPS_MAX_HDOP))
+        || (GPS_MAX_PDOP && pPdopToken && (figures[GPS_QUALITY_PDOP] > GPS_MAX_PDOP))
+        || (pSatellitesToken && (figures[GPS_QUALITY_SATELLITES] < GPS_MIN_SATELLITES * 10))
+        || (pFixToken && (figures[GPS_QUALITY_FIX] < GPS_MIN_FIX * 10))) {
+        return pMessageType | GPS_NMEA_INVALID;
+    }
+#endif
+
+    return pMessageType | GPS_NMEA_VALID;
 }
 
-uint8_t gps_getNMEA(char* pOutput, uint8_t pMaxLength) {
+#if GPS_QUALITY
+/// GPS_NMEA_GGA and/or GPS_NMEA_GSA if the last one of the port failed
+static uint8_t fRejected[UART_PORTS];
+
+/**
+ * \brief Drops the rest of an epoch whose GGA or GSA has failed the fix
+ * quality thresholds
+ *
+ * A GGA starts the verdict of an epoch, a GSA adds to it (if the module sends
+ * only one of them, it decides alone).
+ *
+ * \param pPort The UART port the sentence has been received from
+ * \param pType The return value of gps_classifyNMEA
+ * \return pType, invalidated if the epoch has been rejected
+ */
+static uint8_t gps_gateEpoch(uint8_t pPort, uint8_t pType) {
+    uint8_t type = pType & GPS_NMEA_TYPEMASK;
+    uint8_t failed = (pType & GPS_NMEA_VALID) ? 0 : type;
+
+    if (type == GPS_NMEA_GGA) {
+        fRejected[pPort] = failed;
+    } else if (type == GPS_NMEA_GSA) {
+        fRejected[pPort] = (fRejected[pPort] & GPS_NMEA_GGA) | failed;
+    } else if (fRejected[pPort] && (type & GPS_QUALITY_GATED)) {
+        return type | GPS_NMEA_INVALID;
+    }
+
+    return pType;
+}
+#else
+    #define gps_gateEpoch(pPort, pType) (pType)
+#endif
+
+uint8_t gps_getNMEA(uint8_t pPort, char* pOutput, uint8_t pMaxLength) {
     // A dollar sign indicates the start of a NMEA sentence
-    while(uart_getChar() != '$') {
+    while(uart_getChar(pPort) != '$') {
         // burn energy
         _delay_ms(1);
     }
@@ -207,11 +291,17 @@ uint8_t gps_getNMEA(char* pOutput, uint8_t pMaxLength) {
     char inChar;
 
     do {
-        while(!uart_hasData()) {
+        while(!uart_hasData(pPort)) {
           // burn energy
         }
         
-        inChar = uart_getChar();
+        inChar = uart_getChar(pPort);
+
+        // A sentence which has been cut off (e.g. while the module woke up)
+        // is discarded, the new one starts here
+        if (inChar == '$') {
+            i = 0;
+        }
 
         pOutput[i++] = inChar;
     } while((inChar != LF) && (i < (pMaxLength-1)));
@@ -220,31 +310,62 @@ uint8_t gps_getNMEA(char* pOutput, uint8_t pMaxLength) {
     // everything might crash and burn
     pOutput[i] = 0;
 
-    // Determine the correct validity checker by checking characters 3-5 in a
-    // "Trie"-like if-sentence tree, saves many cycles in comparison to full
-    // prefix check for each possible message
-    switch (pOutput[3]) {
-        case 'G': //GGA, GSA, GSV or GLL
-            switch (pOutput[4]) {
-                case 'G': //only GGA left
-                    return gps_checkNMEA(pOutput, GPS_NMEA_GGA, "$GPGGA", 6, "0", FALSE);
-                case 'S': //GSA or GSV:
-                    if (pOutput[5] == 'A') {
-                        return gps_checkNMEA(pOutput, GPS_NMEA_GSA, "$GPGSA", 2, "1", FALSE);
-                    } else {
-                        return gps_checkNMEA(pOutput, GPS_NMEA_GSV, "$GPGSV", 0, "", FALSE);
-                    }
-                case 'L': //only GLL left
-                    return gps_checkNMEA(pOutput, GPS_NMEA_GLL, "$GPGLL", 6, "A", TRUE);
-                default:
-                    return GPS_NMEA_UNKNOWN;
-            } //btw: no break;s are necessary as every case returns sth.
-        case 'R': //only RMC left
-            return gps_checkNMEA(pOutput, GPS_NMEA_RMC, "$GPRMC", 2, "A", TRUE);
-        case 'V': //only VTG left
-            return gps_checkNMEA(pOutput, GPS_NMEA_VTG, "$GPVTG", 9, "N", FALSE);
-        case 'Z': //only ZDA left
-            return gps_checkNMEA(pOutput, GPS_NMEA_ZDA, "$GPZDA", 0, "", FALSE);
+    return gps_gateEpoch(pPort, gps_classifyNMEA(pOutput));
+}
+
+uint8_t gps_pollNMEA(uint8_t pPort, char* pOutput, uint8_t pMaxLength, uint8_t* pLength) {
+    while (uart_hasData(pPort)) {
+        char inChar = uart_getChar(pPort);
+
+        // A dollar sign indicates the start of a NMEA sentence (and discards
+        // a sentence which has been cut off)
+        if (inChar == '$') {
+            *pLength = 0;
+        } else if (*pLength == 0) {
+            continue;
+        }
+
+        pOutput[(*pLength)++] = inChar;
+
+        // Copy data until LF (same as gps_getNMEA)
+        if ((inChar == LF) || (*pLength >= pMaxLength - 1)) {
+            pOutput[*pLength] = 0;
+            *pLength = 0;
+            return gps_gateEpoch(pPort, gps_classifyNMEA(pOutput));
+        }
+    }
+
+    return GPS_NMEA_NONE;
+}
+
+/// Checker of an entry of GPS_NMEA_TABLE: gps_checkNMEA with the constants of
+/// the type, so the tokens it doesn't contain cost nothing while sweeping
+#define GPS_NMEA_CHECKER(pName, pBit, pFirst, pSecond, pThird, pToken, pCheck, pEquality, pSentences, \
+    pHdop, pPdop, pSatellites, pFix) \
+    static uint8_t gps_check##pName(const char* pSentence) { \
+        return gps_checkNMEA(pSentence, (pBit), (pToken), (pCheck), (pEquality), \
+            (pHdop), (pPdop), (pSatellites), (pFix)); \
+    }
+
+GPS_NMEA_TABLE(GPS_NMEA_CHECKER)
+
+/// Case of gps_classifyNMEA for an entry of GPS_NMEA_TABLE (disabled types are optimized away)
+#define GPS_NMEA_CASE(pName, pBit, pFirst, pSecond, pThird, ...) \
+    case ((pSecond) << 8) | (pThird): \
+        if ((GPS_NMEA_ENABLED & (pBit)) && (pSentence[3] == (pFirst))) { \
+            return gps_check##pName(pSentence); \
+        } \
+        return GPS_NMEA_UNKNOWN;
+
+uint8_t gps_classifyNMEA(const char* pSentence) {
+    if ((pSentence[1] != 'G') || (pSentence[2] != 'P')) {
+        return GPS_NMEA_UNKNOWN;
+    }
+
+    // The characters 4 and 5 are unique, so a single switch determines the
+    // type (the compiler turns it into a search tree)
+    switch ((pSentence[4] << 8) | pSentence[5]) {
+        GPS_NMEA_TABLE(GPS_NMEA_CASE)
         default:
             return GPS_NMEA_UNKNOWN;
     }
@@ -32,26 +32,110 @@
     #define GPS_SET_POWER 0x0C
     #define GPS_SET_UPDATE_RATE 0x0E
     #define GPS_SET_1PPS 0x3E
+    #define GPS_RESTART 0x01
+
+    /// Power mode: continuous tracking
+    #define GPS_POWER_NORMAL 0x00
+    /// Power mode: the module saves power between the fixes
+    #define GPS_POWER_SAVE 0x01
+
+    /// Length of the GPS_RESTART payload: mode, UTC date/time, position
+    #define GPS_RESTART_LENGTH 14
+    /// Start mode: hot start (using the given time and position)
+    #define GPS_RESTART_HOT 0x01
+    /// Offset of the UTC year (2 bytes), followed by month, day, hour, minute, second
+    #define GPS_RESTART_YEAR 1
+    /// Offset of the latitude in 1/100 degrees (signed, 2 bytes)
+    #define GPS_RESTART_LATITUDE 8
+    /// Offset of the longitude in 1/100 degrees (signed, 2 bytes)
+    #define GPS_RESTART_LONGITUDE 10
+    /// Offset of the altitude in meters (signed, 2 bytes)
+    #define GPS_RESTART_ALTITUDE 12
 
     // Indicators if NMEA Message is valid or invalid (validity differs for each Message type)
     #define GPS_NMEA_VALID 0x01
     #define GPS_NMEA_INVALID 0x00
 
-    // Possible NMEA-Messages that may be returned
-    #define GPS_NMEA_GGA 0x02 // 0b00000010 // Note: bit 0 can't be used, is an indicator
-    #define GPS_NMEA_GSA 0x04 // 0b00000100 // for validity of the message
-    #define GPS_NMEA_GSV 0x08 // 0b00001000
-    #define GPS_NMEA_GLL 0x10 // 0b00010000
-    #define GPS_NMEA_RMC 0x20 // 0b00100000
-    #define GPS_NMEA_VTG 0x40 // 0b01000000
-    #define GPS_NMEA_ZDA 0x80 // 0b10000000
+    /**
+     * The NMEA message types, each one declared once. The type bits, the
+     * validity checks of gps_classifyNMEA and the message counts of the
+     * firmware configuration are generated from this table. The order is the
+     * one of the bits and of the intervals passed to gps_init.
+     *
+     * X(name, bit, 1st, 2nd, 3rd character of the name, validity token,
+     *   validity character, equality, sentences per output, HDOP token,
+     *   PDOP token, satellites token, fix type token)
+     *
+     * Bit 0 can't be used, it indicates the validity of the message. A
+     * message is valid if the validity token (token 1 begins after the first
+     * comma, 0 = no check) equals the validity character (equality TRUE) or
+     * differs from it (equality FALSE). The 2nd and 3rd character have to be
+     * unique (gps_classifyNMEA switches on them). The last four tokens (0 =
+     * not contained) are checked against the fix quality thresholds.
+     */
+    #define GPS_NMEA_TABLE(X) \
+        X(GGA, 0x02, 'G', 'G', 'A', 6, '0', FALSE, 1, 8, 0, 7, 0) \
+        X(GSA, 0x04, 'G', 'S', 'A', 2, '1', FALSE, 1, 16, 15, 0, 2) \
+        X(GSV, 0x08, 'G', 'S', 'V', 0, '\0', FALSE, 3, 0, 0, 0, 0) \
+        X(GLL, 0x10, 'G', 'L', 'L', 6, 'A', TRUE, 1, 0, 0, 0, 0) \
+        X(RMC, 0x20, 'R', 'M', 'C', 2, 'A', TRUE, 1, 0, 0, 0, 0) \
+        X(VTG, 0x40, 'V', 'T', 'G', 9, 'N', FALSE, 1, 0, 0, 0, 0) \
+        X(ZDA, 0x80, 'Z', 'D', 'A', 0, '\0', FALSE, 1, 0, 0, 0, 0)
+
+    /// Generates the GPS_NMEA_<TYPE> bit of a table entry
+    #define GPS_NMEA_BIT(pName, pBit, ...) GPS_NMEA_##pName = (pBit),
+    /// Counts the entries of the table
+    #define GPS_NMEA_ONE(...) + 1
+
+    /// Possible NMEA-Messages that may be returned (GPS_NMEA_GGA etc.)
+    enum {
+        GPS_NMEA_TABLE(GPS_NMEA_BIT)
+    };
+
+    /// Message types recognized by gps_classifyNMEA, the others are unknown
+    #ifndef GPS_NMEA_ENABLED
+        #define GPS_NMEA_ENABLED GPS_NMEA_TYPEMASK
+    #endif
+
+    /// Highest HDOP (in 1/10, GGA and GSA) of a valid fix, 0 = no limit
+    #ifndef GPS_MAX_HDOP
+        #define GPS_MAX_HDOP 0
+    #endif
+
+    /// Highest PDOP (in 1/10, GSA) of a valid fix, 0 = no limit
+    #ifndef GPS_MAX_PDOP
+        #define GPS_MAX_PDOP 0
+    #endif
+
+    /// Lowest number of satellites in use (GGA) of a valid fix, 0 = no limit
+    #ifndef GPS_MIN_SATELLITES
+        #define GPS_MIN_SATELLITES 0
+    #endif
+
+    /// Lowest fix type (GSA: 2 = 2D, 3 = 3D) of a valid fix, 0 = no limit
+    #ifndef GPS_MIN_FIX
+        #define GPS_MIN_FIX 0
+    #endif
+
+    /// Fix quality gating is enabled if any of the thresholds is set
+    #define GPS_QUALITY (GPS_MAX_HDOP || GPS_MAX_PDOP || GPS_MIN_SATELLITES || GPS_MIN_FIX)
+
+    /// Message types which are dropped with the epoch if its GGA or GSA fails
+    /// the fix quality thresholds (GSV describes the satellites, not the fix)
+    #define GPS_QUALITY_GATED (GPS_NMEA_GLL | GPS_NMEA_RMC | GPS_NMEA_VTG | GPS_NMEA_ZDA)
 
     /// The value which is returned when no known NMEA-command has been recognized
     #define GPS_NMEA_UNKNOWN 0
 
+    /// The value which is returned by gps_pollNMEA if no sentence is complete yet
+    #define GPS_NMEA_NONE 0xFF
+
     /// A bitmask to extract the message type from a getNMEA return value
     #define GPS_NMEA_TYPEMASK 0xFE
 
+    /// Number of NMEA message types which can be configured in gps_init
+    #define GPS_NMEA_COUNT (0 GPS_NMEA_TABLE(GPS_NMEA_ONE))
+
     /// BAUD-Rate of the serial interface to the GPS module
     #define GPS_BAUDRATE 9600UL
 
@@ -64,74 +148,112 @@
      * The parameters can be used to configure the output produced by the GPS.
      * Please note that certain limitations exist for the parameters values.
      *
+     * \param pPort The UART port the module is connected to (UART_0 or UART_1)
      * \param pFrequency The frequency (in Hertz) in which NMEA-sentences should
      * be returned. The module supports only a value of the set {1,2,4,5,8,10}.
      * Only the values {1,2} are supported by the gLogger-Firmware right now!
      * Higher frequencies may or may not work.
-     * \param pMessages A bitset containing the messages which should be
-     * returned in each message block. Multiple messages can be selected by 
-     * using the OR-operator on the constant values. Possible constant values
-     * are {GPS_NMEA_GGA, GPS_NMEA_RMC, GPS_NMEA_GSA, GPS_NMEA_GSV,
-     * GPS_NMEA_GLL, GPS_NMEA_VTG, GPS_NMEA_ZDA}.
+     * \param pIntervals The output interval of each message type in update
+     * cycles (i.e. 1 = every fix, 5 = every fifth fix, 0 = disabled). The
+     * array contains GPS_NMEA_COUNT values in the order of GPS_NMEA_TABLE
+     * (GGA, GSA, GSV, GLL, RMC, VTG, ZDA).
+     */
+    void gps_init(uint8_t pPort, uint8_t pFrequency, const uint8_t* pIntervals);
+
+    /**
+     * \brief Restarts the GPS-module with a given time and position
+     *
+     * Initializes the UART port with the default baudrate. The configuration
+     * of the module is lost, so gps_init has to be called afterwards.
+     *
+     * \param pPort The UART port the module is connected to
+     * \param pPayload GPS_RESTART_LENGTH bytes (see GPS_RESTART_*)
      */
-    void gps_init(uint8_t pFrequency, uint8_t pMessages);
+    void gps_restart(uint8_t pPort, unsigned char* pPayload);
+
+    /**
+     * \brief Enables the 1PPS output of the GPS-module
+     *
+     * The rising edge of the pulse marks the beginning of each second (only
+     * while a 3D fix is available).
+     *
+     * \param pPort The UART port the module is connected to
+     */
+    void gps_enable1PPS(uint8_t pPort);
+
+    /**
+     * \brief Sets the power mode of the GPS-module
+     *
+     * The mode is only kept in the SRAM of the module, i.e. it is lost when
+     * the module is restarted.
+     *
+     * \param pPort The UART port the module is connected to
+     * \param pMode GPS_POWER_NORMAL or GPS_POWER_SAVE
+     */
+    void gps_setPower(uint8_t pPort, uint8_t pMode);
 
     /**
      * \brief Prompts the GPS to send data with a higher baudrate and
      * reinitializes the UART port.
+     *
+     * \param pPort The UART port the module is connected to
      */
-    void gps_highspeed();
+    void gps_highspeed(uint8_t pPort);
 
     /** 
      * \brief Sets a parameter of the GPS-module to a given value
      * 
+     * \param pPort The UART port the module is connected to
      * \param pCommand The parameter which should be set (see constants)
      * \param pData The data which should be written for this parameter
      * \return GPS_ACK on success, otherwise GPS_NACK
      */
-    unsigned char gps_setParam(unsigned char pCommand, unsigned char* pData, uint16_t pLength);
+    unsigned char gps_setParam(uint8_t pPort, unsigned char pCommand, unsigned char* pData, uint16_t pLength);
   
-    /**
-     * \brief Checks if the given sentence meets the criteria for a valid message
-     *
-     * This method checks several properties, some of them will only indicate if
-     * the message can be considered as "valid" or not, others will say more 
-     * generally if the given message is in a correct format.
-     *
-     * In detail, the method sweeps through the sentence once, while:
-     * - Performing a prefix check (return instantly if invalid)
-     * - Searching for pValidityToken and comparing it with pValidityCheck
-     * - Calculating the checksum and comparing it to given one (if given)
-     * WARNING: Long and ugly code ahead ;-) 
-     *
-     * \param pSentence The sentence which shall be checked
-     * \param pMessageType The message type which is expected
-     * \param pPrefix The prefix (== message type) that the sentence is supposed
-     * to have 
-     * \param pValidityToken The index of a token (a token is delimited by commas)
-     * in which a validity information can be found. Set to 0 if no validity check
-     * should be performed. Token 1 begins after the first comma (i.e. the first
-     * data after the "$GP..." type string)
-     * \param pValidityCheck A string to which the validityToken should be compared
-     * \param pCheckEquality If TRUE, the sentence is considered valid if the 
-     * validityToken equals the validityCheck string, otherwise if they are unequal
-     * \return GPS_NMEA_UNKNOWN if the message has a corrupt format (i.e. prefix or
-     * checksum mismatch), otherwise a composition of GPS_NMEA_<TYPE> | {GPS_NMEA_
-     * VALID or GPS_NMEA_INVALID}. If pValidityToken is zero, GPS_NMEA_VALID will
-     * be returned in combination with the type as we assume that this specific
-     * message type is always valid.
-     */
-    uint8_t gps_checkNMEA(const char* pSentence, uint8_t pMessageType, 
-        char* pPrefix, uint8_t pValidityToken, char* pValidityCheck, 
-        uint8_t pCheckEquality);
-
     /**
      * \brief Writes a NMEA-String into the given output buffer and returns its type
      *
+     * \param pPort The UART port the module is connected to
      * \param pOutput The buffer in which the NMEA string shall be written
      * \param pMaxLength The buffer's maximal length
      * \return A byte composed of the message type (bits 1-7) and a bit indicating
-     * if the message is valid or not (bit 0).
+     * if the message is valid or not (bit 0). If fix quality gating is enabled,
+     * the GPS_QUALITY_GATED sentences behind a GGA or GSA which has failed the
+     * thresholds are invalid as well (until the next GGA or GSA of the port).
+     */
+    uint8_t gps_getNMEA(uint8_t pPort, char* pOutput, uint8_t pMaxLength);
+
+    /**
+     * \brief Same as gps_getNMEA, but returns instead of waiting for data
+     *
+     * Takes the received characters of the port and appends them to the
+     * sentence in the output buffer. This allows receiving from several
+     * modules at once.
+     *
+     * \param pPort The UART port the module is connected to
+     * \param pOutput The buffer in which the NMEA string is assembled (has to be
+     * kept between the calls)
+     * \param pMaxLength The buffer's maximal length
+     * \param pLength The number of characters received so far (0 before the
+     * first call, kept between the calls)
+     * \return GPS_NMEA_NONE if the sentence isn't complete yet, the same as
+     * gps_getNMEA otherwise
+     */
+    uint8_t gps_pollNMEA(uint8_t pPort, char* pOutput, uint8_t pMaxLength, uint8_t* pLength);
+
+    /**
+     * \brief Determines the type and validity of a complete NMEA-String
+     *
+     * The type is looked up by the characters 4 and 5 of the sentence, then
+     * the sentence is swept once, calculating the checksum and extracting the
+     * validity token and the fix quality figures declared for the type in
+     * GPS_NMEA_TABLE. A sentence whose figures fail one of the thresholds
+     * (GPS_MAX_HDOP etc.) is invalid.
+     *
+     * \param pSentence A NUL-terminated sentence starting with '$'
+     * \return GPS_NMEA_UNKNOWN if the type isn't known (or not enabled) or
+     * the checksum doesn't match, otherwise a composition of GPS_NMEA_<TYPE> |
+     * {GPS_NMEA_VALID or GPS_NMEA_INVALID}
      */
-    uint8_t gps_getNMEA(char* pOutput, uint8_t pMaxLength);
+    uint8_t gps_classifyNMEA(const char* pSentence);
 #endif
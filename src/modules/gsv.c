@@ -0,0 +1,131 @@
+/**
+ * \file gsv.c
+ * \brief Aggregation of multi-part GSV groups into a single summary sentence
+ * \author Martin Matysiak
+ */
+
+#include "modules/gsv.h"
+
+/// Number of the part which is expected next (0 if no group is in progress)
+static uint8_t fExpected = 0;
+/// Number of parts of the current group
+static uint8_t fParts = 0;
+/// Number of satellites in view (as announced by the group)
+static uint8_t fInView = 0;
+/// Number of satellites reported so far
+static uint8_t fReported = 0;
+
+/// Statistics of the tracked satellites
+static uint8_t fTracked = 0;
+static uint8_t fMinSnr = 0;
+static uint8_t fMaxSnr = 0;
+static uint16_t fSumSnr = 0;
+static uint8_t fPrns[GSV_MAX_PRNS];
+
+/**
+ * \brief Parses a decimal number at the beginning of a token
+ * \return The number or 0xFF if the token is empty
+ */
+static uint8_t gsv_parseNumber(const char* pToken) {
+    if ((*pToken < '0') || (*pToken > '9')) {
+        return 0xFF;
+    }
+
+    uint8_t value = 0;
+    while ((*pToken >= '0') && (*pToken <= '9')) {
+        value = value * 10 + (*pToken++ - '0');
+    }
+
+    return value;
+}
+
+uint8_t gsv_add(const char* pSentence) {
+    // $GPGSV,<parts>,<part>,<in view>,{<PRN>,<elevation>,<azimuth>,<SNR>}*hh
+    const char* token = nmea_getToken(pSentence, 1);
+    uint8_t parts = gsv_parseNumber(token);
+    token = nmea_getToken(token, 1);
+    uint8_t part = gsv_parseNumber(token);
+    token = nmea_getToken(token, 1);
+    uint8_t inView = gsv_parseNumber(token);
+
+    if (part == 1) {
+        // A new group starts, anything incomplete before is discarded
+        fExpected = 1;
+        fParts = parts;
+        fInView = inView;
+        fReported = fTracked = fMaxSnr = 0;
+        fMinSnr = 0xFF;
+        fSumSnr = 0;
+    }
+
+    if ((part != fExpected) || (parts != fParts) || (inView != fInView) || (inView == 0xFF)) {
+        fExpected = 0;
+        return FALSE;
+    }
+
+    // Up to four satellites per sentence
+    for (uint8_t i = 0; i < 4; i++) {
+        token = nmea_getToken(token, 1);
+        uint8_t prn = gsv_parseNumber(token);
+        if (prn == 0xFF) {
+            break;
+        }
+
+        token = nmea_getToken(token, 3);
+        uint8_t snr = gsv_parseNumber(token);
+        fReported++;
+
+        // Some modules report an SNR of 0 instead of an empty field
+        if ((snr != 0xFF) && (snr > 0)) {
+            if (fTracked < GSV_MAX_PRNS) {
+                fPrns[fTracked] = prn;
+            }
+            fTracked++;
+            fSumSnr += snr;
+
+            if (snr < fMinSnr) {
+                fMinSnr = snr;
+            }
+            if (snr > fMaxSnr) {
+                fMaxSnr = snr;
+            }
+        }
+    }
+
+    if (part < fParts) {
+        fExpected++;
+        return FALSE;
+    }
+
+    // The group is only valid if every announced satellite has been reported
+    fExpected = 0;
+    return fReported == fInView;
+}
+
+void gsv_summary(char* pOutput) {
+    char* position = nmea_writePrefix(pOutput, PSTR("$PGLGSV,"));
+
+    position = nmea_writeNumber(position, fInView);
+    *position++ = ',';
+    position = nmea_writeNumber(position, fTracked);
+    *position++ = ',';
+
+    if (fTracked) {
+        position = nmea_writeNumber(position, fMinSnr);
+        *position++ = ',';
+        position = nmea_writeNumber(position, (fSumSnr + fTracked / 2) / fTracked);
+        *position++ = ',';
+        position = nmea_writeNumber(position, fMaxSnr);
+    } else {
+        *position++ = ',';
+        *position++ = ',';
+    }
+
+    for (uint8_t i = 0; (i < fTracked) && (i < GSV_MAX_PRNS); i++) {
+        *position++ = ',';
+        position = nmea_writeNumber(position, fPrns[i]);
+    }
+
+    *position = '\0';
+    nmea_appendChecksum(pOutput);
+}
@@ -0,0 +1,51 @@
+/**
+ * \file gsv.h
+ * \brief Aggregation of multi-part GSV groups into a single summary sentence
+ * \author Martin Matysiak
+ *
+ * The GPS-module reports the satellites in view in groups of up to four GSV
+ * sentences (four satellites each). These groups are reassembled and
+ * validated (all parts have to arrive in order with a valid checksum). For
+ * every complete group, a summary of the following form can be created:
+ *
+ * $PGLGSV,<in view>,<tracked>,<min SNR>,<mean SNR>,<max SNR>,<PRN>,...*hh
+ *
+ * Satellites count as tracked if the module reports an SNR above 0, only
+ * their PRNs are listed (at most GSV_MAX_PRNS). The SNR fields are empty if
+ * no satellite is tracked. The output rate of the summaries simply follows
+ * the configured GSV interval.
+ *
+ * The aggregator needs about 25 bytes of SRAM.
+ */
+
+#ifndef GSV_H
+    #define GSV_H
+
+    #include "global.h"
+    #include "modules/nmea.h"
+
+    /// Maximum number of tracked PRNs which are listed in the summary
+    #define GSV_MAX_PRNS 16
+
+    /// Minimum size of the buffer passed to gsv_summary: the prefix, five
+    /// fields and GSV_MAX_PRNS PRNs of up to three digits each (with their
+    /// commas) and "*hh", CR, LF and '\0'
+    #define GSV_SUMMARY_LENGTH (8 + 5 * 4 - 1 + GSV_MAX_PRNS * 4 + 6)
+
+    /**
+     * \brief Adds a GSV sentence to the current group
+     *
+     * \param pSentence A GSV sentence with a valid checksum (as returned by
+     * gps_getNMEA)
+     * \return TRUE if this sentence completed a valid group, FALSE otherwise
+     */
+    uint8_t gsv_add(const char* pSentence);
+
+    /**
+     * \brief Writes the summary sentence of the last completed group
+     *
+     * \param pOutput A buffer of at least GSV_SUMMARY_LENGTH bytes, receives
+     * a complete NMEA sentence including checksum and CR LF
+     */
+    void gsv_summary(char* pOutput);
+#endif
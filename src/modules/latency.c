@@ -0,0 +1,192 @@
+/**
+ * \file latency.c
+ * \brief Latency histograms of the logging pipeline, timed by the 1PPS signal
+ * \author Martin Matysiak
+ */
+
+#include "modules/latency.h"
+#include "modules/nmea.h"
+#include "protocols/timer.h"
+
+/// Arrival times of the sentences which are still in the UART buffer
+static volatile uint32_t fReceived[LATENCY_PENDING];
+/// Number of the '$' of each pending arrival time (see fArrivals)
+static volatile uint8_t fNumbers[LATENCY_PENDING];
+/// Index of the oldest pending arrival time
+static volatile uint8_t fReceivedRead = 0;
+/// Index where the next arrival time will be stored
+static volatile uint8_t fReceivedWrite = 0;
+/// Number of '$' which have arrived so far (wraps)
+static volatile uint8_t fArrivals = 0;
+/// Number of '$' which have been fetched or discarded so far (wraps)
+static uint8_t fFetches = 0;
+
+/// Arrival time of the sentence started last
+static uint32_t fCurrent = 0;
+/// TRUE if the arrival time of the sentence started last is known
+static uint8_t fCurrentValid = FALSE;
+
+/// Time of the last 1PPS pulse
+static uint32_t fPps = 0;
+/// TRUE if the first sentence after the last pulse hasn't been seen yet
+static uint8_t fPpsPending = FALSE;
+
+/// Arrival time of the oldest sentence in the current sector
+static uint32_t fSector = 0;
+/// TRUE if the current sector contains a sentence with a known arrival time
+static uint8_t fSectorPending = FALSE;
+
+/// Time of the last report
+static uint32_t fLastReport = 0;
+
+/// The histograms (P, V, D)
+static uint16_t fBuckets[LATENCY_HISTOGRAMS][LATENCY_BUCKETS];
+/// Maximum latency (in ms) of each histogram
+static uint16_t fMax[LATENCY_HISTOGRAMS];
+
+/// Names of the histograms (used in the report)
+static const char fNames[LATENCY_HISTOGRAMS] = {'P', 'V', 'D'};
+
+/**
+ * \brief Adds a latency to a histogram
+ *
+ * \param pHistogram Index of the histogram
+ * \param pTicks The latency in timer ticks
+ */
+static void latency_add(uint8_t pHistogram, uint32_t pTicks) {
+    uint32_t ms = TIMER_TO_MS(pTicks);
+
+    uint8_t bucket = 0;
+    uint16_t limit = 1;
+    while ((bucket < LATENCY_BUCKETS - 1) && (ms >= limit)) {
+        limit <<= 2;
+        bucket++;
+    }
+
+    if (fBuckets[pHistogram][bucket] < 0xFFFF) {
+        fBuckets[pHistogram][bucket]++;
+    }
+
+    if (ms > fMax[pHistogram]) {
+        fMax[pHistogram] = (ms > 0xFFFF) ? 0xFFFF : ms;
+    }
+}
+
+void latency_init() {
+    timer_init();
+    fLastReport = timer_now();
+}
+
+void latency_received() {
+    uint8_t next = (fReceivedWrite + 1) % LATENCY_PENDING;
+
+    // If the buffer is full, the timestamp is lost
+    if (next != fReceivedRead) {
+        fReceived[fReceivedWrite] = timer_now();
+        fNumbers[fReceivedWrite] = fArrivals;
+        fReceivedWrite = next;
+    }
+
+    fArrivals++;
+}
+
+void latency_fetched() {
+    uint8_t number = fFetches++;
+    fCurrentValid = FALSE;
+
+    // Arrival times of discarded characters are skipped. A newer one belongs
+    // to a following sentence (the one of this sentence has been lost).
+    while (fReceivedRead != fReceivedWrite) {
+        int8_t age = number - fNumbers[fReceivedRead];
+        if (age < 0) {
+            break;
+        }
+
+        if (age == 0) {
+            fCurrent = fReceived[fReceivedRead];
+            fCurrentValid = TRUE;
+        }
+        fReceivedRead = (fReceivedRead + 1) % LATENCY_PENDING;
+
+        if (age == 0) {
+            break;
+        }
+    }
+}
+
+void latency_cleared() {
+    fFetches = fArrivals;
+}
+
+void latency_validated() {
+    uint32_t now = timer_now();
+    uint32_t pps;
+
+    if (timer_getPps(&pps)) {
+        fPps = pps;
+        fPpsPending = TRUE;
+    }
+
+    if (!fCurrentValid) {
+        return;
+    }
+
+    latency_add(1, now - fCurrent);
+
+    // Sentences which had arrived before the pulse belong to the last update
+    if (fPpsPending && ((int32_t)(fCurrent - fPps) >= 0)) {
+        latency_add(0, fCurrent - fPps);
+        fPpsPending = FALSE;
+    }
+}
+
+void latency_written() {
+    if (fCurrentValid && !fSectorPending) {
+        fSector = fCurrent;
+        fSectorPending = TRUE;
+    }
+}
+
+void latency_committed() {
+    if (fSectorPending) {
+        latency_add(2, timer_now() - fSector);
+        fSectorPending = FALSE;
+    }
+}
+
+uint8_t latency_due() {
+    uint32_t now = timer_now();
+
+    if (now - fLastReport >= LATENCY_REPORT_INTERVAL * 1000UL * TIMER_TICKS_PER_MS) {
+        fLastReport = now;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+void latency_report(char* pOutput, uint8_t pHistogram) {
+    char* position = nmea_writePrefix(pOutput, PSTR("$PGLLAT,"));
+
+    *position++ = fNames[pHistogram];
+    *position++ = ',';
+
+    uint32_t count = 0;
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+        count += fBuckets[pHistogram][i];
+    }
+
+    position = nmea_writeNumber(position, (count > 0xFFFF) ? 0xFFFF : count);
+    *position++ = ',';
+    position = nmea_writeNumber(position, fMax[pHistogram]);
+
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+        *position++ = ',';
+        position = nmea_writeNumber(position, fBuckets[pHistogram][i]);
+        fBuckets[pHistogram][i] = 0;
+    }
+    fMax[pHistogram] = 0;
+
+    *position = '\0';
+    nmea_appendChecksum(pOutput);
+}
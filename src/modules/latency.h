@@ -0,0 +1,125 @@
+/**
+ * \file latency.h
+ * \brief Latency histograms of the logging pipeline, timed by the 1PPS signal
+ * \author Martin Matysiak
+ *
+ * Every sentence is timestamped when its '$' arrives at the UART, when it has
+ * been validated by the main loop and when the sector containing it has been
+ * committed onto the card by nofs_flush. From these timestamps, three
+ * histograms are collected:
+ *
+ * - P: 1PPS pulse to the first byte of the following update
+ * - V: first byte to validated sentence
+ * - D: first byte to durable (worst case per sector, i.e. the oldest
+ *   sentence in the committed sector)
+ *
+ * Every LATENCY_REPORT_INTERVAL seconds, one sentence per histogram is
+ * written onto the card and the histograms are cleared:
+ *
+ * $PGLLAT,<histogram>,<count>,<max ms>,<bucket 0>,...,<bucket 7>*hh
+ *
+ * Bucket i counts the latencies below 4^i ms (bucket 7: all the others).
+ * The instrumentation needs about 90 bytes of SRAM and Timer1.
+ *
+ * The arrival times wait in a small queue until the main loop fetches their
+ * '$' from the UART buffer. Every '$' is numbered on arrival and on
+ * fetching, so a '$' whose arrival time has been lost (the queue was full)
+ * or which has been discarded (see uart_clearBuf) only leaves its own
+ * sentence untimed.
+ */
+
+#ifndef LATENCY_H
+    #define LATENCY_H
+
+    #include "global.h"
+
+    /// Set to TRUE in order to collect and report the latency histograms
+    #ifndef LATENCY
+        #define LATENCY FALSE
+    #endif
+
+    /// Interval (in seconds) in which the histograms are reported
+    #ifndef LATENCY_REPORT_INTERVAL
+        #define LATENCY_REPORT_INTERVAL 60
+    #endif
+
+    /// Number of buckets per histogram
+    #define LATENCY_BUCKETS 8
+
+    /// Number of histograms
+    #define LATENCY_HISTOGRAMS 3
+
+    /// Number of '$' timestamps which may be pending in the UART buffer
+    #define LATENCY_PENDING 4
+
+    /// Minimum size of the buffer passed to latency_report
+    #define LATENCY_REPORT_LENGTH 80
+
+    #if LATENCY
+        /// Called by the UART for every received character
+        #define LATENCY_RECEIVED(pChar) if ((pChar) == '$') latency_received()
+        /// Called by the UART for every character fetched from the buffer
+        #define LATENCY_FETCHED(pChar) if ((pChar) == '$') latency_fetched()
+        /// Called by the UART when the buffer is cleared
+        #define LATENCY_CLEARED() latency_cleared()
+    #else
+        #define LATENCY_RECEIVED(pChar)
+        #define LATENCY_FETCHED(pChar)
+        #define LATENCY_CLEARED()
+    #endif
+
+    /**
+     * \brief Starts the timebase and the capturing of the 1PPS signal
+     */
+    void latency_init();
+
+    /**
+     * \brief Timestamps the arrival of a '$' (called from the UART interrupt)
+     */
+    void latency_received();
+
+    /**
+     * \brief Takes the arrival time of a '$' which has been fetched from the
+     * UART buffer, i.e. of the sentence which starts
+     */
+    void latency_fetched();
+
+    /**
+     * \brief Discards the arrival times of the characters in the UART buffer
+     * (called with the interrupts disabled)
+     */
+    void latency_cleared();
+
+    /**
+     * \brief Timestamps the validation of the sentence started last
+     */
+    void latency_validated();
+
+    /**
+     * \brief Marks the sentence fetched last as written into the sector buffer
+     */
+    void latency_written();
+
+    /**
+     * \brief Timestamps the commit of the current sector (called by nofs_flush)
+     */
+    void latency_committed();
+
+    /**
+     * \brief Checks if the histograms are due to be reported
+     * \return TRUE if LATENCY_REPORT_INTERVAL seconds have passed since the
+     * last report
+     */
+    uint8_t latency_due();
+
+    /**
+     * \brief Writes the report sentence of a histogram
+     *
+     * The histogram is cleared afterwards.
+     *
+     * \param pOutput A buffer of at least LATENCY_REPORT_LENGTH bytes,
+     * receives a complete NMEA sentence including checksum and CR LF
+     * \param pHistogram Index of the histogram (0 to LATENCY_HISTOGRAMS - 1)
+     */
+    void latency_report(char* pOutput, uint8_t pHistogram);
+#endif
@@ -0,0 +1,202 @@
+/**
+ * \file nmea.c
+ * \brief Hardware independent helpers for extracting data out of NMEA
+ * sentences
+ * \author Martin Matysiak
+ */
+
+#include "modules/nmea.h"
+
+/// Number of days in front of every month (in a year which is no leap year)
+static const uint16_t fMonthDays[12] PROGMEM = {
+    0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+};
+
+/// cos(latitude) * 256 in steps of 5 degrees, used to scale longitude differences
+static const uint8_t fCosTable[19] PROGMEM = {
+    255, 255, 252, 247, 241, 232, 222, 210, 196, 181,
+    165, 147, 128, 108, 88, 66, 44, 22, 0};
+
+/**
+ * \brief Parses a number of exactly two digits
+ * \return The number or 0xFF if the characters are no digits
+ */
+static uint8_t nmea_parseTwoDigits(const char* pToken) {
+    if ((pToken[0] < '0') || (pToken[0] > '9') || (pToken[1] < '0') || (pToken[1] > '9')) {
+        return 0xFF;
+    }
+
+    return (pToken[0] - '0') * 10 + (pToken[1] - '0');
+}
+
+const char* nmea_getToken(const char* pSentence, uint8_t pIndex) {
+    while (pIndex && *pSentence) {
+        if (*pSentence++ == ',') {
+            pIndex--;
+        }
+    }
+
+    return pSentence;
+}
+
+int32_t nmea_parseCoordinate(const char* pToken) {
+    // Integer part contains degrees and minutes (dddmm)
+    uint16_t integer = 0;
+    while ((*pToken >= '0') && (*pToken <= '9')) {
+        integer = integer * 10 + (*pToken++ - '0');
+    }
+
+    // Exactly four digits of the fraction are used (ten-thousandths of a
+    // minute), missing digits are filled up with zeroes
+    uint16_t fraction = 0;
+    if (*pToken == '.') {
+        pToken++;
+    }
+
+    for (uint8_t i = 0; i < 4; i++) {
+        fraction *= 10;
+        if ((*pToken >= '0') && (*pToken <= '9')) {
+            fraction += *pToken++ - '0';
+        }
+    }
+
+    int32_t result = (int32_t)(integer / 100) * NMEA_UNITS_PER_DEGREE
+        + (int32_t)(integer % 100) * 10000 + fraction;
+
+    // Skip remaining digits and look at the hemisphere indicator
+    while (*pToken && (*pToken != ',')) {
+        pToken++;
+    }
+
+    if (*pToken == ',') {
+        pToken++;
+    }
+
+    if ((*pToken == 'S') || (*pToken == 'W')) {
+        result = -result;
+    }
+
+    return result;
+}
+
+uint32_t nmea_parseTime(const char* pToken) {
+    if ((*pToken < '0') || (*pToken > '9')) {
+        return NMEA_TIME_INVALID;
+    }
+
+    // hh, mm and ss are two digits each
+    uint32_t seconds = 0;
+    for (uint8_t i = 0; i < 3; i++) {
+        seconds = seconds * 60 + (pToken[0] - '0') * 10 + (pToken[1] - '0');
+        pToken += 2;
+    }
+
+    // Up to three digits of milliseconds
+    uint16_t milliseconds = 0;
+    if (*pToken == '.') {
+        pToken++;
+    }
+
+    for (uint8_t i = 0; i < 3; i++) {
+        milliseconds *= 10;
+        if ((*pToken >= '0') && (*pToken <= '9')) {
+            milliseconds += *pToken++ - '0';
+        }
+    }
+
+    return seconds * 1000 + milliseconds;
+}
+
+uint32_t nmea_parseDateTime(const char* pSentence) {
+    uint32_t time = nmea_parseTime(nmea_getToken(pSentence, 1));
+    uint8_t day, month, year;
+
+    if (pSentence[3] == 'Z') {
+        // $GPZDA,hhmmss.sss,dd,mm,yyyy,...
+        day = nmea_parseTwoDigits(nmea_getToken(pSentence, 2));
+        month = nmea_parseTwoDigits(nmea_getToken(pSentence, 3));
+        year = nmea_parseTwoDigits(nmea_getToken(pSentence, 4) + 2);
+    } else {
+        // $GPRMC,hhmmss.sss,A,llll.ll,a,yyyyy.yy,a,x.x,x.x,ddmmyy,...
+        const char* date = nmea_getToken(pSentence, 9);
+        day = nmea_parseTwoDigits(date);
+        month = nmea_parseTwoDigits(date + 2);
+        year = nmea_parseTwoDigits(date + 4);
+    }
+
+    if ((time == NMEA_TIME_INVALID) || (day < 1) || (day > 31) || (month < 1)
+        || (month > 12) || (year > 99)) {
+        return NMEA_TIME_INVALID;
+    }
+
+    // Every fourth year is a leap year (including 2000)
+    uint16_t days = year * 365 + (year + 3) / 4 + pgm_read_word(&fMonthDays[month - 1]) + day - 1;
+    if ((month > 2) && (year % 4 == 0)) {
+        days++;
+    }
+
+    return days * NMEA_SECONDS_PER_DAY + time / 1000;
+}
+
+/**
+ * \brief Returns the hexadecimal digit of a nibble (upper case)
+ */
+static char nmea_hexDigit(uint8_t pNibble) {
+    return (pNibble < 10) ? '0' + pNibble : 'A' - 10 + pNibble;
+}
+
+void nmea_appendChecksum(char* pSentence) {
+    uint8_t checksum = 0;
+
+    // Everything between '$' and '*' is covered by the checksum
+    while (*++pSentence) {
+        checksum ^= *pSentence;
+    }
+
+    *pSentence++ = '*';
+    *pSentence++ = nmea_hexDigit(checksum >> 4);
+    *pSentence++ = nmea_hexDigit(checksum & 0x0F);
+    *pSentence++ = CR;
+    *pSentence++ = LF;
+    *pSentence = '\0';
+}
+
+char* nmea_writeNumber(char* pOutput, uint32_t pValue) {
+    char digits[10];
+    uint8_t length = 0;
+
+    do {
+        digits[length++] = '0' + pValue % 10;
+        pValue /= 10;
+    } while (pValue);
+
+    while (length) {
+        *pOutput++ = digits[--length];
+    }
+
+    return pOutput;
+}
+
+char* nmea_writePrefix(char* pOutput, const char* pPrefix) {
+    char character;
+
+    while ((character = pgm_read_byte(pPrefix++))) {
+        *pOutput++ = character;
+    }
+
+    return pOutput;
+}
+
+uint8_t nmea_cosLatitude(int32_t pLatitude) {
+    uint32_t latitude = pLatitude < 0 ? -pLatitude : pLatitude;
+    uint8_t index = latitude / (5 * NMEA_UNITS_PER_DEGREE);
+
+    if (index >= 18) {
+        return 0;
+    }
+
+    // Linear interpolation between the steps of the table
+    uint8_t low = pgm_read_byte(&fCosTable[index]);
+    uint8_t difference = low - pgm_read_byte(&fCosTable[index + 1]);
+    return low - (uint32_t)difference * (latitude % (5 * NMEA_UNITS_PER_DEGREE)) / (5 * NMEA_UNITS_PER_DEGREE);
+}
@@ -0,0 +1,111 @@
+/**
+ * \file nmea.h
+ * \brief Hardware independent helpers for extracting data out of NMEA
+ * sentences
+ * \author Martin Matysiak
+ *
+ * Coordinates are handled as fixed-point numbers in order to avoid floating
+ * point operations on the MCU. The unit of a coordinate is 1/10000 of an
+ * arcminute (which is exactly the resolution of the "ddmm.mmmm" format the
+ * GPS-module uses), i.e. roughly 0.19 meters in north-south direction.
+ */
+
+#ifndef NMEA_H
+    #define NMEA_H
+
+    #include "global.h"
+
+    /// Value which is returned by nmea_parseTime if the token contains no time
+    #define NMEA_TIME_INVALID 0xFFFFFFFFUL
+
+    /// Milliseconds per day, useful when calculating time differences around midnight
+    #define NMEA_MS_PER_DAY 86400000UL
+
+    /// Seconds per day
+    #define NMEA_SECONDS_PER_DAY 86400UL
+
+    /// Coordinate units (1/10000 arcminute) per degree
+    #define NMEA_UNITS_PER_DEGREE 600000L
+
+    /**
+     * \brief Returns a pointer to the beginning of a given token
+     *
+     * Tokens are delimited by commas, token 0 is the "$GPxxx" type string.
+     *
+     * \param pSentence The NMEA sentence which should be searched
+     * \param pIndex The index of the requested token
+     * \return A pointer to the first character of the token. If the sentence
+     * has less tokens, a pointer to the terminating NUL character is returned.
+     */
+    const char* nmea_getToken(const char* pSentence, uint8_t pIndex);
+
+    /**
+     * \brief Parses a coordinate of the form "(d)ddmm.mmmm,H"
+     *
+     * The hemisphere indicator H is expected in the token following the
+     * given one. Southern and western coordinates are returned as negative
+     * values. Missing fraction digits are treated as zeroes, additional ones
+     * are ignored.
+     *
+     * \param pToken A pointer to the first character of the coordinate token
+     * \return The coordinate in 1/10000 arcminutes
+     */
+    int32_t nmea_parseCoordinate(const char* pToken);
+
+    /**
+     * \brief Parses a UTC time of the form "hhmmss(.sss)"
+     *
+     * \param pToken A pointer to the first character of the time token
+     * \return The time in milliseconds since midnight or NMEA_TIME_INVALID if
+     * the token is empty
+     */
+    uint32_t nmea_parseTime(const char* pToken);
+
+    /**
+     * \brief Parses date and UTC time out of a RMC or ZDA sentence
+     *
+     * \param pSentence A complete $GPRMC or $GPZDA sentence
+     * \return The seconds since 2000-01-01 00:00:00 UTC or NMEA_TIME_INVALID
+     * if the sentence contains no (valid) date or time. Valid for the years
+     * 2000 to 2099.
+     */
+    uint32_t nmea_parseDateTime(const char* pSentence);
+
+    /**
+     * \brief Completes a sentence with its checksum and CR LF
+     *
+     * \param pSentence A NUL-terminated sentence starting with '$' (without
+     * '*'), the buffer needs room for 5 additional characters
+     */
+    void nmea_appendChecksum(char* pSentence);
+
+    /**
+     * \brief Appends a decimal number (without leading zeroes) to a string
+     *
+     * \param pOutput The position the digits are written at (the string
+     * isn't terminated)
+     * \param pValue The number
+     * \return A pointer behind the last written character
+     */
+    char* nmea_writeNumber(char* pOutput, uint32_t pValue);
+
+    /**
+     * \brief Copies a string from the flash (e.g. PSTR("$PGLxxx,")), so the
+     * types of the reports take no SRAM
+     *
+     * \param pOutput The position the string is written at (it isn't
+     * terminated)
+     * \param pPrefix The string in the flash
+     * \return A pointer behind the last written character
+     */
+    char* nmea_writePrefix(char* pOutput, const char* pPrefix);
+
+    /**
+     * \brief Returns the factor which converts longitude differences at a
+     * latitude into the units of latitude differences
+     *
+     * \param pLatitude The latitude in 1/10000 arcminutes
+     * \return cos(latitude) * 256 (interpolated between steps of 5 degrees)
+     */
+    uint8_t nmea_cosLatitude(int32_t pLatitude);
+#endif
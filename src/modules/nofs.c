@@ -5,16 +5,455 @@
  */
 
 #include "modules/nofs.h"
+#include "modules/latency.h"
+#include "modules/nmea.h"
 
+#if NOFS_COMPRESSION
+    #include "modules/compress.h"
+#endif
+
+#if NOFS_INSTANCES
+#if NOFS_COMPRESSION
+    #error "NOFS_COMPRESSION is not supported with NOFS_INSTANCES"
+#endif
+
+/// The selected instance, the fields below are redirected into it
+static nofs_instance_t* fInstance = NULL;
+
+#define fCurrentSector (fInstance->currentSector)
+#define fCurrentByte (fInstance->currentByte)
+#define fWriteCount (fInstance->writeCount)
+#define fCommittedByte (fInstance->committedByte)
+#define fTerminalSector (fInstance->terminalSector)
+#define sectorBuf (fInstance->sectorBuf)
+#define fSession (fInstance->session)
+#define fDataStart (fInstance->dataStart)
+#define fIndexStart (fInstance->indexStart)
+#define fIndexTime (fInstance->indexTime)
+#define fDirectoryStart (fInstance->directoryStart)
+#define fDirectorySlot (fInstance->directorySlot)
+#define fSummary (fInstance->summary)
+#define fScratchStart (fInstance->scratchStart)
+#define fProfileStart (fInstance->profileStart)
+#define fTraceStart (fInstance->traceStart)
+
+void nofs_select(nofs_instance_t* pInstance) {
+    fInstance = pInstance;
+}
+#else
 /// Index of the currently active sector
 uint32_t fCurrentSector = 0;
 /// Index which points to the current end of data inside the current sector
 uint16_t fCurrentByte = 0;
 /// Will be incremented upon every writeString call
 uint8_t fWriteCount = 0;
+/// Value of fCurrentByte when the current sector has been written last
+uint16_t fCommittedByte = 0;
+/// The sector behind the current one once its NOFS_TERMINAL has been written
+uint32_t fTerminalSector = 0;
 /// Buffer which holds the currently active sector
 char sectorBuf[NOFS_BUFFER_SIZE];
 
+#if NOFS_SECTOR_HEADER
+/// Identifier of the current session (i.e. its first sector)
+uint32_t fSession = 0;
+#endif
+
+#if NOFS_REGIONS
+/// First sector behind the reserved regions
+uint32_t fDataStart = 0;
+#endif
+
+#if NOFS_INDEX
+/// First sector of the index region (0 if the card has none)
+uint32_t fIndexStart = 0;
+/// Date and time of the first RMC/ZDA sentence in the current sector
+uint32_t fIndexTime = NOFS_TIME_UNKNOWN;
+#endif
+
+#if NOFS_DIRECTORY
+/// First sector of the directory region (0 if the card has none)
+uint32_t fDirectoryStart = 0;
+/// Directory record of the running session
+uint16_t fDirectorySlot = 0;
+/// Summary of the running session (see nofs_setSummary)
+const nofs_summary_t* fSummary = NULL;
+#endif
+
+#if NOFS_SCRATCH
+/// The scratch sector (0 if the card has none)
+uint32_t fScratchStart = 0;
+#endif
+
+#if NOFS_PROFILE
+/// First sector of the profiler region (0 if the card has none)
+uint32_t fProfileStart = 0;
+#endif
+
+#if NOFS_TRACE
+/// First sector of the trace region (0 if the card has none)
+uint32_t fTraceStart = 0;
+#endif
+#endif
+
+/// Sector writes of the data since the last nofs_takeWrites (per NOFS_WRITE_*)
+static uint16_t fWrites[NOFS_WRITE_KINDS];
+/// Age of the data which isn't on the card yet (see nofs_age)
+static uint32_t fAge = 0;
+
+#if NOFS_DIRECTORY
+/// Number of records of the directory region
+#define NOFS_DIRECTORY_SLOTS ((uint16_t)NOFS_DIRECTORY_SECTORS * NOFS_DIRECTORY_RECORDS)
+#endif
+
+#if NOFS_REGIONS
+/// First sector which may contain data
+#define NOFS_FIRST_DATA_SECTOR fDataStart
+#else
+#define NOFS_FIRST_DATA_SECTOR 0
+#endif
+
+/**
+ * \brief Writes a number into a buffer (MSB first)
+ */
+static void nofs_writeNumber(char* pBuffer, uint32_t pValue, uint8_t pBytes) {
+    while (pBytes--) {
+        pBuffer[pBytes] = pValue & 0xFF;
+        pValue >>= 8;
+    }
+}
+
+/**
+ * \brief Reads a number out of a buffer (MSB first)
+ */
+static uint32_t nofs_readNumber(const char* pBuffer, uint8_t pBytes) {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < pBytes; i++) {
+        value = (value << 8) | (uint8_t)pBuffer[i];
+    }
+    return value;
+}
+
+/**
+ * \brief Returns the index of the first data byte of the sector in the buffer
+ */
+static uint16_t nofs_dataStart(uint32_t pSector) {
+    if (pSector == 0) {
+        return NOFS_DATA_START;
+    }
+
+    // Sectors written with or without sector headers may be mixed
+    return sectorBuf[0] == NOFS_SECTOR_MAGIC ? NOFS_SECTOR_HEADER_LENGTH : 0;
+}
+
+/**
+ * \brief Prepares the (empty) buffer for the data of a new sector
+ */
+static void nofs_startSector() {
+    fCurrentByte = 0;
+
+#if NOFS_SECTOR_HEADER
+    sectorBuf[0] = NOFS_SECTOR_MAGIC;
+    sectorBuf[NOFS_SECTOR_FLAGS] = NOFS_COMPRESSION ? NOFS_FLAG_COMPRESSED : 0;
+    nofs_writeNumber(sectorBuf + NOFS_SECTOR_SESSION, fSession, 4);
+    nofs_writeNumber(sectorBuf + NOFS_SECTOR_NUMBER, fCurrentSector, 4);
+    nofs_writeNumber(sectorBuf + NOFS_SECTOR_FIRST, 0, 2);
+    nofs_writeNumber(sectorBuf + NOFS_SECTOR_TIME, NOFS_TIME_UNKNOWN, 4);
+    fCurrentByte = NOFS_SECTOR_HEADER_LENGTH;
+#endif
+
+    sectorBuf[fCurrentByte] = NOFS_TERMINAL;
+    fCommittedByte = fCurrentByte;
+
+#if NOFS_COMPRESSION
+    // Every sector is compressed independently
+    compress_reset();
+#endif
+
+#if NOFS_INDEX
+    fIndexTime = NOFS_TIME_UNKNOWN;
+#endif
+}
+
+/**
+ * \brief Writes a NOFS_TERMINAL into the sector behind the current one
+ *
+ * Called as soon as a sector is started: until its data is written, byte 0
+ * of the current sector holds the only NOFS_TERMINAL on the card.
+ * \return TRUE if the sector has been written
+ */
+static uint8_t nofs_writeTerminal() {
+    // Remember the first byte as we will replace it with the
+    // NOFS_TERMINAL temporarily to write the current+1 sector
+    char temp = sectorBuf[0];
+    sectorBuf[0] = NOFS_TERMINAL;
+    uint8_t written = sdmmc_writeSector(fCurrentSector + 1, sectorBuf);
+    sectorBuf[0] = temp;
+    fWrites[NOFS_WRITE_TERMINAL]++;
+
+    if (written) {
+        fTerminalSector = fCurrentSector + 1;
+    }
+    return written;
+}
+
+/**
+ * \brief Remembers that a sentence starts at the current position
+ */
+static void nofs_markSentence() {
+#if NOFS_SECTOR_HEADER
+    // Only the first sentence of a sector is of interest
+    if (nofs_readNumber(sectorBuf + NOFS_SECTOR_FIRST, 2) == 0) {
+        nofs_writeNumber(sectorBuf + NOFS_SECTOR_FIRST, fCurrentByte, 2);
+    }
+#endif
+}
+
+#if NOFS_REGIONS
+/**
+ * \brief Appends a region to the region table of sector 0 (in the buffer)
+ * \return The first sector behind the new region
+ */
+static uint32_t nofs_addRegion(uint8_t pType, uint32_t pFirst, uint32_t pCount) {
+    char* entry = sectorBuf + NOFS_REGION_TABLE
+        + sectorBuf[NOFS_REGION_COUNT]++ * NOFS_REGION_ENTRY_LENGTH;
+
+    entry[0] = pType;
+    nofs_writeNumber(entry + 1, pFirst, 4);
+    nofs_writeNumber(entry + 5, pCount, 4);
+    return pFirst + pCount;
+}
+
+/**
+ * \brief Reads the region table of sector 0 (in the buffer)
+ */
+static void nofs_readRegions() {
+    fDataStart = 0;
+#if NOFS_INDEX
+    fIndexStart = 0;
+#endif
+#if NOFS_DIRECTORY
+    fDirectoryStart = 0;
+#endif
+#if NOFS_SCRATCH
+    fScratchStart = 0;
+#endif
+#if NOFS_PROFILE
+    fProfileStart = 0;
+#endif
+#if NOFS_TRACE
+    fTraceStart = 0;
+#endif
+
+    if (sectorBuf[NOFS_DATA_START] != NOFS_REGION_MARKER) {
+        return;
+    }
+
+    for (uint8_t i = 0; i < (uint8_t)sectorBuf[NOFS_REGION_COUNT]; i++) {
+        char* entry = sectorBuf + NOFS_REGION_TABLE + i * NOFS_REGION_ENTRY_LENGTH;
+        uint32_t first = nofs_readNumber(entry + 1, 4);
+        uint32_t end = first + nofs_readNumber(entry + 5, 4);
+
+        if (end > fDataStart) {
+            fDataStart = end;
+        }
+
+#if NOFS_INDEX
+        if (entry[0] == NOFS_REGION_INDEX) {
+            fIndexStart = first;
+        }
+#endif
+#if NOFS_DIRECTORY
+        if (entry[0] == NOFS_REGION_DIRECTORY) {
+            fDirectoryStart = first;
+        }
+#endif
+#if NOFS_SCRATCH
+        if (entry[0] == NOFS_REGION_SCRATCH) {
+            fScratchStart = first;
+        }
+#endif
+#if NOFS_PROFILE
+        if (entry[0] == NOFS_REGION_PROFILE) {
+            fProfileStart = first;
+        }
+#endif
+#if NOFS_TRACE
+        if (entry[0] == NOFS_REGION_TRACE) {
+            fTraceStart = first;
+        }
+#endif
+    }
+}
+#endif
+
+#if NOFS_INDEX
+/**
+ * \brief Adds the index record of the current sector (if it needs one)
+ *
+ * Has to be called after the sector has been flushed as the buffer is used
+ * for updating the index sector.
+ */
+static void nofs_writeIndex() {
+    uint32_t slot = fCurrentSector - fDataStart;
+
+    if (!fIndexStart || (fIndexTime == NOFS_TIME_UNKNOWN) || (slot % NOFS_INDEX_INTERVAL)) {
+        return;
+    }
+
+    slot /= NOFS_INDEX_INTERVAL;
+    if (slot >= (uint32_t)NOFS_INDEX_SECTORS * NOFS_INDEX_RECORDS) {
+        return;
+    }
+
+    uint32_t sector = fIndexStart + slot / NOFS_INDEX_RECORDS;
+    char* record = sectorBuf + (slot % NOFS_INDEX_RECORDS) * NOFS_INDEX_RECORD_LENGTH;
+
+    sdmmc_readSector(sector, sectorBuf);
+    nofs_writeNumber(record, fCurrentSector, 4);
+    nofs_writeNumber(record + 4, fIndexTime, 4);
+    sdmmc_writeSector(sector, sectorBuf);
+}
+#endif
+
+#if NOFS_PROFILE && PROFILER
+/**
+ * \brief Writes the samples of the profiler if the current sector completes
+ * NOFS_PROFILE_INTERVAL data sectors
+ *
+ * Has to be called while the buffer is not in use (like nofs_writeIndex).
+ */
+static void nofs_writeProfile() {
+    uint32_t slot = fCurrentSector + 1 - fDataStart;
+
+    if (!fProfileStart || (slot % NOFS_PROFILE_INTERVAL)) {
+        return;
+    }
+
+    nofs_writeNumber(sectorBuf + NOFS_PROFILE_SESSION, fSession, 4);
+    nofs_writeNumber(sectorBuf + NOFS_PROFILE_SECTOR, fCurrentSector, 4);
+    nofs_writeNumber(sectorBuf + NOFS_PROFILE_FREQUENCY, PROFILER_FREQUENCY, 2);
+    sectorBuf[NOFS_PROFILE_BITS] = PROFILER_BUCKET_BITS;
+    sectorBuf[NOFS_PROFILE_COUNT] = PROFILER_BUCKETS;
+
+    for (uint8_t i = 0; i < PROFILER_BUCKETS; i++) {
+        nofs_writeNumber(sectorBuf + NOFS_PROFILE_BUCKETS + 2 * i, profiler_take(i), 2);
+    }
+
+    slot = (slot / NOFS_PROFILE_INTERVAL - 1) % NOFS_PROFILE_SECTORS;
+    sdmmc_writeSector(fProfileStart + slot, sectorBuf);
+}
+#endif
+
+#if NOFS_TRACE && TRACE
+/**
+ * \brief Writes the events of the flight recorder behind the current sector
+ *
+ * Has to be called while the buffer is not in use (like nofs_writeIndex).
+ * \return TRUE if the events have been written
+ */
+static uint8_t nofs_dumpTrace(uint8_t pReason) {
+    if (!fTraceStart) {
+        return FALSE;
+    }
+
+    // The dump itself is the last event
+    trace_add(TRACE_DUMP, pReason);
+
+    nofs_writeNumber(sectorBuf + NOFS_TRACE_SESSION, fSession, 4);
+    nofs_writeNumber(sectorBuf + NOFS_TRACE_SECTOR, fCurrentSector, 4);
+    sectorBuf[NOFS_TRACE_REASON] = pReason;
+    nofs_writeNumber(sectorBuf + NOFS_TRACE_RATE, TRACE_TICKS_PER_SECOND, 2);
+    sectorBuf[NOFS_TRACE_COUNT] = trace_copy(sectorBuf + NOFS_TRACE_EVENTS);
+
+    return sdmmc_writeSector(fTraceStart + fCurrentSector % NOFS_TRACE_SECTORS, sectorBuf);
+}
+#endif
+
+#if NOFS_DIRECTORY
+/**
+ * \brief Reads the sector of a directory record into the buffer
+ * \return The record inside the buffer
+ */
+static char* nofs_readRecord(uint16_t pSlot) {
+    sdmmc_readSector(fDirectoryStart + pSlot / NOFS_DIRECTORY_RECORDS, sectorBuf);
+    return sectorBuf + (pSlot % NOFS_DIRECTORY_RECORDS) * NOFS_DIRECTORY_RECORD_LENGTH;
+}
+
+/**
+ * \brief Writes the record of the running session
+ *
+ * Has to be called while the buffer is not in use (like nofs_writeIndex).
+ *
+ * \param pLast The last sector of the session so far
+ */
+static void nofs_writeDirectory(uint32_t pLast) {
+    if (!fDirectoryStart || (fDirectorySlot >= NOFS_DIRECTORY_SLOTS)) {
+        return;
+    }
+
+    char* record = nofs_readRecord(fDirectorySlot);
+    nofs_writeNumber(record + NOFS_DIRECTORY_FIRST, fSession, 4);
+    nofs_writeNumber(record + NOFS_DIRECTORY_LAST, pLast, 4);
+
+    if (fSummary && fSummary->fixes) {
+        // The fields of the summary are in the order of the record
+        const uint32_t* field = &fSummary->start;
+        for (uint8_t i = 0; i < 8; i++) {
+            nofs_writeNumber(record + NOFS_DIRECTORY_START + 4 * i, field[i], 4);
+        }
+    } else {
+        nofs_writeNumber(record + NOFS_DIRECTORY_START, NOFS_TIME_UNKNOWN, 4);
+        nofs_writeNumber(record + NOFS_DIRECTORY_END, NOFS_TIME_UNKNOWN, 4);
+        for (uint8_t i = NOFS_DIRECTORY_FIXES; i < NOFS_DIRECTORY_STATE; i++) {
+            record[i] = 0;
+        }
+    }
+
+    record[NOFS_DIRECTORY_STATE] = NOFS_SESSION_OPEN;
+    sdmmc_writeSector(fDirectoryStart + fDirectorySlot / NOFS_DIRECTORY_RECORDS, sectorBuf);
+}
+
+/**
+ * \brief Finalizes the record of the previous session and creates the one
+ * of the new session (fSession)
+ *
+ * The records are searched from the start of the region, the first one
+ * whose first sector doesn't follow the one in front of it is free.
+ */
+static void nofs_openDirectory() {
+    if (!fDirectoryStart) {
+        return;
+    }
+
+    uint32_t previous = 0;
+    for (fDirectorySlot = 0; fDirectorySlot < NOFS_DIRECTORY_SLOTS; fDirectorySlot++) {
+        char* record = sectorBuf + (fDirectorySlot % NOFS_DIRECTORY_RECORDS) * NOFS_DIRECTORY_RECORD_LENGTH;
+        if (fDirectorySlot % NOFS_DIRECTORY_RECORDS == 0) {
+            nofs_readRecord(fDirectorySlot);
+        }
+
+        // A session which has written nothing is replaced by the new one
+        uint32_t first = nofs_readNumber(record + NOFS_DIRECTORY_FIRST, 4);
+        if ((first <= previous) || (first < fDataStart) || (first >= fSession)) {
+            break;
+        }
+        previous = first;
+    }
+
+    if (previous) {
+        char* record = nofs_readRecord(fDirectorySlot - 1);
+        if (record[NOFS_DIRECTORY_STATE] == NOFS_SESSION_OPEN) {
+            nofs_writeNumber(record + NOFS_DIRECTORY_LAST, fSession - 1, 4);
+            record[NOFS_DIRECTORY_STATE] = NOFS_SESSION_CLOSED;
+            sdmmc_writeSector(fDirectoryStart + (fDirectorySlot - 1) / NOFS_DIRECTORY_RECORDS, sectorBuf);
+        }
+    }
+
+    nofs_writeDirectory(fSession);
+}
+#endif
+
 void nofs_init() { 
     /*
         Steps of initialization:
@@ -28,6 +467,9 @@ void nofs_init() {
     */
     
     // Step 1
+    fCurrentSector = 0;
+    fCurrentByte = 0;
+    fTerminalSector = 0;
     sdmmc_init();
     
     // Step 2
@@ -39,9 +481,59 @@ void nofs_init() {
     }
     
     // Step 4
-    for (uint8_t i = 0; i < 4; i++) {
-        fCurrentSector += sectorBuf[NOFS_HEADER_LENGTH + i] << ((3 - i) * 8); // MSB first
+    fCurrentSector = nofs_readNumber(sectorBuf + NOFS_HEADER_LENGTH, 4);
+
+#if NOFS_REGIONS
+    // A freshly formatted card gets the reserved regions in front of the
+    // data. The data then starts with an empty sector behind them.
+    if ((fCurrentSector == 0) && (sectorBuf[NOFS_DATA_START] == NOFS_TERMINAL)) {
+        sectorBuf[NOFS_DATA_START] = NOFS_REGION_MARKER;
+        sectorBuf[NOFS_REGION_COUNT] = 0;
+        fCurrentSector = 1;
+#if NOFS_SCRATCH
+        fCurrentSector = nofs_addRegion(NOFS_REGION_SCRATCH, fCurrentSector, 1);
+#endif
+#if NOFS_INDEX
+        fCurrentSector = nofs_addRegion(NOFS_REGION_INDEX, fCurrentSector, NOFS_INDEX_SECTORS);
+#endif
+#if NOFS_PROFILE
+        fCurrentSector = nofs_addRegion(NOFS_REGION_PROFILE, fCurrentSector, NOFS_PROFILE_SECTORS);
+#endif
+#if NOFS_TRACE
+        fCurrentSector = nofs_addRegion(NOFS_REGION_TRACE, fCurrentSector, NOFS_TRACE_SECTORS);
+#endif
+#if NOFS_DIRECTORY
+        fCurrentSector = nofs_addRegion(NOFS_REGION_DIRECTORY, fCurrentSector, NOFS_DIRECTORY_SECTORS);
+#endif
+        nofs_writeNumber(sectorBuf + NOFS_HEADER_LENGTH, fCurrentSector, 4);
+        sdmmc_writeSector(0, sectorBuf);
+
+        sectorBuf[0] = NOFS_TERMINAL;
+        sdmmc_writeSector(fCurrentSector, sectorBuf);
+
+        // Records left from a previous use of the card would still match
+        // their sector (and the directory ends at the first invalid record),
+        // so all regions are cleared. This only happens once per card.
+        for (uint16_t i = 0; i < NOFS_BUFFER_SIZE; i++) {
+            sectorBuf[i] = 0;
+        }
+        for (uint32_t sector = 1; sector < fCurrentSector; sector++) {
+            sdmmc_writeSector(sector, sectorBuf);
+        }
+
+        sdmmc_readSector(0, sectorBuf);
+    }
+
+    nofs_readRegions();
+#endif
+
+#if NOFS_SCRATCH && SDMMC_CALIBRATE
+    // The buffer isn't needed anymore, cards formatted before the scratch
+    // region existed keep SDMMC_SPEED
+    if (fScratchStart) {
+        sdmmc_calibrate(fScratchStart, sectorBuf);
     }
+#endif
     
     // Step 5
 
@@ -60,12 +552,18 @@ void nofs_init() {
     // change failed.
     sdmmc_changeBlockLength(0);
 
-    // Now get the sector in front of this one and look for the last 
-    // byte with actual data
-    sdmmc_readSector(--fCurrentSector, sectorBuf);
+    if (fCurrentSector == NOFS_FIRST_DATA_SECTOR) {
+        // No data at all behind the reserved regions yet
+        fCurrentByte = 0;
+    } else {
+        // Now get the sector in front of this one and look for the last 
+        // byte with actual data (a sector header may contain any value)
+        sdmmc_readSector(--fCurrentSector, sectorBuf);
+        fCurrentByte = nofs_dataStart(fCurrentSector);
 
-    while((sectorBuf[fCurrentByte] != NOFS_TERMINAL) && (fCurrentByte < NOFS_BUFFER_SIZE)) {
-        fCurrentByte++;
+        while((sectorBuf[fCurrentByte] != NOFS_TERMINAL) && (fCurrentByte < NOFS_BUFFER_SIZE)) {
+            fCurrentByte++;
+        }
     }
 
     // Check if we have the edge case that the sector was filled 
@@ -78,52 +576,257 @@ void nofs_init() {
     
     // Step 6
     sdmmc_readSector(0, sectorBuf);
-
-    for (uint8_t i = 0; i < 4; i++) {
-        sectorBuf[NOFS_HEADER_LENGTH + i] = (fCurrentSector >> ((3 - i) * 8)) & 0xFF; // MSB first
-    }
-
+    nofs_writeNumber(sectorBuf + NOFS_HEADER_LENGTH, fCurrentSector, 4);
     sdmmc_writeSector(0, sectorBuf);
     
     // Step 7
     sdmmc_readSector(fCurrentSector, sectorBuf);
+
+#if NOFS_SECTOR_HEADER
+    // Every session starts with a sector of its own, the rest of a partially
+    // written sector is therefore filled up
+    if (fCurrentByte > 0) {
+        while (fCurrentByte < NOFS_BUFFER_SIZE) {
+            sectorBuf[fCurrentByte++] = NOFS_PADDING;
+        }
+
+        // The records of nofs_nextSector belong to the previous session. Its
+        // date isn't known anymore, so the sector gets no index record.
+        nofs_flush();
+        fCurrentSector++;
+    }
+
+    fSession = fCurrentSector;
+#if NOFS_DIRECTORY
+    nofs_openDirectory();
+#endif
+    nofs_startSector();
+#elif NOFS_COMPRESSION
+    // Restore the compressor state for the partially written sector
+    uint16_t start = nofs_dataStart(fCurrentSector);
+    compress_reset();
+    compress_replay(sectorBuf + start, fCurrentByte - start);
+#endif
+
+    // The partially written sector is on the card already
+    fCommittedByte = fCurrentByte;
+    nofs_writeTerminal();
+
+#if TRACE
+    // The ring saved by an error of the previous run (see trace_fatal) is
+    // written behind the first sector of this session. Cards without a trace
+    // region lose it.
+    uint8_t saved = trace_saved();
+    if (saved) {
+        nofs_writeTrace(saved);
+        trace_release();
+    }
+#endif
+}
+
+/**
+ * \brief Writes the full buffer onto the memory card and starts a new sector
+ */
+static void nofs_nextSector() {
+    nofs_flush();
+#if NOFS_INDEX
+    nofs_writeIndex();
+#endif
+#if NOFS_PROFILE && PROFILER
+    nofs_writeProfile();
+#endif
+#if NOFS_TRACE && TRACE
+    // A stalled flush is dumped right away, other requests with the next sector
+    uint8_t reason = trace_pending();
+    if (reason) {
+        nofs_dumpTrace(reason);
+    }
+#endif
+#if NOFS_DIRECTORY
+    if ((fCurrentSector + 1 - fSession) % NOFS_DIRECTORY_INTERVAL == 0) {
+        nofs_writeDirectory(fCurrentSector);
+    }
+#endif
+    fCurrentSector++;
+    nofs_startSector();
+    nofs_writeTerminal();
 }
 
 void nofs_writeString(char* pString) {
+#if NOFS_COMPRESSION
+    // Compress the data token by token into the buffer. If the buffer is
+    // full, write it onto the memory card and create a new empty one
+    char token[2];
+    uint8_t consumed;
+
+    while (*pString) {
+        // Sentences always start with a new token
+        if (*pString == '$') {
+            nofs_markSentence();
+        }
+
+        uint8_t length = compress_token(pString, NOFS_BUFFER_SIZE - fCurrentByte,
+            token, &consumed);
+        pString += consumed;
+
+        for (uint8_t i = 0; i < length; i++) {
+            sectorBuf[fCurrentByte++] = token[i];
+        }
+
+        if (fCurrentByte == NOFS_BUFFER_SIZE) {
+            nofs_nextSector();
+        }
+    }
+#else
     // Copy data into the buffer. If the buffer is full, write it onto the
     // memory card and create a new empty one
     uint8_t i = 0;
 
     while (pString[i]) {
         if(fCurrentByte < NOFS_BUFFER_SIZE) {
+            if (pString[i] == '$') {
+                nofs_markSentence();
+            }
+
             sectorBuf[fCurrentByte++] = pString[i++];
         } else {   
-            nofs_flush();
-            fCurrentSector++;
-            fCurrentByte = 0;
+            nofs_nextSector();
         }
     }
 
     // Set the new end of data
     if (fCurrentByte == NOFS_BUFFER_SIZE) {
-        nofs_flush();
-        fCurrentSector++;
-        fCurrentByte = 0;
+        nofs_nextSector();
     }
+#endif
 
     sectorBuf[fCurrentByte] = ETX;
+
+#if NOFS_COMMIT_BYTES
+    if (nofs_uncommitted() >= NOFS_COMMIT_BYTES) {
+        nofs_commit(NOFS_WRITE_SIZE);
+    }
+#endif
 }
 
-void nofs_flush() {
-    // Remember the first byte as we will replace it with the NOFS_TERMINAL
-    // temporarily to write the current+1 sector
-    char temp = sectorBuf[0];
-    sectorBuf[0] = NOFS_TERMINAL;
-    sdmmc_writeSector(fCurrentSector + 1, sectorBuf);
-    
-    _delay_ms(10);
-    
+void nofs_setTime(uint32_t pTime) {
+#if NOFS_SECTOR_HEADER
+    if (nofs_readNumber(sectorBuf + NOFS_SECTOR_TIME, 4) == NOFS_TIME_UNKNOWN) {
+        nofs_writeNumber(sectorBuf + NOFS_SECTOR_TIME, pTime, 4);
+    }
+#endif
+}
+
+void nofs_setDateTime(uint32_t pDateTime) {
+#if NOFS_INDEX
+    if (fIndexTime == NOFS_TIME_UNKNOWN) {
+        fIndexTime = pDateTime;
+    }
+#endif
+}
+
+void nofs_setSummary(const nofs_summary_t* pSummary) {
+#if NOFS_DIRECTORY
+    fSummary = pSummary;
+#endif
+}
+
+/**
+ * \brief Writes the buffer onto the memory card (see nofs_flush)
+ * \param pKind The kind of the write (NOFS_WRITE_*) which is counted
+ */
+static void nofs_write(uint8_t pKind) {
+#if TRACE
+    uint16_t start = trace_now();
+    trace_add(TRACE_FLUSH, fCurrentSector);
+#endif
+
+    uint8_t written = TRUE;
+
+    // The NOFS_TERMINAL behind has been written when the sector was started
+    // (see nofs_writeTerminal), it's only retried here if that failed. It has
+    // to be on the card before the data overwrites the current one.
+    if (fTerminalSector != fCurrentSector + 1) {
+        written = nofs_writeTerminal();
+        _delay_ms(10);
+    }
+
     // Now write the actual current sector
-    sectorBuf[0] = temp;
-    sdmmc_writeSector(fCurrentSector, sectorBuf);
-}
\ No newline at end of file
+    written &= sdmmc_writeSector(fCurrentSector, sectorBuf);
+    fCommittedByte = fCurrentByte;
+    fWrites[pKind]++;
+    fAge = 0;
+
+#if LATENCY
+    // Everything written so far is durable now
+    latency_committed();
+#endif
+
+#if TRACE
+    trace_add(TRACE_FLUSHED, written);
+    if (!written) {
+        trace_request(TRACE_DUMP_FAILED);
+    } else if ((uint16_t)(trace_now() - start) >= TRACE_STALL_TICKS) {
+        trace_request(TRACE_DUMP_STALL);
+    }
+#endif
+}
+
+void nofs_flush() {
+    nofs_write((fCurrentByte >= NOFS_BUFFER_SIZE) ? NOFS_WRITE_FULL : NOFS_WRITE_OTHER);
+}
+
+void nofs_commit(uint8_t pCause) {
+    if (nofs_uncommitted()) {
+        nofs_write(pCause);
+    }
+}
+
+uint16_t nofs_uncommitted() {
+    return fCurrentByte - fCommittedByte;
+}
+
+void nofs_age(uint16_t pElapsed, uint32_t pLimit) {
+    if (!nofs_uncommitted()) {
+        fAge = 0;
+        return;
+    }
+
+    fAge += pElapsed;
+    if (fAge >= pLimit) {
+        nofs_write(NOFS_WRITE_AGE);
+    }
+}
+
+uint16_t nofs_takeWrites(uint8_t pKind) {
+    uint16_t writes = fWrites[pKind];
+    fWrites[pKind] = 0;
+    return writes;
+}
+
+void nofs_report(char* pOutput) {
+    char* output = nmea_writePrefix(pOutput, PSTR("$PGLCMT"));
+
+    for (uint8_t i = 0; i < NOFS_WRITE_KINDS; i++) {
+        *output++ = ',';
+        output = nmea_writeNumber(output, nofs_takeWrites(i));
+    }
+
+    *output = '\0';
+    nmea_appendChecksum(pOutput);
+}
+
+uint8_t nofs_writeTrace(uint8_t pReason) {
+#if NOFS_TRACE && TRACE
+    if (!fTraceStart) {
+        return FALSE;
+    }
+
+    nofs_flush();
+    uint8_t written = nofs_dumpTrace(pReason);
+    sdmmc_readSector(fCurrentSector, sectorBuf);
+    return written;
+#else
+    return FALSE;
+#endif
+}
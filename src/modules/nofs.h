@@ -23,6 +23,99 @@
  *   The application should ensure that there is always at least one 
  *   NOFS_TERMINAL present on the device (i.e. write the new NOFS_TERMINALs 
  *  _before_ overwriting the old ones).
+ * - If NOFS_COMPRESSION is enabled, the data is compressed as described in
+ *   compress.h. Every sector is compressed independently, starting at its
+ *   first data byte (i.e. byte NOFS_DATA_START in sector 0). As uncompressed
+ *   text is a valid compressed stream as well, both can be mixed freely.
+ * - If NOFS_SECTOR_HEADER is enabled, every sector (except for sector 0)
+ *   starts with a header of NOFS_SECTOR_HEADER_LENGTH bytes. Byte 0 is
+ *   NOFS_SECTOR_MAGIC which never occurs in the data, the other fields
+ *   (numbers MSB first) are:
+ *   - NOFS_SECTOR_FLAGS (1 byte): e.g. NOFS_FLAG_COMPRESSED
+ *   - NOFS_SECTOR_SESSION (4 bytes): the first sector of the session (i.e.
+ *     since power-up) the sector belongs to
+ *   - NOFS_SECTOR_NUMBER (4 bytes): the index of the sector itself
+ *   - NOFS_SECTOR_FIRST (2 bytes): the index of the byte (or token) at which
+ *     the first sentence starting in this sector begins, 0 if there is none
+ *   - NOFS_SECTOR_TIME (4 bytes): UTC time of the first fix in this sector
+ *     in milliseconds since midnight or NOFS_TIME_UNKNOWN
+ *   Every session starts in a new sector, the unused rest of the sector
+ *   in front of it is filled with NOFS_PADDING. Any sector can therefore be
+ *   decoded on its own, even if the sectors around it are corrupt.
+ * - A sector which isn't full yet may be committed (see nofs_commit), e.g.
+ *   after NOFS_COMMIT_BYTES bytes. It is written as it is and rewritten in
+ *   place once more data has been added. The NOFS_TERMINAL in the following
+ *   sector is written as soon as a sector is started, before any data of it.
+ * - Starting with firmware version 1.7, the memory card may contain reserved
+ *   regions (i.e. ranges of sectors which are not part of the data). These
+ *   are created on a freshly formatted card only (i.e. if the pointer is 0
+ *   and the data of sector 0 is empty). In this case, byte NOFS_DATA_START
+ *   of sector 0 is NOFS_REGION_MARKER, followed by the number of regions (1
+ *   byte) and a table of NOFS_REGION_ENTRY_LENGTH bytes per region: its type
+ *   (e.g. NOFS_REGION_INDEX), its first sector and its number of sectors
+ *   (4 bytes each, MSB first). Sector 0 contains no data then, the data
+ *   starts in the first sector behind the last region. The regions are
+ *   cleared (filled with 0) when they are created, so nothing left from a
+ *   previous use of the card is mistaken for a record.
+ * - If NOFS_INDEX is enabled, the NOFS_REGION_INDEX region contains one
+ *   record of NOFS_INDEX_RECORD_LENGTH bytes for every NOFS_INDEX_INTERVAL
+ *   data sectors: record n belongs to the n-th multiple of
+ *   NOFS_INDEX_INTERVAL behind the first data sector and consists of that
+ *   sector's index followed by the date and time of the first RMC or ZDA
+ *   sentence in it (seconds since 2000-01-01 UTC, see nmea_parseDateTime).
+ *   A record is written as soon as its sector is full, records whose sector
+ *   number doesn't match are unused.
+ * - If NOFS_DIRECTORY is enabled, the NOFS_REGION_DIRECTORY region contains
+ *   one record of NOFS_DIRECTORY_RECORD_LENGTH bytes per session, in the
+ *   order of the sessions. Records are valid as long as their first sectors
+ *   are increasing, the first invalid one ends the directory. A record
+ *   consists of (numbers MSB first, 4 bytes each unless noted):
+ *   - NOFS_DIRECTORY_FIRST, NOFS_DIRECTORY_LAST: first and last sector of
+ *     the session
+ *   - NOFS_DIRECTORY_START, NOFS_DIRECTORY_END: date and time of the first
+ *     and last fix (see nmea_parseDateTime) or NOFS_TIME_UNKNOWN
+ *   - NOFS_DIRECTORY_FIXES: the number of logged fixes
+ *   - NOFS_DIRECTORY_SOUTH, _NORTH, _WEST, _EAST: the bounding box of the
+ *     fixes in 1/10000 arcminutes (signed, 0 if there is no fix)
+ *   - NOFS_DIRECTORY_DISTANCE: the distance travelled in meters
+ *   - NOFS_DIRECTORY_STATE (1 byte): NOFS_SESSION_OPEN while the session is
+ *     running, NOFS_SESSION_CLOSED once it has been finalized
+ *   The record of the running session is written at power-up and then every
+ *   NOFS_DIRECTORY_INTERVAL sectors. As the logger is switched off by
+ *   cutting the power, it is finalized at the next power-up: its last sector
+ *   is corrected, the summary covers the data up to the last update.
+ * - If NOFS_SCRATCH is enabled, the NOFS_REGION_SCRATCH region is a single
+ *   sector without meaningful content. It is overwritten at every power-up
+ *   by the calibration of the SPI clock (see sdmmc_calibrate).
+ * - If NOFS_PROFILE is enabled, the NOFS_REGION_PROFILE region contains the
+ *   histograms of the sampling profiler (see profiler.h), one record per
+ *   sector: whenever the data sectors behind the first one add up to a
+ *   multiple of NOFS_PROFILE_INTERVAL, record n (n = multiple - 1) is
+ *   written into sector n modulo the size of the region (the oldest records
+ *   are overwritten). It holds the samples since the previous record of the
+ *   session, or since the power-up (numbers MSB first):
+ *   - NOFS_PROFILE_SESSION (4 bytes): the session the record belongs to
+ *   - NOFS_PROFILE_SECTOR (4 bytes): the full data sector, records whose
+ *     sector doesn't belong to their slot have never been written
+ *   - NOFS_PROFILE_FREQUENCY (2 bytes): samples per second
+ *   - NOFS_PROFILE_BITS (1 byte): a bucket covers 2^bits bytes of flash
+ *   - NOFS_PROFILE_COUNT (1 byte): the number of buckets
+ *   - NOFS_PROFILE_BUCKETS: the samples of each bucket (2 bytes each)
+ * - If NOFS_TRACE is enabled, the NOFS_REGION_TRACE region contains the
+ *   dumps of the flight recorder (see trace.h), one per sector: a dump
+ *   written behind data sector s goes into sector s modulo the size of the
+ *   region (a later dump behind the same sector replaces it). It consists
+ *   of (numbers MSB first):
+ *   - NOFS_TRACE_SESSION (4 bytes): the session the dump belongs to
+ *   - NOFS_TRACE_SECTOR (4 bytes): the data sector s, dumps whose sector
+ *     doesn't belong to their slot have never been written
+ *   - NOFS_TRACE_REASON (1 byte): an error code or TRACE_DUMP_*
+ *   - NOFS_TRACE_COUNT (1 byte): the number of events
+ *   - NOFS_TRACE_RATE (2 bytes): ticks of the event times per second
+ *   - NOFS_TRACE_EVENTS: the events, the oldest one first (type, data and
+ *     time, TRACE_EVENT_LENGTH bytes each), the last one is the TRACE_DUMP
+ *     (the TRACE_ERROR for a ring saved by an error, which is written
+ *     behind the first sector of the next session)
  *
  * \author Martin Matysiak
  */
@@ -32,6 +125,8 @@
 
     #include "global.h"
     #include "modules/sdmmc.h"
+    #include "modules/profiler.h"
+    #include "modules/trace.h"
     
     /// Size of the NoFS-Buffer (equals the block size on a memory card)
     #define NOFS_BUFFER_SIZE SDMMC_SECTOR_SIZE
@@ -41,6 +136,270 @@
     #define NOFS_HEADER_LENGTH 7
     /// The byte which is written to indicate the end of a NoFS partition
     #define NOFS_TERMINAL ETX 
+    /// Index of the first data byte in sector 0 (behind header and pointer)
+    #define NOFS_DATA_START (NOFS_HEADER_LENGTH + 4)
+
+    /// Set to TRUE in order to compress the written data (costs ~160 bytes SRAM)
+    #ifndef NOFS_COMPRESSION
+        #define NOFS_COMPRESSION FALSE
+    #endif
+
+    /// Set to FALSE in order to write sectors without a sector header
+    #ifndef NOFS_SECTOR_HEADER
+        #define NOFS_SECTOR_HEADER TRUE
+    #endif
+
+    /// First byte of a sector which starts with a sector header
+    #define NOFS_SECTOR_MAGIC 0x1E
+    /// Offset of the flags in the sector header
+    #define NOFS_SECTOR_FLAGS 1
+    /// Offset of the session identifier in the sector header
+    #define NOFS_SECTOR_SESSION 2
+    /// Offset of the sector number in the sector header
+    #define NOFS_SECTOR_NUMBER 6
+    /// Offset of the index of the first sentence in the sector header
+    #define NOFS_SECTOR_FIRST 10
+    /// Offset of the time of the first fix in the sector header
+    #define NOFS_SECTOR_TIME 12
+    /// Length of the sector header
+    #define NOFS_SECTOR_HEADER_LENGTH 16
+
+    /// Sector flag: the data has been compressed
+    #define NOFS_FLAG_COMPRESSED 0x01
+    /// Value of a time which is not known
+    #define NOFS_TIME_UNKNOWN 0xFFFFFFFFUL
+    /// Byte which fills up unused space at the end of a sector
+    #define NOFS_PADDING 0x00
+
+    /// Set to FALSE in order to create no time index on fresh memory cards
+    #ifndef NOFS_INDEX
+        #define NOFS_INDEX TRUE
+    #endif
+
+    /// An index record is written every NOFS_INDEX_INTERVAL sectors (power of 2)
+    #ifndef NOFS_INDEX_INTERVAL
+        #define NOFS_INDEX_INTERVAL 256
+    #endif
+
+    /// Size of the index region: 256 sectors cover 2 GB with the default
+    /// interval, the most sdmmc addresses (byte addresses, no SDHC)
+    #ifndef NOFS_INDEX_SECTORS
+        #define NOFS_INDEX_SECTORS 256
+    #endif
+
+    /// Length of an index record (sector and time)
+    #define NOFS_INDEX_RECORD_LENGTH 8
+    /// Number of index records per sector
+    #define NOFS_INDEX_RECORDS (NOFS_BUFFER_SIZE / NOFS_INDEX_RECORD_LENGTH)
+
+    /// Set to FALSE in order to create no session directory on fresh memory
+    /// cards, disabled by default on MCUs with 1 KB of SRAM (the directory and
+    /// the session summary need about 55 bytes)
+    #ifndef NOFS_DIRECTORY
+        #define NOFS_DIRECTORY (NOFS_SECTOR_HEADER && !MCU_SMALL_SRAM)
+    #endif
+
+    #if NOFS_DIRECTORY && !NOFS_SECTOR_HEADER
+        #error "NOFS_DIRECTORY needs NOFS_SECTOR_HEADER (the session identifiers)"
+    #endif
+
+    /// The record of the running session is updated every NOFS_DIRECTORY_INTERVAL sectors
+    #ifndef NOFS_DIRECTORY_INTERVAL
+        #define NOFS_DIRECTORY_INTERVAL 64
+    #endif
+
+    /// Size of the directory region (64 sectors hold 512 sessions)
+    #ifndef NOFS_DIRECTORY_SECTORS
+        #define NOFS_DIRECTORY_SECTORS 64
+    #endif
+
+    /// Length of a directory record
+    #define NOFS_DIRECTORY_RECORD_LENGTH 64
+    /// Number of directory records per sector
+    #define NOFS_DIRECTORY_RECORDS (NOFS_BUFFER_SIZE / NOFS_DIRECTORY_RECORD_LENGTH)
+
+    /// Offsets of the fields of a directory record
+    #define NOFS_DIRECTORY_FIRST 0
+    #define NOFS_DIRECTORY_LAST 4
+    #define NOFS_DIRECTORY_START 8
+    #define NOFS_DIRECTORY_END 12
+    #define NOFS_DIRECTORY_FIXES 16
+    #define NOFS_DIRECTORY_SOUTH 20
+    #define NOFS_DIRECTORY_NORTH 24
+    #define NOFS_DIRECTORY_WEST 28
+    #define NOFS_DIRECTORY_EAST 32
+    #define NOFS_DIRECTORY_DISTANCE 36
+    #define NOFS_DIRECTORY_STATE 40
+
+    /// Session state: running (or not finalized yet)
+    #define NOFS_SESSION_OPEN 0x01
+    /// Session state: finalized at the next power-up
+    #define NOFS_SESSION_CLOSED 0x02
+
+    /// Set to FALSE in order to create no scratch sector on fresh memory cards
+    #ifndef NOFS_SCRATCH
+        #define NOFS_SCRATCH SDMMC_CALIBRATE
+    #endif
+
+    /// Set to FALSE in order to create no profiler region on fresh memory cards
+    #ifndef NOFS_PROFILE
+        #define NOFS_PROFILE PROFILER
+    #endif
+
+    /// A profiler record is written every NOFS_PROFILE_INTERVAL sectors
+    #ifndef NOFS_PROFILE_INTERVAL
+        #define NOFS_PROFILE_INTERVAL 16
+    #endif
+
+    /// Size of the profiler region (one record per sector)
+    #ifndef NOFS_PROFILE_SECTORS
+        #define NOFS_PROFILE_SECTORS 64
+    #endif
+
+    /// Offsets of the fields of a profiler record
+    #define NOFS_PROFILE_SESSION 0
+    #define NOFS_PROFILE_SECTOR 4
+    #define NOFS_PROFILE_FREQUENCY 8
+    #define NOFS_PROFILE_BITS 10
+    #define NOFS_PROFILE_COUNT 11
+    #define NOFS_PROFILE_BUCKETS 12
+
+    #if NOFS_PROFILE && !NOFS_SECTOR_HEADER
+        #error "NOFS_PROFILE needs NOFS_SECTOR_HEADER (the session identifiers)"
+    #endif
+
+    #if NOFS_PROFILE && (NOFS_PROFILE_BUCKETS + 2 * PROFILER_BUCKETS > NOFS_BUFFER_SIZE)
+        #error "The profiler record doesn't fit into a sector"
+    #endif
+
+    /// Set to FALSE in order to create no trace region on fresh memory cards
+    #ifndef NOFS_TRACE
+        #define NOFS_TRACE (TRACE && NOFS_SECTOR_HEADER)
+    #endif
+
+    /// Size of the trace region (one dump per sector)
+    #ifndef NOFS_TRACE_SECTORS
+        #define NOFS_TRACE_SECTORS 16
+    #endif
+
+    /// Offsets of the fields of a dump of the flight recorder
+    #define NOFS_TRACE_SESSION 0
+    #define NOFS_TRACE_SECTOR 4
+    #define NOFS_TRACE_REASON 8
+    #define NOFS_TRACE_COUNT 9
+    #define NOFS_TRACE_RATE 10
+    #define NOFS_TRACE_EVENTS 12
+
+    #if NOFS_TRACE && !NOFS_SECTOR_HEADER
+        #error "NOFS_TRACE needs NOFS_SECTOR_HEADER (the session identifiers)"
+    #endif
+
+    #if NOFS_TRACE && (NOFS_TRACE_EVENTS + TRACE_EVENT_LENGTH * TRACE_EVENTS > NOFS_BUFFER_SIZE)
+        #error "The dump of the flight recorder doesn't fit into a sector"
+    #endif
+
+    /// Reserved regions are only created if at least one of them is used
+    #define NOFS_REGIONS (NOFS_INDEX || NOFS_DIRECTORY || NOFS_SCRATCH || NOFS_PROFILE || NOFS_TRACE)
+
+    /// Byte which indicates a region table in sector 0 (at NOFS_DATA_START)
+    #define NOFS_REGION_MARKER 0x1D
+    /// Offset of the number of regions in sector 0
+    #define NOFS_REGION_COUNT (NOFS_DATA_START + 1)
+    /// Offset of the region table in sector 0
+    #define NOFS_REGION_TABLE (NOFS_DATA_START + 2)
+    /// Length of an entry of the region table (type, first sector, count)
+    #define NOFS_REGION_ENTRY_LENGTH 9
+
+    /// Region type: time index
+    #define NOFS_REGION_INDEX 0x01
+    /// Region type: session directory
+    #define NOFS_REGION_DIRECTORY 0x02
+    /// Region type: scratch sector
+    #define NOFS_REGION_SCRATCH 0x03
+    /// Region type: profiler records
+    #define NOFS_REGION_PROFILE 0x04
+    /// Region type: dumps of the flight recorder
+    #define NOFS_REGION_TRACE 0x05
+
+    /**
+     * \brief Summary of the running session (see nofs_setSummary)
+     *
+     * Times and coordinates in the units of the directory record.
+     */
+    typedef struct {
+        uint32_t start;
+        uint32_t end;
+        uint32_t fixes;
+        int32_t south;
+        int32_t north;
+        int32_t west;
+        int32_t east;
+        uint32_t distance;
+    } nofs_summary_t;
+
+    /// Commits the current sector whenever it holds NOFS_COMMIT_BYTES bytes
+    /// which aren't on the card yet (0: only full sectors are written)
+    #ifndef NOFS_COMMIT_BYTES
+        #define NOFS_COMMIT_BYTES 0
+    #endif
+
+    /// Sector writes counted by nofs_takeWrites: full data sectors
+    #define NOFS_WRITE_FULL 0
+    /// Sector writes: NOFS_TERMINAL behind a data sector
+    #define NOFS_WRITE_TERMINAL 1
+    /// Sector writes: partial sectors committed because of their age
+    #define NOFS_WRITE_AGE 2
+    /// Sector writes: partial sectors committed after NOFS_COMMIT_BYTES bytes
+    #define NOFS_WRITE_SIZE 3
+    /// Sector writes: partial sectors committed because the supply fails
+    #define NOFS_WRITE_SUPPLY 4
+    /// Sector writes: other partial sectors (nofs_flush, nofs_writeTrace)
+    #define NOFS_WRITE_OTHER 5
+    /// Number of kinds of sector writes
+    #define NOFS_WRITE_KINDS 6
+
+    /// Minimum size of the buffer passed to nofs_report
+    #define NOFS_REPORT_LENGTH 64
+
+    /// Set to TRUE on hosts which write several NoFS instances (see nofs_select)
+    #ifndef NOFS_INSTANCES
+        #define NOFS_INSTANCES FALSE
+    #endif
+
+    #if NOFS_INSTANCES
+        /**
+         * \brief The complete state of a NoFS instance
+         *
+         * Has to be zeroed before nofs_init is called for it.
+         */
+        typedef struct {
+            uint32_t currentSector;
+            uint16_t currentByte;
+            uint8_t writeCount;
+            char sectorBuf[NOFS_BUFFER_SIZE];
+            uint32_t session;
+            uint32_t dataStart;
+            uint32_t indexStart;
+            uint32_t indexTime;
+            uint32_t directoryStart;
+            uint16_t directorySlot;
+            const nofs_summary_t* summary;
+            uint32_t scratchStart;
+            uint32_t profileStart;
+            uint32_t traceStart;
+            uint16_t committedByte;
+            uint32_t terminalSector;
+        } nofs_instance_t;
+
+        /**
+         * \brief Selects the instance the following calls operate on
+         *
+         * The memory card behind the instance is the one the sdmmc functions
+         * access at that time. Compression is not supported (the state of the
+         * compressor is not part of the instance).
+         */
+        void nofs_select(nofs_instance_t* pInstance);
+    #endif
 
     /**
      * \brief Initializes the NoFS. Locks the processor in case of error
@@ -50,18 +409,118 @@
     /**
      * \brief Appends a character string to the present data
      * 
-     * \param pString A null-terminated character string which should be written
+     * \param pString A null-terminated character string which should be
+     * written (7-bit characters only if NOFS_COMPRESSION is enabled)
      */
     void nofs_writeString(char* pString);
+
+    /**
+     * \brief Sets the time of the data which is written next
+     *
+     * Only the first time set for a sector is stored in its sector header,
+     * further calls have no effect. Does nothing if NOFS_SECTOR_HEADER is
+     * disabled.
+     *
+     * \param pTime The UTC time in milliseconds since midnight
+     */
+    void nofs_setTime(uint32_t pTime);
+
+    /**
+     * \brief Sets the date and time of the data which is written next
+     *
+     * Only the first value set for a sector is used for the time index.
+     * Does nothing if NOFS_INDEX is disabled.
+     *
+     * \param pDateTime The UTC time in seconds since 2000-01-01 (see
+     * nmea_parseDateTime)
+     */
+    void nofs_setDateTime(uint32_t pDateTime);
+
+    /**
+     * \brief Sets the summary which is written into the directory record of
+     * the running session
+     *
+     * The summary is kept up to date by the caller, it is read whenever the
+     * record is updated. Does nothing if NOFS_DIRECTORY is disabled.
+     *
+     * \param pSummary The summary (has to stay valid), NULL for none
+     */
+    void nofs_setSummary(const nofs_summary_t* pSummary);
     
     /**
      * \brief Writes the current data buffer onto the memory card
      * 
      * The buffer gets written to the sector specified by the global field
-     * fCurrentSector. Additionally, there will be written a NOFS_TERMINAL
-     * into the respective next sector (i.e. fCurrentSector + 1). This ensures
-     * that the scanning algorithm during initialization won't fail to
-     * find a terminal symbol.
+     * fCurrentSector. The NOFS_TERMINAL in the respective next sector (i.e.
+     * fCurrentSector + 1) has been written when the sector was started, it's
+     * only written first if that failed. This ensures that the scanning
+     * algorithm during initialization won't fail to find a terminal symbol.
      */
     void nofs_flush();
+
+    /**
+     * \brief Writes the current sector onto the memory card if it holds data
+     * which isn't on the card yet
+     *
+     * The sector stays in the buffer and is rewritten in place later on.
+     *
+     * \param pCause The cause of the commit (NOFS_WRITE_AGE, _SIZE or
+     * _SUPPLY), only used for nofs_takeWrites
+     */
+    void nofs_commit(uint8_t pCause);
+
+    /**
+     * \brief Returns the number of bytes in the buffer which aren't on the
+     * card yet (compressed bytes if NOFS_COMPRESSION is enabled)
+     */
+    uint16_t nofs_uncommitted();
+
+    /**
+     * \brief Advances the age of the data which isn't on the card yet and
+     * commits it (NOFS_WRITE_AGE) once the age reaches a limit
+     *
+     * Has to be called periodically, so the age advances while no data
+     * arrives as well. The age starts with the call which finds uncommitted
+     * data (its interval is counted completely) and restarts whenever the
+     * sector is written.
+     *
+     * \param pElapsed The time since the previous call (in any unit)
+     * \param pLimit The age which causes a commit (in the same unit)
+     */
+    void nofs_age(uint16_t pElapsed, uint32_t pLimit);
+
+    /**
+     * \brief Fetches a counter of the sector writes of the data and clears it
+     *
+     * The writes of the reserved regions are not counted. The write
+     * amplification of the commit policy is the number of all writes per
+     * NOFS_WRITE_FULL write.
+     *
+     * \param pKind The kind of the writes (NOFS_WRITE_*)
+     * \return The number of writes since the last call
+     */
+    uint16_t nofs_takeWrites(uint8_t pKind);
+
+    /**
+     * \brief Creates a sentence with the sector writes since the last report
+     * (the counters are cleared):
+     *
+     * $PGLCMT,<full>,<terminal>,<age>,<size>,<supply>,<other>*hh
+     *
+     * \param pOutput Receives the sentence (at least NOFS_REPORT_LENGTH bytes)
+     */
+    void nofs_report(char* pOutput);
+
+    /**
+     * \brief Writes the events of the flight recorder (see trace.h) onto the
+     * memory card
+     *
+     * The data written so far is flushed first, as the buffer is needed for
+     * the dump (and read back afterwards). Does nothing if the card has no
+     * trace region (yet) or if NOFS_TRACE is disabled.
+     *
+     * \param pReason The reason of the dump (e.g. an error code)
+     * \return TRUE if the events have been written
+     */
+    uint8_t nofs_writeTrace(uint8_t pReason);
 #endif
@@ -0,0 +1,36 @@
+/**
+ * \file power.c
+ * \brief Power scheduling of the GPS-module, the memory card and the MCU
+ * \author Martin Matysiak
+ */
+
+#include <avr/sleep.h>
+#include "modules/power.h"
+#include "modules/gps.h"
+#include "protocols/uart.h"
+
+void power_init(uint8_t pPort, uint8_t pFrequency, uint8_t pSaveFrequency) {
+    if (pFrequency <= pSaveFrequency) {
+        gps_setPower(pPort, GPS_POWER_SAVE);
+        _delay_ms(50);
+    }
+}
+
+void power_sleep() {
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    cli();
+
+    for (uint8_t port = 0; port < UART_PORTS; port++) {
+        if (uart_hasData(port)) {
+            sei();
+            return;
+        }
+    }
+
+    // The instruction following sei is always executed, so no interrupt can
+    // occur between the check and the sleep
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    sleep_disable();
+}
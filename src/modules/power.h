@@ -0,0 +1,41 @@
+/**
+ * \file power.h
+ * \brief Power scheduling of the GPS-module, the memory card and the MCU
+ * \author Martin Matysiak
+ *
+ * At low update rates, the GPS-module is switched into its power save mode,
+ * in which it switches its receiver off between the fixes (the time to the
+ * next fix is too short for this at higher rates). The output of the module
+ * stays the same, only the sentences may start with a delay after the
+ * module woke up. The memory card is put into its standby state after every
+ * access (see sdmmc.c), and the MCU sleeps whenever no data is pending.
+ *
+ * tools/powerbench estimates the energy per logged fix of both schedules.
+ */
+
+#ifndef POWER_H
+    #define POWER_H
+
+    #include "global.h"
+
+    /**
+     * \brief Configures the power mode of the GPS-module
+     *
+     * Has to be called after gps_init.
+     *
+     * \param pPort The UART port the module is connected to
+     * \param pFrequency The update rate of the module in Hertz
+     * \param pSaveFrequency The highest update rate at which the module is
+     * switched into its power save mode (0: never)
+     */
+    void power_init(uint8_t pPort, uint8_t pFrequency, uint8_t pSaveFrequency);
+
+    /**
+     * \brief Puts the MCU into idle sleep unless a receiver has pending data
+     *
+     * The check and the sleep are atomic, so a character which arrives right
+     * before can't be left in the buffer until the next one wakes the MCU
+     * (with the module in power save mode, that may take a whole period).
+     */
+    void power_sleep();
+#endif
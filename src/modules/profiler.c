@@ -0,0 +1,105 @@
+/**
+ * \file profiler.c
+ * \brief Sampling profiler: histogram of the program counter, timed by Timer2
+ * \author Martin Matysiak
+ */
+
+#include "modules/profiler.h"
+
+// The interrupt handler would be linked in any case (and keep the histogram)
+#if PROFILER
+
+#if defined(__AVR_3_BYTE_PC__)
+    #error "The profiler only supports MCUs with a 2 byte program counter"
+#endif
+
+/// Samples per bucket since the last profiler_take
+static volatile uint16_t fBuckets[PROFILER_BUCKETS];
+
+void profiler_init() {
+    // CTC mode, prescaler 1024
+    TCCR2A = (1 << WGM21);
+    TCCR2B = (1 << CS22) | (1 << CS21) | (1 << CS20);
+    OCR2A = PROFILER_COMPARE;
+    TCNT2 = 0;
+
+    TIFR2 = (1 << OCF2A);
+    TIMSK2 = (1 << OCIE2A);
+}
+
+uint16_t profiler_take(uint8_t pBucket) {
+    uint8_t sreg = SREG;
+    cli();
+
+    uint16_t count = fBuckets[pBucket];
+    fBuckets[pBucket] = 0;
+
+    SREG = sreg;
+    return count;
+}
+
+/**
+ * \brief Counts the program counter of the interrupted code
+ *
+ * Naked, as the offset of the return address on the stack has to be known.
+ * Only r24, r25 and Z are used, the zero register can't be relied on (the
+ * interrupted code may be in the middle of a multiplication).
+ */
+ISR(TIMER2_COMPA_vect, ISR_NAKED) {
+    asm volatile(
+        "push r24" "\n\t"
+        "in r24, __SREG__" "\n\t"
+        "push r24" "\n\t"
+        "push r25" "\n\t"
+        "push r30" "\n\t"
+        "push r31" "\n\t"
+
+        // The return address (a word address, high byte first) is right
+        // above the five bytes pushed
+        "in r30, __SP_L__" "\n\t"
+        "in r31, __SP_H__" "\n\t"
+        "ldd r25, Z+6" "\n\t"
+        "ldd r24, Z+7" "\n\t"
+
+        ".rept %[shift]" "\n\t"
+        "lsr r25" "\n\t"
+        "ror r24" "\n\t"
+        ".endr" "\n\t"
+
+        // Addresses behind the last bucket are counted in it
+        "ldi r30, 0" "\n\t"
+        "cpi r24, %[count]" "\n\t"
+        "cpc r25, r30" "\n\t"
+        "brlo 1f" "\n\t"
+        "ldi r24, %[count] - 1" "\n\t"
+        "ldi r25, 0" "\n\t"
+        "1:" "\n\t"
+
+        "lsl r24" "\n\t"
+        "rol r25" "\n\t"
+        "movw r30, r24" "\n\t"
+        "subi r30, lo8(-(%[buckets]))" "\n\t"
+        "sbci r31, hi8(-(%[buckets]))" "\n\t"
+
+        // The counter saturates
+        "ld r24, Z" "\n\t"
+        "ldd r25, Z+1" "\n\t"
+        "adiw r24, 1" "\n\t"
+        "breq 2f" "\n\t"
+        "st Z, r24" "\n\t"
+        "std Z+1, r25" "\n\t"
+        "2:" "\n\t"
+
+        "pop r31" "\n\t"
+        "pop r30" "\n\t"
+        "pop r25" "\n\t"
+        "pop r24" "\n\t"
+        "out __SREG__, r24" "\n\t"
+        "pop r24" "\n\t"
+        "reti" "\n\t"
+        :
+        : [shift] "n" (PROFILER_BUCKET_BITS - 1), [count] "n" (PROFILER_BUCKETS),
+          [buckets] "i" (fBuckets)
+    );
+}
+#endif
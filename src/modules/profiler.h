@@ -0,0 +1,78 @@
+/**
+ * \file profiler.h
+ * \brief Sampling profiler: histogram of the program counter, timed by Timer2
+ * \author Martin Matysiak
+ *
+ * PROFILER_FREQUENCY times per second, the compare match interrupt of Timer2
+ * takes the return address off the stack, i.e. the program counter of the
+ * interrupted code, and counts it in one of PROFILER_BUCKETS buckets of
+ * 2^PROFILER_BUCKET_BITS bytes of flash each (addresses behind the last
+ * bucket are counted in the last one). The handler is written in assembler,
+ * it doesn't know about any other code and costs about 40 cycles.
+ *
+ * Timer2 keeps running in idle sleep, so the time the main loop sleeps is
+ * attributed to the instruction behind the sleep (power_sleep). Other
+ * interrupt handlers can't be sampled (interrupts don't nest), their time
+ * is attributed to the code they have interrupted.
+ *
+ * The histogram is written into the NOFS_REGION_PROFILE region of the card
+ * and cleared every NOFS_PROFILE_INTERVAL sectors (see nofs.h), the
+ * counters saturate at 0xFFFF. tools/nofsprofile maps the buckets onto the
+ * functions of gLogger.map. With the default configuration, the profiler
+ * needs 2 * PROFILER_BUCKETS = 128 bytes of SRAM.
+ */
+
+#ifndef PROFILER_H
+    #define PROFILER_H
+
+    #include "global.h"
+
+    /// Set to TRUE in order to sample the program counter (make PROFILER=1)
+    #ifndef PROFILER
+        #define PROFILER FALSE
+    #endif
+
+    /// Samples per second (F_CPU / 1024 / 256 = 29 Hz at least)
+    #ifndef PROFILER_FREQUENCY
+        #define PROFILER_FREQUENCY 100
+    #endif
+
+    /// Size of a bucket: 2^PROFILER_BUCKET_BITS bytes of flash
+    #ifndef PROFILER_BUCKET_BITS
+        #define PROFILER_BUCKET_BITS 7
+    #endif
+
+    /// Number of buckets (the default covers the 8 KiB of the ATmega88)
+    #ifndef PROFILER_BUCKETS
+        #define PROFILER_BUCKETS 64
+    #endif
+
+    /// Compare value of Timer2 (CTC mode, prescaler 1024)
+    #define PROFILER_COMPARE (F_CPU / 1024 / PROFILER_FREQUENCY - 1)
+
+    #if PROFILER && (PROFILER_COMPARE > 255)
+        #error "PROFILER_FREQUENCY is too low for Timer2"
+    #endif
+
+    #if PROFILER && ((PROFILER_BUCKETS < 1) || (PROFILER_BUCKETS > 255))
+        #error "PROFILER_BUCKETS has to be between 1 and 255"
+    #endif
+
+    #if PROFILER && (PROFILER_BUCKET_BITS < 1)
+        #error "A bucket has to hold at least one instruction word"
+    #endif
+
+    /**
+     * \brief Starts sampling (takes Timer2, which must not be disabled in
+     * the PRR register)
+     */
+    void profiler_init();
+
+    /**
+     * \brief Fetches a counter of the histogram and clears it
+     *
+     * \param pBucket Index of the bucket (0 to PROFILER_BUCKETS - 1)
+     * \return The number of samples since the last call
+     */
+    uint16_t profiler_take(uint8_t pBucket);
+#endif
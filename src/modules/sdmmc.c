@@ -5,9 +5,86 @@
  */
 
 #include "modules/sdmmc.h"
+#include "modules/trace.h"
+
+#if SDMMC_BENCHMARK || SDMMC_CALIBRATE
+    #include "modules/nmea.h"
+#endif
 
 /// The block length which is currently set
 uint16_t fBlockLength = SDMMC_SECTOR_SIZE;
+/// The SPI clock in use (applied whenever the SPI is powered up)
+static uint8_t fSpeed = SDMMC_SPEED;
+
+/// One step of the CRC7 (polynomial 0x09, kept in bits 7 to 1)
+#define SDMMC_CRC7_STEP(pCrc) ((((pCrc) << 1) ^ (((pCrc) & 0x80) ? 0x12 : 0)) & 0xFF)
+/// One step of the CRC16 (polynomial 0x1021)
+#define SDMMC_CRC16_STEP(pCrc) ((((uint32_t)(pCrc) << 1) ^ (((pCrc) & 0x8000) ? 0x1021 : 0)) & 0xFFFF)
+
+/// Eight steps (one byte) of a CRC
+#define SDMMC_CRC_BYTE(pStep, pCrc) pStep(pStep(pStep(pStep(pStep(pStep(pStep(pStep(pCrc))))))))
+
+/// Table entries of the CRC7 and the CRC16
+#define SDMMC_CRC7_ENTRY(pIndex) SDMMC_CRC_BYTE(SDMMC_CRC7_STEP, (pIndex))
+#define SDMMC_CRC16_ENTRY(pIndex) SDMMC_CRC_BYTE(SDMMC_CRC16_STEP, (uint32_t)(pIndex) << 8)
+
+/// Generates the 256 entries of a table at compile time
+#define SDMMC_TABLE4(pEntry, pIndex) pEntry(pIndex), pEntry((pIndex) + 1), pEntry((pIndex) + 2), pEntry((pIndex) + 3)
+#define SDMMC_TABLE16(pEntry, pIndex) SDMMC_TABLE4(pEntry, pIndex), SDMMC_TABLE4(pEntry, (pIndex) + 4), \
+    SDMMC_TABLE4(pEntry, (pIndex) + 8), SDMMC_TABLE4(pEntry, (pIndex) + 12)
+#define SDMMC_TABLE64(pEntry, pIndex) SDMMC_TABLE16(pEntry, pIndex), SDMMC_TABLE16(pEntry, (pIndex) + 16), \
+    SDMMC_TABLE16(pEntry, (pIndex) + 32), SDMMC_TABLE16(pEntry, (pIndex) + 48)
+#define SDMMC_TABLE256(pEntry) SDMMC_TABLE64(pEntry, 0), SDMMC_TABLE64(pEntry, 64), \
+    SDMMC_TABLE64(pEntry, 128), SDMMC_TABLE64(pEntry, 192)
+
+/// CRC7 of every byte value (shifted left by one)
+static const uint8_t fCrc7Table[256] PROGMEM = {SDMMC_TABLE256(SDMMC_CRC7_ENTRY)};
+
+/// Adds a byte to a CRC7 (kept in bits 7 to 1)
+#define SDMMC_CRC7(pCrc, pByte) pgm_read_byte(&fCrc7Table[(pCrc) ^ (pByte)])
+
+#if SDMMC_CRC
+/// CRC16 of every byte value
+static const uint16_t fCrc16Table[256] PROGMEM = {SDMMC_TABLE256(SDMMC_CRC16_ENTRY)};
+
+/// Adds a byte to a CRC16
+#define SDMMC_CRC16(pCrc, pByte) (((pCrc) << 8) ^ pgm_read_word(&fCrc16Table[((pCrc) >> 8) ^ (pByte)]))
+#else
+/// The card doesn't check the CRC16, the dummy value 0xFFFF is sent
+#define SDMMC_CRC16(pCrc, pByte) 0xFFFF
+#endif
+
+/**
+ * \brief Powers the SPI up and configures it for the card
+ *
+ * Writes to the registers of the SPI are ignored while it is powered down,
+ * so the configuration is applied afresh every time.
+ */
+static void sdmmc_powerUp() {
+    PRR &= ~(1 << PRSPI);
+    SPCR = (1 << SPE) | (1 << MSTR);
+    spi_setSpeed(fSpeed);
+}
+
+/**
+ * \brief Powers the SPI up and selects the card
+ */
+static void sdmmc_select() {
+    sdmmc_powerUp();
+    SET_CS();
+}
+
+/**
+ * \brief Deselects the card and powers the SPI down
+ *
+ * The card only releases its output and drops into its standby state (the
+ * lowest current one) after eight more clocks.
+ */
+static void sdmmc_release() {
+    CLEAR_CS();
+    spi_writeByte(0xFF);
+    PRR |= (1 << PRSPI);
+}
 
 void sdmmc_init() {
     // Initializes SPI interface first
@@ -25,8 +102,8 @@ void sdmmc_init() {
 
     // Send command 0 (GO_IDLE_STATE, i.e. change from SD into SPI mode)
     while (response != 1) {
-        response = sdmmc_writeCommand(SDMMC_GO_IDLE_STATE, 0, SDMMC_GO_IDLE_STATE_CRC); // 0x95 is a precalculated CRC checksum
-        
+        response = sdmmc_writeCommand(SDMMC_GO_IDLE_STATE, 0);
+
         // If the device does not respond correctly, return FALSE after
         // having it tried several times
         if (retry++ == 0xFF) {
@@ -40,7 +117,7 @@ void sdmmc_init() {
     retry = 0;
 
     while (response != 0) {
-        response = sdmmc_writeCommand(SDMMC_SEND_OP_COND, 0, SDMMC_DEFAULT_CRC);
+        response = sdmmc_writeCommand(SDMMC_SEND_OP_COND, 0);
 
         if (retry++ == 0xFF) {
             CLEAR_CS();
@@ -48,39 +125,44 @@ void sdmmc_init() {
         }
     }
 
-    CLEAR_CS();
+#if SDMMC_CRC
+    // From now on, the card checks the CRC of commands and data blocks
+    sdmmc_writeCommand(SDMMC_CRC_ON_OFF, 1);
+#endif
 
     // switch to higher SPI frequency once initialized
-    spi_highspeed();
+    spi_setSpeed(SDMMC_SPEED);
+    sdmmc_release();
 }
 
-uint8_t sdmmc_writeCommand(uint8_t pCommand, uint32_t pArgument, uint8_t pCrc) {
+uint8_t sdmmc_writeCommand(uint8_t pCommand, uint32_t pArgument) {
     // The command is composed out of 6 Byte:
     // Byte 1: 0b01xxxxxx where xx = pCommand
     // Byte 2-5: pArgument
-    // Byte 6: 0byyyyyyy1 where yy = CRC7 (ignored when card is in SPI mode)
+    // Byte 6: 0byyyyyyy1 where yy = CRC7
 
     // Make sure that bits 7 and 6 of pCommand are 0 and 1
     pCommand &= ~(1 << 7);
     pCommand |= (1 << 6);
 
-    // Calculate CRC7 (// TODO //, currently precalculated values)
-
-    // Bit 0 of the checksum byte has to be set
-    pCrc |= 1;
-
     // Send some dummy clock signals
     CLEAR_CS();
     spi_writeByte(0xFF);
     SET_CS();
 
-    // Send the data
+    // Send the data, the CRC7 is calculated along the way
+    uint8_t crc = SDMMC_CRC7(0, pCommand);
     spi_writeByte(pCommand);
-    spi_writeByte((uint8_t)((pArgument & 0xFF000000) >> 24));
-    spi_writeByte((uint8_t)((pArgument & 0x00FF0000) >> 16));
-    spi_writeByte((uint8_t)((pArgument & 0x0000FF00) >> 8));
-    spi_writeByte((uint8_t)(pArgument & 0x000000FF));
-    spi_writeByte(pCrc);
+
+    for (uint8_t i = 0; i < 4; i++) {
+        uint8_t data = pArgument >> 24;
+        crc = SDMMC_CRC7(crc, data);
+        spi_writeByte(data);
+        pArgument <<= 8;
+    }
+
+    // Bit 0 of the checksum byte has to be set
+    spi_writeByte(crc | 1);
 
     // Get a response
     uint8_t result = 0xFF;
@@ -94,15 +176,19 @@ uint8_t sdmmc_writeCommand(uint8_t pCommand, uint32_t pArgument, uint8_t pCrc) {
         }
     }
 
+    TRACE_EVENT(TRACE_COMMAND | (pCommand & 0x3F), result);
     return result;
 }
 
-uint8_t sdmmc_writeSector(uint32_t pSectorNum, char* pInput) {
-    SET_CS();
+/**
+ * \brief Sends a block to the card (one attempt of sdmmc_writeSector)
+ */
+static uint8_t sdmmc_transmitSector(uint32_t pSectorNum, const char* pInput) {
+    sdmmc_select();
 
     // Send command 24 (WRITE_BLOCK)
-    if (sdmmc_writeCommand(SDMMC_WRITE_BLOCK, SECTOR_TO_BYTE(pSectorNum), SDMMC_DEFAULT_CRC) != 0) {
-        CLEAR_CS();
+    if (sdmmc_writeCommand(SDMMC_WRITE_BLOCK, SECTOR_TO_BYTE(pSectorNum)) != 0) {
+        sdmmc_release();
         return FALSE;
     }
 
@@ -114,18 +200,25 @@ uint8_t sdmmc_writeSector(uint32_t pSectorNum, char* pInput) {
     // Send start-byte
     spi_writeByte(0xFE);
 
-    // Send data
+    // Send data. The CRC16 is calculated while the SPI shifts the byte out,
+    // so it adds (almost) no time.
+    uint16_t crc = 0;
+
     for(uint16_t i = 0; i < fBlockLength; i++) {
-        spi_writeByte(pInput[i]);
+        uint8_t data = pInput[i];
+        SPI_START(data);
+        crc = SDMMC_CRC16(crc, data);
+        SPI_WAIT();
     }
 
-    // Send dummy CRC checksum (won't be checked in SPI mode)
-    spi_writeByte(0xFF);
-    spi_writeByte(0xFF);
+    spi_writeByte(crc >> 8);
+    spi_writeByte(crc);
 
-    // Get response
-    if ((spi_readByte() & 0x1F) != 0x05) {
-        CLEAR_CS();
+    // Get response (0x05: accepted, 0x0B: CRC error, 0x0D: write error)
+    uint8_t response = spi_readByte();
+    if ((response & 0x1F) != 0x05) {
+        TRACE_EVENT(TRACE_WRITE_FAILED, response);
+        sdmmc_release();
         return FALSE;
     }
 
@@ -134,16 +227,33 @@ uint8_t sdmmc_writeSector(uint32_t pSectorNum, char* pInput) {
         // burn energy
     }
 
-    CLEAR_CS();
+    sdmmc_release();
     return TRUE;
 }
 
-uint8_t sdmmc_readSector(uint32_t pSectorNum, char* pOutput) {
-    SET_CS();
+uint8_t sdmmc_writeSector(uint32_t pSectorNum, char* pInput) {
+    for (uint8_t attempt = 0; attempt < SDMMC_RETRIES; attempt++) {
+        if (sdmmc_transmitSector(pSectorNum, pInput)) {
+            if (attempt) {
+                TRACE_EVENT(TRACE_WRITE_RETRIES, attempt);
+            }
+            return TRUE;
+        }
+    }
+
+    TRACE_EVENT(TRACE_WRITE_RETRIES, SDMMC_RETRIES);
+    return FALSE;
+}
+
+/**
+ * \brief Receives a block from the card (one attempt of sdmmc_readSector)
+ */
+static uint8_t sdmmc_receiveSector(uint32_t pSectorNum, char* pOutput) {
+    sdmmc_select();
 
     // Send command 17 (READ_SINGLE_BLOCK)
-    if (sdmmc_writeCommand(SDMMC_READ_SINGLE_BLOCK, SECTOR_TO_BYTE(pSectorNum), SDMMC_DEFAULT_CRC) != 0) {
-        CLEAR_CS();
+    if (sdmmc_writeCommand(SDMMC_READ_SINGLE_BLOCK, SECTOR_TO_BYTE(pSectorNum)) != 0) {
+        sdmmc_release();
         return FALSE;
     }
 
@@ -154,37 +264,243 @@ uint8_t sdmmc_readSector(uint32_t pSectorNum, char* pOutput) {
     while(response != 0xFE) {
         response = spi_readByte();
         if (retry++ == 0xFF) {
-            CLEAR_CS();
+            TRACE_EVENT(TRACE_READ_FAILED, response);
+            sdmmc_release();
             return FALSE;
         }
     }
 
-    // Read the block
+    // Read the block. The transfer of the next byte is started before the
+    // CRC16 of the current one is calculated (the last one starts the
+    // transfer of the CRC).
+    uint16_t crc = 0;
+    SPI_START(0xFF);
+
     for (uint16_t i = 0; i < fBlockLength; i++) {
-        pOutput[i] = spi_readByte();
+        SPI_WAIT();
+        uint8_t data = SPDR;
+        SPI_START(0xFF);
+        pOutput[i] = data;
+        crc = SDMMC_CRC16(crc, data);
     }
 
-    // Ignore the CRC checksum
-    spi_readByte();
-    spi_readByte();
+    SPI_WAIT();
+    uint16_t received = SPDR << 8;
+    received |= spi_readByte();
+
+    sdmmc_release();
+    if (received != crc) {
+        TRACE_EVENT(TRACE_READ_FAILED, 0);
+        return FALSE;
+    }
 
-    CLEAR_CS();
     return TRUE;
 }
 
+uint8_t sdmmc_readSector(uint32_t pSectorNum, char* pOutput) {
+    for (uint8_t attempt = 0; attempt < SDMMC_RETRIES; attempt++) {
+        if (sdmmc_receiveSector(pSectorNum, pOutput)) {
+            if (attempt) {
+                TRACE_EVENT(TRACE_READ_RETRIES, attempt);
+            }
+            return TRUE;
+        }
+    }
+
+    TRACE_EVENT(TRACE_READ_RETRIES, SDMMC_RETRIES);
+    return FALSE;
+}
+
 
 uint8_t sdmmc_changeBlockLength(uint16_t pLength) {
     if (pLength == 0) {
         pLength = SDMMC_SECTOR_SIZE;
     }
 
-    SET_CS();
-    if (sdmmc_writeCommand(SDMMC_SET_BLOCKLEN, pLength, SDMMC_DEFAULT_CRC) != 0) {
-        CLEAR_CS();
+    sdmmc_select();
+    if (sdmmc_writeCommand(SDMMC_SET_BLOCKLEN, pLength) != 0) {
+        sdmmc_release();
         return FALSE;
     }
 
-    CLEAR_CS();
+    sdmmc_release();
     fBlockLength = pLength;
     return TRUE;
-}
\ No newline at end of file
+}
+
+#if SDMMC_CALIBRATE
+/// Duration of a Timer1 tick (prescaler 64) in nanoseconds
+#define SDMMC_TICK_NS (64 * 1000000000ULL / F_CPU)
+
+/// Ticks of the sector write and read at that speed (0 if not calibrated)
+static uint16_t fWriteTicks = 0;
+static uint16_t fReadTicks = 0;
+
+/**
+ * \brief Byte i of the calibration pattern (every value occurs, the pattern
+ * differs with every speed so that an old one doesn't pass)
+ */
+static uint8_t sdmmc_pattern(uint16_t pIndex, uint8_t pSpeed) {
+    return ((uint8_t)pIndex * 0x1D) ^ ((pIndex & 0x100) ? 0xA5 : 0x5A) ^ pSpeed;
+}
+
+/**
+ * \brief Stops Timer1 and returns its ticks (0xFFFF if it overflowed)
+ */
+static uint16_t sdmmc_stopTimer() {
+    uint16_t ticks = TCNT1;
+    TCCR1B = 0;
+
+    if (TIFR1 & (1 << TOV1)) {
+        ticks = 0xFFFF;
+    }
+
+    return ticks;
+}
+
+/**
+ * \brief Starts Timer1 with the prescaler 64
+ */
+static void sdmmc_startTimer() {
+    TCNT1 = 0;
+    TIFR1 = (1 << TOV1);
+    TCCR1B = (1 << CS11) | (1 << CS10);
+}
+
+uint8_t sdmmc_calibrate(uint32_t pSector, char* pBuffer) {
+    uint8_t prr = PRR;
+    PRR &= ~(1 << PRTIM1);
+    TCCR1A = 0;
+
+    // The speed is applied when the card is selected (the SPI is powered
+    // down in between)
+    for (uint8_t speed = SPI_SPEED_2; speed <= SPI_SPEED_128; speed++) {
+        fSpeed = speed;
+
+        for (uint16_t i = 0; i < SDMMC_SECTOR_SIZE; i++) {
+            pBuffer[i] = sdmmc_pattern(i, speed);
+        }
+
+        // Single attempts, a speed which needs retries is not reliable
+        sdmmc_startTimer();
+        uint8_t valid = sdmmc_transmitSector(pSector, pBuffer);
+        uint16_t writeTicks = sdmmc_stopTimer();
+
+        sdmmc_startTimer();
+        valid = valid && sdmmc_receiveSector(pSector, pBuffer);
+        uint16_t readTicks = sdmmc_stopTimer();
+
+        for (uint16_t i = 0; valid && (i < SDMMC_SECTOR_SIZE); i++) {
+            valid = ((uint8_t)pBuffer[i] == sdmmc_pattern(i, speed));
+        }
+
+        if (valid) {
+            fWriteTicks = writeTicks;
+            fReadTicks = readTicks;
+            PRR = prr;
+            return TRUE;
+        }
+    }
+
+    fSpeed = SDMMC_SPEED;
+    PRR = prr;
+    return FALSE;
+}
+
+/**
+ * \brief Converts the ticks of a sector transfer into bytes per second
+ */
+static uint32_t sdmmc_throughput(uint16_t pTicks) {
+    if (pTicks == 0) {
+        return 0;
+    }
+
+    // The constant is folded by the compiler, only the 32 bit division is left
+    return (uint32_t)(SDMMC_SECTOR_SIZE * 1000000000ULL / SDMMC_TICK_NS) / pTicks;
+}
+
+void sdmmc_report(char* pOutput) {
+    char* output = nmea_writePrefix(pOutput, PSTR("$PGLSPD"));
+
+    *output++ = ',';
+    output = nmea_writeNumber(output, SPI_DIVIDER(fSpeed));
+    *output++ = ',';
+    output = nmea_writeNumber(output, sdmmc_throughput(fWriteTicks));
+    *output++ = ',';
+    output = nmea_writeNumber(output, sdmmc_throughput(fReadTicks));
+
+    *output = '\0';
+    nmea_appendChecksum(pOutput);
+}
+#endif
+
+#if SDMMC_BENCHMARK
+/// The CRC16 calculated by the benchmark
+static volatile uint16_t fBenchmarkCrc;
+
+void sdmmc_benchmark(char* pOutput) {
+    uint8_t prr = PRR;
+    uint16_t cycles[4];
+    uint16_t crc = 0;
+
+    // Timer1 counts the CPU cycles, the card is not selected
+    PRR &= ~(1 << PRTIM1);
+    sdmmc_powerUp();
+    TCCR1A = 0;
+    TCCR1B = (1 << CS10);
+
+    // Write loop as it was before the CRC16
+    TCNT1 = 0;
+    for (uint16_t i = 0; i < SDMMC_SECTOR_SIZE; i++) {
+        spi_writeByte(pOutput[i % SDMMC_BENCHMARK_LENGTH]);
+    }
+    cycles[0] = TCNT1;
+
+    // Write loop of sdmmc_transmitSector
+    TCNT1 = 0;
+    for (uint16_t i = 0; i < SDMMC_SECTOR_SIZE; i++) {
+        uint8_t data = pOutput[i % SDMMC_BENCHMARK_LENGTH];
+        SPI_START(data);
+        crc = SDMMC_CRC16(crc, data);
+        SPI_WAIT();
+    }
+    cycles[1] = TCNT1;
+
+    // Read loop as it was before the CRC16
+    TCNT1 = 0;
+    for (uint16_t i = 0; i < SDMMC_SECTOR_SIZE; i++) {
+        pOutput[i % SDMMC_BENCHMARK_LENGTH] = spi_readByte();
+    }
+    cycles[2] = TCNT1;
+
+    // Read loop of sdmmc_receiveSector
+    TCNT1 = 0;
+    SPI_START(0xFF);
+    for (uint16_t i = 0; i < SDMMC_SECTOR_SIZE; i++) {
+        SPI_WAIT();
+        uint8_t data = SPDR;
+        SPI_START(0xFF);
+        pOutput[i % SDMMC_BENCHMARK_LENGTH] = data;
+        crc = SDMMC_CRC16(crc, data);
+    }
+    SPI_WAIT();
+    cycles[3] = TCNT1;
+
+    TCCR1B = 0;
+    PRR = prr;
+
+    // The CRC is stored, so the compiler can't drop its calculation
+    fBenchmarkCrc = crc;
+
+    char* output = nmea_writePrefix(pOutput, PSTR("$PGLSPI"));
+
+    for (uint8_t i = 0; i < 4; i++) {
+        *output++ = ',';
+        output = nmea_writeNumber(output, cycles[i]);
+    }
+
+    *output = '\0';
+
+    nmea_appendChecksum(pOutput);
+}
+#endif
@@ -23,12 +23,43 @@
     #define SDMMC_READ_SINGLE_BLOCK 17
     /// CMD24 - Write a block
     #define SDMMC_WRITE_BLOCK 24
-    
-    /// Precalculated Checksum for CMD0
-    #define SDMMC_GO_IDLE_STATE_CRC 0x95
-    
-    /// Default CRC value when in SPI mode (won't be checked)
-    #define SDMMC_DEFAULT_CRC 0xFF
+    /// CMD59 - Turn the CRC checks on or off
+    #define SDMMC_CRC_ON_OFF 59
+
+    /// Set to FALSE in order to transfer the data blocks without CRC16 (the
+    /// commands always carry their CRC7)
+    #ifndef SDMMC_CRC
+        #define SDMMC_CRC TRUE
+    #endif
+
+    /// Number of attempts to transfer a sector (e.g. after a CRC error)
+    #ifndef SDMMC_RETRIES
+        #define SDMMC_RETRIES 3
+    #endif
+
+    /// Set to TRUE in order to log the cycles of the sector transfer loops
+    /// at power-up (see sdmmc_benchmark, uses Timer1)
+    #ifndef SDMMC_BENCHMARK
+        #define SDMMC_BENCHMARK FALSE
+    #endif
+
+    /// Minimum size of the buffer passed to sdmmc_benchmark
+    #define SDMMC_BENCHMARK_LENGTH 48
+
+    /// SPI clock after the initialization (see spi.h), also used if the
+    /// calibration fails or can't be done
+    #ifndef SDMMC_SPEED
+        #define SDMMC_SPEED SPI_SPEED_8
+    #endif
+
+    /// Set to FALSE in order to keep SDMMC_SPEED instead of calibrating the
+    /// SPI clock on a scratch sector (see sdmmc_calibrate)
+    #ifndef SDMMC_CALIBRATE
+        #define SDMMC_CALIBRATE TRUE
+    #endif
+
+    /// Minimum size of the buffer passed to sdmmc_report
+    #define SDMMC_REPORT_LENGTH 40
     
     /// Macro to convert from a sector count to a byte count
     #define SECTOR_TO_BYTE(pSector) pSector << 9 // << 9 equals * 512
@@ -44,7 +75,8 @@
      *
      * Please note that writing operations will be done by default in 
      * 512 byte blocks unless the block length has been changed by using
-     * sdmmc_changeBlockLength.
+     * sdmmc_changeBlockLength. If the card rejects the block (e.g. because
+     * of a CRC error), it is sent again up to SDMMC_RETRIES times.
      *
      * \param pSectorNum an integer containing the index of the sector to which
      * the data should be written
@@ -58,21 +90,21 @@
      * 
      * See http://www.sandisk.com/Assets/File/OEM/Manuals/SD_SDIO_specsv1.pdf 
      * for an overview of possible commands in SD (Apendix A) and SPI (Appendix
-     * B) mode.
+     * B) mode. The CRC7 of the command is calculated while it is sent.
      *
      * \param pCommand The command which should be sent
      * \param pArgument Additional data for the command
-     * \param pCrc The CRC-checksum for the given command (will be ignored if in SPI mode)
-     * \return TRUE on success, otherwise FALSE
+     * \return The response of the card (R1, 0 on success)
      */
-    uint8_t sdmmc_writeCommand(uint8_t pCommand, uint32_t pArgument, uint8_t pCrc);
+    uint8_t sdmmc_writeCommand(uint8_t pCommand, uint32_t pArgument);
 
     /**
      * \brief Reads a sector from the SD/MMC-card
      *
      * Please note that reading operations will be done by default in 
      * 512 byte blocks unless the block langth has been changed by using 
-     * sdmmc_changeBlockLength.
+     * sdmmc_changeBlockLength. A block whose CRC16 doesn't match is read
+     * again up to SDMMC_RETRIES times.
      *
      * \param pSectorNum an integer containing the index of the sector which
      * should be read out
@@ -95,6 +127,50 @@
      * \return TRUE on success, otherwise FALSE
      */
     uint8_t sdmmc_changeBlockLength(uint16_t pLength);
+
+    /**
+     * \brief Selects the fastest SPI clock at which the card works reliably
+     *
+     * Starting with F_CPU / 2, a test pattern is written to the scratch
+     * sector and read back at every SPI speed until it comes back intact
+     * (without retries). The time of the transfers is measured with Timer1,
+     * which has to be free at this point. If no speed works, SDMMC_SPEED is
+     * kept. Only available if SDMMC_CALIBRATE is enabled.
+     *
+     * \param pSector A sector whose content may be overwritten
+     * \param pBuffer A buffer of at least 512 bytes
+     * \return TRUE if a speed has been found, otherwise FALSE
+     */
+    uint8_t sdmmc_calibrate(uint32_t pSector, char* pBuffer);
+
+    /**
+     * \brief Writes the result of sdmmc_calibrate as sentence
+     *
+     * $PGLSPD,<divider>,<write B/s>,<read B/s>*hh
+     *
+     * The divider is the one of the SPI clock in use, the throughputs are the
+     * ones measured for a sector (0 if the card hasn't been calibrated). Only
+     * available if SDMMC_CALIBRATE is enabled.
+     *
+     * \param pOutput A buffer of at least SDMMC_REPORT_LENGTH bytes
+     */
+    void sdmmc_report(char* pOutput);
+
+    /**
+     * \brief Measures the cycles of the sector transfer loops
+     *
+     * A block of 512 bytes is clocked out and in with the card deselected,
+     * once with the plain loops and once with the loops which calculate the
+     * CRC16. The result is written as sentence:
+     *
+     * $PGLSPI,<write>,<write with CRC>,<read>,<read with CRC>*hh
+     *
+     * Has to be called before the timebase of the latency instrumentation
+     * is started. Only available if SDMMC_BENCHMARK is enabled.
+     *
+     * \param pOutput A buffer of at least SDMMC_BENCHMARK_LENGTH bytes
+     */
+    void sdmmc_benchmark(char* pOutput);
 #endif
 
 
@@ -0,0 +1,107 @@
+/**
+ * \file session.c
+ * \brief Summary of the running session for the on-card session directory
+ * \author Martin Matysiak
+ */
+
+#include "modules/session.h"
+
+/// The minimum step in coordinate units (1/10000 arcminute)
+#define SESSION_STEP_UNITS ((uint32_t)SESSION_STEP * 10000 / 1852)
+
+/// The summary which is written into the directory
+static nofs_summary_t fSummary;
+
+/// End of the last step which has been added to the distance
+static int32_t fAnchorLat, fAnchorLon;
+
+/// Distance in coordinate units
+static uint32_t fUnits = 0;
+
+/**
+ * \brief Calculates the integer square root
+ */
+static uint16_t session_sqrt(uint32_t pValue) {
+    uint16_t root = 0;
+
+    for (uint16_t bit = 0x8000; bit; bit >>= 1) {
+        uint16_t trial = root | bit;
+        if ((uint32_t)trial * trial <= pValue) {
+            root = trial;
+        }
+    }
+
+    return root;
+}
+
+/**
+ * \brief Returns the distance between a position and the anchor
+ * \return The distance in coordinate units
+ */
+static uint32_t session_distance(int32_t pLat, int32_t pLon) {
+    uint32_t dLat = labs(pLat - fAnchorLat);
+    uint32_t dLon = labs(pLon - fAnchorLon);
+
+    // Large steps (e.g. behind a gap) are scaled down until the squares fit
+    uint8_t shift = 0;
+    while ((dLat > 0x7FFF) || (dLon > 0x7FFF)) {
+        dLat >>= 1;
+        dLon >>= 1;
+        shift++;
+    }
+
+    // Longitude differences get smaller towards the poles
+    dLon = (dLon * nmea_cosLatitude(pLat)) >> 8;
+
+    return (uint32_t)session_sqrt(dLat * dLat + dLon * dLon) << shift;
+}
+
+void session_init() {
+    fSummary.fixes = 0;
+    fSummary.distance = 0;
+    fUnits = 0;
+    nofs_setSummary(&fSummary);
+}
+
+void session_update(const char* pSentence, uint8_t pType) {
+    if (pType != (GPS_NMEA_RMC | GPS_NMEA_VALID)) {
+        return;
+    }
+
+    uint32_t time = nmea_parseDateTime(pSentence);
+    int32_t lat = nmea_parseCoordinate(nmea_getToken(pSentence, 3));
+    int32_t lon = nmea_parseCoordinate(nmea_getToken(pSentence, 5));
+
+    if (time == NMEA_TIME_INVALID) {
+        return;
+    }
+
+    if (fSummary.fixes++ == 0) {
+        fSummary.start = time;
+        fSummary.south = fSummary.north = fAnchorLat = lat;
+        fSummary.west = fSummary.east = fAnchorLon = lon;
+    }
+    fSummary.end = time;
+
+    if (lat < fSummary.south) {
+        fSummary.south = lat;
+    } else if (lat > fSummary.north) {
+        fSummary.north = lat;
+    }
+
+    if (lon < fSummary.west) {
+        fSummary.west = lon;
+    } else if (lon > fSummary.east) {
+        fSummary.east = lon;
+    }
+
+    uint32_t step = session_distance(lat, lon);
+    if (step >= SESSION_STEP_UNITS) {
+        fUnits += step;
+        fAnchorLat = lat;
+        fAnchorLon = lon;
+
+        // One arcminute equals 1852 meters (split up, so nothing overflows)
+        fSummary.distance = fUnits / 2500 * 463 + fUnits % 2500 * 463 / 2500;
+    }
+}
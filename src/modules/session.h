@@ -0,0 +1,45 @@
+/**
+ * \file session.h
+ * \brief Summary of the running session for the on-card session directory
+ * \author Martin Matysiak
+ *
+ * Every logged RMC sentence updates the summary incrementally: date and time
+ * of the first and last fix, the number of fixes, the bounding box and the
+ * distance travelled. NoFS writes the summary into the directory record of
+ * the session (see NOFS_DIRECTORY in nofs.h).
+ *
+ * The distance is summed up with integer arithmetic only. A step is only
+ * added once the position is at least SESSION_STEP meters away from the end
+ * of the last one, so the noise of a standing receiver doesn't add up. The
+ * module needs about 45 bytes of SRAM.
+ */
+
+#ifndef SESSION_H
+    #define SESSION_H
+
+    #include "global.h"
+    #include "modules/gps.h"
+    #include "modules/nmea.h"
+    #include "modules/nofs.h"
+
+    /// Minimum step (in meters) which is added to the distance
+    #ifndef SESSION_STEP
+        #define SESSION_STEP 10
+    #endif
+
+    /**
+     * \brief Resets the summary and hands it to NoFS
+     *
+     * Has to be called after nofs_init.
+     */
+    void session_init();
+
+    /**
+     * \brief Adds a logged sentence to the summary
+     *
+     * \param pSentence The NMEA sentence as returned by gps_getNMEA
+     * \param pType The type of the sentence as returned by gps_getNMEA (only
+     * valid RMC sentences are used)
+     */
+    void session_update(const char* pSentence, uint8_t pType);
+#endif
@@ -0,0 +1,51 @@
+/**
+ * \file stack.c
+ * \brief SRAM usage: stack painting and high-watermark probe
+ * \author Martin Matysiak
+ */
+
+#include "modules/stack.h"
+#include "modules/nmea.h"
+
+/// End of the statically allocated data, defined by the linker
+extern uint8_t __heap_start;
+
+void stack_paint() __attribute__((naked, used, section(".init3")));
+
+/**
+ * \brief Fills the unused SRAM with the canary
+ *
+ * Part of the startup code (.init3, the stack pointer and the zero register
+ * have already been set up). It is never called, execution simply falls
+ * through into the following init sections, so it must not use the stack.
+ */
+void stack_paint() {
+    uint8_t* position = &__heap_start;
+
+    while (position <= (uint8_t*)RAMEND) {
+        *position++ = STACK_CANARY;
+    }
+}
+
+uint16_t stack_unused() {
+    const uint8_t* position = &__heap_start;
+
+    while ((position <= (const uint8_t*)RAMEND) && (*position == STACK_CANARY)) {
+        position++;
+    }
+
+    return position - &__heap_start;
+}
+
+void stack_report(char* pOutput) {
+    char* position = nmea_writePrefix(pOutput, PSTR("$PGLMEM,"));
+
+    position = nmea_writeNumber(position, &__heap_start - (uint8_t*)RAMSTART);
+    *position++ = ',';
+    position = nmea_writeNumber(position, stack_unused());
+    *position++ = ',';
+    position = nmea_writeNumber(position, RAMEND - RAMSTART + 1);
+
+    *position = '\0';
+    nmea_appendChecksum(pOutput);
+}
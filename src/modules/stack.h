@@ -0,0 +1,54 @@
+/**
+ * \file stack.h
+ * \brief SRAM usage: stack painting and high-watermark probe
+ * \author Martin Matysiak
+ *
+ * At reset, the SRAM between the statically allocated data (.data, .bss,
+ * .noinit) and the end of the SRAM is filled with STACK_CANARY, before main
+ * is entered. As the stack grows down from RAMEND, the canary bytes which
+ * are still intact at the bottom of that area show the minimum headroom
+ * since the reset (the high-watermark of the stack, interrupts included).
+ *
+ * The figures are reported as sentence:
+ *
+ * $PGLMEM,<static bytes>,<unused bytes>,<SRAM size>*hh
+ *
+ * The worst case computed from the call graph is printed by make memreport
+ * (see tools/memreport.c). The painting runs in the startup code, no
+ * function has to be called at power-up.
+ */
+
+#ifndef STACK_H
+    #define STACK_H
+
+    #include "global.h"
+
+    /// Value the unused SRAM is filled with
+    #define STACK_CANARY 0xC5
+
+    /// Minimum size of the buffer passed to stack_report
+    #define STACK_REPORT_LENGTH 32
+
+    #ifndef RAMSTART
+        /// Start of the SRAM (not defined by older versions of avr-libc)
+        #define RAMSTART 0x100
+    #endif
+
+    /**
+     * \brief Determines the minimum headroom of the stack since the reset
+     *
+     * A byte at the bottom of the stack which has been written with the value
+     * of the canary is still counted as unused.
+     *
+     * \return The number of bytes which have never been used by the stack
+     */
+    uint16_t stack_unused();
+
+    /**
+     * \brief Writes the SRAM usage as sentence
+     *
+     * \param pOutput A buffer of at least STACK_REPORT_LENGTH bytes, receives
+     * a complete NMEA sentence including checksum and CR LF
+     */
+    void stack_report(char* pOutput);
+#endif
@@ -0,0 +1,54 @@
+/**
+ * \file supply.c
+ * \brief Supply monitor: early warning of a power cut by the analog comparator
+ * \author Martin Matysiak
+ */
+
+#include "modules/supply.h"
+#include "modules/nofs.h"
+
+// The interrupt handler would be linked in any case
+#if SUPPLY_MONITOR
+
+/// TRUE while the interrupt may commit the buffer itself
+static volatile uint8_t fIdle = FALSE;
+/// TRUE if the supply has dropped while the NoFS has been in use
+static volatile uint8_t fFailing = FALSE;
+
+void supply_init() {
+    // Input without pull-up and without digital input buffer
+    SUPPLY_DIR &= ~(1 << SUPPLY_PIN);
+    SUPPLY_PORT &= ~(1 << SUPPLY_PIN);
+    DIDR1 = (1 << AIN1D);
+
+    // Bandgap on the positive input, the output rises when the supply drops
+    ACSR = (1 << ACBG) | (1 << ACIS1) | (1 << ACIS0);
+    ACSR |= (1 << ACI);
+    ACSR |= (1 << ACIE);
+}
+
+void supply_setIdle(uint8_t pIdle) {
+    uint8_t sreg = SREG;
+    cli();
+
+    // Nothing else uses the NoFS now, the interrupt can't interfere either
+    if (pIdle && fFailing) {
+        fFailing = FALSE;
+        nofs_commit(NOFS_WRITE_SUPPLY);
+    }
+
+    fIdle = pIdle;
+    SREG = sreg;
+}
+
+/**
+ * \brief Commits the buffer when the supply drops (later if the NoFS is in use)
+ */
+ISR(ANALOG_COMP_vect) {
+    if (fIdle) {
+        nofs_commit(NOFS_WRITE_SUPPLY);
+    } else {
+        fFailing = TRUE;
+    }
+}
+#endif
@@ -0,0 +1,67 @@
+/**
+ * \file supply.h
+ * \brief Supply monitor: early warning of a power cut by the analog comparator
+ * \author Martin Matysiak
+ *
+ * The brown-out detector of the MCU can only reset it, which is too late for
+ * saving the sector buffer. Instead, the supply voltage is divided onto the
+ * AIN1 pin and compared against the internal bandgap reference (1.1 V): as
+ * soon as it drops below, the interrupt of the analog comparator fires,
+ * while the capacitors of the supply still hold enough energy for writing a
+ * sector. With the 3.3 V supply of the logger, a divider of 100k (to the
+ * supply) and 56k (to ground) warns at 1.1 V * 156 / 56 = 3.06 V (the
+ * bandgap may deviate by 0.1 V, i.e. about 0.3 V at the supply).
+ *
+ * The buffer is committed (see nofs_commit) right in the interrupt if the
+ * main loop is waiting for data (see supply_setIdle), otherwise as soon as
+ * the main loop starts waiting again.
+ *
+ * In both cases, the commit runs with the interrupts disabled (in
+ * ISR(ANALOG_COMP_vect) or in supply_setIdle): the sector takes about 10 ms
+ * or more with a slow card, the UART rings lose the characters arriving
+ * meanwhile. Its NOFS_TERMINAL has been written when the sector was started,
+ * so a single write is needed.
+ */
+
+#ifndef SUPPLY_H
+    #define SUPPLY_H
+
+    #include "global.h"
+
+    /// Set to TRUE if the supply is divided onto AIN1 (make SUPPLY_MONITOR=1)
+    #ifndef SUPPLY_MONITOR
+        #define SUPPLY_MONITOR FALSE
+    #endif
+
+    #if MCU_40PIN
+        #define SUPPLY_DIR DDRB
+        #define SUPPLY_PORT PORTB
+        #define SUPPLY_PIN PB3
+    #else
+        /// Direction register of the comparator input (AIN1)
+        #define SUPPLY_DIR DDRD
+        /// Port of the comparator input
+        #define SUPPLY_PORT PORTD
+        /// Comparator input (AIN1) the divided supply is connected to
+        #define SUPPLY_PIN PD7
+    #endif
+
+    /**
+     * \brief Starts monitoring the supply
+     *
+     * Has to be called after nofs_init, as the interrupt may commit the
+     * buffer.
+     */
+    void supply_init();
+
+    /**
+     * \brief Tells the monitor whether the NoFS may be used by the interrupt
+     *
+     * A drop of the supply while the main loop has been busy is handled when
+     * the main loop becomes idle.
+     *
+     * \param pIdle TRUE while the main loop only waits for data (the NoFS and
+     * the SPI are not in use), FALSE otherwise
+     */
+    void supply_setIdle(uint8_t pIdle);
+#endif
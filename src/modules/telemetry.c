@@ -0,0 +1,123 @@
+/**
+ * \file telemetry.c
+ * \brief Live binary telemetry of the fixes on the TX line of a USART
+ * \author Martin Matysiak
+ */
+
+#include "modules/telemetry.h"
+#include "modules/gps.h"
+#include "modules/nmea.h"
+#include "protocols/uart.h"
+
+/// Number of RMC sentences since the last frame
+static uint8_t fCount = 0;
+/// Sequence number of the next frame
+static uint8_t fSequence = 0;
+/// Frames dropped since the last sent one
+static uint8_t fDropped = 0;
+
+uint8_t telemetry_crc(uint8_t pCrc, uint8_t pData) {
+    pCrc ^= pData;
+
+    for (uint8_t i = 0; i < 8; i++) {
+        pCrc = (pCrc & 0x80) ? (pCrc << 1) ^ 0x07 : pCrc << 1;
+    }
+
+    return pCrc;
+}
+
+/**
+ * \brief Parses a decimal number with (at most) one fraction digit
+ * \return The number in tenths
+ */
+static uint16_t telemetry_parseTenths(const char* pToken) {
+    uint16_t value = 0;
+
+    while ((*pToken >= '0') && (*pToken <= '9')) {
+        value = value * 10 + (*pToken++ - '0');
+    }
+
+    value *= 10;
+    if ((pToken[0] == '.') && (pToken[1] >= '0') && (pToken[1] <= '9')) {
+        value += pToken[1] - '0';
+    }
+
+    return value;
+}
+
+/**
+ * \brief Writes a value into the frame (little endian)
+ */
+static void telemetry_setBytes(uint8_t* pFrame, uint32_t pValue, uint8_t pLength) {
+    while (pLength--) {
+        *pFrame++ = (uint8_t)pValue;
+        pValue >>= 8;
+    }
+}
+
+/**
+ * \brief Returns TRUE if a byte has to be escaped
+ */
+static uint8_t telemetry_escaped(uint8_t pData) {
+    return (pData == TELEMETRY_END) || (pData == TELEMETRY_ESC) || (pData == 0xA0);
+}
+
+void telemetry_update(uint8_t pPort, const char* pSentence, uint8_t pType, uint8_t pInterval) {
+    if (((pType & GPS_NMEA_TYPEMASK) != GPS_NMEA_RMC) || (++fCount < pInterval)) {
+        return;
+    }
+    fCount = 0;
+
+    uint8_t frame[TELEMETRY_FRAME_LENGTH];
+    uint32_t time = nmea_parseTime(nmea_getToken(pSentence, 1));
+
+    frame[0] = TELEMETRY_TYPE_FIX;
+    frame[1] = fSequence++;
+    telemetry_setBytes(frame + 2, (time == NMEA_TIME_INVALID) ? TELEMETRY_TIME_UNKNOWN : time / 100, 3);
+    telemetry_setBytes(frame + 5, nmea_parseCoordinate(nmea_getToken(pSentence, 3)), 4);
+    telemetry_setBytes(frame + 9, nmea_parseCoordinate(nmea_getToken(pSentence, 5)), 4);
+    telemetry_setBytes(frame + 13, telemetry_parseTenths(nmea_getToken(pSentence, 7)), 2);
+    telemetry_setBytes(frame + 15, telemetry_parseTenths(nmea_getToken(pSentence, 8)), 2);
+    frame[17] = (fDropped << 1) | ((pType & GPS_NMEA_VALID) ? TELEMETRY_FLAG_VALID : 0);
+
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < TELEMETRY_FRAME_LENGTH - 1; i++) {
+        crc = telemetry_crc(crc, frame[i]);
+    }
+    frame[TELEMETRY_FRAME_LENGTH - 1] = crc;
+
+    // The whole frame has to fit, the UART must never be waited for
+    uint8_t length = TELEMETRY_FRAME_LENGTH + 2;
+    for (uint8_t i = 0; i < TELEMETRY_FRAME_LENGTH; i++) {
+        length += telemetry_escaped(frame[i]);
+    }
+
+    if (length > uart_outputFree(pPort)) {
+        if (fDropped < 0x7F) {
+            fDropped++;
+        }
+        return;
+    }
+    fDropped = 0;
+
+    uart_setChar(pPort, TELEMETRY_END);
+    for (uint8_t i = 0; i < TELEMETRY_FRAME_LENGTH; i++) {
+        switch (frame[i]) {
+            case TELEMETRY_END:
+                uart_setChar(pPort, TELEMETRY_ESC);
+                uart_setChar(pPort, TELEMETRY_ESC_END);
+                break;
+            case TELEMETRY_ESC:
+                uart_setChar(pPort, TELEMETRY_ESC);
+                uart_setChar(pPort, TELEMETRY_ESC_ESC);
+                break;
+            case 0xA0:
+                uart_setChar(pPort, TELEMETRY_ESC);
+                uart_setChar(pPort, TELEMETRY_ESC_A0);
+                break;
+            default:
+                uart_setChar(pPort, frame[i]);
+        }
+    }
+    uart_setChar(pPort, TELEMETRY_END);
+}
@@ -0,0 +1,78 @@
+/**
+ * \file telemetry.h
+ * \brief Live binary telemetry of the fixes on the TX line of a USART
+ * \author Martin Matysiak
+ *
+ * After the initialization, the TX line to the GPS-module is idle. Every
+ * TELEMETRY_INTERVAL-th RMC sentence is sent on it as compact binary frame,
+ * so a receiver tapping the line (see tools/telemetryrx.h) can monitor the
+ * logger without pulling the card.
+ *
+ * Frames are SLIP-encoded (TELEMETRY_END ... TELEMETRY_END). 0xA0 is escaped
+ * as well, so the stream never contains the start sequence 0xA0 0xA1 of the
+ * binary messages of the GPS-module. Before encoding, a frame consists of
+ * TELEMETRY_FRAME_LENGTH bytes (multi-byte values little endian):
+ *
+ * - type (TELEMETRY_TYPE_FIX)
+ * - sequence number (incremented for every frame, also for dropped ones)
+ * - UTC time in 1/10 seconds since midnight (3 bytes, 0xFFFFFF: unknown)
+ * - latitude and longitude in 1/10000 arcminutes (4 bytes each)
+ * - speed in 1/10 knots, course in 1/10 degrees (2 bytes each)
+ * - flags: bit 0 valid fix, bits 1 to 7 frames dropped since the last one
+ * - CRC-8 (polynomial 0x07) of the preceding bytes
+ *
+ * The frames are only put into the output buffer of the UART, which is
+ * emptied by the interrupt. A frame which doesn't fit into the free space
+ * of the buffer is dropped instead of waiting, so telemetry never delays
+ * the logging.
+ */
+
+#ifndef TELEMETRY_H
+    #define TELEMETRY_H
+
+    #include "global.h"
+
+    /// Frame delimiter (SLIP)
+    #define TELEMETRY_END 0xC0
+    /// Escape character, followed by one of the TELEMETRY_ESC_* characters
+    #define TELEMETRY_ESC 0xDB
+    /// Escaped TELEMETRY_END
+    #define TELEMETRY_ESC_END 0xDC
+    /// Escaped TELEMETRY_ESC
+    #define TELEMETRY_ESC_ESC 0xDD
+    /// Escaped 0xA0 (start of a binary message of the GPS-module)
+    #define TELEMETRY_ESC_A0 0xDE
+
+    /// Frame type of a fix
+    #define TELEMETRY_TYPE_FIX 0x01
+
+    /// Length of a frame before encoding, including the CRC
+    #define TELEMETRY_FRAME_LENGTH 19
+
+    /// Value of the time field if the time is unknown
+    #define TELEMETRY_TIME_UNKNOWN 0xFFFFFFUL
+
+    /// Flag: the frame contains a valid fix
+    #define TELEMETRY_FLAG_VALID 0x01
+
+    /**
+     * \brief Calculates the CRC-8 of the frames
+     *
+     * \param pCrc The CRC of the preceding bytes (0 for the first byte)
+     * \param pData The next byte
+     * \return The updated CRC
+     */
+    uint8_t telemetry_crc(uint8_t pCrc, uint8_t pData);
+
+    /**
+     * \brief Sends every pInterval-th RMC sentence as frame
+     *
+     * Never waits for the UART.
+     *
+     * \param pPort The UART port whose TX line carries the telemetry
+     * \param pSentence A sentence as returned by gps_getNMEA
+     * \param pType The type of the sentence as returned by gps_getNMEA
+     * \param pInterval Number of RMC sentences per frame
+     */
+    void telemetry_update(uint8_t pPort, const char* pSentence, uint8_t pType, uint8_t pInterval);
+#endif
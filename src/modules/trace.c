@@ -0,0 +1,189 @@
+/**
+ * \file trace.c
+ * \brief Flight recorder: ring of the last events, timed by Timer0
+ * \author Martin Matysiak
+ */
+
+#include "modules/trace.h"
+
+// The interrupt handler would be linked in any case
+#if TRACE
+
+/// An event of the ring
+typedef struct {
+    uint8_t type;
+    uint8_t data;
+    uint16_t time;
+} trace_event_t;
+
+/// The ring of the last events and its state, kept across a reset
+typedef struct {
+    trace_event_t events[TRACE_EVENTS];
+    /// Index of the slot the next event is written into
+    uint8_t next;
+    /// Number of events in the ring
+    uint8_t count;
+    /// Error code the ring has been saved with (0 if it is recording)
+    uint8_t saved;
+    /// TRACE_SAVED_CHECK ^ saved if the ring has been saved
+    uint16_t check;
+} trace_ring_t;
+
+/// Marks a saved ring (together with its error code)
+#define TRACE_SAVED_CHECK 0x7A3C
+
+/// The ring, not initialized by the startup code (see trace_fatal)
+static trace_ring_t fRing __attribute__((section(".noinit")));
+/// Upper 8 bits of the time (i.e. number of Timer0 overflows)
+static volatile uint8_t fOverflows = 0;
+/// Reason of the requested dump (0 if none)
+static volatile uint8_t fPending = 0;
+/// Reset flags of the power-up (MCUSR), recorded once the ring records
+static uint8_t fResetFlags = 0;
+
+void trace_init() {
+    // Normal mode, prescaler 1024
+    TCCR0A = 0;
+    TCCR0B = (1 << CS02) | (1 << CS00);
+    TCNT0 = 0;
+
+    TIFR0 = (1 << TOV0);
+    TIMSK0 = (1 << TOIE0);
+
+    fResetFlags = MCUSR;
+    MCUSR = 0;
+
+    // Anything but an intact saved ring is garbage of the SRAM
+    if (!fRing.saved || (fRing.check != (TRACE_SAVED_CHECK ^ fRing.saved))
+            || (fRing.next >= TRACE_EVENTS) || (fRing.count > TRACE_EVENTS)) {
+        trace_release();
+    }
+}
+
+uint8_t trace_saved() {
+    return fRing.saved;
+}
+
+void trace_release() {
+    uint8_t sreg = SREG;
+    cli();
+    fRing.saved = 0;
+    fRing.check = 0;
+    fRing.next = 0;
+    fRing.count = 0;
+    SREG = sreg;
+
+    trace_add(TRACE_BOOT, fResetFlags);
+}
+
+/**
+ * \brief Combines the value of Timer0 with the overflow counter
+ *
+ * Has to be called with interrupts disabled (see timer_extend).
+ */
+static uint16_t trace_extend() {
+    uint8_t value = TCNT0;
+    uint8_t overflows = fOverflows;
+
+    if ((TIFR0 & (1 << TOV0)) && (value < 0x80)) {
+        overflows++;
+    }
+
+    return ((uint16_t)overflows << 8) | value;
+}
+
+uint16_t trace_now() {
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t now = trace_extend();
+    SREG = sreg;
+
+    return now;
+}
+
+void trace_add(uint8_t pType, uint8_t pData) {
+    uint8_t sreg = SREG;
+    cli();
+
+    // A saved ring is kept until it has been dumped
+    if (!fRing.saved) {
+        trace_event_t* event = &fRing.events[fRing.next];
+        event->type = pType;
+        event->data = pData;
+        event->time = trace_extend();
+
+        if (++fRing.next == TRACE_EVENTS) {
+            fRing.next = 0;
+        }
+        if (fRing.count < TRACE_EVENTS) {
+            fRing.count++;
+        }
+    }
+
+    SREG = sreg;
+}
+
+void trace_request(uint8_t pReason) {
+    uint8_t sreg = SREG;
+    cli();
+    if (!fPending) {
+        fPending = pReason;
+    }
+    SREG = sreg;
+}
+
+uint8_t trace_pending() {
+    uint8_t sreg = SREG;
+    cli();
+    uint8_t reason = fPending;
+    fPending = 0;
+    SREG = sreg;
+
+    return reason;
+}
+
+uint8_t trace_copy(char* pOutput) {
+    uint8_t sreg = SREG;
+    cli();
+
+    // The oldest event is the one the next event would replace
+    uint8_t index = (fRing.count < TRACE_EVENTS) ? 0 : fRing.next;
+    uint8_t count = fRing.count;
+
+    for (uint8_t i = 0; i < count; i++) {
+        const trace_event_t* event = &fRing.events[index];
+        *pOutput++ = event->type;
+        *pOutput++ = event->data;
+        *pOutput++ = event->time >> 8;
+        *pOutput++ = event->time;
+
+        if (++index == TRACE_EVENTS) {
+            index = 0;
+        }
+    }
+
+    SREG = sreg;
+    return count;
+}
+
+void trace_fatal(uint8_t pCode) {
+    uint8_t sreg = SREG;
+    cli();
+
+    // The ring of an earlier error which hasn't been dumped yet is kept
+    if (!fRing.saved) {
+        trace_add(TRACE_ERROR, pCode);
+        fRing.saved = pCode;
+        fRing.check = TRACE_SAVED_CHECK ^ pCode;
+    }
+
+    SREG = sreg;
+}
+
+/**
+ * \brief Extends the time to 16 bit
+ */
+ISR(TIMER0_OVF_vect) {
+    fOverflows++;
+}
+#endif
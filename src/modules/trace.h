@@ -0,0 +1,184 @@
+/**
+ * \file trace.h
+ * \brief Flight recorder: ring of the last events, timed by Timer0
+ * \author Martin Matysiak
+ *
+ * The card commands and their responses, failed transfers and retries, the
+ * start and end of every flush, baudrate changes and bytes lost by the UART
+ * ring are recorded as events of TRACE_EVENT_LENGTH bytes: the type, one
+ * byte of data (see the TRACE_* types) and the time (MSB first) in ticks of
+ * Timer0 (prescaler 1024, i.e. 7200 ticks per second at 7.3728 MHz). The
+ * time wraps every 9.1 seconds, the intervals between the events are
+ * unambiguous as long as they are shorter.
+ *
+ * The ring is written into the NOFS_REGION_TRACE region of the card (see
+ * nofs.h) when a flush fails or takes longer than TRACE_STALL_MS and when
+ * the UART ring has overflowed. When error is called, it is written right
+ * away if the card has a trace region already. Otherwise the ring is saved:
+ * it lives in the .noinit section, which the startup code leaves alone, and
+ * survives the reset by the watchdog of error (not a power cut, a garbled
+ * ring is discarded). The next run records nothing until nofs_init has found the
+ * regions of the card and written the saved ring behind the first sector
+ * of its session, so errors during the initialization of the card are
+ * covered as well. tools/nofstrace decodes the dumps.
+ *
+ * Recording an event takes about 40 cycles, Timer0 wakes the CPU up 28
+ * times per second. With the default configuration, the recorder needs
+ * about 75 bytes of SRAM (the ring takes 4 * TRACE_EVENTS of them).
+ */
+
+#ifndef TRACE_H
+    #define TRACE_H
+
+    #include "global.h"
+
+    /// Set to FALSE in order to record no events (make TRACE=0), disabled by
+    /// default on MCUs with 1 KB of SRAM (the recorder needs about 75 bytes)
+    #ifndef TRACE
+        #ifdef __AVR__
+            #define TRACE (!MCU_SMALL_SRAM)
+        #else
+            // Host builds have no timebase
+            #define TRACE FALSE
+        #endif
+    #endif
+
+    /// Number of events kept in the ring
+    #ifndef TRACE_EVENTS
+        #define TRACE_EVENTS 16
+    #endif
+
+    /// Duration of a flush (in ms, at most 9000) which causes a dump
+    #ifndef TRACE_STALL_MS
+        #define TRACE_STALL_MS 500
+    #endif
+
+    /// Ticks of the time of an event per second (Timer0, prescaler 1024)
+    #define TRACE_TICKS_PER_SECOND (F_CPU / 1024)
+
+    /// TRACE_STALL_MS in ticks
+    #define TRACE_STALL_TICKS ((uint16_t)(TRACE_STALL_MS * TRACE_TICKS_PER_SECOND / 1000))
+
+    /// Length of an event in a dump (type, data, time)
+    #define TRACE_EVENT_LENGTH 4
+
+    #if TRACE && ((TRACE_EVENTS < 1) || (TRACE_EVENTS > 255))
+        #error "TRACE_EVENTS has to be between 1 and 255"
+    #endif
+
+    #if TRACE && (TRACE_STALL_MS > 9000)
+        #error "TRACE_STALL_MS exceeds the range of the event times"
+    #endif
+
+    /// Event: power-up, data: the reset flags (MCUSR)
+    #define TRACE_BOOT 0x01
+    /// Event: error has been called, data: the error code
+    #define TRACE_ERROR 0x02
+    /// Event: nofs_flush starts, data: low byte of the sector
+    #define TRACE_FLUSH 0x03
+    /// Event: nofs_flush ends, data: TRUE if both sectors have been written
+    #define TRACE_FLUSHED 0x04
+    /// Event: the card refused a data block, data: its data response
+    #define TRACE_WRITE_FAILED 0x05
+    /// Event: a block couldn't be read, data: the byte received instead of
+    /// the start token (0xFF: timeout, else an error token), 0 for a CRC error
+    #define TRACE_READ_FAILED 0x06
+    /// Event: sdmmc_writeSector needed retries, data: the failed attempts
+    #define TRACE_WRITE_RETRIES 0x07
+    /// Event: sdmmc_readSector needed retries, data: the failed attempts
+    #define TRACE_READ_RETRIES 0x08
+    /// Event: the ring is written onto the card, data: the reason
+    #define TRACE_DUMP 0x09
+    /// Event (| port): the baudrate has been set, data: low byte of UBRR
+    #define TRACE_BAUD 0x10
+    /// Event (| port): the UART ring has overflowed, data: the lost bytes
+    /// (up to 255), recorded by the interrupt handler once the ring takes
+    /// characters again
+    #define TRACE_OVERFLOW 0x20
+    /// Event (| command index): a card command, data: the R1 response
+    #define TRACE_COMMAND 0x40
+
+    /// Dump reason (besides the error codes): a flush took too long
+    #define TRACE_DUMP_STALL 0x80
+    /// Dump reason: a flush failed
+    #define TRACE_DUMP_FAILED 0x81
+    /// Dump reason: the UART ring has overflowed
+    #define TRACE_DUMP_OVERFLOW 0x82
+
+    #if TRACE
+        /// Records an event, may be used anywhere (interrupts included)
+        #define TRACE_EVENT(pType, pData) trace_add(pType, pData)
+    #else
+        #define TRACE_EVENT(pType, pData)
+    #endif
+
+    /**
+     * \brief Starts the timebase and records the power-up
+     *
+     * Timer0 must not be disabled in the PRR register. The reset flags are
+     * cleared. If the ring has been saved by trace_fatal before the reset,
+     * it is kept and the power-up is recorded by trace_release.
+     */
+    void trace_init();
+
+    /**
+     * \brief Returns the error code the ring has been saved with
+     * \return The code passed to trace_fatal, 0 if the ring is recording
+     */
+    uint8_t trace_saved();
+
+    /**
+     * \brief Discards the events (e.g. once a saved ring has been dumped)
+     * and records the power-up
+     */
+    void trace_release();
+
+    /**
+     * \brief Returns the current time (may be called from interrupts as well)
+     * \return The time in ticks (wraps every 9.1 seconds)
+     */
+    uint16_t trace_now();
+
+    /**
+     * \brief Records an event (may be called from interrupts as well)
+     *
+     * Nothing is recorded while the ring is saved (see trace_fatal).
+     *
+     * \param pType The type of the event (TRACE_*)
+     * \param pData The data of the event
+     */
+    void trace_add(uint8_t pType, uint8_t pData);
+
+    /**
+     * \brief Requests a dump of the ring, which is written by the NoFS at
+     * the end of the current sector
+     *
+     * \param pReason The reason of the dump (a pending one is kept)
+     */
+    void trace_request(uint8_t pReason);
+
+    /**
+     * \brief Fetches the reason of a requested dump and clears it
+     * \return The reason, 0 if no dump is due
+     */
+    uint8_t trace_pending();
+
+    /**
+     * \brief Copies the events into a buffer, the oldest one first
+     *
+     * \param pOutput Receives TRACE_EVENT_LENGTH bytes per event
+     * \return The number of events
+     */
+    uint8_t trace_copy(char* pOutput);
+
+    /**
+     * \brief Records an error and saves the ring for the next run (called
+     * by error)
+     *
+     * Nothing is recorded afterwards. The ring of an earlier error which
+     * hasn't been dumped yet is kept as it is.
+     *
+     * \param pCode The error code (not 0)
+     */
+    void trace_fatal(uint8_t pCode);
+#endif
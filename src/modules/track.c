@@ -0,0 +1,192 @@
+/**
+ * \file track.c
+ * \brief Streaming track simplification which drops redundant fixes before
+ * they are written onto the memory card
+ * \author Martin Matysiak
+ */
+
+#include "modules/track.h"
+
+/// 180 degrees in coordinate units
+#define TRACK_HALF_TURN (180L * 60 * 10000)
+
+/// Largest longitude difference which can be scaled by nmea_cosLatitude
+/// without an overflow (larger ones exceed the range of an int16_t anyway)
+#define TRACK_MAX_SCALED (INT32_MAX >> 8)
+
+/// Maximum allowed deviation in coordinate units (1/10000 arcminute)
+static uint16_t fThreshold = 0;
+/// Maximum age of the last kept fix in milliseconds
+static uint16_t fMaxInterval = 0;
+
+/// TRUE as soon as the first fix has been kept
+static uint8_t fHasAnchor = FALSE;
+/// Decision for the current epoch
+static uint8_t fKeepEpoch = TRUE;
+/// UTC time of the current epoch
+static uint32_t fEpochTime = NMEA_TIME_INVALID;
+
+/// Position and time of the last kept fix
+static int32_t fAnchorLat, fAnchorLon;
+static uint32_t fAnchorTime;
+
+/// Movement (position and time difference) when the last fix was kept
+static int16_t fStepLat, fStepLon;
+static uint16_t fStepTime;
+
+/// Position and time of the last received fix
+static int32_t fLastLat, fLastLon;
+static uint32_t fLastTime;
+
+/**
+ * \brief Calculates the difference between two times of the day
+ * \return pTo - pFrom in milliseconds, taking a wrap at midnight into account
+ */
+static uint32_t track_elapsed(uint32_t pFrom, uint32_t pTo) {
+    return pTo >= pFrom ? pTo - pFrom : pTo + NMEA_MS_PER_DAY - pFrom;
+}
+
+/**
+ * \brief Limits a value to -pLimit ... pLimit
+ */
+static int32_t track_limit(int32_t pValue, int32_t pLimit) {
+    if (pValue > pLimit) {
+        return pLimit;
+    } else if (pValue < -pLimit) {
+        return -pLimit;
+    }
+
+    return pValue;
+}
+
+/**
+ * \brief Limits a coordinate difference to the range of an int16_t
+ */
+static int16_t track_clamp(int32_t pValue) {
+    return track_limit(pValue, INT16_MAX);
+}
+
+/**
+ * \brief Calculates the difference between two longitudes
+ * \return pTo - pFrom, the short way around (across the antimeridian if
+ * necessary)
+ */
+static int32_t track_deltaLon(int32_t pFrom, int32_t pTo) {
+    int32_t delta = pTo - pFrom;
+
+    if (delta > TRACK_HALF_TURN) {
+        delta -= 2 * TRACK_HALF_TURN;
+    } else if (delta < -TRACK_HALF_TURN) {
+        delta += 2 * TRACK_HALF_TURN;
+    }
+
+    return delta;
+}
+
+/**
+ * \brief Decides if the given fix has to be kept and updates the state
+ * \return TRUE if the fix should be kept, FALSE otherwise
+ */
+static uint8_t track_evaluate(int32_t pLat, int32_t pLon, uint32_t pTime) {
+    uint8_t keep = TRUE;
+
+    if (fHasAnchor) {
+        uint32_t elapsed = track_elapsed(fAnchorTime, pTime);
+
+        if (elapsed < fMaxInterval) {
+            // Predict the current position using the last known movement
+            int32_t predictedLat = fAnchorLat;
+            int32_t predictedLon = fAnchorLon;
+
+            if (fStepTime) {
+                predictedLat += (int32_t)fStepLat * (int32_t)elapsed / fStepTime;
+                predictedLon += (int32_t)fStepLon * (int32_t)elapsed / fStepTime;
+            }
+
+            // Longitude differences get smaller towards the poles
+            uint8_t cosLat = nmea_cosLatitude(pLat);
+
+            int32_t dLat = track_clamp(pLat - predictedLat);
+            int32_t dLon = track_limit(track_deltaLon(predictedLon, pLon), TRACK_MAX_SCALED);
+            dLon = track_clamp((dLon * cosLat) >> 8);
+
+            keep = (uint32_t)(dLat * dLat + dLon * dLon) > (uint32_t)fThreshold * fThreshold;
+        }
+    }
+
+    if (keep) {
+        // Remember the current movement as velocity for future predictions.
+        // Gaps which are too large do not describe a velocity anymore.
+        uint32_t stepTime = track_elapsed(fLastTime, pTime);
+
+        if (fHasAnchor && (stepTime <= UINT16_MAX)) {
+            fStepLat = track_clamp(pLat - fLastLat);
+            fStepLon = track_clamp(track_deltaLon(fLastLon, pLon));
+            fStepTime = stepTime;
+        } else {
+            fStepTime = 0;
+        }
+
+        fAnchorLat = pLat;
+        fAnchorLon = pLon;
+        fAnchorTime = pTime;
+        fHasAnchor = TRUE;
+    }
+
+    fLastLat = pLat;
+    fLastLon = pLon;
+    fLastTime = pTime;
+
+    return keep;
+}
+
+void track_init(uint16_t pThreshold, uint8_t pMaxInterval) {
+    // One arcminute equals 1852 meters
+    fThreshold = (uint32_t)pThreshold * 10000 / 1852;
+
+    if (pMaxInterval > TRACK_MAX_INTERVAL_LIMIT) {
+        pMaxInterval = TRACK_MAX_INTERVAL_LIMIT;
+    }
+    fMaxInterval = (uint16_t)pMaxInterval * 1000;
+
+    fHasAnchor = FALSE;
+    fKeepEpoch = TRUE;
+    fEpochTime = NMEA_TIME_INVALID;
+}
+
+uint8_t track_filter(const char* pSentence, uint8_t pType) {
+    // Token indices of time and latitude (longitude is always two tokens
+    // behind the latitude)
+    uint8_t timeToken, latToken;
+
+    switch (pType & GPS_NMEA_TYPEMASK) {
+        case GPS_NMEA_GGA:
+            timeToken = 1;
+            latToken = 2;
+            break;
+        case GPS_NMEA_RMC:
+            timeToken = 1;
+            latToken = 3;
+            break;
+        case GPS_NMEA_GLL:
+            timeToken = 5;
+            latToken = 1;
+            break;
+        default:
+            // no position inside, use the decision of the current epoch
+            return fKeepEpoch;
+    }
+
+    uint32_t time = nmea_parseTime(nmea_getToken(pSentence, timeToken));
+
+    // Only the first position of an epoch is evaluated
+    if ((time != NMEA_TIME_INVALID) && (time != fEpochTime)) {
+        const char* latitude = nmea_getToken(pSentence, latToken);
+
+        fEpochTime = time;
+        fKeepEpoch = track_evaluate(nmea_parseCoordinate(latitude),
+            nmea_parseCoordinate(nmea_getToken(latitude, 2)), time);
+    }
+
+    return fKeepEpoch;
+}
@@ -0,0 +1,53 @@
+/**
+ * \file track.h
+ * \brief Streaming track simplification which drops redundant fixes before
+ * they are written onto the memory card
+ * \author Martin Matysiak
+ *
+ * The filter uses a dead-reckoning approach: whenever a fix is kept, the
+ * movement between this fix and the one received before is remembered as
+ * the current velocity. Every following fix is compared against the position
+ * that has been predicted by this velocity. Only if the deviation exceeds the
+ * configured threshold (or if the last kept fix is too old), the fix will be
+ * kept again. Straight lines with constant speed are therefore reduced to a
+ * few points while curves and stops are preserved.
+ *
+ * All sentences of one epoch (i.e. with the same UTC time) share the
+ * decision which has been made for the first position-bearing sentence
+ * (GGA, RMC or GLL) of this epoch. Sentences without a position (GSA, GSV,
+ * VTG, ZDA) simply follow the last decision.
+ *
+ * The filter needs about 40 bytes of SRAM and works solely with integer
+ * arithmetic.
+ */
+
+#ifndef TRACK_H
+    #define TRACK_H
+
+    #include "global.h"
+    #include "modules/gps.h"
+    #include "modules/nmea.h"
+
+    /// The maximum age (in seconds) of the last kept fix that is supported
+    #define TRACK_MAX_INTERVAL_LIMIT 65
+
+    /**
+     * \brief Initializes the track filter and resets its state
+     *
+     * \param pThreshold The maximum allowed deviation (in meters) between the
+     * predicted and the actual position. Fixes deviating less will be dropped.
+     * \param pMaxInterval A fix will be kept at least every pMaxInterval
+     * seconds, even if it has been predicted correctly. Values above
+     * TRACK_MAX_INTERVAL_LIMIT will be truncated.
+     */
+    void track_init(uint16_t pThreshold, uint8_t pMaxInterval);
+
+    /**
+     * \brief Decides whether a (valid) sentence should be written or not
+     *
+     * \param pSentence The NMEA sentence as returned by gps_getNMEA
+     * \param pType The type of the sentence as returned by gps_getNMEA
+     * \return TRUE if the sentence should be kept, FALSE otherwise
+     */
+    uint8_t track_filter(const char* pSentence, uint8_t pType);
+#endif
@@ -0,0 +1,184 @@
+/**
+ * \file warmstart.c
+ * \brief Warm start assistance: the last fix is kept in the EEPROM and handed
+ * to the GPS-module at power-up
+ * \author Martin Matysiak
+ */
+
+#ifdef __AVR__
+    #include <avr/eeprom.h>
+#endif
+#include "modules/warmstart.h"
+
+/// The stored fix (GPS_RESTART payload followed by a check byte)
+static uint8_t fStored[GPS_RESTART_LENGTH + 1] EEMEM;
+/// The fix which is being stored (payload followed by the check byte)
+static unsigned char fPending[GPS_RESTART_LENGTH + 1];
+/// Index of the next byte of fPending to be stored (behind it: all stored)
+static uint8_t fPendingByte = sizeof(fPending);
+
+/// The last fix (GPS_RESTART payload)
+static unsigned char fFix[GPS_RESTART_LENGTH];
+/// Time (seconds since 2000) at which the fix has been stored the last time
+static uint32_t fSaved = 0;
+/// Number of invalid RMC sentences before the first fix
+static uint16_t fEpochs = 0;
+/// TRUE as soon as the first valid RMC sentence has been received
+static uint8_t fFixed = FALSE;
+/// TRUE if the module has been restarted with a stored fix
+static uint8_t fAided = FALSE;
+
+/**
+ * \brief Calculates the check byte of a payload (an erased or cleared EEPROM
+ * never matches)
+ */
+static uint8_t warmstart_check(const unsigned char* pPayload) {
+    uint8_t check = 0xA5;
+    for (uint8_t i = 0; i < GPS_RESTART_LENGTH; i++) {
+        check ^= pPayload[i];
+    }
+
+    return check;
+}
+
+/**
+ * \brief Parses two decimal digits
+ */
+static uint8_t warmstart_parseTwoDigits(const char* pToken) {
+    return (pToken[0] - '0') * 10 + (pToken[1] - '0');
+}
+
+/**
+ * \brief Stores a signed 16 bit value (MSB first) in the payload
+ */
+static void warmstart_setWord(uint8_t pOffset, int16_t pValue) {
+    fFix[pOffset] = (uint16_t)pValue >> 8;
+    fFix[pOffset + 1] = pValue & 0xFF;
+}
+
+/**
+ * \brief Stores the next byte of fPending which differs from the EEPROM
+ *
+ * Programming a byte takes 3.4 ms, so at most one is started per call and
+ * the call returns right away while the EEPROM is still busy.
+ */
+static void warmstart_store() {
+    if (!eeprom_is_ready()) {
+        return;
+    }
+
+    while (fPendingByte < sizeof(fPending)) {
+        uint8_t index = fPendingByte++;
+
+        // Only bytes which changed are actually written
+        if (eeprom_read_byte(&fStored[index]) != fPending[index]) {
+            eeprom_write_byte(&fStored[index], fPending[index]);
+            return;
+        }
+    }
+}
+
+uint8_t warmstart_restore(uint8_t pPort) {
+    unsigned char stored[GPS_RESTART_LENGTH + 1];
+
+    // Power-up state (host builds restart without a reset)
+    fSaved = 0;
+    fEpochs = 0;
+    fFixed = FALSE;
+    fAided = FALSE;
+    fPendingByte = sizeof(fPending);
+
+    eeprom_read_block(stored, fStored, sizeof(stored));
+
+    if ((stored[0] != GPS_RESTART_HOT) || (warmstart_check(stored) != stored[GPS_RESTART_LENGTH])) {
+        return FALSE;
+    }
+
+    gps_restart(pPort, stored);
+    fAided = TRUE;
+    return TRUE;
+}
+
+uint8_t warmstart_update(const char* pSentence, uint8_t pType, uint16_t pInterval) {
+    warmstart_store();
+
+    if (pType == (GPS_NMEA_GGA | GPS_NMEA_VALID)) {
+        // $GPGGA,hhmmss.sss,llll.ll,a,yyyyy.yy,a,x,xx,x.x,altitude,M,...
+        const char* token = nmea_getToken(pSentence, 9);
+        uint8_t negative = (*token == '-');
+        int16_t altitude = 0;
+
+        token += negative;
+        while ((*token >= '0') && (*token <= '9')) {
+            altitude = altitude * 10 + (*token++ - '0');
+        }
+
+        warmstart_setWord(GPS_RESTART_ALTITUDE, negative ? -altitude : altitude);
+        return FALSE;
+    }
+
+    if ((pType & GPS_NMEA_TYPEMASK) != GPS_NMEA_RMC) {
+        return FALSE;
+    }
+
+    uint32_t now = nmea_parseDateTime(pSentence);
+
+    if (!(pType & GPS_NMEA_VALID) || (now == NMEA_TIME_INVALID)) {
+        if (!fFixed && (fEpochs < 0xFFFF)) {
+            fEpochs++;
+        }
+        return FALSE;
+    }
+
+    // $GPRMC,hhmmss.sss,A,llll.ll,a,yyyyy.yy,a,x.x,x.x,ddmmyy,...
+    const char* time = nmea_getToken(pSentence, 1);
+    const char* date = nmea_getToken(time, 8);
+
+    fFix[0] = GPS_RESTART_HOT;
+    warmstart_setWord(GPS_RESTART_YEAR, 2000 + warmstart_parseTwoDigits(date + 4));
+    fFix[GPS_RESTART_YEAR + 2] = warmstart_parseTwoDigits(date + 2);
+    fFix[GPS_RESTART_YEAR + 3] = warmstart_parseTwoDigits(date);
+    fFix[GPS_RESTART_YEAR + 4] = warmstart_parseTwoDigits(time);
+    fFix[GPS_RESTART_YEAR + 5] = warmstart_parseTwoDigits(time + 2);
+    fFix[GPS_RESTART_YEAR + 6] = warmstart_parseTwoDigits(time + 4);
+
+    // The module expects 1/100 degrees
+    warmstart_setWord(GPS_RESTART_LATITUDE,
+        nmea_parseCoordinate(nmea_getToken(time, 2)) / (NMEA_UNITS_PER_DEGREE / 100));
+    warmstart_setWord(GPS_RESTART_LONGITUDE,
+        nmea_parseCoordinate(nmea_getToken(time, 4)) / (NMEA_UNITS_PER_DEGREE / 100));
+
+    if ((fSaved == 0) || (now - fSaved >= pInterval)) {
+        // Stored byte by byte by the following calls, the check byte last
+        for (uint8_t i = 0; i < GPS_RESTART_LENGTH; i++) {
+            fPending[i] = fFix[i];
+        }
+        fPending[GPS_RESTART_LENGTH] = warmstart_check(fFix);
+        fPendingByte = 0;
+        fSaved = now;
+    }
+
+    if (!fFixed) {
+        fFixed = TRUE;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+void warmstart_report(char* pOutput, uint16_t pTenths) {
+    char* position = nmea_writePrefix(pOutput, PSTR("$PGLTTF,"));
+
+    position = nmea_writeNumber(position, fEpochs);
+    *position++ = ',';
+
+    uint32_t tenths = (uint32_t)fEpochs * pTenths;
+    position = nmea_writeNumber(position, tenths > 655359 ? 65535 : tenths / 10);
+    *position++ = '.';
+    *position++ = '0' + tenths % 10;
+    *position++ = ',';
+    *position++ = fAided ? '1' : '0';
+
+    *position = '\0';
+    nmea_appendChecksum(pOutput);
+}
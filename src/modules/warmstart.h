@@ -0,0 +1,71 @@
+/**
+ * \file warmstart.h
+ * \brief Warm start assistance: the last fix is kept in the EEPROM and handed
+ * to the GPS-module at power-up
+ * \author Martin Matysiak
+ *
+ * The position (from RMC), altitude (from GGA) and UTC time of the last fix
+ * are stored in the EEPROM every WARMSTART_INTERVAL seconds, already in the
+ * format of the payload of the GPS_RESTART message. At power-up, the module
+ * is restarted with this payload (hot start), so it doesn't have to search
+ * the whole sky. As there is no real-time clock, the time is the one of the
+ * last fix, i.e. it lags behind by the time the logger has been switched
+ * off (which is short compared to the tolerance of the module for the
+ * typical short trips).
+ *
+ * The EEPROM is only written if the content changed, with the default
+ * interval its 100000 write cycles last for about two years of continuous
+ * logging. As programming a byte takes 3.4 ms, warmstart_update starts at
+ * most one byte per call and never waits for the EEPROM, so the main loop
+ * isn't blocked (the fix is stored within 15 sentences). Until the check
+ * byte has been written, the stored fix is invalid. The module needs about
+ * 40 bytes of SRAM.
+ *
+ * Host builds provide the EEPROM with -DHOST_IO (see tools/eeprom_host.h).
+ */
+
+#ifndef WARMSTART_H
+    #define WARMSTART_H
+
+    #include "global.h"
+    #include "modules/gps.h"
+    #include "modules/nmea.h"
+
+    /// Minimum size of the buffer passed to warmstart_report
+    #define WARMSTART_REPORT_LENGTH 32
+
+    /**
+     * \brief Restarts the GPS-module with the stored fix (if there is one)
+     *
+     * Has to be called at power-up before gps_init, as the restart discards
+     * the configuration of the module. Starts the measurement of the time to
+     * first fix.
+     *
+     * \param pPort The UART port the module is connected to
+     * \return TRUE if the module has been aided, FALSE if no valid fix has
+     * been stored yet
+     */
+    uint8_t warmstart_restore(uint8_t pPort);
+
+    /**
+     * \brief Takes position and time out of a sentence and continues storing
+     * the fix in the EEPROM
+     *
+     * \param pSentence The NMEA sentence as returned by gps_getNMEA
+     * \param pType The type of the sentence as returned by gps_getNMEA
+     * (invalid RMC sentences are counted for the time to first fix)
+     * \param pInterval Seconds between two stored fixes
+     * \return TRUE for the first valid RMC sentence since power-up
+     */
+    uint8_t warmstart_update(const char* pSentence, uint8_t pType, uint16_t pInterval);
+
+    /**
+     * \brief Writes the time to first fix as sentence
+     *
+     * $PGLTTF,<RMC sentences before the fix>,<time to first fix>,<aided>*hh
+     *
+     * \param pOutput A buffer of at least WARMSTART_REPORT_LENGTH bytes
+     * \param pTenths Duration of one RMC interval in 1/10 seconds
+     */
+    void warmstart_report(char* pOutput, uint16_t pTenths);
+#endif
@@ -31,7 +31,7 @@ uint8_t spi_init() {
 }
 
 void spi_writeByte(uint8_t pByte) {
-    SPDR = pByte;
+    SPI_START(pByte);
 
     // Wait for transfer to complete
     while (!(SPSR & (1 << SPIF))) {
@@ -41,7 +41,7 @@ void spi_writeByte(uint8_t pByte) {
 
 uint8_t spi_readByte() {
     // Send dummybyte in order to generate clock signals
-    SPDR = 0xFF;  
+    SPI_START(0xFF);
 
     // Wait for transfer to complete
     while (!(SPSR & (1 << SPIF))) {
@@ -51,10 +51,14 @@ uint8_t spi_readByte() {
     return SPDR;
 }
 
-void spi_highspeed() {
-    // Set speed in SPI Control Register to F_CPU / 4
-    SPCR &=~ (1 << SPR1) | (1 << SPR0);
+void spi_setSpeed(uint8_t pSpeed) {
+    // SPR1 and SPR0 select F_CPU / 4, 16, 64 or 128, SPI2X doubles the first
+    // three of them (which gives the even speeds)
+    SPCR = (SPCR & ~((1 << SPR1) | (1 << SPR0))) | ((pSpeed >> 1) << SPR0);
 
-    // Double SPI Frequency (that makes F_SPI = F_CPU / 2)
-    SPSR |= (1<<SPI2X); 
+    if (!(pSpeed & 1) && (pSpeed < SPI_SPEED_128)) {
+        SPSR |= (1 << SPI2X);
+    } else {
+        SPSR &= ~(1 << SPI2X);
+    }
 }
@@ -7,26 +7,59 @@
 #ifndef SPI_H
     #define SPI_H
 
+    #include "global.h"
+
     /// The port at which the SPI Pins are
     #define SPI_PORT PORTB
     /// The direction register for the SPI Port
     #define SPI_PORT_DIR DDRB
 
-    /// Chipselect Pin
-    #define SPI_CS PB2
-    /// MOSI Pin
-    #define SPI_MOSI PB3
-    /// MISO Pin
-    #define SPI_MISO PB4
-    /// SCK (CLK) Pin
-    #define SPI_SCK PB5
+    #if MCU_40PIN
+        #define SPI_CS PB4
+        #define SPI_MOSI PB5
+        #define SPI_MISO PB6
+        #define SPI_SCK PB7
+    #else
+        /// Chipselect Pin
+        #define SPI_CS PB2
+        /// MOSI Pin
+        #define SPI_MOSI PB3
+        /// MISO Pin
+        #define SPI_MISO PB4
+        /// SCK (CLK) Pin
+        #define SPI_SCK PB5
+    #endif
 
     /// Macro to set the Chipselect (i.e. chipselect is pulled to low)
     #define SET_CS() SPI_PORT &= ~(1 << SPI_CS)
     /// Macro to clear the Chipselect (i.e. chipselect is pulled to high)
     #define CLEAR_CS() SPI_PORT |= (1 << SPI_CS)
 
-    #include "global.h"
+    /// SPI clock F_CPU / 2 (the speeds are the exponent of the divider minus 1)
+    #define SPI_SPEED_2 0
+    /// SPI clock F_CPU / 4
+    #define SPI_SPEED_4 1
+    /// SPI clock F_CPU / 8
+    #define SPI_SPEED_8 2
+    /// SPI clock F_CPU / 16
+    #define SPI_SPEED_16 3
+    /// SPI clock F_CPU / 32
+    #define SPI_SPEED_32 4
+    /// SPI clock F_CPU / 64
+    #define SPI_SPEED_64 5
+    /// SPI clock F_CPU / 128 (used by spi_init)
+    #define SPI_SPEED_128 6
+
+    /// Macro to convert a speed into the divider of the SPI clock
+    #define SPI_DIVIDER(pSpeed) (2 << (pSpeed))
+
+    #ifndef SPI_START
+        /// Macro to start the transfer of a byte without waiting for it (the
+        /// only way SPDR is written, host builds replace it)
+        #define SPI_START(pByte) SPDR = (pByte)
+    #endif
+    /// Macro to wait for the end of a transfer started with SPI_START
+    #define SPI_WAIT() while (!(SPSR & (1 << SPIF))) {}
 
     /**
      * \brief Initializes the SPI Port.
@@ -49,10 +82,10 @@
     uint8_t spi_readByte();
     
     /**
-     * \brief Switches SPI Configuration into Highspeed mode
+     * \brief Changes the SPI clock
      *
-     * The speed will be set to the highest possible value, i.e.
-     * F_SPI = F_CPU / 2
+     * \param pSpeed One of the SPI_SPEED values, e.g. SPI_SPEED_2 for the
+     * highest possible clock F_SPI = F_CPU / 2
      */
-    void spi_highspeed();
+    void spi_setSpeed(uint8_t pSpeed);
 #endif
@@ -0,0 +1,91 @@
+/**
+ * \file timer.c
+ * \brief Free-running 32 bit timebase (Timer1) with input capture of the
+ * 1PPS signal of the GPS-module
+ * \author Martin Matysiak
+ */
+
+#include "protocols/timer.h"
+#include "modules/latency.h"
+
+// The interrupt handlers would be linked in any case
+#if LATENCY
+
+/// Upper 16 bits of the timebase (i.e. number of Timer1 overflows)
+static volatile uint16_t fOverflows = 0;
+/// Time of the last 1PPS pulse
+static volatile uint32_t fPps = 0;
+/// TRUE if a pulse has been captured which hasn't been fetched yet
+static volatile uint8_t fNewPps = FALSE;
+
+void timer_init() {
+    // The 1PPS pin is an input without pull-up
+    TIMER_PPS_DIR &= ~(1 << TIMER_PPS);
+    TIMER_PPS_PORT &= ~(1 << TIMER_PPS);
+
+    // Normal mode, capture on rising edges with noise canceler, prescaler 64
+    TCCR1A = 0;
+    TCCR1B = (1 << ICNC1) | (1 << ICES1) | (1 << CS11) | (1 << CS10);
+    TCNT1 = 0;
+
+    TIFR1 = (1 << ICF1) | (1 << TOV1);
+    TIMSK1 = (1 << ICIE1) | (1 << TOIE1);
+}
+
+/**
+ * \brief Combines a 16 bit timer value with the overflow counter
+ *
+ * Has to be called with interrupts disabled. An overflow which happened
+ * before the value has been taken but which hasn't been handled yet is taken
+ * into account.
+ */
+static uint32_t timer_extend(uint16_t pValue) {
+    uint16_t overflows = fOverflows;
+
+    if ((TIFR1 & (1 << TOV1)) && (pValue < 0x8000)) {
+        overflows++;
+    }
+
+    return ((uint32_t)overflows << 16) | pValue;
+}
+
+uint32_t timer_now() {
+    uint8_t sreg = SREG;
+    cli();
+    uint32_t now = timer_extend(TCNT1);
+    SREG = sreg;
+
+    return now;
+}
+
+uint8_t timer_getPps(uint32_t* pTime) {
+    uint8_t result = FALSE;
+    uint8_t sreg = SREG;
+    cli();
+
+    if (fNewPps) {
+        *pTime = fPps;
+        fNewPps = FALSE;
+        result = TRUE;
+    }
+
+    SREG = sreg;
+    return result;
+}
+
+/**
+ * \brief Extends the timebase to 32 bit
+ */
+ISR(TIMER1_OVF_vect) {
+    fOverflows++;
+}
+
+/**
+ * \brief Remembers the time of a 1PPS pulse (captured by hardware)
+ */
+ISR(TIMER1_CAPT_vect) {
+    fPps = timer_extend(ICR1);
+    fNewPps = TRUE;
+}
+
+#endif
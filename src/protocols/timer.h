@@ -0,0 +1,61 @@
+/**
+ * \file timer.h
+ * \brief Free-running 32 bit timebase (Timer1) with input capture of the
+ * 1PPS signal of the GPS-module
+ * \author Martin Matysiak
+ *
+ * Timer1 runs with F_CPU / TIMER_PRESCALER and is extended to 32 bit by
+ * counting its overflows (about 10 hours until the timebase wraps). The
+ * rising edge of the 1PPS output (connected to ICP1) is captured by hardware,
+ * so the timestamp doesn't suffer from interrupt latency.
+ */
+
+#ifndef TIMER_H
+    #define TIMER_H
+
+    #include "global.h"
+
+    #if MCU_40PIN
+        #define TIMER_PPS_PORT PORTD
+        #define TIMER_PPS_DIR DDRD
+        #define TIMER_PPS PD6
+    #else
+        /// Port of the input capture pin (1PPS input)
+        #define TIMER_PPS_PORT PORTB
+        /// Direction register of the input capture pin
+        #define TIMER_PPS_DIR DDRB
+        /// Input capture pin (ICP1)
+        #define TIMER_PPS PB0
+    #endif
+
+    /// Prescaler of Timer1 (one tick = 8.68us at 7.3728MHz)
+    #define TIMER_PRESCALER 64
+
+    /// Number of timer ticks per millisecond
+    #define TIMER_TICKS_PER_MS (F_CPU / TIMER_PRESCALER / 1000)
+
+    /// Converts timer ticks into milliseconds
+    #define TIMER_TO_MS(pTicks) ((pTicks) / TIMER_TICKS_PER_MS)
+
+    /**
+     * \brief Starts the timebase and the capturing of the 1PPS signal
+     *
+     * Timer1 must not be disabled in the PRR register.
+     */
+    void timer_init();
+
+    /**
+     * \brief Returns the current time (may be called from interrupts as well)
+     * \return The timer ticks since timer_init
+     */
+    uint32_t timer_now();
+
+    /**
+     * \brief Returns the time of the last 1PPS pulse
+     *
+     * \param pTime Receives the time (in timer ticks) of the last pulse
+     * \return TRUE if there has been a new pulse since the last call, FALSE
+     * otherwise (pTime is left untouched then)
+     */
+    uint8_t timer_getPps(uint32_t* pTime);
+#endif
@@ -5,78 +5,143 @@
  */
 
 #include "protocols/uart.h"
+#include "modules/latency.h"
+#include "modules/trace.h"
 #include <avr/interrupt.h>
 
-/// FIFO input buffer
-static volatile char uart_inputBuf0[UART_INPUT_BUFFER_SIZE];
+#if UART_PORTS > 1
+    // The registers of both USARTs have the same layout, the port is
+    // selected at runtime
+    #define UART_UDR(pPort) (*((pPort) ? &UDR1 : &UDR0))
+    #define UART_UCSRB(pPort) (*((pPort) ? &UCSR1B : &UCSR0B))
+    #define UART_UCSRC(pPort) (*((pPort) ? &UCSR1C : &UCSR0C))
+    #define UART_UBRRH(pPort) (*((pPort) ? &UBRR1H : &UBRR0H))
+    #define UART_UBRRL(pPort) (*((pPort) ? &UBRR1L : &UBRR0L))
+#else
+    #define UART_UDR(pPort) UDR0
+    #define UART_UCSRB(pPort) UCSR0B
+    #define UART_UCSRC(pPort) UCSR0C
+    #define UART_UBRRH(pPort) UBRR0H
+    #define UART_UBRRL(pPort) UBRR0L
+#endif
+
+// MCUs with two USARTs number the interrupt vectors of both
+#ifdef USART0_RX_vect
+    #define UART_RX0_vect USART0_RX_vect
+    #define UART_UDRE0_vect USART0_UDRE_vect
+#else
+    #define UART_RX0_vect USART_RX_vect
+    #define UART_UDRE0_vect USART_UDRE_vect
+#endif
+
+#if UART_INPUT_BUFFER_SIZE > 256
+    // Larger input buffers need 16 bit indices, which the main program only
+    // accesses with interrupts disabled
+    typedef uint16_t uart_index_t;
+    #define UART_ATOMIC_START() uint8_t sreg = SREG; cli()
+    #define UART_ATOMIC_END() SREG = sreg
+#else
+    typedef uint8_t uart_index_t;
+    #define UART_ATOMIC_START()
+    #define UART_ATOMIC_END()
+#endif
+
+/// FIFO input buffers
+static volatile char uart_inputBuf[UART_PORTS][UART_INPUT_BUFFER_SIZE];
 /// Index of the last character that has been read in the input buffer
-static volatile uint8_t uart_inputBuf0Read = 0;
+static volatile uart_index_t uart_inputBufRead[UART_PORTS];
 /// Index of the last charachter that has been written in the input buffer
-static volatile uint8_t uart_inputBuf0Write = 0;
+static volatile uart_index_t uart_inputBufWrite[UART_PORTS];
 
-/// FIFO output buffer
-static volatile char uart_outputBuf0[UART_OUTPUT_BUFFER_SIZE];
+/// FIFO output buffers
+static volatile char uart_outputBuf[UART_PORTS][UART_OUTPUT_BUFFER_SIZE];
 /// Index of the last character that has been read in the output buffer
-static volatile uint8_t uart_outputBuf0Read = 0;
+static volatile uint8_t uart_outputBufRead[UART_PORTS];
 /// Index of the last character that has been written in the output buffer
-static volatile uint8_t uart_outputBuf0Write = 0;
+static volatile uint8_t uart_outputBufWrite[UART_PORTS];
+
+#if TRACE
+/// Characters discarded by the current overflow (saturating), only used by
+/// the interrupt handlers
+static uint8_t uart_lost[UART_PORTS];
+#endif
 
-void uart_init(uint8_t pConfig, uint16_t pUbr) {
+void uart_init(uint8_t pPort, uint8_t pConfig, uint16_t pUbr) {
     // write baudrate config (high-byte has to be written first!)
-    UBRR0H = (uint8_t)(pUbr >> 8);
-    UBRR0L = (uint8_t)pUbr;
+    UART_UBRRH(pPort) = (uint8_t)(pUbr >> 8);
+    UART_UBRRL(pPort) = (uint8_t)pUbr;
 
     // configure port and activate interrupts
-    UCSR0B |= (1 << RXCIE0) | (1 << RXEN0) | (1 << TXEN0);
+    UART_UCSRB(pPort) |= (1 << RXCIE0) | (1 << RXEN0) | (1 << TXEN0);
 
     // write frame configuration
-    UCSR0C = pConfig;
+    UART_UCSRC(pPort) = pConfig;
+
+    TRACE_EVENT(TRACE_BAUD | pPort, pUbr);
 }
 
-void uart_changeBaud(uint16_t pUbr) {
+void uart_changeBaud(uint8_t pPort, uint16_t pUbr) {
 
     // we delay the baudrate change until the output buffer is empty
-    while (uart_outputBuf0Read != uart_outputBuf0Write) {
+    while (uart_outputBufRead[pPort] != uart_outputBufWrite[pPort]) {
         // wait, buffer contains some data
         LEDCODE_BLINK();
         _delay_ms(50);
     }
 
     // disable UART port
-    UCSR0B &=~((1 << RXEN0) | (1 << TXEN0));
+    UART_UCSRB(pPort) &=~((1 << RXEN0) | (1 << TXEN0));
 
     _delay_ms(100);
 
     // write new baudrate
-    UBRR0H = (uint8_t)(pUbr >> 8);
-    UBRR0L = (uint8_t)pUbr;
+    UART_UBRRH(pPort) = (uint8_t)(pUbr >> 8);
+    UART_UBRRL(pPort) = (uint8_t)pUbr;
 
     // re-enable UART port
-    UCSR0B |= (1 << RXCIE0) | (1 << RXEN0) | (1 << TXEN0);
+    UART_UCSRB(pPort) |= (1 << RXCIE0) | (1 << RXEN0) | (1 << TXEN0);
+
+    TRACE_EVENT(TRACE_BAUD | pPort, pUbr);
 }
 
-unsigned char uart_getChar() {
-    if (uart_inputBuf0Read != uart_inputBuf0Write) {
+unsigned char uart_getChar(uint8_t pPort) {
+    unsigned char result = '\0';
+    UART_ATOMIC_START();
+
+    if (uart_inputBufRead[pPort] != uart_inputBufWrite[pPort]) {
         // increment reading pointer while catching a possible array overflow
-        if (++uart_inputBuf0Read >= UART_INPUT_BUFFER_SIZE) {
-            uart_inputBuf0Read = 0;
+        uart_index_t read = uart_inputBufRead[pPort] + 1;
+        if (read >= UART_INPUT_BUFFER_SIZE) {
+            read = 0;
         }
 
-        return uart_inputBuf0[uart_inputBuf0Read];
-    } 
+        uart_inputBufRead[pPort] = read;
+        result = uart_inputBuf[pPort][read];
+    }
+
+    UART_ATOMIC_END();
+
+    // Only the first receiver is timed
+    if (pPort == UART_0) {
+        LATENCY_FETCHED(result);
+    }
 
-    return '\0';
+    return result;
 }
 
-uint8_t uart_hasData() {
-    return uart_inputBuf0Read != uart_inputBuf0Write;
+uint8_t uart_hasData(uint8_t pPort) {
+    UART_ATOMIC_START();
+    uint8_t result = uart_inputBufRead[pPort] != uart_inputBufWrite[pPort];
+    UART_ATOMIC_END();
+
+    return result;
 }
 
-uint8_t uart_getString(char* pResult, uint8_t pResultSize) {
+uint8_t uart_getString(uint8_t pPort, char* pResult, uint8_t pResultSize) {
     uint8_t currentChar = 0;
     while(currentChar < pResultSize) {
-        pResult[currentChar++] = uart_getChar();
-        if ((!uart_hasData()) || (pResult[currentChar - 1] == LF)) {
+        pResult[currentChar++] = uart_getChar(pPort);
+        if ((!uart_hasData(pPort)) || (pResult[currentChar - 1] == LF)) {
             break;
         }
     }
@@ -89,86 +154,138 @@ uint8_t uart_getString(char* pResult, uint8_t pResultSize) {
     return currentChar;
 }
 
-void uart_setChar(char pData) {
+void uart_setChar(uint8_t pPort, char pData) {
     // write byte into the output buffer, wait if the buffer is currently full
-    if (uart_outputBuf0Write+1 >= UART_OUTPUT_BUFFER_SIZE) {
-        // writing pointer is at the end of the buffer array, next index will be 0  
-        while (uart_outputBuf0Read == 0) {
-            // wait, buffer is full
-        }
-
-        uart_outputBuf0Write = 0;
-    } else {
-        while (uart_outputBuf0Write+1 == uart_outputBuf0Read) {
-            // wait, buffer is full
-        }
+    uint8_t write = uart_outputBufWrite[pPort] + 1;
+    if (write >= UART_OUTPUT_BUFFER_SIZE) {
+        // writing pointer is at the end of the buffer array, next index will be 0
+        write = 0;
+    }
 
-        uart_outputBuf0Write++;
+    while (write == uart_outputBufRead[pPort]) {
+        // wait, buffer is full
     }
 
-    // write character into buffer   
-    uart_outputBuf0[uart_outputBuf0Write] = pData;
+    // write character into buffer
+    uart_outputBuf[pPort][write] = pData;
+    uart_outputBufWrite[pPort] = write;
 
     // activate interrupt
-    UCSR0B |= (1 << UDRIE0); 
+    UART_UCSRB(pPort) |= (1 << UDRIE0);
 }
 
-void uart_setString(const char* pData) {
+void uart_setString(uint8_t pPort, const char* pData) {
     // simply call setChar for each character in the string
     uint8_t i = 0;
     while(pData[i]) {
-        uart_setChar(pData[i++]);
+        uart_setChar(pPort, pData[i++]);
+    }
+}
+
+uint8_t uart_outputFree(uint8_t pPort) {
+    // One slot stays empty in order to tell a full buffer from an empty one
+    uint8_t read = uart_outputBufRead[pPort];
+    uint8_t write = uart_outputBufWrite[pPort];
+
+    if (read > write) {
+        return read - write - 1;
     }
+
+    return UART_OUTPUT_BUFFER_SIZE - 1 - (write - read);
 }
 
-void uart_clearBuf() {
-    uart_inputBuf0Read = uart_inputBuf0Write;
+void uart_clearBuf(uint8_t pPort) {
+    UART_ATOMIC_START();
+    uart_inputBufRead[pPort] = uart_inputBufWrite[pPort];
+
+    if (pPort == UART_0) {
+        LATENCY_CLEARED();
+    }
+    UART_ATOMIC_END();
 }
 
 /**
- * \brief Interrupt handling for incoming UART-data
- * 
- * The method will write the incoming character directly into the input buffer.
- * If the buffer is full, characters may be discarded.
+ * \brief Writes an incoming character directly into the input buffer
+ *
+ * If the buffer is full, the character is discarded. Only inlined into the
+ * interrupt handlers, so the port is a constant there.
  */
-ISR(USART_RX_vect) {
-    if(uart_inputBuf0Write+1 >= UART_INPUT_BUFFER_SIZE) {
-            // writing pointer is at the end of the buffer array, next index will be 0
-            if(uart_inputBuf0Read != 0) {
-                uart_inputBuf0Write = 0;
-                uart_inputBuf0[uart_inputBuf0Write] = UDR0;
-                return;
-            }
-    } else {
-        if(uart_inputBuf0Write+1 != uart_inputBuf0Read) {
-            uart_inputBuf0[++uart_inputBuf0Write] = UDR0;
-            return;
-        }
+static inline void uart_receive(uint8_t pPort, char pData) {
+    uart_index_t write = uart_inputBufWrite[pPort] + 1;
+    if (write >= UART_INPUT_BUFFER_SIZE) {
+        // writing pointer is at the end of the buffer array, next index will be 0
+        write = 0;
     }
 
-    // if the method didn't return, it means that the buffer is full
-    // discard the byte in order to prevent a blocked UDR register
-    char garbage;
-    garbage = UDR0;
+    if (write != uart_inputBufRead[pPort]) {
+        uart_inputBuf[pPort][write] = pData;
+        uart_inputBufWrite[pPort] = write;
+
+        // Only the first receiver is timed
+        if (pPort == UART_0) {
+            LATENCY_RECEIVED(pData);
+        }
+
+#if TRACE
+        // The overflow is over, the event tells how much it has cost
+        if (uart_lost[pPort]) {
+            trace_add(TRACE_OVERFLOW | pPort, uart_lost[pPort]);
+            trace_request(TRACE_DUMP_OVERFLOW);
+            uart_lost[pPort] = 0;
+        }
+#endif
+    }
+#if TRACE
+    else if (uart_lost[pPort] != 0xFF) {
+        uart_lost[pPort]++;
+    }
+#endif
 }
 
 /**
- * \brief Interrupt handling for outgoing UART-data
+ * \brief Writes the next byte of the output buffer into the data register
  *
- * As long as there is data in the output buffer, the method will write the data
- * into the specific UART register. When the buffer is empty, the interrupt will
- * deactivate itself.
+ * When the buffer is empty, the interrupt will deactivate itself.
  */
-ISR(USART_UDRE_vect) {
+static inline void uart_transmit(uint8_t pPort) {
     // write next byte until reading index == writing index
-    if (uart_outputBuf0Read != uart_outputBuf0Write) {
-        if (++uart_outputBuf0Read >= UART_OUTPUT_BUFFER_SIZE) {
-            uart_outputBuf0Read = 0;
+    if (uart_outputBufRead[pPort] != uart_outputBufWrite[pPort]) {
+        uint8_t read = uart_outputBufRead[pPort] + 1;
+        if (read >= UART_OUTPUT_BUFFER_SIZE) {
+            read = 0;
         }
 
-        UDR0 = uart_outputBuf0[uart_outputBuf0Read];
+        uart_outputBufRead[pPort] = read;
+        UART_UDR(pPort) = uart_outputBuf[pPort][read];
     } else {
         // buffer empty, deactivate interrupt
-        UCSR0B &= ~(1 << UDRIE0);
+        UART_UCSRB(pPort) &= ~(1 << UDRIE0);
     }
 }
+
+/**
+ * \brief Interrupt handling for incoming UART-data
+ *
+ * The data register is always read in order to prevent a blocked UDR
+ * register, even if the byte has to be discarded.
+ */
+ISR(UART_RX0_vect) {
+    uart_receive(UART_0, UDR0);
+}
+
+/**
+ * \brief Interrupt handling for outgoing UART-data
+ */
+ISR(UART_UDRE0_vect) {
+    uart_transmit(UART_0);
+}
+
+#if UART_PORTS > 1
+ISR(USART1_RX_vect) {
+    uart_receive(UART_1, UDR1);
+}
+
+ISR(USART1_UDRE_vect) {
+    uart_transmit(UART_1);
+}
+#endif
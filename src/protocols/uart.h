@@ -28,8 +28,20 @@
     #define UART_0 0
     #define UART_1 1
 
-    /// Size of the input buffer in bytes
-    #define UART_INPUT_BUFFER_SIZE 128
+    /// Number of USARTs in use (2 requires a dual-USART MCU, e.g. ATmega644P)
+    #ifndef UART_PORTS
+        #define UART_PORTS 1
+    #endif
+
+    #if (UART_PORTS > 1) && defined(__AVR__) && !defined(UDR1)
+        #error "UART_PORTS > 1 requires an MCU with two USARTs"
+    #endif
+
+    /// Size of the input buffer in bytes (per port, scaled with the SRAM of
+    /// the MCU by the Makefile)
+    #ifndef UART_INPUT_BUFFER_SIZE
+        #define UART_INPUT_BUFFER_SIZE 128
+    #endif
     
     /// Size of the output buffer in bytes
     #define UART_OUTPUT_BUFFER_SIZE 32
@@ -41,28 +53,31 @@
     #define UART_CALCULATE_BAUD(pFrequency, pBaudrate) (pFrequency / (16 * pBaudrate)) - 1
 
     /// Macro for sending a "new line"-sequence
-    #define UART_NEWLINE() uart_setChar(CR); uart_setChar(LF);
+    #define UART_NEWLINE(pPort) uart_setChar(pPort, CR); uart_setChar(pPort, LF);
 
     /**
      * \brief Initializes the UART-port
      * 
+     * \param pPort The port (UART_0 or UART_1)
      * \param pConfig The UART configuration byte
      * \param pUbr A 16-bit integer containing the baudrate configuration value
      */
-    void uart_init(uint8_t pConfig, uint16_t pUbr);
+    void uart_init(uint8_t pPort, uint8_t pConfig, uint16_t pUbr);
 
     /**
      * \brief Reinitializes the UART-port with a new Baudrate
      *
+     * \param pPort The port (UART_0 or UART_1)
      * \param pUbr A 16-bit integer containing the new baudrate configuration value
      */
-    void uart_changeBaud(uint16_t pUbr);
+    void uart_changeBaud(uint8_t pPort, uint16_t pUbr);
 
     /**
      * \brief Takes a character from the input buffer and returns it (FIFO).
+     * \param pPort The port (UART_0 or UART_1)
      * \return The first not yet processed byte
      */
-    unsigned char uart_getChar();
+    unsigned char uart_getChar(uint8_t pPort);
 
     /**
      * \brief Takes a string from the input buffer and writes it into pResult.
@@ -71,11 +86,12 @@
      * a NULL-byte is encountered before. Then the string will be terminated at
      * this point.
      * 
+     * \param pPort The port (UART_0 or UART_1)
      * \param pResult A pointer to the output array
      * \param pResultSize An integer containing the size of the output array
      * \return The count of actually returned characters
      */
-    uint8_t uart_getString(char* pResult, uint8_t pResultSize);
+    uint8_t uart_getString(uint8_t pPort, char* pResult, uint8_t pResultSize);
 
     /**
      * \brief Checks if there is unprocessed data in the input buffer.
@@ -83,25 +99,40 @@
      * This method can be used in order to prevent a blockage of the cpu
      * when trying to read from an empty input buffer.
      * 
+     * \param pPort The port (UART_0 or UART_1)
      * \return TRUE if data is available, otherwise FALSE
      */
-    uint8_t uart_hasData();
+    uint8_t uart_hasData(uint8_t pPort);
 
     /**
      * \brief Sends a character.
+     * \param pPort The port (UART_0 or UART_1)
      * \param pData The character which shall be sent
      */
-    void uart_setChar(char pData);
+    void uart_setChar(uint8_t pPort, char pData);
 
     /**
      * \brief Sends a string.
+     * \param pPort The port (UART_0 or UART_1)
      * \param pData A pointer to a NULL-terminated character-array with data
      * which shall be sent
      */
-    void uart_setString(const char* pData);
+    void uart_setString(uint8_t pPort, const char* pData);
+
+    /**
+     * \brief Returns the free space of the output buffer
+     *
+     * As many characters can be passed to uart_setChar without waiting (the
+     * interrupt only frees space, it doesn't take any).
+     *
+     * \param pPort The port (UART_0 or UART_1)
+     * \return The number of characters which fit into the output buffer
+     */
+    uint8_t uart_outputFree(uint8_t pPort);
 
     /**
      * \brief Empties the input buffer, discarding everything inside.
+     * \param pPort The port (UART_0 or UART_1)
      */ 
-    void uart_clearBuf();
+    void uart_clearBuf(uint8_t pPort);
 #endif
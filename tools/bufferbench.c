@@ -0,0 +1,351 @@
+/**
+ * \file bufferbench.c
+ * \brief Host tool which determines the UART ring and sector buffering the
+ * logger needs with a given memory card latency
+ * \author Martin Matysiak
+ *
+ * Usage: bufferbench [-p profile]... [-f hz,hz,...] [-b bytes] [-d divider]
+ *     capture.nmea
+ *
+ * The valid sentences of the capture are written through the firmware's
+ * NoFS code onto a simulated memory card with the given latency profiles
+ * (see sdmmc_host.h), which yields the time the main loop is blocked by each
+ * sentence: the SPI transfers at F_CPU / divider (default: SDMMC_SPEED) and
+ * the delays of the firmware, which keep the CPU busy, and the latency of
+ * the card. The capture is then replayed at every update rate: each epoch
+ * (starting with the type of the first sentence) is sent by the GPS-module
+ * at the beginning of its period, at the baudrate gps_init uses for the
+ * rate. While the main loop is blocked, the received bytes pile up in the
+ * UART ring.
+ *
+ * With one sector buffer (the firmware as it is), the main loop waits for
+ * every write. With n buffers, n - 1 sectors can be in flight while the
+ * next one is filled: the main loop still clocks every sector out (the
+ * transfers are charged to it when the sector is handed over), but only
+ * waits for the latency of the card if all buffers are busy.
+ * For each profile and rate, the report gives the ring size needed for zero
+ * drops with 1 to 4 sector buffers, and the number of sector buffers needed
+ * with a ring of the given size in bytes (default: UART_INPUT_BUFFER_SIZE).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdmmc_host.h"
+#include "modules/gps.h"
+#include "protocols/uart.h"
+
+/// Maximum number of profiles and rates
+#define MAX_ENTRIES 16
+
+/// Largest number of sector buffers which is tried
+#define MAX_BUFFERS 16
+
+/// The profiles used if none is given
+static const char* fDefaultProfiles[] = {"none", "fixed:2", "random:1,20", "gc:2,100,64", "gc:2,250,32"};
+
+/// A sentence of the capture
+typedef struct {
+    size_t length;
+    /// Index of the epoch the sentence belongs to
+    size_t epoch;
+    /// Bytes of the capture before this sentence
+    size_t offset;
+    int valid;
+    /// Time the main loop is blocked by writing the sentence (ms)
+    double block;
+    /// Part of it the card is busy on its own (latency)
+    double busy;
+} sentence_t;
+
+static sentence_t* fSentences = NULL;
+static size_t fCount = 0;
+static char* fText = NULL;
+
+/**
+ * \brief Reads the sentences of a capture (with CR LF like the GPS-module)
+ */
+static void load(const char* pPath) {
+    FILE* file = fopen(pPath, "r");
+    if (!file) {
+        perror(pPath);
+        exit(1);
+    }
+
+    size_t capacity = 1024, textCapacity = 1 << 20, textLength = 0;
+    char line[256], first[7] = "";
+
+    fSentences = malloc(capacity * sizeof(sentence_t));
+    fText = malloc(textCapacity);
+
+    while (fgets(line, sizeof(line), file)) {
+        char* start = strchr(line, '$');
+        if (!start) {
+            continue;
+        }
+
+        size_t length = strcspn(start, "\r\n");
+        if (fCount == capacity) {
+            capacity *= 2;
+            fSentences = realloc(fSentences, capacity * sizeof(sentence_t));
+        }
+        if (textLength + length + 3 > textCapacity) {
+            textCapacity *= 2;
+            fText = realloc(fText, textCapacity);
+        }
+
+        sentence_t* sentence = &fSentences[fCount];
+        memcpy(fText + textLength, start, length);
+        memcpy(fText + textLength + length, "\r\n", 3);
+
+        // Epochs start with the type of the first sentence
+        if (fCount == 0) {
+            snprintf(first, sizeof(first), "%.6s", start);
+        }
+        sentence->epoch = (fCount == 0) ? 0 : fSentences[fCount - 1].epoch
+            + (strncmp(start, first, 6) == 0);
+        sentence->offset = textLength;
+        sentence->length = length + 2;
+        sentence->valid = gps_classifyNMEA(fText + textLength) & GPS_NMEA_VALID;
+
+        textLength += length + 3;
+        fCount++;
+    }
+
+    fclose(file);
+}
+
+/**
+ * \brief Writes the capture onto a card with the given profile and records
+ * the time the main loop is blocked by each sentence
+ * \return The longest block in ms, or -1 if the profile is invalid
+ */
+static double record(const char* pProfile, size_t pBytes) {
+    sdmmchost_create(pBytes / NOFS_BUFFER_SIZE * 2 + 16 + NOFS_INDEX_SECTORS);
+    if (sdmmchost_setLatency(pProfile) != 0) {
+        return -1;
+    }
+    nofs_init();
+
+    double longest = 0;
+    for (size_t i = 0; i < fCount; i++) {
+        unsigned long writes;
+        double start = hostDelayed();
+        double busy = sdmmchost_busy(&writes);
+
+        // Invalid sentences are dropped by the main loop
+        if (fSentences[i].valid) {
+            nofs_writeString(fText + fSentences[i].offset);
+        }
+
+        fSentences[i].block = hostDelayed() - start;
+        fSentences[i].busy = sdmmchost_busy(&writes) - busy;
+        if (fSentences[i].block > longest) {
+            longest = fSentences[i].block;
+        }
+    }
+
+    return longest;
+}
+
+/**
+ * \brief Replays the capture at an update rate
+ *
+ * \param pFrequency The update rate in Hz
+ * \param pBuffers The number of sector buffers
+ * \return The largest number of bytes waiting in the UART ring, or -1 if
+ * the baudrate is too low for the data of an epoch
+ */
+static long replay(int pFrequency, int pBuffers) {
+    double baudrate = (pFrequency >= 4) ? GPS_BAUDRATE_HIGHSPEED : GPS_BAUDRATE;
+    double byteTime = 10000.0 / baudrate;
+    double period = 1000.0 / pFrequency;
+
+    // Time at which the last byte of each sentence has been received
+    double* starts = malloc(fCount * sizeof(double));
+    double* ends = malloc(fCount * sizeof(double));
+    double line = 0;
+
+    for (size_t i = 0; i < fCount; i++) {
+        double epochStart = fSentences[i].epoch * period;
+
+        // The module has to finish an epoch before the next one begins
+        if (line > epochStart + period) {
+            free(starts);
+            free(ends);
+            return -1;
+        }
+
+        starts[i] = (line > epochStart) ? line : epochStart;
+        ends[i] = starts[i] + fSentences[i].length * byteTime;
+        line = ends[i];
+    }
+
+    // Finishing times of the sectors in flight (oldest first)
+    double* flight = malloc(MAX_BUFFERS * sizeof(double));
+    int inFlight = 0;
+    double cardFree = 0, main = 0;
+    size_t received = 0, consumed = 0, arriving = 0;
+    long peak = 0;
+
+    for (size_t i = 0; i < fCount; i++) {
+        // Bytes which have arrived while the main loop was busy
+        while ((arriving < fCount) && (ends[arriving] <= main)) {
+            received += fSentences[arriving++].length;
+        }
+        long waiting = received - consumed;
+        if ((arriving < fCount) && (main > starts[arriving])) {
+            waiting += (long)((main - starts[arriving]) / byteTime);
+        }
+        if (waiting > peak) {
+            peak = waiting;
+        }
+
+        // Received while waiting, the sentence is read as it arrives
+        if (ends[i] > main) {
+            main = ends[i];
+        }
+        consumed += fSentences[i].length;
+
+        double block = fSentences[i].block;
+        if (block <= 0) {
+            continue;
+        }
+
+        if (pBuffers == 1) {
+            main += block;
+            continue;
+        }
+
+        while ((inFlight > 0) && (flight[0] <= main)) {
+            memmove(flight, flight + 1, --inFlight * sizeof(double));
+        }
+
+        // All buffers busy: wait for the oldest sector
+        if (inFlight == pBuffers - 1) {
+            main = flight[0];
+            memmove(flight, flight + 1, --inFlight * sizeof(double));
+        }
+
+        // The CPU clocks the sector out, the card programs it on its own
+        main += block - fSentences[i].busy;
+        cardFree = ((cardFree > main) ? cardFree : main) + fSentences[i].busy;
+        flight[inFlight++] = cardFree;
+    }
+
+    free(flight);
+    free(starts);
+    free(ends);
+    return peak;
+}
+
+/**
+ * \brief Splits a comma separated list of numbers
+ * \return The number of values
+ */
+static int parseList(const char* pList, int* pValues) {
+    int count = 0;
+
+    while (*pList && (count < MAX_ENTRIES)) {
+        pValues[count++] = atoi(pList);
+        pList += strcspn(pList, ",");
+        pList += (*pList == ',');
+    }
+
+    return count;
+}
+
+int main(int argc, char** argv) {
+    const char* profiles[MAX_ENTRIES];
+    int profileCount = 0;
+    int frequencies[MAX_ENTRIES] = {1, 2, 4, 8, 10};
+    int frequencyCount = 5;
+    long ring = UART_INPUT_BUFFER_SIZE - 1;
+    int argument = 1;
+
+    for (; (argument < argc - 2) && (argv[argument][0] == '-'); argument += 2) {
+        if ((strcmp(argv[argument], "-p") == 0) && (profileCount < MAX_ENTRIES)) {
+            profiles[profileCount++] = argv[argument + 1];
+        } else if (strcmp(argv[argument], "-f") == 0) {
+            frequencyCount = parseList(argv[argument + 1], frequencies);
+        } else if (strcmp(argv[argument], "-b") == 0) {
+            ring = atol(argv[argument + 1]) - 1;
+        } else if (strcmp(argv[argument], "-d") == 0) {
+            int divider = atoi(argv[argument + 1]);
+            uint8_t speed = SPI_SPEED_2;
+            while ((speed < SPI_SPEED_128) && (SPI_DIVIDER(speed) < divider)) {
+                speed++;
+            }
+            sdmmchost_setSpeed(speed);
+        } else {
+            break;
+        }
+    }
+
+    if ((argument != argc - 1) || (frequencyCount == 0)) {
+        fprintf(stderr, "usage: %s [-p profile]... [-f hz,hz,...] [-b bytes] [-d divider] capture.nmea\n",
+            argv[0]);
+        return 1;
+    }
+
+    if (profileCount == 0) {
+        profileCount = sizeof(fDefaultProfiles) / sizeof(fDefaultProfiles[0]);
+        memcpy(profiles, fDefaultProfiles, sizeof(fDefaultProfiles));
+    }
+
+    load(argv[argument]);
+    if (fCount == 0) {
+        fprintf(stderr, "%s: no sentences\n", argv[argument]);
+        return 1;
+    }
+
+    size_t bytes = fSentences[fCount - 1].offset + fSentences[fCount - 1].length;
+    double epochBytes = (double)bytes / (fSentences[fCount - 1].epoch + 1);
+
+    printf("%-24s %8s %4s %7s %7s %7s %7s %7s %9s\n", "profile", "max ms", "Hz", "B/s",
+        "ring@1", "ring@2", "ring@3", "ring@4", "buffers");
+
+    for (int p = 0; p < profileCount; p++) {
+        double longest = record(profiles[p], bytes);
+        if (longest < 0) {
+            return 1;
+        }
+
+        for (int f = 0; f < frequencyCount; f++) {
+            printf("%-24s %8.1f %4d %7.0f", profiles[p], longest, frequencies[f],
+                epochBytes * frequencies[f]);
+
+            long needed[MAX_BUFFERS + 1];
+            int buffers = 0;
+            for (int n = 1; n <= MAX_BUFFERS; n++) {
+                needed[n] = replay(frequencies[f], n);
+                if (!buffers && (needed[n] >= 0) && (needed[n] <= ring)) {
+                    buffers = n;
+                }
+            }
+
+            // The ring needs one more byte than it holds (see uart.c)
+            for (int n = 1; n <= 4; n++) {
+                if (needed[n] < 0) {
+                    printf(" %7s", "baud");
+                } else {
+                    printf(" %7ld", needed[n] + 1);
+                }
+            }
+
+            if (buffers) {
+                printf(" %9d\n", buffers);
+            } else {
+                printf(" %9s\n", needed[1] < 0 ? "-" : ">16");
+            }
+        }
+    }
+
+    printf("\nring@n: UART ring size (bytes) for zero drops with n sector buffers\n");
+    printf("buffers: sector buffers needed with a ring of %ld bytes\n", ring + 1);
+
+    free(fSentences);
+    free(fText);
+    return 0;
+}
@@ -0,0 +1,320 @@
+/**
+ * \file commitbench.c
+ * \brief Host tool which compares the commit policies of the NoFS by the
+ * sector writes they cost and the data they risk
+ * \author Martin Matysiak
+ *
+ * Usage: commitbench [-p policy]... [-f hz,hz,...] capture.nmea
+ *
+ * The valid sentences of the capture are written through the firmware's
+ * NoFS code onto a simulated memory card, once per policy and update rate.
+ * A policy is "none" (full sectors only) or a comma separated list of
+ * "age:seconds" (COMMIT_AGE of gLogger.c) and "bytes:count"
+ * (NOFS_COMMIT_BYTES, applied behind every sentence like nofs_writeString
+ * does). The age is advanced by nofs_age like the main loop does: behind
+ * every sentence and at every overflow of Timer0 while the receivers are
+ * silent.
+ *
+ * The update rates may be fractions of a Hertz. The default ones are 1 Hz
+ * and a sparse 0.05 Hz (a fix every 20 seconds, e.g. a receiver which
+ * sends its fixes at a low rate or has lost them for a while), where the
+ * age has to advance between the sentences.
+ *
+ * The report gives the sector writes of the data (see nofs_takeWrites): full
+ * sectors, terminal sectors and partial commits, the write amplification
+ * (all writes per full sector), the writes per minute and the longest time
+ * data has been kept in the sector buffer only, i.e. the data a power cut
+ * may destroy.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdmmc_host.h"
+#include "modules/gps.h"
+#include "modules/trace.h"
+
+/// Maximum number of policies and rates
+#define MAX_ENTRIES 16
+
+/// Ticks of the timebase between two wake-ups of the main loop by Timer0
+#define OVERFLOW_TICKS 256
+
+/// The policies used if none is given
+static const char* fDefaultPolicies[] = {"none", "age:5", "age:30", "age:120", "bytes:128", "bytes:256"};
+
+/// The update rates used if none are given
+static const double fDefaultFrequencies[] = {1, 0.05};
+
+/// A sentence of the capture
+typedef struct {
+    /// Index of the epoch the sentence belongs to
+    size_t epoch;
+    /// Bytes of the capture before this sentence
+    size_t offset;
+    int valid;
+} sentence_t;
+
+static sentence_t* fSentences = NULL;
+static size_t fCount = 0;
+static char* fText = NULL;
+static size_t fBytes = 0;
+
+/**
+ * \brief Reads the sentences of a capture (with CR LF like the GPS-module)
+ */
+static void load(const char* pPath) {
+    FILE* file = fopen(pPath, "r");
+    if (!file) {
+        perror(pPath);
+        exit(1);
+    }
+
+    size_t capacity = 1024, textCapacity = 1 << 20;
+    char line[256], first[7] = "";
+
+    fSentences = malloc(capacity * sizeof(sentence_t));
+    fText = malloc(textCapacity);
+
+    while (fgets(line, sizeof(line), file)) {
+        char* start = strchr(line, '$');
+        if (!start) {
+            continue;
+        }
+
+        size_t length = strcspn(start, "\r\n");
+        if (fCount == capacity) {
+            capacity *= 2;
+            fSentences = realloc(fSentences, capacity * sizeof(sentence_t));
+        }
+        if (fBytes + length + 3 > textCapacity) {
+            textCapacity *= 2;
+            fText = realloc(fText, textCapacity);
+        }
+
+        sentence_t* sentence = &fSentences[fCount];
+        memcpy(fText + fBytes, start, length);
+        memcpy(fText + fBytes + length, "\r\n", 3);
+
+        // Epochs start with the type of the first sentence
+        if (fCount == 0) {
+            snprintf(first, sizeof(first), "%.6s", start);
+        }
+        sentence->epoch = (fCount == 0) ? 0 : fSentences[fCount - 1].epoch
+            + (strncmp(start, first, 6) == 0);
+        sentence->offset = fBytes;
+        sentence->valid = gps_classifyNMEA(fText + fBytes) & GPS_NMEA_VALID;
+
+        fBytes += length + 3;
+        fCount++;
+    }
+
+    fclose(file);
+}
+
+/**
+ * \brief Splits a comma separated list of numbers
+ * \return The number of values, -1 if a value isn't positive
+ */
+static int parseList(const char* pList, double* pValues) {
+    int count = 0;
+
+    while (*pList && (count < MAX_ENTRIES)) {
+        pValues[count] = atof(pList);
+        if (pValues[count++] <= 0) {
+            return -1;
+        }
+        pList += strcspn(pList, ",");
+        pList += (*pList == ',');
+    }
+
+    return count;
+}
+
+/**
+ * \brief Reads a policy
+ * \return 0 on success, -1 if the policy is invalid
+ */
+static int parsePolicy(const char* pPolicy, int* pAge, int* pBytes) {
+    *pAge = 0;
+    *pBytes = 0;
+
+    if (strcmp(pPolicy, "none") == 0) {
+        return 0;
+    }
+
+    while (*pPolicy) {
+        int value;
+        if (sscanf(pPolicy, "age:%d", &value) == 1) {
+            *pAge = value;
+        } else if (sscanf(pPolicy, "bytes:%d", &value) == 1) {
+            *pBytes = value;
+        } else {
+            fprintf(stderr, "invalid policy: %s\n", pPolicy);
+            return -1;
+        }
+
+        pPolicy += strcspn(pPolicy, ",");
+        pPolicy += (*pPolicy == ',');
+    }
+
+    return 0;
+}
+
+/**
+ * \brief Adds up the sector writes since the last call
+ * \return The number of all writes
+ */
+static unsigned long takeWrites(unsigned long* pWrites) {
+    unsigned long all = 0;
+
+    for (uint8_t i = 0; i < NOFS_WRITE_KINDS; i++) {
+        unsigned long writes = nofs_takeWrites(i);
+        pWrites[i] += writes;
+        all += writes;
+    }
+
+    return all;
+}
+
+/// Arrival time (in ticks) of the oldest data which is only kept in the
+/// sector buffer, -1 if there is none
+static double fOldest;
+/// Longest time (in ticks) data has been kept in the sector buffer only
+static double fExposure;
+
+/**
+ * \brief Updates the exposure of the buffered data after the policy has run
+ * \param pNow The current time in ticks
+ * \param pWrites Receives the sector writes since the last call
+ */
+static void observe(double pNow, unsigned long* pWrites) {
+    if ((fOldest >= 0) && (pNow - fOldest > fExposure)) {
+        fExposure = pNow - fOldest;
+    }
+
+    // The data left behind a write has arrived right now
+    if (takeWrites(pWrites)) {
+        fOldest = nofs_uncommitted() ? pNow : -1;
+    } else if (nofs_uncommitted() && (fOldest < 0)) {
+        fOldest = pNow;
+    }
+}
+
+/**
+ * \brief Writes the capture with a policy at an update rate and prints the
+ * line of the report
+ */
+static void run(const char* pPolicy, int pAge, int pBytes, double pFrequency) {
+    sdmmchost_create(fBytes / NOFS_BUFFER_SIZE * 2 + 16 + NOFS_INDEX_SECTORS);
+    nofs_init();
+
+    // The writes of the initialization are not part of the policy
+    unsigned long writes[NOFS_WRITE_KINDS] = {0};
+    takeWrites(writes);
+    memset(writes, 0, sizeof(writes));
+
+    // COMMIT_TICKS of gLogger.c
+    double epochs = fSentences[fCount - 1].epoch + 1;
+    uint32_t limit = pAge * (uint32_t)TRACE_TICKS_PER_SECOND;
+    double time = 0;
+    fOldest = -1;
+    fExposure = 0;
+
+    for (size_t i = 0; i < fCount; i++) {
+        double now = fSentences[i].epoch * TRACE_TICKS_PER_SECOND / pFrequency;
+
+        // The main loop is woken up by Timer0 while it waits for the sentence
+        while (pAge && (time + OVERFLOW_TICKS <= now)) {
+            time += OVERFLOW_TICKS;
+            nofs_age(OVERFLOW_TICKS, limit);
+            observe(time, writes);
+        }
+
+        // Invalid sentences are dropped by the main loop
+        if (fSentences[i].valid) {
+            nofs_writeString(fText + fSentences[i].offset);
+        }
+
+        if (pBytes && (nofs_uncommitted() >= pBytes)) {
+            nofs_commit(NOFS_WRITE_SIZE);
+        }
+
+        if (pAge) {
+            nofs_age((uint16_t)(now - time), limit);
+        }
+
+        time = now;
+        observe(now, writes);
+    }
+
+    unsigned long all = 0;
+    for (uint8_t i = 0; i < NOFS_WRITE_KINDS; i++) {
+        all += writes[i];
+    }
+
+    unsigned long partial = writes[NOFS_WRITE_AGE] + writes[NOFS_WRITE_SIZE];
+    printf("%-20s %6.2f %8lu %8lu %8lu %8.2f %8.2f %9.1f\n", pPolicy, pFrequency,
+        writes[NOFS_WRITE_FULL], writes[NOFS_WRITE_TERMINAL], partial,
+        writes[NOFS_WRITE_FULL] ? (double)all / writes[NOFS_WRITE_FULL] : 0.0,
+        60.0 * all * pFrequency / epochs, fExposure / TRACE_TICKS_PER_SECOND);
+}
+
+int main(int argc, char** argv) {
+    const char* policies[MAX_ENTRIES];
+    int policyCount = 0;
+    double frequencies[MAX_ENTRIES];
+    int frequencyCount = sizeof(fDefaultFrequencies) / sizeof(fDefaultFrequencies[0]);
+    memcpy(frequencies, fDefaultFrequencies, sizeof(fDefaultFrequencies));
+    int argument = 1;
+
+    for (; (argument < argc - 2) && (argv[argument][0] == '-'); argument += 2) {
+        if ((strcmp(argv[argument], "-p") == 0) && (policyCount < MAX_ENTRIES)) {
+            policies[policyCount++] = argv[argument + 1];
+        } else if (strcmp(argv[argument], "-f") == 0) {
+            frequencyCount = parseList(argv[argument + 1], frequencies);
+        } else {
+            break;
+        }
+    }
+
+    if ((argument != argc - 1) || (frequencyCount <= 0)) {
+        fprintf(stderr, "usage: %s [-p policy]... [-f hz,hz,...] capture.nmea\n", argv[0]);
+        return 1;
+    }
+
+    if (policyCount == 0) {
+        policyCount = sizeof(fDefaultPolicies) / sizeof(fDefaultPolicies[0]);
+        memcpy(policies, fDefaultPolicies, sizeof(fDefaultPolicies));
+    }
+
+    int ages[MAX_ENTRIES], bytes[MAX_ENTRIES];
+    for (int p = 0; p < policyCount; p++) {
+        if (parsePolicy(policies[p], &ages[p], &bytes[p]) != 0) {
+            return 1;
+        }
+    }
+
+    load(argv[argument]);
+    if (fCount == 0) {
+        fprintf(stderr, "%s: no sentences\n", argv[argument]);
+        return 1;
+    }
+
+    printf("%-20s %6s %8s %8s %8s %8s %8s %9s\n", "policy", "Hz", "full", "terminal",
+        "partial", "amplif.", "per min", "exposed s");
+
+    for (int f = 0; f < frequencyCount; f++) {
+        for (int p = 0; p < policyCount; p++) {
+            run(policies[p], ages[p], bytes[p], frequencies[f]);
+        }
+    }
+
+    printf("\nfull, terminal, partial: sector writes of the data (see nofs_takeWrites)\n");
+    printf("amplif.: write amplification (sector writes per full sector)\n");
+    printf("per min: sector writes per minute of the capture\n");
+    printf("exposed s: longest time data has only been kept in the sector buffer\n");
+
+    return 0;
+}
@@ -0,0 +1,195 @@
+/**
+ * \file compressbench.c
+ * \brief Host tool which measures compression ratio and speed of the NoFS
+ * compression (see modules/compress.h) over recorded NMEA captures
+ * \author Martin Matysiak
+ *
+ * Usage: compressbench [-r sentences] [-o image] capture.nmea ...
+ *
+ * The capture is written through the firmware's NoFS code (compiled with
+ * NOFS_COMPRESSION) onto a simulated memory card. Afterwards the card is
+ * decoded again and compared with the input. With -r, the logger is
+ * restarted every given number of sentences in order to exercise the
+ * continuation inside a partially written sector.
+ *
+ * The encoding speed is the one of the host. It tells nothing about the
+ * cycles the AVR needs per byte, the last column only gives the data rate
+ * the compressor would have to sustain at BENCH_FREQUENCY.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nofsimage.h"
+#include "sdmmc_host.h"
+#include "modules/nmea.h"
+
+/// Update rate for which the required throughput is reported
+#define BENCH_FREQUENCY 10
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/**
+ * \brief Reads the sentences of a capture into a single string
+ * \return The number of sentences, the text is returned through pText
+ */
+static size_t load(const char* pPath, char** pText, size_t* pLength, size_t* pEpochs) {
+    FILE* file = fopen(pPath, "r");
+    if (!file) {
+        perror(pPath);
+        exit(1);
+    }
+
+    size_t capacity = 1 << 20, count = 0;
+    char line[256];
+
+    *pText = malloc(capacity);
+    *pLength = 0;
+    *pEpochs = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+        char* start = strchr(line, '$');
+        if (!start) {
+            continue;
+        }
+
+        // The firmware writes complete lines including CR LF
+        size_t length = strcspn(start, "\r\n");
+        if (*pLength + length + 3 > capacity) {
+            capacity *= 2;
+            *pText = realloc(*pText, capacity);
+        }
+
+        memcpy(*pText + *pLength, start, length);
+        memcpy(*pText + *pLength + length, "\r\n", 3);
+        *pLength += length + 2;
+        count++;
+
+        if (strncmp(start, "$GPGGA", 6) == 0) {
+            (*pEpochs)++;
+        }
+    }
+
+    fclose(file);
+    return count;
+}
+
+int main(int argc, char** argv) {
+    size_t restart = 0;
+    const char* output = NULL;
+    int argument = 1;
+
+    for (; (argument < argc - 1) && (argv[argument][0] == '-'); argument += 2) {
+        if (strcmp(argv[argument], "-r") == 0) {
+            restart = atol(argv[argument + 1]);
+        } else if (strcmp(argv[argument], "-o") == 0) {
+            output = argv[argument + 1];
+        } else {
+            break;
+        }
+    }
+
+    if (argument >= argc) {
+        fprintf(stderr, "usage: %s [-r sentences] [-o image] capture.nmea ...\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-24s %10s %10s %7s %9s %9s %10s\n", "capture", "bytes", "stored",
+        "ratio", "enc ns/B", "dec MB/s", "B/s@10Hz");
+
+    for (; argument < argc; argument++) {
+        char* text;
+        size_t length, epochs;
+        size_t sentences = load(argv[argument], &text, &length, &epochs);
+
+        sdmmchost_create(length / NOFS_BUFFER_SIZE * 2 + 16 + NOFS_INDEX_SECTORS);
+        nofs_init();
+
+        // Write every sentence the same way the main loop does
+        double start = now();
+        char* sentence = text;
+        for (size_t i = 0; i < sentences; i++) {
+            char* end = strchr(sentence, '\n') + 1;
+            char next = *end;
+            *end = '\0';
+
+            if (restart && (i % restart == restart - 1)) {
+                // Power loss: the partial sector has to be on the card
+                nofs_flush();
+                nofs_init();
+            }
+
+            if ((strncmp(sentence, "$GPGGA", 6) == 0) || (strncmp(sentence, "$GPRMC", 6) == 0)
+                || (strncmp(sentence, "$GPZDA", 6) == 0)) {
+                nofs_setTime(nmea_parseTime(nmea_getToken(sentence, 1)));
+            }
+
+            if ((strncmp(sentence, "$GPRMC", 6) == 0) || (strncmp(sentence, "$GPZDA", 6) == 0)) {
+                nofs_setDateTime(nmea_parseDateTime(sentence));
+            }
+
+            nofs_writeString(sentence);
+            *end = next;
+            sentence = end;
+        }
+        nofs_flush();
+        double encode = now() - start;
+
+        char path[] = "/tmp/compressbenchXXXXXX";
+        int fd = mkstemp(path);
+        close(fd);
+        sdmmchost_save(output ? output : path);
+
+        // Decode the card again
+        nofsimage_t image;
+        if (nofsimage_open(&image, output ? output : path) != 0) {
+            return 1;
+        }
+
+        uint64_t first = nofsimage_firstSector(&image);
+        uint64_t last = nofsimage_lastSector(&image);
+        char* decoded = malloc((last - first + 1) * NOFSIMAGE_MAX_DECODED);
+        size_t decodedLength = 0;
+
+        start = now();
+        for (uint64_t i = first; i <= last; i++) {
+            decodedLength += nofsimage_decodeSector(&image, i, decoded + decodedLength);
+        }
+        double decode = now() - start;
+
+        // The stored size includes the unused part of the last sector
+        size_t stored = nofsimage_dataStart(&image, last);
+        const uint8_t* lastSector = nofsimage_sector(&image, last);
+        while ((stored < NOFS_BUFFER_SIZE) && (lastSector[stored] != NOFS_TERMINAL)) {
+            stored++;
+        }
+        stored += (last - first) * NOFS_BUFFER_SIZE - (first == 0 ? NOFS_DATA_START : 0);
+
+        if ((decodedLength != length) || (memcmp(decoded, text, length) != 0)) {
+            fprintf(stderr, "%s: decoded data differs from input\n", argv[argument]);
+            return 1;
+        }
+
+        printf("%-24s %10zu %10zu %6.2fx %9.1f %9.1f %10.0f\n", argv[argument],
+            length, stored, (double)length / stored, encode * 1e9 / length,
+            length / decode / 1e6,
+            epochs ? (double)length / epochs * BENCH_FREQUENCY : 0.0);
+
+        nofsimage_close(&image);
+        unlink(path);
+        free(decoded);
+        free(text);
+    }
+
+    printf("\nenc ns/B: host time per input byte, not a measure of the AVR\n");
+    printf("B/s@%uHz: input the compressor has to take at %u Hz\n", BENCH_FREQUENCY, BENCH_FREQUENCY);
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+/**
+ * \file eeprom_host.c
+ * \brief Host model of the EEPROM functions of avr-libc used by warmstart.c
+ * \author Martin Matysiak
+ */
+
+#include <string.h>
+
+#include "global.h"
+
+/// Simulated time at which the byte being programmed is done
+static double fBusyUntil = 0;
+static eepromhost_stats_t fStats;
+
+/**
+ * \brief Waits until the EEPROM is ready
+ */
+static void eepromhost_wait() {
+    double wait = fBusyUntil - hostDelayed();
+
+    if (wait > 0) {
+        hostDelay(wait);
+        fStats.waited += wait;
+    }
+}
+
+uint8_t eeprom_is_ready() {
+    return hostDelayed() >= fBusyUntil;
+}
+
+uint8_t eeprom_read_byte(const uint8_t* pAddress) {
+    eepromhost_wait();
+    return *pAddress;
+}
+
+void eeprom_read_block(void* pDestination, const void* pSource, size_t pLength) {
+    eepromhost_wait();
+    memcpy(pDestination, pSource, pLength);
+}
+
+void eeprom_write_byte(uint8_t* pAddress, uint8_t pValue) {
+    eepromhost_wait();
+    *pAddress = pValue;
+    fBusyUntil = hostDelayed() + EEPROMHOST_WRITE_MS;
+    fStats.writes++;
+}
+
+eepromhost_stats_t eepromhost_takeStats() {
+    eepromhost_stats_t stats = fStats;
+    memset(&fStats, 0, sizeof(fStats));
+    return stats;
+}
@@ -0,0 +1,51 @@
+/**
+ * \file eeprom_host.h
+ * \brief Host model of the EEPROM functions of avr-libc used by warmstart.c
+ * \author Martin Matysiak
+ *
+ * Host builds compiled with -DHOST_IO='"eeprom_host.h"' include this file
+ * through global.h. EEMEM variables live in regular memory, so they keep
+ * their content across simulated power-ups within one run. Like on the MCU,
+ * programming a byte takes EEPROMHOST_WRITE_MS of the simulated time (see
+ * hostDelayed), and every function except eeprom_is_ready first waits until
+ * the EEPROM is ready. The time spent waiting is counted.
+ */
+
+#ifndef EEPROM_HOST_H
+    #define EEPROM_HOST_H
+
+    #include <stddef.h>
+    #include <stdint.h>
+
+    /// Time to program a byte in ms (erase and write, 3.4 ms on the ATmega)
+    #define EEPROMHOST_WRITE_MS 3.4
+
+    /// Places a variable in the EEPROM
+    #define EEMEM
+
+    /// Counters of the simulated EEPROM
+    typedef struct {
+        /// Bytes programmed
+        unsigned long writes;
+        /// Time the firmware has waited for the EEPROM in ms
+        double waited;
+    } eepromhost_stats_t;
+
+    /**
+     * \brief Returns TRUE if no byte is being programmed
+     */
+    uint8_t eeprom_is_ready();
+
+    uint8_t eeprom_read_byte(const uint8_t* pAddress);
+    void eeprom_read_block(void* pDestination, const void* pSource, size_t pLength);
+
+    /**
+     * \brief Starts programming a byte (returns right away)
+     */
+    void eeprom_write_byte(uint8_t* pAddress, uint8_t pValue);
+
+    /**
+     * \brief Returns the counters of the EEPROM and resets them
+     */
+    eepromhost_stats_t eepromhost_takeStats();
+#endif
@@ -0,0 +1,262 @@
+/**
+ * \file gpsbench.c
+ * \brief Host tool which checks the configuration of the GPS-module by
+ * gps_init against a simulated ST22
+ * \author Martin Matysiak
+ *
+ * Usage: gpsbench [-t capture.nmea] [-f hz,hz,...] [-i interval,...] [-s seconds] [-b boots]
+ *
+ * For each update rate, a freshly powered-up module (see st22_host.h) is
+ * configured by the firmware's gps_init with the given message intervals
+ * (default: the ones of gLogger.c), then the sentences are read with
+ * gps_getNMEA (the main loop polls, which is the same for one receiver).
+ * The module sends the fixes of the capture or, without -t, a synthetic
+ * track.
+ *
+ * The report gives the time gps_init takes, the answers of the module, the
+ * time until the first sentence arrives and, over the given number of
+ * seconds (default 10, after one second to settle), the update rate, the
+ * lost bytes and the sentences per second of each type. A rate fails if a
+ * message isn't acknowledged or is lost, if the module doesn't end up with
+ * the rate and baudrate gps_init intends, if bytes are lost or if the types
+ * received don't match the intervals or fall behind the module (the
+ * baudrate is too low for the data of a fix). The exit status is 1 if any
+ * rate fails, so the tool can be used as a regression check.
+ *
+ * Then the time to first fix is measured over the given number of
+ * simulated power-ups at 1 Hz (default 3, see warmstart.h): the module is
+ * restarted with the fix stored in the EEPROM (see eeprom_host.h) by
+ * warmstart_restore, configured by gps_init, and every sentence is handed
+ * to warmstart_update until the fix has been stored after the first one.
+ * The report gives the time from power-up to the first fix, $PGLTTF, the
+ * bytes written into the EEPROM and the time the firmware waited for it. A
+ * power-up fails if the module isn't aided by the fix of the previous one
+ * (or is aided on the first), if it doesn't get a fix, or if the firmware
+ * waited for the EEPROM.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "st22_host.h"
+#include "modules/warmstart.h"
+
+/// Maximum number of rates
+#define MAX_ENTRIES 16
+
+/// Time after gps_init which isn't measured in ms
+#define SETTLE 1000
+
+/// Longest time from power-up to the first fix in ms
+#define BOOT_TIMEOUT 120000
+/// Time after the first fix until the power is cut in ms (storing the fix
+/// takes 15 sentences)
+#define BOOT_STORE 10000
+/// WARMSTART_INTERVAL of gLogger.c
+#define BOOT_INTERVAL 600
+
+/// Names of the message types (in the order of GPS_NMEA_TABLE)
+#define TYPE_NAME(pName, ...) #pName,
+static const char* fTypes[GPS_NMEA_COUNT] = { GPS_NMEA_TABLE(TYPE_NAME) };
+
+/**
+ * \brief Splits a comma separated list of numbers
+ * \return The number of values
+ */
+static int parseList(const char* pList, int* pValues, int pMaximum) {
+    int count = 0;
+
+    while (*pList && (count < pMaximum)) {
+        pValues[count++] = atoi(pList);
+        pList += strcspn(pList, ",");
+        pList += (*pList == ',');
+    }
+
+    return count;
+}
+
+/**
+ * \brief Configures a module at an update rate and measures its output
+ * \return TRUE if the rate passes all checks
+ */
+static int run(const char* pTrack, int pFrequency, const uint8_t* pIntervals, int pSeconds) {
+    if (st22host_create(pTrack) != 0) {
+        exit(1);
+    }
+
+    const st22host_stats_t* stats = st22host_stats(UART_0);
+    double start = hostDelayed();
+    gps_init(UART_0, pFrequency, pIntervals);
+    double init = hostDelayed() - start;
+
+    char sentence[128];
+    unsigned long received[GPS_NMEA_COUNT] = {0};
+    double first = -1, measure = hostDelayed() + SETTLE, end = measure + pSeconds * 1000.0;
+    unsigned long fixes = 0, lost = 0, sent[GPS_NMEA_COUNT] = {0};
+
+    while (hostDelayed() < end) {
+        uint8_t type = gps_getNMEA(UART_0, sentence, sizeof(sentence)) & GPS_NMEA_TYPEMASK;
+
+        if (first < 0) {
+            first = hostDelayed() - start;
+        }
+
+        if (hostDelayed() < measure) {
+            fixes = stats->fixes;
+            lost = stats->lostBytes;
+            memcpy(sent, stats->sentences, sizeof(sent));
+            continue;
+        }
+
+        for (uint8_t i = 0; i < GPS_NMEA_COUNT; i++) {
+            received[i] += (type == (2 << i));
+        }
+    }
+
+    uint32_t baudrate;
+    uint8_t rate;
+    st22host_config(UART_0, &baudrate, &rate);
+    fixes = stats->fixes - fixes;
+    lost = stats->lostBytes - lost;
+
+    int ok = (stats->nacks == 0) && (stats->lostCommands == 0) && (lost == 0) && (rate == pFrequency)
+        && (baudrate == ((pFrequency >= 4) ? GPS_BAUDRATE_HIGHSPEED : GPS_BAUDRATE))
+        && (fixes > 0) && (fixes >= (unsigned long)(pFrequency * pSeconds - 1))
+        && (fixes <= (unsigned long)(pFrequency * pSeconds + 1));
+
+    printf("%4d %8.0f %4lu %4lu %6lu %8lu %8.0f %6.1f %6lu", pFrequency, init, stats->acks,
+        stats->nacks + stats->lostCommands, (unsigned long)baudrate, lost, first,
+        (double)fixes / pSeconds, stats->fixes);
+
+    for (uint8_t i = 0; i < GPS_NMEA_COUNT; i++) {
+        printf(" %5.1f", (double)received[i] / pSeconds);
+
+        // A type arrives if and only if it is configured, and as often as
+        // the module sends it (up to the fix on the line at the end)
+        sent[i] = stats->sentences[i] - sent[i];
+        ok = ok && ((received[i] > 0) == (pIntervals[i] > 0))
+            && (fixes > 0) && (received[i] + (sent[i] + fixes - 1) / fixes >= sent[i]);
+    }
+
+    printf(" %6s\n", ok ? "ok" : "FAIL");
+    return ok;
+}
+
+/**
+ * \brief Powers the logger and a module up and measures the time to first fix
+ * \param pIntervals The message intervals (RMC has to be configured)
+ * \return TRUE if the power-up passes all checks
+ */
+static int boot(const char* pTrack, int pBoot, const uint8_t* pIntervals, uint8_t pRmcInterval) {
+    if (st22host_create(pTrack) != 0) {
+        exit(1);
+    }
+
+    const st22host_stats_t* stats = st22host_stats(UART_0);
+    double start = hostDelayed(), end = start + BOOT_TIMEOUT, ttff = -1;
+    char sentence[128], report[WARMSTART_REPORT_LENGTH] = "";
+
+    uint8_t aided = warmstart_restore(UART_0);
+    gps_init(UART_0, 1, pIntervals);
+
+    while (hostDelayed() < end) {
+        uint8_t type = gps_getNMEA(UART_0, sentence, sizeof(sentence));
+
+        if (warmstart_update(sentence, type, BOOT_INTERVAL)) {
+            ttff = hostDelayed() - start;
+            warmstart_report(report, pRmcInterval * 10);
+            end = hostDelayed() + BOOT_STORE;
+        }
+    }
+
+    eepromhost_stats_t eeprom = eepromhost_takeStats();
+    unsigned long epochs = 0;
+    double reported = 0;
+    sscanf(report, "$PGLTTF,%lu,%lf", &epochs, &reported);
+
+    int ok = (ttff >= 0) && (aided == (pBoot > 1)) && (stats->hotStarts == aided) && (eeprom.waited == 0);
+
+    printf("%4d %5s %8.0f %6lu %6.1f %6lu %9.1f %6s\n", pBoot, aided ? "yes" : "no", ttff,
+        epochs, reported, eeprom.writes, eeprom.waited, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    const char* track = NULL;
+    int frequencies[MAX_ENTRIES] = {1, 2, 4, 5, 8, 10};
+    int frequencyCount = 6;
+    int intervals[GPS_NMEA_COUNT] = {1, 0, 0, 0, 1, 1, 0};
+    int seconds = 10;
+    int boots = 3;
+    int argument = 1;
+
+    for (; (argument < argc - 1) && (argv[argument][0] == '-'); argument += 2) {
+        if (strcmp(argv[argument], "-t") == 0) {
+            track = argv[argument + 1];
+        } else if (strcmp(argv[argument], "-f") == 0) {
+            frequencyCount = parseList(argv[argument + 1], frequencies, MAX_ENTRIES);
+        } else if (strcmp(argv[argument], "-i") == 0) {
+            if (parseList(argv[argument + 1], intervals, GPS_NMEA_COUNT) != GPS_NMEA_COUNT) {
+                break;
+            }
+        } else if (strcmp(argv[argument], "-s") == 0) {
+            seconds = atoi(argv[argument + 1]);
+        } else if (strcmp(argv[argument], "-b") == 0) {
+            boots = atoi(argv[argument + 1]);
+        } else {
+            break;
+        }
+    }
+
+    if ((argument != argc) || (frequencyCount == 0) || (seconds <= 0) || (boots < 0)) {
+        fprintf(stderr, "usage: %s [-t capture.nmea] [-f hz,hz,...] [-i interval,...] [-s seconds] [-b boots]\n",
+            argv[0]);
+        return 1;
+    }
+
+    uint8_t configured[GPS_NMEA_COUNT];
+    for (uint8_t i = 0; i < GPS_NMEA_COUNT; i++) {
+        configured[i] = intervals[i];
+    }
+
+    printf("%4s %8s %4s %4s %6s %8s %8s %6s %6s", "Hz", "init ms", "ack", "lost", "baud",
+        "lost B", "first ms", "fix/s", "fixes");
+    for (uint8_t i = 0; i < GPS_NMEA_COUNT; i++) {
+        printf(" %5s", fTypes[i]);
+    }
+    printf(" %6s\n", "result");
+
+    int failed = 0;
+    for (int f = 0; f < frequencyCount; f++) {
+        failed |= !run(track, frequencies[f], configured, seconds);
+    }
+
+    printf("\nack: acknowledged messages, lost: refused or not understood messages\n");
+    printf("<type>: sentences per second received by gps_getNMEA\n");
+
+    // The time to first fix is taken from the RMC sentences
+    uint8_t rmc = 0;
+    for (uint8_t i = 0; i < GPS_NMEA_COUNT; i++) {
+        if ((2 << i) == GPS_NMEA_RMC) {
+            rmc = configured[i];
+        }
+    }
+
+    if (boots && !rmc) {
+        printf("\nno time to first fix without RMC sentences\n");
+    } else if (boots) {
+        printf("\n%4s %5s %8s %6s %6s %6s %9s %6s\n", "boot", "aided", "ttff ms", "epochs",
+            "ttff s", "eep B", "waited ms", "result");
+
+        for (int b = 1; b <= boots; b++) {
+            failed |= !boot(track, b, configured, rmc);
+        }
+
+        printf("\nttff ms: time from power-up to the first fix\n");
+        printf("epochs, ttff s: $PGLTTF (RMC sentences without a fix, the time they cover)\n");
+        printf("eep B, waited ms: bytes written into the EEPROM, time the firmware waited for it\n");
+    }
+
+    return failed;
+}
@@ -0,0 +1,483 @@
+/**
+ * \file memreport.c
+ * \brief Host tool which computes the SRAM budget of the firmware
+ * \author Martin Matysiak
+ *
+ * Usage: memreport [-s sram] [-r bytes] gLogger.map gLogger.dis file.su ...
+ *
+ * The statically allocated SRAM (.data, .bss and .noinit) is taken out of
+ * the linker map, the stack frame of every function out of the .su files
+ * written by -fstack-usage and the call graph out of the disassembly
+ * (avr-objdump -d). The worst case stack usage of a function is its frame,
+ * the return address and the worst case of its most expensive callee. The
+ * total is the worst case of main plus the one of the most expensive
+ * interrupt handler (interrupts don't nest).
+ *
+ * Functions without .su entry (avr-libc, libgcc) are counted with an empty
+ * frame, as are indirect calls and recursion; they are marked in the
+ * report. Called by make memreport, -s is the size of the SRAM in bytes and
+ * -r the size of a return address (2, 3 for more than 128 KiB of flash).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Maximum length of a symbol name
+#define NAME_LENGTH 64
+
+/// Number of statically allocated objects listed
+#define LARGEST_OBJECTS 10
+
+/// Flag: the frame size isn't known (no .su entry)
+#define FLAG_UNKNOWN 0x01
+/// Flag: the frame size depends on the arguments (alloca, VLAs)
+#define FLAG_DYNAMIC 0x02
+/// Flag: the function calls through a pointer
+#define FLAG_INDIRECT 0x04
+/// Flag: the function is part of a recursion
+#define FLAG_RECURSIVE 0x08
+
+/// A function of the call graph
+typedef struct {
+    char name[NAME_LENGTH];
+    unsigned frame;
+    unsigned flags;
+    /// Flags of the function and all functions it may call
+    unsigned reach;
+    /// Indices of the called functions
+    size_t* callees;
+    size_t callCount;
+    /// Worst case stack usage including the callees, computed by worstCase
+    unsigned worst;
+    /// Callee which causes the worst case (or -1)
+    long next;
+    /// 0: not visited yet, 1: being visited, 2: done
+    int state;
+} function_t;
+
+/// A statically allocated object
+typedef struct {
+    char name[NAME_LENGTH];
+    unsigned size;
+} object_t;
+
+static function_t* fFunctions = NULL;
+static size_t fFunctionCount = 0;
+
+/// Size of a return address in bytes
+static unsigned fReturn = 2;
+
+/**
+ * \brief Looks up a function by name, adds it if it doesn't exist yet
+ * \return The index of the function
+ */
+static size_t function(const char* pName) {
+    for (size_t i = 0; i < fFunctionCount; i++) {
+        if (strcmp(fFunctions[i].name, pName) == 0) {
+            return i;
+        }
+    }
+
+    fFunctions = realloc(fFunctions, (fFunctionCount + 1) * sizeof(function_t));
+    function_t* added = &fFunctions[fFunctionCount];
+    memset(added, 0, sizeof(function_t));
+    snprintf(added->name, NAME_LENGTH, "%s", pName);
+    added->flags = FLAG_UNKNOWN;
+    added->next = -1;
+
+    return fFunctionCount++;
+}
+
+/**
+ * \brief Adds an edge to the call graph (once per pair of functions)
+ */
+static void addCall(size_t pCaller, size_t pCallee) {
+    function_t* caller = &fFunctions[pCaller];
+
+    for (size_t i = 0; i < caller->callCount; i++) {
+        if (caller->callees[i] == pCallee) {
+            return;
+        }
+    }
+
+    caller->callees = realloc(caller->callees, (caller->callCount + 1) * sizeof(size_t));
+    caller->callees[caller->callCount++] = pCallee;
+}
+
+/**
+ * \brief Reads the stack frames out of a .su file
+ *
+ * Every line has the form "file.c:line:column:function<TAB>bytes<TAB>qualifier".
+ */
+static int readStackUsage(const char* pPath) {
+    FILE* file = fopen(pPath, "r");
+    if (!file) {
+        perror(pPath);
+        return -1;
+    }
+
+    char line[512];
+    while (fgets(line, sizeof(line), file)) {
+        char* tab = strchr(line, '\t');
+        if (!tab) {
+            continue;
+        }
+        *tab = '\0';
+
+        char* name = strrchr(line, ':');
+        name = name ? name + 1 : line;
+
+        char qualifier[32] = "";
+        unsigned frame = 0;
+        sscanf(tab + 1, "%u %31s", &frame, qualifier);
+
+        size_t index = function(name);
+        function_t* entry = &fFunctions[index];
+        // Static functions of the same name in several files share an entry
+        if ((entry->flags & FLAG_UNKNOWN) || (frame > entry->frame)) {
+            entry->frame = frame;
+        }
+        entry->flags &= ~FLAG_UNKNOWN;
+        if (strcmp(qualifier, "static") != 0) {
+            entry->flags |= FLAG_DYNAMIC;
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+/**
+ * \brief Reads the call graph out of the disassembly
+ *
+ * Functions start with a line "<address> <name>:". Calls and jumps to the
+ * start of another function ("call ... <name>", tail calls as "jmp ...
+ * <name>") are edges of the graph, jumps within a function have an offset
+ * ("<name+0x12>") and are ignored.
+ */
+static int readDisassembly(const char* pPath) {
+    FILE* file = fopen(pPath, "r");
+    if (!file) {
+        perror(pPath);
+        return -1;
+    }
+
+    char line[512];
+    long current = -1;
+
+    while (fgets(line, sizeof(line), file)) {
+        char name[NAME_LENGTH];
+        unsigned long address;
+
+        if (sscanf(line, "%lx <%63[^>]>:", &address, name) == 2) {
+            current = function(name);
+            continue;
+        }
+
+        // Instruction lines: "address:<TAB>opcode bytes<TAB>mnemonic operands"
+        char* mnemonic = strchr(line, '\t');
+        mnemonic = mnemonic ? strchr(mnemonic + 1, '\t') : NULL;
+        if ((current < 0) || !mnemonic) {
+            continue;
+        }
+        mnemonic++;
+
+        size_t length = strcspn(mnemonic, " \t\n");
+        int call = ((length == 4) && (strncmp(mnemonic, "call", 4) == 0))
+            || ((length == 5) && (strncmp(mnemonic, "rcall", 5) == 0))
+            || ((length == 5) && (strncmp(mnemonic, "callq", 5) == 0));
+        int jump = ((length == 3) && (strncmp(mnemonic, "jmp", 3) == 0))
+            || ((length == 4) && (strncmp(mnemonic, "rjmp", 4) == 0))
+            || ((length == 4) && (strncmp(mnemonic, "jmpq", 4) == 0));
+
+        if (((length == 5) && (strncmp(mnemonic, "icall", 5) == 0))
+            || ((length == 6) && (strncmp(mnemonic, "eicall", 6) == 0))
+            || (call && (mnemonic[length + strspn(mnemonic + length, " \t")] == '*'))) {
+            fFunctions[current].flags |= FLAG_INDIRECT;
+            continue;
+        }
+
+        char* target = strrchr(mnemonic, '<');
+        if (!(call || jump) || !target || (sscanf(target, "<%63[^>]>", name) != 1)
+            || strpbrk(name, "+-")) {
+            continue;
+        }
+
+        size_t callee = function(name);
+        if (callee != (size_t)current) {
+            addCall(current, callee);
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+/**
+ * \brief Computes the worst case stack usage of a function and its callees
+ */
+static unsigned worstCase(size_t pIndex) {
+    function_t* entry = &fFunctions[pIndex];
+
+    if (entry->state == 2) {
+        return entry->worst;
+    }
+    if (entry->state == 1) {
+        // Recursion, the depth is unknown
+        entry->flags |= FLAG_RECURSIVE;
+        return 0;
+    }
+
+    entry->state = 1;
+    unsigned deepest = 0;
+
+    for (size_t i = 0; i < entry->callCount; i++) {
+        function_t* callee = &fFunctions[entry->callees[i]];
+        unsigned usage = worstCase(entry->callees[i]);
+
+        if (callee->state == 1) {
+            entry->flags |= FLAG_RECURSIVE;
+        }
+        entry->reach |= callee->reach;
+
+        if (fReturn + usage > deepest) {
+            deepest = fReturn + usage;
+            entry->next = entry->callees[i];
+        }
+    }
+
+    entry->worst = entry->frame + deepest;
+    entry->reach |= entry->flags;
+    entry->state = 2;
+    return entry->worst;
+}
+
+/**
+ * \brief Prints the path of calls which leads to the worst case of a function
+ */
+static void printPath(size_t pIndex) {
+    long next = pIndex;
+    unsigned depth = 0;
+
+    while ((next >= 0) && (depth++ < 32)) {
+        printf("%s%s", depth > 1 ? " > " : "", fFunctions[next].name);
+        next = fFunctions[next].next;
+    }
+}
+
+/**
+ * \brief Prints the flags of a function as characters
+ */
+static void printFlags(unsigned pFlags) {
+    printf(" %c%c%c%c", (pFlags & FLAG_UNKNOWN) ? '?' : ' ', (pFlags & FLAG_DYNAMIC) ? 'd' : ' ',
+        (pFlags & FLAG_INDIRECT) ? 'i' : ' ', (pFlags & FLAG_RECURSIVE) ? 'r' : ' ');
+}
+
+static int compareObjects(const void* pA, const void* pB) {
+    return (int)((const object_t*)pB)->size - (int)((const object_t*)pA)->size;
+}
+
+static int compareFunctions(const void* pA, const void* pB) {
+    return (int)fFunctions[*(const size_t*)pB].worst - (int)fFunctions[*(const size_t*)pA].worst;
+}
+
+/**
+ * \brief Reads the statically allocated SRAM out of the linker map
+ *
+ * Output sections start in the first column (".bss 0x00800112 0x32c"), the
+ * input sections they consist of are indented (" .bss.nmeaBuf 0x... 0x100
+ * gLogger.o", the address and size may be on the following line for long
+ * names). Thanks to -fdata-sections, every object has its own section.
+ *
+ * \return The number of statically allocated bytes or -1
+ */
+static long readMap(const char* pPath, object_t** pObjects, size_t* pCount) {
+    FILE* file = fopen(pPath, "r");
+    if (!file) {
+        perror(pPath);
+        return -1;
+    }
+
+    const char* outputs[] = {".data", ".bss", ".noinit"};
+    unsigned long sizes[3] = {0, 0, 0};
+    int section = -1;
+    char pending[NAME_LENGTH] = "";
+    char line[512];
+
+    *pObjects = NULL;
+    *pCount = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+        char name[NAME_LENGTH];
+        unsigned long address, size;
+
+        if (line[0] == '.') {
+            section = -1;
+            pending[0] = '\0';
+            for (int i = 0; i < 3; i++) {
+                size_t length = strlen(outputs[i]);
+                if ((strncmp(line, outputs[i], length) == 0) && strchr(" \t\n", line[length])) {
+                    section = i;
+                    if (sscanf(line + length, " %lx %lx", &address, &size) == 2) {
+                        sizes[i] = size;
+                    }
+                }
+            }
+            continue;
+        }
+
+        if (section < 0) {
+            continue;
+        }
+
+        if ((line[0] == ' ') && (line[1] == '.')) {
+            int fields = sscanf(line, " %63s %lx %lx", name, &address, &size);
+            if (fields == 1) {
+                // Address and size follow on the next line
+                snprintf(pending, sizeof(pending), "%s", name);
+                continue;
+            }
+            pending[0] = '\0';
+            if (fields != 3) {
+                continue;
+            }
+        } else if (pending[0] && (sscanf(line, " %lx %lx", &address, &size) == 2)) {
+            snprintf(name, sizeof(name), "%s", pending);
+            pending[0] = '\0';
+        } else {
+            continue;
+        }
+
+        // Only sections of a single object are listed (".bss.nmeaBuf")
+        const char* object = strchr(name + 1, '.');
+        if (!object || (size == 0)) {
+            continue;
+        }
+
+        *pObjects = realloc(*pObjects, (*pCount + 1) * sizeof(object_t));
+        snprintf((*pObjects)[*pCount].name, NAME_LENGTH, "%s", object + 1);
+        (*pObjects)[(*pCount)++].size = size;
+    }
+
+    fclose(file);
+    printf("Static SRAM\n");
+    for (int i = 0; i < 3; i++) {
+        printf("  %-8s %6lu\n", outputs[i], sizes[i]);
+    }
+
+    return sizes[0] + sizes[1] + sizes[2];
+}
+
+int main(int argc, char** argv) {
+    long sram = 0;
+    int argument = 1;
+
+    for (; (argument < argc - 1) && (argv[argument][0] == '-'); argument++) {
+        if ((strcmp(argv[argument], "-s") == 0) && (argument < argc - 2)) {
+            sram = atol(argv[++argument]);
+        } else if ((strcmp(argv[argument], "-r") == 0) && (argument < argc - 2)) {
+            fReturn = atoi(argv[++argument]);
+        } else {
+            break;
+        }
+    }
+
+    if (argc - argument < 3) {
+        fprintf(stderr, "usage: %s [-s sram] [-r bytes] firmware.map firmware.dis file.su ...\n", argv[0]);
+        return 1;
+    }
+
+    object_t* objects;
+    size_t objectCount;
+    long staticSize = readMap(argv[argument], &objects, &objectCount);
+    if (staticSize < 0) {
+        return 1;
+    }
+
+    qsort(objects, objectCount, sizeof(object_t), compareObjects);
+    printf("\nLargest objects\n");
+    for (size_t i = 0; (i < objectCount) && (i < LARGEST_OBJECTS); i++) {
+        printf("  %-32s %6u\n", objects[i].name, objects[i].size);
+    }
+    free(objects);
+
+    for (int i = argument + 2; i < argc; i++) {
+        if (readStackUsage(argv[i]) != 0) {
+            return 1;
+        }
+    }
+    if (readDisassembly(argv[argument + 1]) != 0) {
+        return 1;
+    }
+
+    // Only functions of the firmware (with .su entry) are listed
+    size_t* order = malloc(fFunctionCount * sizeof(size_t));
+    size_t listed = 0;
+    for (size_t i = 0; i < fFunctionCount; i++) {
+        worstCase(i);
+    }
+    for (size_t i = 0; i < fFunctionCount; i++) {
+        if (!(fFunctions[i].flags & FLAG_UNKNOWN)) {
+            order[listed++] = i;
+        }
+    }
+    qsort(order, listed, sizeof(size_t), compareFunctions);
+
+    printf("\nStack (? unknown callee frame, d dynamic, i indirect call, r recursion)\n");
+    printf("  %-32s %6s %6s\n", "function", "frame", "worst");
+    for (size_t i = 0; i < listed; i++) {
+        function_t* entry = &fFunctions[order[i]];
+
+        // The marks cover all functions which may be called
+        printf("  %-32s %6u %6u", entry->name, entry->frame, entry->worst);
+        printFlags(entry->reach);
+        printf("\n");
+    }
+
+    // Entry points: main (called by the startup code) and the interrupts
+    long worstInterrupt = -1;
+    for (size_t i = 0; i < fFunctionCount; i++) {
+        if ((strncmp(fFunctions[i].name, "__vector_", 9) == 0)
+            && ((worstInterrupt < 0) || (fFunctions[i].worst > fFunctions[worstInterrupt].worst))) {
+            worstInterrupt = i;
+        }
+    }
+
+    long mainIndex = -1;
+    for (size_t i = 0; i < fFunctionCount; i++) {
+        if (strcmp(fFunctions[i].name, "main") == 0) {
+            mainIndex = i;
+        }
+    }
+
+    unsigned mainUsage = (mainIndex >= 0) ? fReturn + fFunctions[mainIndex].worst : 0;
+    unsigned interruptUsage = (worstInterrupt >= 0) ? fReturn + fFunctions[worstInterrupt].worst : 0;
+
+    printf("\nWorst case\n");
+    printf("  %-24s %6ld\n", "static", staticSize);
+    if (mainIndex >= 0) {
+        printf("  %-24s %6u  ", "main", mainUsage);
+        printPath(mainIndex);
+        printf("\n");
+    }
+    if (worstInterrupt >= 0) {
+        printf("  %-24s %6u  ", "interrupt", interruptUsage);
+        printPath(worstInterrupt);
+        printf("\n");
+    }
+
+    long total = staticSize + mainUsage + interruptUsage;
+    printf("  %-24s %6ld\n", "total", total);
+    if (sram > 0) {
+        printf("  %-24s %6ld of %ld\n", "headroom", sram - total, sram);
+    }
+
+    for (size_t i = 0; i < fFunctionCount; i++) {
+        free(fFunctions[i].callees);
+    }
+    free(fFunctions);
+    free(order);
+
+    return (sram > 0) && (total > sram) ? 2 : 0;
+}
@@ -0,0 +1,658 @@
+/**
+ * \file nofsd.c
+ * \brief Host daemon which logs many GPS receivers at once, each into a NoFS
+ * image of its own, using the firmware's sentence checks and NoFS code
+ * \author Martin Matysiak
+ *
+ * Usage: nofsd [-o directory] [-r baud] [-s sectors] device ...
+ *        nofsd -b capture.nmea
+ *
+ * All devices (serial ports, ptys or pipes) are served by a single epoll
+ * loop. Every stream has a sentence buffer and a NoFS instance of its own
+ * (see nofs_select), i.e. the firmware's nmeaBuf, sectorBuf, fCurrentSector
+ * etc. exist once per stream. Sentences are assembled the same way as in
+ * gps_getNMEA and checked by gps_classifyNMEA, valid ones are written like in
+ * the main loop. The device /dev/ttyUSB0 is logged into
+ * <directory>/ttyUSB0.nofs which is created (sparse) and formatted if it
+ * doesn't exist yet.
+ *
+ * The sector writes of a stream are collected in a window of
+ * NOFSD_BATCH_SECTORS sectors and written with a single pwrite, aligned to
+ * NOFSD_ALIGN_SECTORS. Every NOFSD_SYNC_INTERVAL seconds (and on exit), the
+ * partially filled sectors are flushed into the images.
+ *
+ * With -b, the capture is fed through 1, 2, 4, ... NOFSD_BENCH_STREAMS pipes
+ * into temporary images, the sentences per second are reported and the
+ * images are checked against the input.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nofsimage.h"
+#include "modules/gps.h"
+#include "modules/nmea.h"
+#include "modules/nofs.h"
+
+#if !NOFS_INSTANCES
+    #error "nofsd has to be built with NOFS_INSTANCES"
+#endif
+
+/// Number of sectors which are collected before they are written
+#define NOFSD_BATCH_SECTORS 64
+/// Alignment of the writes in sectors (4 KB)
+#define NOFSD_ALIGN_SECTORS 8
+/// Interval (in seconds) in which partially filled sectors are flushed
+#define NOFSD_SYNC_INTERVAL 5
+/// Default size of a newly created image in sectors (128 MB)
+#define NOFSD_IMAGE_SECTORS 262144
+/// Size of the sentence buffer (same as nmeaBuf in the firmware)
+#define NOFSD_SENTENCE_LENGTH 128
+/// Maximum number of streams in the benchmark
+#define NOFSD_BENCH_STREAMS 64
+/// Amount of NMEA data fed through all streams of a benchmark run
+#define NOFSD_BENCH_BYTES (32 << 20)
+
+/// A receiver which is logged into an image
+typedef struct {
+    char name[64];
+    /// Device and image file descriptors (-1 if closed)
+    int fd, image;
+    /// Size of the image in sectors
+    uint32_t sectors;
+    /// Block length set by sdmmc_changeBlockLength
+    uint16_t blockLength;
+
+    /// The sentence which is currently received and its length so far
+    char nmeaBuf[NOFSD_SENTENCE_LENGTH];
+    uint8_t length;
+
+    /// State of the firmware's NoFS code
+    nofs_instance_t nofs;
+
+    /// Write window: first sector, range of modified sectors
+    char* window;
+    uint32_t windowFirst, dirtyFirst, dirtyLast;
+    uint8_t loaded, dirty;
+
+    /// Statistics: received and written sentences, written bytes
+    uint64_t sentences, written, bytes;
+} stream_t;
+
+/// The stream whose image is accessed by the sdmmc functions
+static stream_t* fStream = NULL;
+/// Set by SIGINT/SIGTERM
+static volatile sig_atomic_t fStop = 0;
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/**
+ * \brief Writes the modified sectors of the window (aligned) into the image
+ */
+static void window_write(stream_t* pStream) {
+    if (!pStream->dirty) {
+        return;
+    }
+
+    uint32_t first = pStream->dirtyFirst & ~(NOFSD_ALIGN_SECTORS - 1);
+    uint32_t last = pStream->dirtyLast | (NOFSD_ALIGN_SECTORS - 1);
+    if (last >= pStream->sectors) {
+        last = pStream->sectors - 1;
+    }
+    size_t length = (size_t)(last - first + 1) * SDMMC_SECTOR_SIZE;
+
+    if (pwrite(pStream->image, pStream->window + (size_t)(first - pStream->windowFirst) * SDMMC_SECTOR_SIZE,
+            length, (off_t)first * SDMMC_SECTOR_SIZE) != (ssize_t)length) {
+        perror(pStream->name);
+    }
+
+    pStream->dirty = FALSE;
+}
+
+/**
+ * \brief Moves the window onto the batch containing the given sector
+ */
+static void window_move(stream_t* pStream, uint32_t pSector) {
+    uint32_t first = pSector & ~(NOFSD_BATCH_SECTORS - 1);
+    if (pStream->loaded && (first == pStream->windowFirst)) {
+        return;
+    }
+
+    window_write(pStream);
+
+    // The aligned writes need the unmodified sectors of the window as well
+    ssize_t length = pread(pStream->image, pStream->window,
+        NOFSD_BATCH_SECTORS * SDMMC_SECTOR_SIZE, (off_t)first * SDMMC_SECTOR_SIZE);
+    if (length < NOFSD_BATCH_SECTORS * SDMMC_SECTOR_SIZE) {
+        memset(pStream->window + (length > 0 ? length : 0), 0,
+            NOFSD_BATCH_SECTORS * SDMMC_SECTOR_SIZE - (length > 0 ? length : 0));
+    }
+
+    pStream->windowFirst = first;
+    pStream->loaded = TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SDMMC interface (see modules/sdmmc.h) on top of the image of fStream
+
+void sdmmc_init() {
+    fStream->blockLength = SDMMC_SECTOR_SIZE;
+}
+
+uint8_t sdmmc_writeSector(uint32_t pSectorNum, char* pInput) {
+    if (pSectorNum >= fStream->sectors) {
+        return FALSE;
+    }
+
+    window_move(fStream, pSectorNum);
+    memcpy(fStream->window + (size_t)(pSectorNum - fStream->windowFirst) * SDMMC_SECTOR_SIZE,
+        pInput, fStream->blockLength);
+
+    if (!fStream->dirty) {
+        fStream->dirtyFirst = fStream->dirtyLast = pSectorNum;
+        fStream->dirty = TRUE;
+    } else if (pSectorNum < fStream->dirtyFirst) {
+        fStream->dirtyFirst = pSectorNum;
+    } else if (pSectorNum > fStream->dirtyLast) {
+        fStream->dirtyLast = pSectorNum;
+    }
+
+    return TRUE;
+}
+
+uint8_t sdmmc_readSector(uint32_t pSectorNum, char* pOutput) {
+    if (pSectorNum >= fStream->sectors) {
+        // Behave like an empty area of the card
+        memset(pOutput, NOFS_TERMINAL, fStream->blockLength);
+        return FALSE;
+    }
+
+    // The window may contain sectors which haven't been written yet
+    if (fStream->loaded && (pSectorNum - fStream->windowFirst < NOFSD_BATCH_SECTORS)) {
+        memcpy(pOutput, fStream->window + (size_t)(pSectorNum - fStream->windowFirst) * SDMMC_SECTOR_SIZE,
+            fStream->blockLength);
+        return TRUE;
+    }
+
+    if (pread(fStream->image, pOutput, fStream->blockLength,
+            (off_t)pSectorNum * SDMMC_SECTOR_SIZE) != fStream->blockLength) {
+        memset(pOutput, 0, fStream->blockLength);
+    }
+
+    return TRUE;
+}
+
+uint8_t sdmmc_changeBlockLength(uint16_t pLength) {
+    fStream->blockLength = pLength ? pLength : SDMMC_SECTOR_SIZE;
+    return TRUE;
+}
+
+uint8_t sdmmc_writeCommand(uint8_t pCommand, uint32_t pArgument) {
+    return 0;
+}
+
+uint8_t sdmmc_calibrate(uint32_t pSector, char* pBuffer) {
+    // There is no SPI clock, the scratch sector is written like on the card
+    memset(pBuffer, 0, SDMMC_SECTOR_SIZE);
+    return sdmmc_writeSector(pSector, pBuffer);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * \brief Opens (or creates and formats) the image of a stream and
+ * initializes its NoFS instance
+ * \return 0 on success, -1 otherwise
+ */
+static int stream_open(stream_t* pStream, const char* pPath, uint32_t pSectors) {
+    pStream->image = open(pPath, O_RDWR | O_CREAT, 0644);
+    if (pStream->image < 0) {
+        perror(pPath);
+        return -1;
+    }
+
+    struct stat info;
+    fstat(pStream->image, &info);
+
+    if (info.st_size == 0) {
+        // A freshly formatted card: header, pointer to sector 0 and terminals
+        char sector[SDMMC_SECTOR_SIZE] = NOFS_HEADER;
+        sector[NOFS_DATA_START] = NOFS_TERMINAL;
+
+        if ((ftruncate(pStream->image, (off_t)pSectors * SDMMC_SECTOR_SIZE) != 0)
+                || (pwrite(pStream->image, sector, SDMMC_SECTOR_SIZE, 0) != SDMMC_SECTOR_SIZE)
+                || (pwrite(pStream->image, "\003", 1, SDMMC_SECTOR_SIZE) != 1)) {
+            perror(pPath);
+            return -1;
+        }
+        pStream->sectors = pSectors;
+    } else {
+        pStream->sectors = info.st_size / SDMMC_SECTOR_SIZE;
+    }
+
+    pStream->window = malloc(NOFSD_BATCH_SECTORS * SDMMC_SECTOR_SIZE);
+    pStream->length = 0;
+
+    memset(&pStream->nofs, 0, sizeof(pStream->nofs));
+    fStream = pStream;
+    nofs_select(&pStream->nofs);
+    nofs_init();
+
+    return 0;
+}
+
+/**
+ * \brief Writes the partially filled sector and all batched sectors
+ */
+static void stream_sync(stream_t* pStream) {
+    fStream = pStream;
+    nofs_select(&pStream->nofs);
+    nofs_flush();
+    window_write(pStream);
+}
+
+static void stream_close(stream_t* pStream) {
+    stream_sync(pStream);
+    fdatasync(pStream->image);
+    close(pStream->image);
+    free(pStream->window);
+}
+
+/**
+ * \brief Handles a complete sentence the same way the firmware's main loop does
+ */
+static void stream_sentence(stream_t* pStream) {
+    char* sentence = pStream->nmeaBuf;
+    uint8_t type = gps_classifyNMEA(sentence);
+    pStream->sentences++;
+
+    if (!(type & GPS_NMEA_VALID)) {
+        return;
+    }
+
+    fStream = pStream;
+    nofs_select(&pStream->nofs);
+
+    if (type & (GPS_NMEA_GGA | GPS_NMEA_RMC | GPS_NMEA_ZDA)) {
+        nofs_setTime(nmea_parseTime(nmea_getToken(sentence, 1)));
+    }
+
+    if (type & (GPS_NMEA_RMC | GPS_NMEA_ZDA)) {
+        nofs_setDateTime(nmea_parseDateTime(sentence));
+    }
+
+    pStream->written++;
+    pStream->bytes += strlen(sentence);
+    nofs_writeString(sentence);
+}
+
+/**
+ * \brief Splits received data into sentences (same as gps_getNMEA)
+ */
+static void stream_feed(stream_t* pStream, const char* pData, size_t pLength) {
+    for (size_t i = 0; i < pLength; i++) {
+        // A dollar sign indicates the start of a NMEA sentence
+        if ((pStream->length == 0) && (pData[i] != '$')) {
+            continue;
+        }
+
+        pStream->nmeaBuf[pStream->length++] = pData[i];
+
+        if ((pData[i] == LF) || (pStream->length == NOFSD_SENTENCE_LENGTH - 1)) {
+            pStream->nmeaBuf[pStream->length] = '\0';
+            stream_sentence(pStream);
+            pStream->length = 0;
+        }
+    }
+}
+
+/**
+ * \brief Serves the streams until all of them are closed or a signal arrives
+ */
+static void serve(stream_t* pStreams, int pCount) {
+    int poll = epoll_create1(0);
+    int active = 0;
+
+    for (int i = 0; i < pCount; i++) {
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = &pStreams[i]};
+        if (epoll_ctl(poll, EPOLL_CTL_ADD, pStreams[i].fd, &event) == 0) {
+            active++;
+        } else {
+            perror(pStreams[i].name);
+        }
+    }
+
+    double lastSync = now();
+    struct epoll_event events[NOFSD_BENCH_STREAMS];
+    char data[4096];
+
+    while (active && !fStop) {
+        int ready = epoll_wait(poll, events, NOFSD_BENCH_STREAMS, 1000);
+
+        for (int i = 0; i < ready; i++) {
+            stream_t* stream = events[i].data.ptr;
+            ssize_t length = read(stream->fd, data, sizeof(data));
+
+            if (length > 0) {
+                stream_feed(stream, data, length);
+            } else if ((length == 0) || ((errno != EAGAIN) && (errno != EINTR))) {
+                // End of file or the device is gone
+                epoll_ctl(poll, EPOLL_CTL_DEL, stream->fd, NULL);
+                close(stream->fd);
+                stream->fd = -1;
+                stream_sync(stream);
+                active--;
+            }
+        }
+
+        if (now() - lastSync >= NOFSD_SYNC_INTERVAL) {
+            for (int i = 0; i < pCount; i++) {
+                if (pStreams[i].fd >= 0) {
+                    stream_sync(&pStreams[i]);
+                }
+            }
+            lastSync = now();
+        }
+    }
+
+    close(poll);
+}
+
+/**
+ * \brief Configures a serial port (raw, 8N1, given baudrate)
+ */
+static void configure(int pFd, int pBaudrate) {
+    if (!isatty(pFd)) {
+        return;
+    }
+
+    speed_t speed;
+    switch (pBaudrate) {
+        case 4800: speed = B4800; break;
+        case 19200: speed = B19200; break;
+        case 38400: speed = B38400; break;
+        case 57600: speed = B57600; break;
+        case 115200: speed = B115200; break;
+        default: speed = B9600; break;
+    }
+
+    struct termios options;
+    if (tcgetattr(pFd, &options) == 0) {
+        cfmakeraw(&options);
+        cfsetispeed(&options, speed);
+        cfsetospeed(&options, speed);
+        options.c_cflag |= CLOCAL | CREAD;
+        tcsetattr(pFd, TCSANOW, &options);
+    }
+}
+
+static void stop(int pSignal) {
+    fStop = 1;
+}
+
+/// Input of a benchmark run
+typedef struct {
+    const char* text;
+    size_t length;
+    int count, repeats;
+    int* pipes;
+} feed_t;
+
+/**
+ * \brief Writes the capture round robin into the pipes of all streams
+ */
+static void* feed(void* pArgument) {
+    feed_t* feed = pArgument;
+    size_t total = feed->length * feed->repeats;
+    size_t* positions = calloc(feed->count, sizeof(size_t));
+    int open = feed->count;
+
+    while (open) {
+        for (int i = 0; i < feed->count; i++) {
+            if (positions[i] == total) {
+                continue;
+            }
+
+            size_t offset = positions[i] % feed->length;
+            size_t length = feed->length - offset;
+            if (length > 4096) {
+                length = 4096;
+            }
+
+            ssize_t written = write(feed->pipes[i], feed->text + offset, length);
+            positions[i] += written > 0 ? written : 0;
+
+            if (positions[i] == total) {
+                close(feed->pipes[i]);
+                open--;
+            }
+        }
+    }
+
+    free(positions);
+    return NULL;
+}
+
+/**
+ * \brief Reads the sentences of a capture into a single string (CR LF)
+ */
+static char* load(const char* pPath, size_t* pLength) {
+    FILE* file = fopen(pPath, "r");
+    if (!file) {
+        perror(pPath);
+        exit(1);
+    }
+
+    size_t capacity = 1 << 20;
+    char* text = malloc(capacity);
+    char line[256];
+    *pLength = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+        char* start = strchr(line, '$');
+        if (!start) {
+            continue;
+        }
+
+        size_t length = strcspn(start, "\r\n");
+        if (*pLength + length + 3 > capacity) {
+            capacity *= 2;
+            text = realloc(text, capacity);
+        }
+
+        memcpy(text + *pLength, start, length);
+        memcpy(text + *pLength + length, "\r\n", 3);
+        *pLength += length + 2;
+    }
+
+    fclose(file);
+    return text;
+}
+
+/**
+ * \brief Measures the throughput with an increasing number of streams
+ */
+static int benchmark(const char* pCapture) {
+    size_t length;
+    char* text = load(pCapture, &length);
+    if (length == 0) {
+        fprintf(stderr, "%s: no sentences\n", pCapture);
+        return 1;
+    }
+
+    char directory[] = "/tmp/nofsdXXXXXX";
+    if (!mkdtemp(directory)) {
+        perror(directory);
+        return 1;
+    }
+
+    printf("%8s %12s %10s %14s %10s\n", "streams", "sentences", "seconds",
+        "sentences/s", "MB/s");
+
+    for (int count = 1; count <= NOFSD_BENCH_STREAMS; count *= 2) {
+        stream_t* streams = calloc(count, sizeof(stream_t));
+        int* pipes = malloc(count * sizeof(int));
+
+        int repeats = NOFSD_BENCH_BYTES / count / length;
+        if (repeats < 1) {
+            repeats = 1;
+        }
+
+        // Room for the data (uncompressed) and the reserved regions
+        uint32_t sectors = (uint64_t)length * repeats / NOFS_BUFFER_SIZE * 2
+            + NOFS_INDEX_SECTORS + 2 * NOFSD_BATCH_SECTORS;
+        sectors = (sectors + NOFSD_BATCH_SECTORS - 1) & ~(NOFSD_BATCH_SECTORS - 1);
+
+        for (int i = 0; i < count; i++) {
+            int ends[2];
+            char path[64];
+
+            snprintf(streams[i].name, sizeof(streams[i].name), "stream%d", i);
+            snprintf(path, sizeof(path), "%s/%s.nofs", directory, streams[i].name);
+            if ((pipe(ends) != 0) || (stream_open(&streams[i], path, sectors) != 0)) {
+                return 1;
+            }
+
+            fcntl(ends[0], F_SETFL, O_NONBLOCK);
+            streams[i].fd = ends[0];
+            pipes[i] = ends[1];
+        }
+
+        feed_t input = {text, length, count, repeats, pipes};
+        pthread_t feeder;
+
+        double start = now();
+        pthread_create(&feeder, NULL, feed, &input);
+        serve(streams, count);
+        pthread_join(feeder, NULL);
+        for (int i = 0; i < count; i++) {
+            stream_close(&streams[i]);
+        }
+        double seconds = now() - start;
+
+        // Every image has to contain exactly the valid sentences of its stream
+        uint64_t sentences = 0;
+        for (int i = 0; i < count; i++) {
+            char path[64];
+            nofsimage_t image;
+
+            snprintf(path, sizeof(path), "%s/%s.nofs", directory, streams[i].name);
+            if (nofsimage_open(&image, path) != 0) {
+                return 1;
+            }
+
+            uint64_t decoded = 0;
+            char* output = malloc(NOFSIMAGE_MAX_DECODED);
+            uint64_t last = nofsimage_lastSector(&image);
+            for (uint64_t j = nofsimage_firstSector(&image); j <= last; j++) {
+                decoded += nofsimage_decodeSector(&image, j, output);
+            }
+            free(output);
+            nofsimage_close(&image);
+            unlink(path);
+
+            if (decoded != streams[i].bytes) {
+                fprintf(stderr, "%s: image contains %lu instead of %lu bytes\n",
+                    streams[i].name, (unsigned long)decoded, (unsigned long)streams[i].bytes);
+                return 1;
+            }
+
+            sentences += streams[i].sentences;
+        }
+
+        printf("%8d %12lu %10.3f %14.0f %10.1f\n", count, (unsigned long)sentences,
+            seconds, sentences / seconds, (double)length * repeats * count / seconds / 1e6);
+
+        free(pipes);
+        free(streams);
+    }
+
+    rmdir(directory);
+    free(text);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const char* directory = ".";
+    int baudrate = 9600;
+    uint32_t sectors = NOFSD_IMAGE_SECTORS;
+    int argument = 1;
+
+    for (; (argument < argc - 1) && (argv[argument][0] == '-'); argument += 2) {
+        if (strcmp(argv[argument], "-b") == 0) {
+            return benchmark(argv[argument + 1]);
+        } else if (strcmp(argv[argument], "-o") == 0) {
+            directory = argv[argument + 1];
+        } else if (strcmp(argv[argument], "-r") == 0) {
+            baudrate = atoi(argv[argument + 1]);
+        } else if (strcmp(argv[argument], "-s") == 0) {
+            sectors = strtoul(argv[argument + 1], NULL, 10);
+        } else {
+            break;
+        }
+    }
+
+    if (argument >= argc) {
+        fprintf(stderr, "usage: %s [-o directory] [-r baud] [-s sectors] device ...\n"
+            "       %s -b capture.nmea\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    // The images are written in whole batches
+    sectors = (sectors + NOFSD_BATCH_SECTORS - 1) & ~(NOFSD_BATCH_SECTORS - 1);
+
+    int count = argc - argument;
+    stream_t* streams = calloc(count, sizeof(stream_t));
+
+    for (int i = 0; i < count; i++) {
+        const char* device = argv[argument + i];
+        const char* name = strrchr(device, '/') ? strrchr(device, '/') + 1 : device;
+        char path[4096];
+
+        snprintf(streams[i].name, sizeof(streams[i].name), "%s", name);
+        snprintf(path, sizeof(path), "%s/%s.nofs", directory, streams[i].name);
+
+        streams[i].fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (streams[i].fd < 0) {
+            streams[i].fd = open(device, O_RDONLY | O_NONBLOCK);
+        }
+        if ((streams[i].fd < 0) || (stream_open(&streams[i], path, sectors) != 0)) {
+            perror(device);
+            return 1;
+        }
+
+        configure(streams[i].fd, baudrate);
+    }
+
+    struct sigaction action = {.sa_handler = stop};
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    serve(streams, count);
+
+    for (int i = 0; i < count; i++) {
+        if (streams[i].fd >= 0) {
+            close(streams[i].fd);
+        }
+        stream_close(&streams[i]);
+        fprintf(stderr, "%s: %lu sentences, %lu written\n", streams[i].name,
+            (unsigned long)streams[i].sentences, (unsigned long)streams[i].written);
+    }
+
+    free(streams);
+    return 0;
+}
@@ -0,0 +1,669 @@
+/**
+ * \file nofsexport.c
+ * \brief Host tool which converts a NoFS image into NMEA, CSV, GPX or GeoJSON
+ * using all available cores
+ * \author Martin Matysiak
+ *
+ * Usage: nofsexport [-f nmea|csv|gpx|geojson] [-j threads] [-s] image > out
+ *        nofsexport -b [-f format] image
+ *
+ * The data sectors are processed in rounds of EXPORT_ROUND_SECTORS sectors,
+ * every round is split into one chunk per thread. Each thread decodes its
+ * chunk, scans it for sentence boundaries ('$' and '\n') and verifies the
+ * XOR checksums (using SSE2 if available, -s forces the scalar code). A
+ * sentence which is cut by the end of a chunk is completed by decoding the
+ * following sector, the thread of the next chunk skips everything in front
+ * of its first '$'. GGA and RMC sentences of the same epoch are merged into
+ * a single fix. Afterwards, the date (known from RMC sentences only) is
+ * carried over the chunk borders sequentially and the fixes are formatted in
+ * parallel again.
+ *
+ * With -b, the image is converted with 1, 2, 4, ... threads without writing
+ * the result and the throughput is compared with just reading the image.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+#include "nofsimage.h"
+#include "modules/nmea.h"
+
+/// Number of sectors which are processed per round (limits the memory usage)
+#ifndef EXPORT_ROUND_SECTORS
+    #define EXPORT_ROUND_SECTORS 65536
+#endif
+
+/// Fix field: the fix contains the data of a GGA sentence
+#define FIX_GGA 0x01
+/// Fix field: the fix contains the data of a RMC sentence
+#define FIX_RMC 0x02
+
+/// Output formats
+typedef enum {
+    FORMAT_NMEA, FORMAT_CSV, FORMAT_GPX, FORMAT_GEOJSON
+} format_t;
+
+/// A position fix (merged out of the sentences of one epoch)
+typedef struct {
+    /// UTC time in milliseconds since midnight
+    uint32_t time;
+    /// Days since 2000-01-01, -1 if unknown
+    int32_t day;
+    /// Coordinates in 1/10000 arcminutes
+    int32_t latitude, longitude;
+    float altitude, speed, course, hdop;
+    uint8_t satellites;
+    /// Combination of FIX_GGA and FIX_RMC, 0 if the fix has been merged
+    uint8_t fields;
+} fix_t;
+
+/// A growing buffer
+typedef struct {
+    char* data;
+    size_t length, capacity;
+} buffer_t;
+
+/// Work of a single thread
+typedef struct {
+    const nofsimage_t* image;
+    format_t format;
+    /// Sectors of the chunk and the last data sector of the image
+    uint64_t first, last, end;
+    buffer_t text, output;
+    fix_t* fixes;
+    size_t fixCount, fixCapacity;
+    /// Number of records written in front of this chunk
+    uint64_t index;
+    size_t sentences, dropped;
+} chunk_t;
+
+/// Forces the scalar implementation of the scanning functions
+static int fScalar = 0;
+
+static void reserve(buffer_t* pBuffer, size_t pLength) {
+    if (pBuffer->length + pLength > pBuffer->capacity) {
+        pBuffer->capacity = (pBuffer->length + pLength) * 2;
+        pBuffer->data = realloc(pBuffer->data, pBuffer->capacity);
+    }
+}
+
+static void append(buffer_t* pBuffer, const char* pData, size_t pLength) {
+    reserve(pBuffer, pLength);
+    memcpy(pBuffer->data + pBuffer->length, pData, pLength);
+    pBuffer->length += pLength;
+}
+
+/**
+ * \brief Returns the index of the next '$' or '\n' at or behind pStart
+ * \return pLength if there is none
+ */
+static size_t findDelimiter(const char* pText, size_t pStart, size_t pLength) {
+#ifdef __SSE2__
+    if (!fScalar) {
+        const __m128i dollar = _mm_set1_epi8('$');
+        const __m128i newline = _mm_set1_epi8('\n');
+
+        while (pStart + 16 <= pLength) {
+            __m128i block = _mm_loadu_si128((const __m128i*)(pText + pStart));
+            int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, dollar),
+                _mm_cmpeq_epi8(block, newline)));
+
+            if (mask) {
+                return pStart + __builtin_ctz(mask);
+            }
+            pStart += 16;
+        }
+    }
+#endif
+
+    while ((pStart < pLength) && (pText[pStart] != '$') && (pText[pStart] != '\n')) {
+        pStart++;
+    }
+
+    return pStart;
+}
+
+/**
+ * \brief Calculates the XOR of all given bytes (i.e. the NMEA checksum)
+ */
+static uint8_t checksum(const char* pData, size_t pLength) {
+    uint8_t result = 0;
+
+#ifdef __SSE2__
+    if (!fScalar) {
+        __m128i sum = _mm_setzero_si128();
+        for (; pLength >= 16; pLength -= 16, pData += 16) {
+            sum = _mm_xor_si128(sum, _mm_loadu_si128((const __m128i*)pData));
+        }
+
+        // Fold the 16 bytes into a single one
+        sum = _mm_xor_si128(sum, _mm_srli_si128(sum, 8));
+        sum = _mm_xor_si128(sum, _mm_srli_si128(sum, 4));
+        sum = _mm_xor_si128(sum, _mm_srli_si128(sum, 2));
+        sum = _mm_xor_si128(sum, _mm_srli_si128(sum, 1));
+        result = _mm_cvtsi128_si32(sum) & 0xFF;
+    }
+#endif
+
+    while (pLength--) {
+        result ^= *pData++;
+    }
+
+    return result;
+}
+
+static int hexValue(char pCharacter) {
+    if ((pCharacter >= '0') && (pCharacter <= '9')) {
+        return pCharacter - '0';
+    } else if ((pCharacter >= 'A') && (pCharacter <= 'F')) {
+        return pCharacter - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * \brief Checks the form "$...*hh\r" and the checksum of a sentence
+ * \param pLength The length of the sentence without the trailing '\n'
+ */
+static int validSentence(const char* pSentence, size_t pLength) {
+    if ((pLength < 7) || (pSentence[pLength - 1] != '\r') || (pSentence[pLength - 4] != '*')) {
+        return 0;
+    }
+
+    int high = hexValue(pSentence[pLength - 3]), low = hexValue(pSentence[pLength - 2]);
+    return (high >= 0) && (low >= 0)
+        && (checksum(pSentence + 1, pLength - 5) == ((high << 4) | low));
+}
+
+/**
+ * \brief Adds the data of a GGA or RMC sentence to the fixes of a chunk
+ */
+static void addFix(chunk_t* pChunk, const char* pSentence) {
+    int gga = strncmp(pSentence + 3, "GGA", 3) == 0;
+    if (!gga && (strncmp(pSentence + 3, "RMC", 3) != 0)) {
+        return;
+    }
+
+    // Only valid positions are exported
+    const char* validity = nmea_getToken(pSentence, gga ? 6 : 2);
+    uint32_t time = nmea_parseTime(nmea_getToken(pSentence, 1));
+    if ((*validity == '0') || (*validity == 'V') || (*validity == ',') || (time == NMEA_TIME_INVALID)) {
+        return;
+    }
+
+    // Sentences of the same epoch are merged
+    fix_t* fix = pChunk->fixCount ? &pChunk->fixes[pChunk->fixCount - 1] : NULL;
+    if (!fix || (fix->time != time) || (fix->fields & (gga ? FIX_GGA : FIX_RMC))) {
+        if (pChunk->fixCount == pChunk->fixCapacity) {
+            pChunk->fixCapacity = pChunk->fixCapacity ? pChunk->fixCapacity * 2 : 1024;
+            pChunk->fixes = realloc(pChunk->fixes, pChunk->fixCapacity * sizeof(fix_t));
+        }
+
+        fix = &pChunk->fixes[pChunk->fixCount++];
+        memset(fix, 0, sizeof(fix_t));
+        fix->time = time;
+        fix->day = -1;
+    }
+
+    if (gga) {
+        fix->latitude = nmea_parseCoordinate(nmea_getToken(pSentence, 2));
+        fix->longitude = nmea_parseCoordinate(nmea_getToken(pSentence, 4));
+        fix->satellites = atoi(nmea_getToken(pSentence, 7));
+        fix->hdop = atof(nmea_getToken(pSentence, 8));
+        fix->altitude = atof(nmea_getToken(pSentence, 9));
+        fix->fields |= FIX_GGA;
+    } else {
+        fix->latitude = nmea_parseCoordinate(nmea_getToken(pSentence, 3));
+        fix->longitude = nmea_parseCoordinate(nmea_getToken(pSentence, 5));
+        fix->speed = atof(nmea_getToken(pSentence, 7)) * 1.852;
+        fix->course = atof(nmea_getToken(pSentence, 8));
+
+        uint32_t dateTime = nmea_parseDateTime(pSentence);
+        if (dateTime != NMEA_TIME_INVALID) {
+            fix->day = dateTime / NMEA_SECONDS_PER_DAY;
+        }
+        fix->fields |= FIX_RMC;
+    }
+}
+
+/**
+ * \brief Phase 1: decodes a chunk and splits it into valid sentences
+ */
+static void* scanChunk(void* pChunk) {
+    chunk_t* chunk = pChunk;
+    chunk->text.length = chunk->output.length = 0;
+    chunk->fixCount = chunk->sentences = chunk->dropped = 0;
+
+    for (uint64_t sector = chunk->first; sector <= chunk->last; sector++) {
+        reserve(&chunk->text, NOFSIMAGE_MAX_DECODED);
+        chunk->text.length += nofsimage_decodeSector(chunk->image, sector,
+            chunk->text.data + chunk->text.length);
+    }
+
+    // Complete the last sentence out of the following sectors
+    for (uint64_t sector = chunk->last + 1; sector <= chunk->end; sector++) {
+        size_t last = chunk->text.length;
+        while ((last > 0) && (chunk->text.data[last - 1] != '$') && (chunk->text.data[last - 1] != '\n')) {
+            last--;
+        }
+
+        // Nothing to complete if the text ends behind a '\n'
+        if ((last == 0) || (chunk->text.data[last - 1] == '\n')) {
+            break;
+        }
+
+        char* decoded = malloc(NOFSIMAGE_MAX_DECODED);
+        size_t length = nofsimage_decodeSector(chunk->image, sector, decoded);
+        size_t used = findDelimiter(decoded, 0, length);
+
+        // Stop at the beginning of the next sentence (i.e. a cut sentence)
+        append(&chunk->text, decoded, used < length && decoded[used] == '\n' ? used + 1 : used);
+        free(decoded);
+
+        if (used < length) {
+            break;
+        }
+    }
+
+    const char* text = chunk->text.data;
+    size_t length = chunk->text.length;
+    size_t position = findDelimiter(text, 0, length);
+
+    // The part in front of the first '$' belongs to the previous chunk
+    while ((position < length) && (text[position] != '$')) {
+        position = findDelimiter(text, position + 1, length);
+    }
+
+    while (position < length) {
+        size_t end = findDelimiter(text, position + 1, length);
+
+        if ((end == length) || (text[end] == '$')) {
+            // Cut sentence (e.g. power loss) or end of the data
+            chunk->dropped++;
+            position = end;
+            continue;
+        }
+
+        size_t sentenceLength = end - position;
+        if (!validSentence(text + position, sentenceLength)) {
+            chunk->dropped++;
+        } else if (chunk->format == FORMAT_NMEA) {
+            append(&chunk->output, text + position, sentenceLength + 1);
+            chunk->sentences++;
+        } else {
+            char sentence[256];
+            if (sentenceLength < sizeof(sentence)) {
+                memcpy(sentence, text + position, sentenceLength);
+                sentence[sentenceLength] = '\0';
+                addFix(chunk, sentence);
+            }
+            chunk->sentences++;
+        }
+
+        // Skip anything up to the next sentence
+        position = end;
+        while ((position < length) && (text[position] != '$')) {
+            position = findDelimiter(text, position + 1, length);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * \brief Formats date and time of a fix as ISO 8601 (date omitted if unknown)
+ */
+static int formatTime(char* pOutput, size_t pSize, const fix_t* pFix, const char* pSeparator) {
+    char date[24] = "";
+    if (pFix->day >= 0) {
+        // Civil date out of the day number without gmtime (which is neither
+        // fast nor thread-safe). Years are counted from March 1st on, so the
+        // leap day is the last day of a year (and 2000-03-01 starts a 400
+        // year cycle).
+        int32_t days = (pFix->day + 146097 - 60) % 146097;
+        int32_t year = (days - days / 1460 + days / 36524 - days / 146096) / 365;
+        int32_t dayOfYear = days - (365 * year + year / 4 - year / 100);
+        int32_t month = (5 * dayOfYear + 2) / 153;
+
+        snprintf(date, sizeof(date), "%04d-%02d-%02d",
+            (pFix->day >= 60 ? 2000 : 1600) + year + (month >= 10),
+            month < 10 ? month + 3 : month - 9, dayOfYear - (153 * month + 2) / 5 + 1);
+    }
+
+    return snprintf(pOutput, pSize, "%s%s%02u:%02u:%02u.%03u", date, pFix->day >= 0 ? pSeparator : "",
+        pFix->time / 3600000, pFix->time / 60000 % 60, pFix->time / 1000 % 60, pFix->time % 1000);
+}
+
+/**
+ * \brief Phase 3: formats the fixes of a chunk
+ */
+static void* formatChunk(void* pChunk) {
+    chunk_t* chunk = pChunk;
+    uint64_t index = chunk->index;
+    char line[512], time[32];
+
+    for (size_t i = 0; i < chunk->fixCount; i++) {
+        const fix_t* fix = &chunk->fixes[i];
+        if (!fix->fields) {
+            continue;
+        }
+
+        double latitude = fix->latitude / (double)NMEA_UNITS_PER_DEGREE;
+        double longitude = fix->longitude / (double)NMEA_UNITS_PER_DEGREE;
+        int length = 0;
+
+        switch (chunk->format) {
+            case FORMAT_CSV:
+                formatTime(time, sizeof(time), fix, ",");
+                length = snprintf(line, sizeof(line), "%s%s,%.7f,%.7f,%.1f,%.2f,%.1f,%u,%.1f\n",
+                    fix->day >= 0 ? "" : ",", time, latitude, longitude, fix->altitude,
+                    fix->speed, fix->course, fix->satellites, fix->hdop);
+                break;
+            case FORMAT_GPX:
+                formatTime(time, sizeof(time), fix, "T");
+                length = snprintf(line, sizeof(line),
+                    "<trkpt lat=\"%.7f\" lon=\"%.7f\"><ele>%.1f</ele>%s%s%s</trkpt>\n",
+                    latitude, longitude, fix->altitude, fix->day >= 0 ? "<time>" : "",
+                    fix->day >= 0 ? time : "", fix->day >= 0 ? "Z</time>" : "");
+                break;
+            case FORMAT_GEOJSON:
+                formatTime(time, sizeof(time), fix, "T");
+                length = snprintf(line, sizeof(line),
+                    "%s{\"type\":\"Feature\",\"geometry\":{\"type\":\"Point\",\"coordinates\":"
+                    "[%.7f,%.7f,%.1f]},\"properties\":{\"time\":\"%s%s\",\"speed\":%.2f,"
+                    "\"course\":%.1f,\"satellites\":%u,\"hdop\":%.1f}}",
+                    index ? ",\n" : "", longitude, latitude, fix->altitude, time,
+                    fix->day >= 0 ? "Z" : "", fix->speed, fix->course, fix->satellites, fix->hdop);
+                break;
+            default:
+                break;
+        }
+
+        append(&chunk->output, line, length);
+        index++;
+    }
+
+    return NULL;
+}
+
+/// State which is carried from one chunk (and round) to the next one
+typedef struct {
+    int32_t day;
+    uint32_t time;
+    fix_t* last;
+    uint64_t index;
+} carry_t;
+
+/**
+ * \brief Phase 2: merges epochs split by chunk borders and resolves the dates
+ */
+static void resolve(chunk_t* pChunk, carry_t* pCarry) {
+    pChunk->index = pCarry->index;
+
+    for (size_t i = 0; i < pChunk->fixCount; i++) {
+        fix_t* fix = &pChunk->fixes[i];
+
+        if ((i == 0) && pCarry->last && (pCarry->last->time == fix->time)
+            && !(pCarry->last->fields & fix->fields)) {
+            // The epoch has been split, the fix of the previous chunk is
+            // completed (it is only formatted after this phase)
+            fix_t* previous = pCarry->last;
+            if (fix->fields & FIX_GGA) {
+                previous->altitude = fix->altitude;
+                previous->satellites = fix->satellites;
+                previous->hdop = fix->hdop;
+            } else {
+                previous->speed = fix->speed;
+                previous->course = fix->course;
+                if (fix->day >= 0) {
+                    previous->day = pCarry->day = fix->day;
+                }
+            }
+            previous->fields |= fix->fields;
+            fix->fields = 0;
+            continue;
+        }
+
+        if (fix->day >= 0) {
+            pCarry->day = fix->day;
+        } else if (pCarry->day >= 0) {
+            // Midnight passed in front of the next RMC sentence
+            if (fix->time + NMEA_MS_PER_DAY / 2 < pCarry->time) {
+                pCarry->day++;
+            }
+            fix->day = pCarry->day;
+        }
+
+        pCarry->time = fix->time;
+        pCarry->last = fix;
+        pCarry->index++;
+    }
+}
+
+/**
+ * \brief Converts the image
+ * \param pOutput The output file or NULL in order to drop the output
+ * \return The number of bytes produced by the decompression
+ */
+static size_t export(const nofsimage_t* pImage, format_t pFormat, long pThreads, FILE* pOutput,
+    size_t* pSentences, size_t* pDropped) {
+    static const char* headers[] = {
+        "",
+        "date,time,latitude,longitude,altitude,speed,course,satellites,hdop\n",
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<gpx version=\"1.1\" creator=\"nofsexport\" "
+            "xmlns=\"http://www.topografix.com/GPX/1/1\">\n<trk><trkseg>\n",
+        "{\"type\":\"FeatureCollection\",\"features\":[\n"
+    };
+    static const char* footers[] = {"", "", "</trkseg></trk>\n</gpx>\n", "\n]}\n"};
+
+    uint64_t first = nofsimage_firstSector(pImage);
+    uint64_t end = nofsimage_lastSector(pImage);
+    size_t decoded = 0;
+
+    chunk_t* chunks = calloc(pThreads, sizeof(chunk_t));
+    pthread_t* ids = calloc(pThreads, sizeof(pthread_t));
+
+    // The last fix of a round is kept until it's clear that the next round
+    // doesn't complete it
+    fix_t held;
+    carry_t carry = {-1, 0, NULL, 0};
+    int holding = 0;
+
+    *pSentences = *pDropped = 0;
+    if (pOutput) {
+        fputs(headers[pFormat], pOutput);
+    }
+
+    for (uint64_t round = first; round <= end; round += EXPORT_ROUND_SECTORS) {
+        uint64_t sectors = end - round + 1 < EXPORT_ROUND_SECTORS ? end - round + 1 : EXPORT_ROUND_SECTORS;
+        long threads = (uint64_t)pThreads > sectors ? (long)sectors : pThreads;
+
+        for (long i = 0; i < threads; i++) {
+            chunks[i].image = pImage;
+            chunks[i].format = pFormat;
+            chunks[i].first = round + sectors * i / threads;
+            chunks[i].last = round + sectors * (i + 1) / threads - 1;
+            chunks[i].end = end;
+            pthread_create(&ids[i], NULL, scanChunk, &chunks[i]);
+        }
+
+        for (long i = 0; i < threads; i++) {
+            pthread_join(ids[i], NULL);
+            decoded += chunks[i].text.length;
+            *pSentences += chunks[i].sentences;
+            *pDropped += chunks[i].dropped;
+        }
+
+        if (pFormat != FORMAT_NMEA) {
+            carry.last = holding ? &held : NULL;
+            for (long i = 0; i < threads; i++) {
+                resolve(&chunks[i], &carry);
+            }
+
+            // The fix held back from the previous round is complete now
+            if (holding) {
+                chunk_t single = {.format = pFormat, .fixes = &held, .fixCount = 1,
+                    .index = chunks[0].index - 1};
+                formatChunk(&single);
+                if (pOutput) {
+                    fwrite(single.output.data, 1, single.output.length, pOutput);
+                }
+                free(single.output.data);
+                holding = 0;
+
+                if (carry.last == &held) {
+                    carry.last = NULL;
+                }
+            }
+
+            // Hold back the last fix of this round
+            if (carry.last) {
+                held = *carry.last;
+                carry.last->fields = 0;
+                carry.last = &held;
+                holding = 1;
+            }
+
+            for (long i = 0; i < threads; i++) {
+                pthread_create(&ids[i], NULL, formatChunk, &chunks[i]);
+            }
+            for (long i = 0; i < threads; i++) {
+                pthread_join(ids[i], NULL);
+            }
+        }
+
+        for (long i = 0; i < threads; i++) {
+            if (pOutput) {
+                fwrite(chunks[i].output.data, 1, chunks[i].output.length, pOutput);
+            }
+        }
+    }
+
+    if (holding) {
+        chunk_t single = {.format = pFormat, .fixes = &held, .fixCount = 1, .index = carry.index - 1};
+        formatChunk(&single);
+        if (pOutput) {
+            fwrite(single.output.data, 1, single.output.length, pOutput);
+        }
+        free(single.output.data);
+    }
+
+    if (pOutput) {
+        fputs(footers[pFormat], pOutput);
+    }
+
+    for (long i = 0; i < pThreads; i++) {
+        free(chunks[i].text.data);
+        free(chunks[i].output.data);
+        free(chunks[i].fixes);
+    }
+    free(chunks);
+    free(ids);
+
+    return decoded;
+}
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/**
+ * \brief Compares the conversion speed with the speed of reading the image
+ */
+static void benchmark(const nofsimage_t* pImage, format_t pFormat, long pThreads) {
+    uint64_t first = nofsimage_firstSector(pImage);
+    uint64_t bytes = (nofsimage_lastSector(pImage) - first + 1) * NOFS_BUFFER_SIZE;
+    size_t sentences, dropped;
+
+    // Reading the data only (the image is cached after the first pass)
+    volatile uint64_t sum = 0;
+    double start = now();
+    for (uint64_t i = 0; i < bytes; i += sizeof(uint64_t)) {
+        sum += *(const uint64_t*)(nofsimage_sector(pImage, first) + i);
+    }
+    double read = now() - start;
+
+    printf("%-8s %7s %10s %10s %12s\n", "scanner", "threads", "image MB/s", "text MB/s", "sentences/s");
+    printf("%-8s %7d %10.1f %10s %12s\n", "read", 1, bytes / read / 1e6, "-", "-");
+
+    for (int scalar = 0; scalar <= 1; scalar++) {
+#ifndef __SSE2__
+        if (!scalar) {
+            continue;
+        }
+#endif
+        fScalar = scalar;
+
+        for (long threads = 1; ; threads = threads * 2 < pThreads ? threads * 2 : pThreads) {
+            start = now();
+            size_t text = export(pImage, pFormat, threads, NULL, &sentences, &dropped);
+            double duration = now() - start;
+
+            printf("%-8s %7ld %10.1f %10.1f %12.0f\n", scalar ? "scalar" : "sse2", threads,
+                bytes / duration / 1e6, text / duration / 1e6, sentences / duration);
+
+            if (threads == pThreads) {
+                break;
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    static const char* formats[] = {"nmea", "csv", "gpx", "geojson"};
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    format_t format = FORMAT_NMEA;
+    int bench = 0, argument = 1;
+
+    for (; (argument < argc - 1) && (argv[argument][0] == '-'); argument++) {
+        if ((strcmp(argv[argument], "-j") == 0) && (argument < argc - 2)) {
+            threads = atol(argv[++argument]);
+        } else if ((strcmp(argv[argument], "-f") == 0) && (argument < argc - 2)) {
+            argument++;
+            for (format = FORMAT_NMEA; format <= FORMAT_GEOJSON; format++) {
+                if (strcmp(argv[argument], formats[format]) == 0) {
+                    break;
+                }
+            }
+        } else if (strcmp(argv[argument], "-s") == 0) {
+            fScalar = 1;
+        } else if (strcmp(argv[argument], "-b") == 0) {
+            bench = 1;
+        } else {
+            break;
+        }
+    }
+
+    if ((argument != argc - 1) || (threads < 1) || (format > FORMAT_GEOJSON)) {
+        fprintf(stderr, "usage: %s [-f nmea|csv|gpx|geojson] [-j threads] [-s] [-b] image\n", argv[0]);
+        return 1;
+    }
+
+    nofsimage_t image;
+    if (nofsimage_open(&image, argv[argument]) != 0) {
+        return 1;
+    }
+
+    if (nofsimage_lastSector(&image) + 1 <= nofsimage_firstSector(&image)) {
+        fprintf(stderr, "%s: no data\n", argv[argument]);
+    } else if (bench) {
+        benchmark(&image, format, threads);
+    } else {
+        size_t sentences, dropped;
+        export(&image, format, threads, stdout, &sentences, &dropped);
+        fprintf(stderr, "%zu sentences, %zu dropped\n", sentences, dropped);
+    }
+
+    nofsimage_close(&image);
+    return 0;
+}
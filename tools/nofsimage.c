@@ -0,0 +1,210 @@
+/**
+ * \file nofsimage.c
+ * \brief Host side access to raw NoFS images (dumps or block devices)
+ * \author Martin Matysiak
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "nofsimage.h"
+#include "modules/compress.h"
+
+int nofsimage_open(nofsimage_t* pImage, const char* pPath) {
+    int fd = open(pPath, O_RDONLY);
+    if (fd < 0) {
+        perror(pPath);
+        return -1;
+    }
+
+    // lseek works for regular files as well as for block devices
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (size < NOFS_BUFFER_SIZE) {
+        fprintf(stderr, "%s: image too small\n", pPath);
+        close(fd);
+        return -1;
+    }
+
+    void* data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        perror(pPath);
+        return -1;
+    }
+
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    pImage->data = data;
+    pImage->size = size;
+    pImage->sectors = size / NOFS_BUFFER_SIZE;
+
+    if (memcmp(pImage->data, NOFS_HEADER, NOFS_HEADER_LENGTH) != 0) {
+        fprintf(stderr, "%s: no NoFS header found\n", pPath);
+        nofsimage_close(pImage);
+        return -1;
+    }
+
+    return 0;
+}
+
+void nofsimage_close(nofsimage_t* pImage) {
+    munmap((void*)pImage->data, pImage->size);
+    pImage->data = NULL;
+}
+
+const uint8_t* nofsimage_sector(const nofsimage_t* pImage, uint64_t pSector) {
+    return pImage->data + pSector * NOFS_BUFFER_SIZE;
+}
+
+/**
+ * \brief Reads a number out of a buffer (MSB first)
+ */
+static uint32_t nofsimage_number(const uint8_t* pBuffer, int pBytes) {
+    uint32_t value = 0;
+    for (int i = 0; i < pBytes; i++) {
+        value = (value << 8) | pBuffer[i];
+    }
+    return value;
+}
+
+int nofsimage_header(const nofsimage_t* pImage, uint64_t pSector, nofsimage_header_t* pHeader) {
+    const uint8_t* sector = nofsimage_sector(pImage, pSector);
+
+    if ((pSector == 0) || (sector[0] != NOFS_SECTOR_MAGIC)
+        || (nofsimage_number(sector + NOFS_SECTOR_NUMBER, 4) != (pSector & 0xFFFFFFFF))) {
+        return 0;
+    }
+
+    if (pHeader) {
+        pHeader->flags = sector[NOFS_SECTOR_FLAGS];
+        pHeader->session = nofsimage_number(sector + NOFS_SECTOR_SESSION, 4);
+        pHeader->number = nofsimage_number(sector + NOFS_SECTOR_NUMBER, 4);
+        pHeader->first = nofsimage_number(sector + NOFS_SECTOR_FIRST, 2);
+        pHeader->time = nofsimage_number(sector + NOFS_SECTOR_TIME, 4);
+    }
+
+    return 1;
+}
+
+int nofsimage_region(const nofsimage_t* pImage, uint8_t pType, uint64_t* pFirst, uint64_t* pCount) {
+    if (pImage->data[NOFS_DATA_START] != NOFS_REGION_MARKER) {
+        return 0;
+    }
+
+    for (int i = 0; i < pImage->data[NOFS_REGION_COUNT]; i++) {
+        const uint8_t* entry = pImage->data + NOFS_REGION_TABLE + i * NOFS_REGION_ENTRY_LENGTH;
+        if (entry[0] == pType) {
+            if (pFirst) {
+                *pFirst = nofsimage_number(entry + 1, 4);
+            }
+            if (pCount) {
+                *pCount = nofsimage_number(entry + 5, 4);
+            }
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+long nofsimage_directory(const nofsimage_t* pImage, nofsimage_session_t** pSessions) {
+    uint64_t first, count;
+    if (!nofsimage_region(pImage, NOFS_REGION_DIRECTORY, &first, &count)) {
+        *pSessions = NULL;
+        return -1;
+    }
+
+    uint64_t dataStart = nofsimage_firstSector(pImage);
+    uint64_t last = nofsimage_lastSector(pImage);
+    long slots = count * NOFS_DIRECTORY_RECORDS, length = 0;
+    uint32_t previous = 0;
+
+    *pSessions = malloc(slots * sizeof(nofsimage_session_t));
+
+    // Same rules as nofs_openDirectory: the first sectors have to increase
+    for (long slot = 0; (slot < slots) && (first + slot / NOFS_DIRECTORY_RECORDS < pImage->sectors); slot++) {
+        const uint8_t* record = nofsimage_sector(pImage, first + slot / NOFS_DIRECTORY_RECORDS)
+            + slot % NOFS_DIRECTORY_RECORDS * NOFS_DIRECTORY_RECORD_LENGTH;
+        nofsimage_session_t* session = &(*pSessions)[length];
+
+        session->first = nofsimage_number(record + NOFS_DIRECTORY_FIRST, 4);
+        if ((session->first <= previous) || (session->first < dataStart) || (session->first > last + 1)) {
+            break;
+        }
+        previous = session->first;
+
+        session->last = nofsimage_number(record + NOFS_DIRECTORY_LAST, 4);
+        session->start = nofsimage_number(record + NOFS_DIRECTORY_START, 4);
+        session->end = nofsimage_number(record + NOFS_DIRECTORY_END, 4);
+        session->fixes = nofsimage_number(record + NOFS_DIRECTORY_FIXES, 4);
+        session->south = nofsimage_number(record + NOFS_DIRECTORY_SOUTH, 4);
+        session->north = nofsimage_number(record + NOFS_DIRECTORY_NORTH, 4);
+        session->west = nofsimage_number(record + NOFS_DIRECTORY_WEST, 4);
+        session->east = nofsimage_number(record + NOFS_DIRECTORY_EAST, 4);
+        session->distance = nofsimage_number(record + NOFS_DIRECTORY_DISTANCE, 4);
+        session->state = record[NOFS_DIRECTORY_STATE];
+        length++;
+    }
+
+    // Only the last session can be open, the data ends with it
+    if ((length > 0) && ((*pSessions)[length - 1].state == NOFS_SESSION_OPEN)
+        && (last > (*pSessions)[length - 1].last)) {
+        (*pSessions)[length - 1].last = last;
+    }
+
+    return length;
+}
+
+uint64_t nofsimage_firstSector(const nofsimage_t* pImage) {
+    uint64_t first = 0;
+
+    if (pImage->data[NOFS_DATA_START] == NOFS_REGION_MARKER) {
+        for (int i = 0; i < pImage->data[NOFS_REGION_COUNT]; i++) {
+            const uint8_t* entry = pImage->data + NOFS_REGION_TABLE + i * NOFS_REGION_ENTRY_LENGTH;
+            uint64_t end = nofsimage_number(entry + 1, 4) + nofsimage_number(entry + 5, 4);
+            if (end > first) {
+                first = end;
+            }
+        }
+    }
+
+    return first;
+}
+
+uint16_t nofsimage_dataStart(const nofsimage_t* pImage, uint64_t pSector) {
+    if (pSector == 0) {
+        // Sector 0 contains no data if there are reserved regions
+        return pImage->data[NOFS_DATA_START] == NOFS_REGION_MARKER ? NOFS_BUFFER_SIZE : NOFS_DATA_START;
+    }
+
+    return nofsimage_sector(pImage, pSector)[0] == NOFS_SECTOR_MAGIC ? NOFS_SECTOR_HEADER_LENGTH : 0;
+}
+
+uint64_t nofsimage_lastSector(const nofsimage_t* pImage) {
+    uint64_t sector = 0;
+    for (int i = 0; i < 4; i++) {
+        sector = (sector << 8) | pImage->data[NOFS_HEADER_LENGTH + i]; // MSB first
+    }
+
+    while ((sector < pImage->sectors) && (nofsimage_sector(pImage, sector)[0] != NOFS_TERMINAL)) {
+        sector++;
+    }
+
+    return sector > 0 ? sector - 1 : 0;
+}
+
+size_t nofsimage_decodeSector(const nofsimage_t* pImage, uint64_t pSector, char* pOutput) {
+    uint16_t start = nofsimage_dataStart(pImage, pSector);
+    const uint8_t* data = nofsimage_sector(pImage, pSector) + start;
+
+    // Neither text nor tokens contain the padding byte
+    const uint8_t* padding = memchr(data, NOFS_PADDING, NOFS_BUFFER_SIZE - start);
+    uint16_t length = padding ? padding - data : NOFS_BUFFER_SIZE - start;
+
+    return compress_decode((const char*)data, length, pOutput);
+}
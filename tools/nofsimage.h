@@ -0,0 +1,135 @@
+/**
+ * \file nofsimage.h
+ * \brief Host side access to raw NoFS images (dumps or block devices)
+ * \author Martin Matysiak
+ *
+ * The image is mapped into memory, so even very large images can be
+ * processed without reading them completely.
+ */
+
+#ifndef NOFSIMAGE_H
+    #define NOFSIMAGE_H
+
+    #include <stddef.h>
+    #include <stdint.h>
+
+    #include "modules/nofs.h"
+
+    /// A mapped NoFS image
+    typedef struct {
+        /// Content of the whole image
+        const uint8_t* data;
+        /// Size of the image in bytes
+        uint64_t size;
+        /// Number of (complete) sectors in the image
+        uint64_t sectors;
+    } nofsimage_t;
+
+    /// Content of a sector header
+    typedef struct {
+        uint8_t flags;
+        uint32_t session;
+        uint32_t number;
+        uint16_t first;
+        uint32_t time;
+    } nofsimage_header_t;
+
+    /// A record of the session directory (see NOFS_DIRECTORY)
+    typedef struct {
+        uint32_t first;
+        uint32_t last;
+        uint32_t start;
+        uint32_t end;
+        uint32_t fixes;
+        int32_t south;
+        int32_t north;
+        int32_t west;
+        int32_t east;
+        uint32_t distance;
+        uint8_t state;
+    } nofsimage_session_t;
+
+    /**
+     * \brief Maps an image and checks the NoFS header
+     * \return 0 on success, -1 otherwise (an error message has been printed)
+     */
+    int nofsimage_open(nofsimage_t* pImage, const char* pPath);
+
+    /**
+     * \brief Unmaps an image
+     */
+    void nofsimage_close(nofsimage_t* pImage);
+
+    /**
+     * \brief Returns a pointer to the beginning of a sector
+     */
+    const uint8_t* nofsimage_sector(const nofsimage_t* pImage, uint64_t pSector);
+
+    /**
+     * \brief Reads the sector header of a sector
+     *
+     * A sector header is only considered valid if it contains the index of
+     * the sector it has been read from. Misplaced or stale copies (like the
+     * terminal sector) are therefore rejected.
+     *
+     * \param pHeader Receives the header, may be NULL
+     * \return 1 if the sector has a valid header, 0 otherwise
+     */
+    int nofsimage_header(const nofsimage_t* pImage, uint64_t pSector, nofsimage_header_t* pHeader);
+
+    /**
+     * \brief Searches the region table of sector 0 for a reserved region
+     *
+     * \param pFirst Receives the first sector of the region, may be NULL
+     * \param pCount Receives the number of sectors of the region, may be NULL
+     * \return 1 if the image contains such a region, 0 otherwise
+     */
+    int nofsimage_region(const nofsimage_t* pImage, uint8_t pType, uint64_t* pFirst, uint64_t* pCount);
+
+    /**
+     * \brief Reads the valid records of the session directory
+     *
+     * The last sector of a session which hasn't been finalized yet (i.e. the
+     * logger is still running or hasn't been switched on again) is taken from
+     * the data, like the logger does at the next power-up.
+     *
+     * \param pSessions Receives the records (has to be freed)
+     * \return The number of records, -1 if the image has no directory
+     */
+    long nofsimage_directory(const nofsimage_t* pImage, nofsimage_session_t** pSessions);
+
+    /**
+     * \brief Returns the first sector which may contain data (i.e. the first
+     * sector behind the reserved regions)
+     */
+    uint64_t nofsimage_firstSector(const nofsimage_t* pImage);
+
+    /**
+     * \brief Returns the index of the first data byte inside a sector
+     */
+    uint16_t nofsimage_dataStart(const nofsimage_t* pImage, uint64_t pSector);
+
+    /**
+     * \brief Searches the last sector containing data (same as nofs_init)
+     *
+     * Starting at the sector stored behind the header, the first sector
+     * starting with a NOFS_TERMINAL is searched.
+     *
+     * \return The index of the sector in front of the terminal sector
+     */
+    uint64_t nofsimage_lastSector(const nofsimage_t* pImage);
+
+    /**
+     * \brief Decodes the data of a single sector
+     *
+     * Decoding stops at a NOFS_TERMINAL or at the padding at the end of a
+     * session.
+     *
+     * \param pOutput A buffer of at least NOFSIMAGE_MAX_DECODED bytes
+     * \return The number of decoded bytes
+     */
+    size_t nofsimage_decodeSector(const nofsimage_t* pImage, uint64_t pSector, char* pOutput);
+
+    /// Maximum number of bytes which may be decoded out of a single sector
+    #define NOFSIMAGE_MAX_DECODED (NOFS_BUFFER_SIZE * 33)
+#endif
@@ -0,0 +1,322 @@
+/**
+ * \file nofsprofile.c
+ * \brief Host tool which maps the samples of the profiler (see profiler.h)
+ * in a NoFS image onto the functions of the firmware
+ * \author Martin Matysiak
+ *
+ * Usage: nofsprofile [-s session] [-b] image gLogger.map
+ *
+ * The records of the NOFS_REGION_PROFILE region are added up, either the
+ * ones of all sessions or the ones of the session starting at the given
+ * sector. A record is only used if the data sector it has been written
+ * after belongs to its slot and to its session.
+ *
+ * The functions are taken out of the .text output section of the linker
+ * map: thanks to -ffunction-sections, every function has an input section
+ * of its own (".text.gps_checkNMEA", static functions included), the
+ * symbols listed inside the other input sections (avr-libc, libgcc) split
+ * them further. The samples of a bucket are shared among the functions it
+ * overlaps in proportion to the bytes of each, so the figures of small
+ * functions are estimates (make the buckets smaller with
+ * PROFILER_BUCKET_BITS for a closer look). With -b, the buckets are listed
+ * as well.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nofsimage.h"
+
+/// Maximum length of a symbol name
+#define NAME_LENGTH 64
+
+/// A function (or any other piece) of the flash
+typedef struct {
+    char name[NAME_LENGTH];
+    unsigned long start;
+    unsigned long end;
+    double samples;
+} function_t;
+
+static function_t* fFunctions = NULL;
+static size_t fFunctionCount = 0;
+
+/**
+ * \brief Adds a function, a symbol at the address of an existing one only
+ * names an input section which has no function name
+ */
+static void addFunction(const char* pName, unsigned long pStart, unsigned long pEnd) {
+    for (size_t i = 0; i < fFunctionCount; i++) {
+        if (fFunctions[i].start == pStart) {
+            if ((fFunctions[i].name[0] == '.') && (pName[0] != '.')) {
+                snprintf(fFunctions[i].name, NAME_LENGTH, "%s", pName);
+            }
+            return;
+        }
+    }
+
+    fFunctions = realloc(fFunctions, (fFunctionCount + 1) * sizeof(function_t));
+    function_t* function = &fFunctions[fFunctionCount++];
+    snprintf(function->name, NAME_LENGTH, "%s", pName);
+    function->start = pStart;
+    function->end = pEnd;
+    function->samples = 0;
+}
+
+static int compareStarts(const void* pA, const void* pB) {
+    const function_t* a = pA;
+    const function_t* b = pB;
+    return (a->start > b->start) - (a->start < b->start);
+}
+
+static int compareSamples(const void* pA, const void* pB) {
+    const function_t* a = pA;
+    const function_t* b = pB;
+    return (a->samples < b->samples) - (a->samples > b->samples);
+}
+
+/**
+ * \brief Reads the functions out of the .text section of the linker map
+ *
+ * Input sections are indented by one space (" .text.nofs_flush 0x... 0x...
+ * nofs.o", address and size may be on the following line for long names),
+ * the symbols inside them by 16 spaces ("0x... nofs_flush").
+ *
+ * \return 0 on success, -1 otherwise
+ */
+static int readMap(const char* pPath) {
+    FILE* file = fopen(pPath, "r");
+    if (!file) {
+        perror(pPath);
+        return -1;
+    }
+
+    int inText = 0;
+    unsigned long textEnd = 0;
+    char pending[NAME_LENGTH] = "";
+    char line[512];
+
+    while (fgets(line, sizeof(line), file)) {
+        char name[NAME_LENGTH];
+        unsigned long address, size;
+
+        if (line[0] == '.') {
+            inText = (strncmp(line, ".text", 5) == 0) && strchr(" \t\n", line[5]);
+            if (inText && (sscanf(line + 5, " %lx %lx", &address, &size) == 2)) {
+                textEnd = address + size;
+            }
+            pending[0] = '\0';
+            continue;
+        }
+
+        if (!inText) {
+            continue;
+        }
+
+        if ((line[0] == ' ') && (line[1] == '.')) {
+            int fields = sscanf(line, " %63s %lx %lx", name, &address, &size);
+            if (fields == 1) {
+                snprintf(pending, sizeof(pending), "%s", name);
+                continue;
+            }
+            pending[0] = '\0';
+            if (fields != 3) {
+                continue;
+            }
+        } else if (pending[0] && (sscanf(line, " %lx %lx", &address, &size) == 2)) {
+            snprintf(name, sizeof(name), "%s", pending);
+            pending[0] = '\0';
+        } else if ((sscanf(line, " 0x%lx %63s", &address, name) == 2) && (name[0] != '.')
+            && !strchr(name, '=') && !strchr(name, '(')) {
+            // A symbol, ends where the next piece starts
+            addFunction(name, address, 0);
+            continue;
+        } else {
+            continue;
+        }
+
+        if (size == 0) {
+            continue;
+        }
+
+        // ".text.gps_checkNMEA" is gps_checkNMEA, others keep their name
+        const char* function = name;
+        if ((strncmp(name, ".text.", 6) == 0) && name[6]) {
+            function = name + 6;
+        }
+        addFunction(function, address, address + size);
+    }
+
+    fclose(file);
+    if (fFunctionCount == 0) {
+        fprintf(stderr, "%s: no .text section\n", pPath);
+        return -1;
+    }
+
+    // Symbols end at the next piece, the last one at the end of .text
+    qsort(fFunctions, fFunctionCount, sizeof(function_t), compareStarts);
+    for (size_t i = 0; i < fFunctionCount; i++) {
+        unsigned long next = (i + 1 < fFunctionCount) ? fFunctions[i + 1].start : textEnd;
+        if ((fFunctions[i].end == 0) || (fFunctions[i].end > next)) {
+            fFunctions[i].end = next;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * \brief Reads a number out of a record (MSB first)
+ */
+static uint32_t readNumber(const uint8_t* pBuffer, uint8_t pBytes) {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < pBytes; i++) {
+        value = (value << 8) | pBuffer[i];
+    }
+    return value;
+}
+
+int main(int argc, char** argv) {
+    long session = -1;
+    int buckets = 0;
+    int argument = 1;
+
+    for (; (argument < argc - 2) && (argv[argument][0] == '-'); argument++) {
+        if ((strcmp(argv[argument], "-s") == 0) && (argument < argc - 3)) {
+            session = atol(argv[++argument]);
+        } else if (strcmp(argv[argument], "-b") == 0) {
+            buckets = 1;
+        } else {
+            break;
+        }
+    }
+
+    if (argument != argc - 2) {
+        fprintf(stderr, "usage: %s [-s session] [-b] image gLogger.map\n", argv[0]);
+        return 1;
+    }
+
+    nofsimage_t image;
+    if (nofsimage_open(&image, argv[argument]) != 0) {
+        return 1;
+    }
+
+    uint64_t first, count;
+    if (!nofsimage_region(&image, NOFS_REGION_PROFILE, &first, &count)) {
+        fprintf(stderr, "%s: no profiler region\n", argv[argument]);
+        nofsimage_close(&image);
+        return 1;
+    }
+
+    if (readMap(argv[argument + 1]) != 0) {
+        nofsimage_close(&image);
+        return 1;
+    }
+
+    uint64_t dataStart = nofsimage_firstSector(&image);
+    unsigned long samples[256] = {0}, total = 0, records = 0;
+    int bits = -1, bucketCount = 0;
+    unsigned frequency = 0;
+
+    for (uint64_t slot = 0; slot < count; slot++) {
+        const uint8_t* record = nofsimage_sector(&image, first + slot);
+        uint32_t recordSession = readNumber(record + NOFS_PROFILE_SESSION, 4);
+        uint64_t sector = readNumber(record + NOFS_PROFILE_SECTOR, 4);
+        uint64_t full = sector + 1 - dataStart;
+        nofsimage_header_t header;
+
+        // Records which don't belong to their slot have never been written
+        if ((sector < dataStart) || (full % NOFS_PROFILE_INTERVAL)
+            || ((full / NOFS_PROFILE_INTERVAL - 1) % count != slot)
+            || !nofsimage_header(&image, sector, &header) || (header.session != recordSession)
+            || ((session >= 0) && (recordSession != session))) {
+            continue;
+        }
+
+        int recordBits = record[NOFS_PROFILE_BITS];
+        int recordCount = record[NOFS_PROFILE_COUNT];
+        if ((recordCount == 0) || (NOFS_PROFILE_BUCKETS + 2 * recordCount > NOFS_BUFFER_SIZE)) {
+            continue;
+        }
+
+        if (bits < 0) {
+            bits = recordBits;
+            bucketCount = recordCount;
+            frequency = readNumber(record + NOFS_PROFILE_FREQUENCY, 2);
+        } else if ((bits != recordBits) || (bucketCount != recordCount)) {
+            fprintf(stderr, "record of sector %llu: other buckets, skipped\n", (unsigned long long)sector);
+            continue;
+        }
+
+        for (int i = 0; i < bucketCount; i++) {
+            unsigned long value = readNumber(record + NOFS_PROFILE_BUCKETS + 2 * i, 2);
+            samples[i] += value;
+            total += value;
+        }
+        records++;
+    }
+
+    nofsimage_close(&image);
+
+    if (total == 0) {
+        fprintf(stderr, "no samples\n");
+        return 1;
+    }
+
+    // Shares of the functions overlapping each bucket
+    unsigned long size = 1UL << bits, outside = 0;
+    for (int i = 0; i < bucketCount; i++) {
+        unsigned long start = i * size, end = start + size;
+        unsigned long covered = 0;
+
+        for (size_t f = 0; f < fFunctionCount; f++) {
+            unsigned long from = (fFunctions[f].start > start) ? fFunctions[f].start : start;
+            unsigned long to = (fFunctions[f].end < end) ? fFunctions[f].end : end;
+            covered += (to > from) ? to - from : 0;
+        }
+
+        if (buckets) {
+            printf("%06lx-%06lx %8lu ", start, end - 1, samples[i]);
+        }
+
+        for (size_t f = 0; covered && (f < fFunctionCount); f++) {
+            unsigned long from = (fFunctions[f].start > start) ? fFunctions[f].start : start;
+            unsigned long to = (fFunctions[f].end < end) ? fFunctions[f].end : end;
+            if (to > from) {
+                fFunctions[f].samples += (double)samples[i] * (to - from) / covered;
+                if (buckets) {
+                    printf(" %s", fFunctions[f].name);
+                }
+            }
+        }
+
+        if (!covered) {
+            outside += samples[i];
+        }
+
+        if (buckets) {
+            printf("\n");
+        }
+    }
+
+    if (buckets) {
+        printf("\n");
+    }
+
+    printf("%lu samples in %lu records (%.0f s at %u Hz, buckets of %lu bytes)\n\n", total,
+        records, (double)total / frequency, frequency, size);
+
+    qsort(fFunctions, fFunctionCount, sizeof(function_t), compareSamples);
+    printf("%10s %6s  %s\n", "samples", "%", "function");
+    for (size_t f = 0; (f < fFunctionCount) && (fFunctions[f].samples >= 0.5); f++) {
+        printf("%10.0f %6.2f  %s\n", fFunctions[f].samples, 100 * fFunctions[f].samples / total,
+            fFunctions[f].name);
+    }
+
+    if (outside) {
+        printf("%10lu %6.2f  (outside .text)\n", outside, 100.0 * outside / total);
+    }
+
+    return 0;
+}
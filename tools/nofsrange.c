@@ -0,0 +1,234 @@
+/**
+ * \file nofsrange.c
+ * \brief Host tool which extracts the sentences of a time range out of a
+ * NoFS image by means of the on-card time index (see NOFS_INDEX)
+ * \author Martin Matysiak
+ *
+ * Usage: nofsrange [-i] image from to > range.nmea
+ *
+ * Times are given in UTC as "YYYY-MM-DD HH:MM:SS". The index records are
+ * binary searched for the sectors enclosing the range, only these sectors
+ * are read from the image. With -i, the index records are listed instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "nofsimage.h"
+#include "modules/nmea.h"
+
+/// Seconds between 1970-01-01 and 2000-01-01 (the epoch of the index)
+#define EPOCH_2000 946684800L
+
+/// A valid index record
+typedef struct {
+    uint64_t sector;
+    uint32_t time;
+} record_t;
+
+/**
+ * \brief Reads all valid records of the index region
+ * \return The number of records, the records are returned through pRecords
+ */
+static size_t readIndex(const nofsimage_t* pImage, record_t** pRecords) {
+    uint64_t first, count;
+    if (!nofsimage_region(pImage, NOFS_REGION_INDEX, &first, &count)) {
+        *pRecords = NULL;
+        return 0;
+    }
+
+    uint64_t dataStart = nofsimage_firstSector(pImage);
+    uint64_t last = nofsimage_lastSector(pImage);
+    size_t slots = count * NOFS_INDEX_RECORDS, length = 0;
+
+    *pRecords = malloc(slots * sizeof(record_t));
+
+    for (size_t slot = 0; slot < slots; slot++) {
+        uint64_t sector = dataStart + (uint64_t)slot * NOFS_INDEX_INTERVAL;
+        if (sector > last) {
+            break;
+        }
+
+        // Records which don't point to their own slot have never been written
+        const uint8_t* record = nofsimage_sector(pImage, first + slot / NOFS_INDEX_RECORDS)
+            + slot % NOFS_INDEX_RECORDS * NOFS_INDEX_RECORD_LENGTH;
+        uint32_t number = (record[0] << 24) | (record[1] << 16) | (record[2] << 8) | record[3];
+        uint32_t time = (record[4] << 24) | (record[5] << 16) | (record[6] << 8) | record[7];
+
+        if ((number == (sector & 0xFFFFFFFF)) && (time != NOFS_TIME_UNKNOWN)) {
+            (*pRecords)[length].sector = sector;
+            (*pRecords)[length].time = time;
+            length++;
+        }
+    }
+
+    return length;
+}
+
+/**
+ * \brief Converts "YYYY-MM-DD HH:MM:SS" (UTC) into seconds since 2000
+ * \return 0 on success, -1 otherwise
+ */
+static int parseTime(const char* pText, long* pTime) {
+    struct tm time;
+    memset(&time, 0, sizeof(time));
+
+    if (sscanf(pText, "%d-%d-%d%*[ T]%d:%d:%d", &time.tm_year, &time.tm_mon,
+        &time.tm_mday, &time.tm_hour, &time.tm_min, &time.tm_sec) != 6) {
+        return -1;
+    }
+
+    time.tm_year -= 1900;
+    time.tm_mon -= 1;
+    *pTime = timegm(&time) - EPOCH_2000;
+    return 0;
+}
+
+/**
+ * \brief Prints a time in seconds since 2000 in the format of parseTime
+ */
+static void printTime(FILE* pFile, long pTime) {
+    time_t time = pTime + EPOCH_2000;
+    char text[32];
+    strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", gmtime(&time));
+    fputs(text, pFile);
+}
+
+/**
+ * \brief Returns the index of the first record with a time after pTime
+ */
+static size_t search(const record_t* pRecords, size_t pLength, long pTime) {
+    size_t low = 0, high = pLength;
+
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if ((long)pRecords[middle].time <= pTime) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+int main(int argc, char** argv) {
+    int list = (argc > 1) && (strcmp(argv[1], "-i") == 0);
+    long from = 0, to = 0;
+
+    if ((list && (argc != 3)) || (!list && ((argc != 4) || (parseTime(argv[2], &from) != 0)
+        || (parseTime(argv[3], &to) != 0)))) {
+        fprintf(stderr, "usage: %s [-i] image \"YYYY-MM-DD HH:MM:SS\" \"YYYY-MM-DD HH:MM:SS\"\n", argv[0]);
+        return 1;
+    }
+
+    nofsimage_t image;
+    if (nofsimage_open(&image, argv[list ? 2 : 1]) != 0) {
+        return 1;
+    }
+
+    if (!nofsimage_region(&image, NOFS_REGION_INDEX, NULL, NULL)) {
+        fprintf(stderr, "%s: no time index, use nofsunpack instead\n", argv[list ? 2 : 1]);
+        nofsimage_close(&image);
+        return 1;
+    }
+
+    record_t* records;
+    size_t length = readIndex(&image, &records);
+
+    if (list) {
+        for (size_t i = 0; i < length; i++) {
+            printf("%10lu ", (unsigned long)records[i].sector);
+            printTime(stdout, records[i].time);
+            printf("\n");
+        }
+
+        free(records);
+        nofsimage_close(&image);
+        return 0;
+    }
+
+    // The range starts in the sector of the last record before it and ends
+    // in the sector of the first record behind it (inclusive, as the data in
+    // front of its first RMC/ZDA sentence may still belong to the range)
+    size_t after = search(records, length, from);
+    size_t behind = search(records, length, to);
+    uint64_t first = after > 0 ? records[after - 1].sector : nofsimage_firstSector(&image);
+    uint64_t last = behind < length ? records[behind].sector : nofsimage_lastSector(&image);
+
+    // The date is unknown until the first RMC/ZDA sentence, unless the
+    // range starts at an index record
+    long day = after > 0 ? records[after - 1].time / NMEA_SECONDS_PER_DAY : -1;
+    uint32_t timeOfDay = NMEA_TIME_INVALID;
+
+    char* decoded = malloc(NOFSIMAGE_MAX_DECODED);
+    char sentence[256];
+    size_t sentenceLength = 0, written = 0;
+
+    for (uint64_t sector = first; sector <= last; sector++) {
+        size_t decodedLength = nofsimage_decodeSector(&image, sector, decoded);
+
+        for (size_t i = 0; i < decodedLength; i++) {
+            if (decoded[i] == '$') {
+                sentenceLength = 0;
+            }
+
+            if (sentenceLength < sizeof(sentence) - 1) {
+                sentence[sentenceLength++] = decoded[i];
+            }
+
+            // The first sentence of the range may have been cut
+            if ((decoded[i] != '\n') || (sentence[0] != '$')) {
+                continue;
+            }
+
+            sentence[sentenceLength] = '\0';
+            sentenceLength = 0;
+
+            if ((strncmp(sentence, "$GPRMC", 6) == 0) || (strncmp(sentence, "$GPZDA", 6) == 0)) {
+                uint32_t dateTime = nmea_parseDateTime(sentence);
+                if (dateTime != NMEA_TIME_INVALID) {
+                    day = dateTime / NMEA_SECONDS_PER_DAY;
+                }
+            }
+
+            // Sentences without a time belong to the epoch in front of them
+            if ((strncmp(sentence, "$GPGGA", 6) == 0) || (strncmp(sentence, "$GPRMC", 6) == 0)
+                || (strncmp(sentence, "$GPZDA", 6) == 0)) {
+                uint32_t time = nmea_parseTime(nmea_getToken(sentence, 1));
+                if (time != NMEA_TIME_INVALID) {
+                    // Passing midnight before the date has been updated
+                    if ((timeOfDay != NMEA_TIME_INVALID) && (time + NMEA_MS_PER_DAY / 2 < timeOfDay)) {
+                        day++;
+                    }
+                    timeOfDay = time;
+                }
+            }
+
+            if ((day < 0) || (timeOfDay == NMEA_TIME_INVALID)) {
+                continue;
+            }
+
+            long time = day * NMEA_SECONDS_PER_DAY + timeOfDay / 1000;
+            if ((time >= from) && (time <= to)) {
+                fputs(sentence, stdout);
+                written++;
+            }
+        }
+    }
+
+    fprintf(stderr, "%zu sentences, read %lu of %lu data sectors (", written,
+        (unsigned long)(last - first + 1),
+        (unsigned long)(nofsimage_lastSector(&image) - nofsimage_firstSector(&image) + 1));
+    printTime(stderr, from);
+    fprintf(stderr, " - ");
+    printTime(stderr, to);
+    fprintf(stderr, ")\n");
+
+    free(decoded);
+    free(records);
+    nofsimage_close(&image);
+    return 0;
+}
@@ -0,0 +1,245 @@
+/**
+ * \file nofstrace.c
+ * \brief Host tool which decodes the dumps of the flight recorder (see
+ * trace.h) in a NoFS image
+ * \author Martin Matysiak
+ *
+ * Usage: nofstrace [-s session] image
+ *
+ * The dumps of the NOFS_REGION_TRACE region are listed in the order they
+ * have been written, either all of them or the ones of the session starting
+ * at the given sector. A dump is only used if the data sector it has been
+ * written behind belongs to its slot and to its session.
+ *
+ * The times of the events are given in milliseconds relative to the dump
+ * (the last event, the error for a ring saved by an error). They are unwrapped from the 16 bit timer values, so an
+ * interval longer than 65536 ticks (9.1 seconds) appears shorter. The end
+ * of a flush additionally shows the time the flush has taken.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nofsimage.h"
+
+/// A valid dump of the trace region
+typedef struct {
+    uint32_t session;
+    uint32_t sector;
+    const uint8_t* record;
+} dump_t;
+
+/**
+ * \brief Reads a number out of a record (MSB first)
+ */
+static uint32_t readNumber(const uint8_t* pBuffer, uint8_t pBytes) {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < pBytes; i++) {
+        value = (value << 8) | pBuffer[i];
+    }
+    return value;
+}
+
+static int compareSectors(const void* pA, const void* pB) {
+    const dump_t* a = pA;
+    const dump_t* b = pB;
+    return (a->sector > b->sector) - (a->sector < b->sector);
+}
+
+/**
+ * \brief Names the reason of a dump
+ */
+static const char* reasonName(uint8_t pReason) {
+    switch (pReason) {
+        case ERROR_SDMMC: return "error (SDMMC)";
+        case ERROR_NOFS: return "error (NOFS)";
+        case ERROR_GPS: return "error (GPS)";
+        case TRACE_DUMP_STALL: return "stalled flush";
+        case TRACE_DUMP_FAILED: return "failed flush";
+        case TRACE_DUMP_OVERFLOW: return "UART overflow";
+        default: return "unknown";
+    }
+}
+
+/**
+ * \brief Names a card command
+ */
+static const char* commandName(uint8_t pCommand) {
+    switch (pCommand) {
+        case SDMMC_GO_IDLE_STATE: return "GO_IDLE_STATE";
+        case SDMMC_SEND_OP_COND: return "SEND_OP_COND";
+        case SDMMC_SET_BLOCKLEN: return "SET_BLOCKLEN";
+        case SDMMC_READ_SINGLE_BLOCK: return "READ_SINGLE_BLOCK";
+        case SDMMC_WRITE_BLOCK: return "WRITE_BLOCK";
+        case SDMMC_CRC_ON_OFF: return "CRC_ON_OFF";
+        default: return "?";
+    }
+}
+
+/**
+ * \brief Prints the description of an event
+ */
+static void printEvent(uint8_t pType, uint8_t pData) {
+    if (pType & TRACE_COMMAND) {
+        printf("CMD%-2u %-17s R1 0x%02X", pType & 0x3F, commandName(pType & 0x3F), pData);
+        return;
+    }
+
+    switch (pType & 0xF0) {
+        case TRACE_BAUD:
+            printf("UART%u baudrate %lu (UBRR %u)", pType & 0x0F,
+                (unsigned long)(F_CPU / 16 / (pData + 1)), pData);
+            return;
+        case TRACE_OVERFLOW:
+            printf("UART%u overflow, %u%s bytes lost", pType & 0x0F, pData,
+                (pData == 0xFF) ? " or more" : "");
+            return;
+    }
+
+    switch (pType) {
+        case TRACE_BOOT:
+            printf("power-up, reset flags 0x%02X%s%s%s%s", pData, (pData & 0x01) ? " power-on" : "",
+                (pData & 0x02) ? " external" : "", (pData & 0x04) ? " brown-out" : "",
+                (pData & 0x08) ? " watchdog" : "");
+            break;
+        case TRACE_ERROR:
+            printf("error %u", pData);
+            break;
+        case TRACE_FLUSH:
+            printf("flush of sector ...%02X", pData);
+            break;
+        case TRACE_FLUSHED:
+            printf("flush %s", pData ? "done" : "FAILED");
+            break;
+        case TRACE_WRITE_FAILED:
+            printf("data block refused, response 0x%02X%s", pData,
+                ((pData & 0x1F) == 0x0B) ? " (CRC error)" : ((pData & 0x1F) == 0x0D) ? " (write error)" : "");
+            break;
+        case TRACE_READ_FAILED:
+            if (pData == 0) {
+                printf("read failed, CRC error");
+            } else {
+                printf("read failed, %s 0x%02X", (pData == 0xFF) ? "timeout" : "error token", pData);
+            }
+            break;
+        case TRACE_WRITE_RETRIES:
+        case TRACE_READ_RETRIES:
+            printf("%s needed %u retries%s", (pType == TRACE_WRITE_RETRIES) ? "write" : "read",
+                pData, (pData >= SDMMC_RETRIES) ? ", gave up" : "");
+            break;
+        case TRACE_DUMP:
+            printf("dump (%s)", reasonName(pData));
+            break;
+        default:
+            printf("unknown event 0x%02X, data 0x%02X", pType, pData);
+            break;
+    }
+}
+
+/**
+ * \brief Prints a dump, the times relative to its last event
+ */
+static void printDump(const dump_t* pDump) {
+    const uint8_t* record = pDump->record;
+    uint8_t reason = record[NOFS_TRACE_REASON];
+    uint8_t count = record[NOFS_TRACE_COUNT];
+    double rate = readNumber(record + NOFS_TRACE_RATE, 2);
+    const uint8_t* events = record + NOFS_TRACE_EVENTS;
+
+    printf("session %lu, behind sector %lu: %s (0x%02X), %u events\n",
+        (unsigned long)pDump->session, (unsigned long)pDump->sector, reasonName(reason), reason, count);
+
+    // Ticks in front of the last event, unwrapped backwards
+    long ticks[256];
+    ticks[count - 1] = 0;
+    for (int i = count - 2; i >= 0; i--) {
+        uint16_t time = readNumber(events + TRACE_EVENT_LENGTH * i + 2, 2);
+        uint16_t next = readNumber(events + TRACE_EVENT_LENGTH * (i + 1) + 2, 2);
+        ticks[i] = ticks[i + 1] - (uint16_t)(next - time);
+    }
+
+    long flushStart = 1;
+    for (int i = 0; i < count; i++) {
+        const uint8_t* event = events + TRACE_EVENT_LENGTH * i;
+
+        printf("  %10.1f ms  ", 1000.0 * ticks[i] / rate);
+        printEvent(event[0], event[1]);
+
+        if (event[0] == TRACE_FLUSH) {
+            flushStart = ticks[i];
+        } else if ((event[0] == TRACE_FLUSHED) && (flushStart <= 0)) {
+            printf(", took %.1f ms", 1000.0 * (ticks[i] - flushStart) / rate);
+            flushStart = 1;
+        }
+        printf("\n");
+    }
+
+    printf("\n");
+}
+
+int main(int argc, char** argv) {
+    long session = -1;
+    int argument = 1;
+
+    if ((argc == 4) && (strcmp(argv[1], "-s") == 0)) {
+        session = atol(argv[2]);
+        argument = 3;
+    }
+
+    if (argument != argc - 1) {
+        fprintf(stderr, "usage: %s [-s session] image\n", argv[0]);
+        return 1;
+    }
+
+    nofsimage_t image;
+    if (nofsimage_open(&image, argv[argument]) != 0) {
+        return 1;
+    }
+
+    uint64_t first, count;
+    if (!nofsimage_region(&image, NOFS_REGION_TRACE, &first, &count)) {
+        fprintf(stderr, "%s: no trace region\n", argv[argument]);
+        nofsimage_close(&image);
+        return 1;
+    }
+
+    dump_t* dumps = calloc(count, sizeof(dump_t));
+    size_t dumpCount = 0;
+
+    for (uint64_t slot = 0; slot < count; slot++) {
+        const uint8_t* record = nofsimage_sector(&image, first + slot);
+        uint32_t recordSession = readNumber(record + NOFS_TRACE_SESSION, 4);
+        uint32_t sector = readNumber(record + NOFS_TRACE_SECTOR, 4);
+        uint8_t events = record[NOFS_TRACE_COUNT];
+        nofsimage_header_t header;
+
+        // Dumps which don't belong to their slot have never been written
+        if ((sector < nofsimage_firstSector(&image)) || (sector >= image.sectors)
+            || (sector % count != slot)
+            || !nofsimage_header(&image, sector, &header) || (header.session != recordSession)
+            || ((session >= 0) && (recordSession != session)) || (events == 0)
+            || (NOFS_TRACE_EVENTS + TRACE_EVENT_LENGTH * events > NOFS_BUFFER_SIZE)
+            || (readNumber(record + NOFS_TRACE_RATE, 2) == 0)) {
+            continue;
+        }
+
+        dumps[dumpCount].session = recordSession;
+        dumps[dumpCount].sector = sector;
+        dumps[dumpCount].record = record;
+        dumpCount++;
+    }
+
+    qsort(dumps, dumpCount, sizeof(dump_t), compareSectors);
+    for (size_t i = 0; i < dumpCount; i++) {
+        printDump(&dumps[i]);
+    }
+
+    if (dumpCount == 0) {
+        fprintf(stderr, "no dumps\n");
+    }
+
+    free(dumps);
+    nofsimage_close(&image);
+    return dumpCount ? 0 : 1;
+}
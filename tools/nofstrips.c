@@ -0,0 +1,94 @@
+/**
+ * \file nofstrips.c
+ * \brief Host tool which lists the trips (sessions) of a NoFS image by means
+ * of the on-card session directory (see NOFS_DIRECTORY)
+ * \author Martin Matysiak
+ *
+ * Usage: nofstrips image [trip] > trip.nmea
+ *
+ * Without a trip number, the directory is listed: first and last sector,
+ * date and time of the first and last fix, number of fixes, bounding box
+ * (degrees) and distance of every trip. With a trip number, the text of the
+ * trip is extracted. Only the directory and the sectors of the trip are read
+ * from the image.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "nofsimage.h"
+#include "modules/nmea.h"
+
+/// Seconds between 1970-01-01 and 2000-01-01 (the epoch of the directory)
+#define EPOCH_2000 946684800L
+
+/**
+ * \brief Prints a time in seconds since 2000
+ */
+static void printTime(uint32_t pTime) {
+    if (pTime == NOFS_TIME_UNKNOWN) {
+        printf(" %19s", "-");
+        return;
+    }
+
+    time_t time = pTime + EPOCH_2000;
+    char text[32];
+    strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", gmtime(&time));
+    printf(" %19s", text);
+}
+
+int main(int argc, char** argv) {
+    if ((argc < 2) || (argc > 3)) {
+        fprintf(stderr, "usage: %s image [trip]\n", argv[0]);
+        return 1;
+    }
+
+    nofsimage_t image;
+    if (nofsimage_open(&image, argv[1]) != 0) {
+        return 1;
+    }
+
+    nofsimage_session_t* sessions;
+    long count = nofsimage_directory(&image, &sessions);
+    if (count < 0) {
+        fprintf(stderr, "%s: no session directory, use nofsunpack -l instead\n", argv[1]);
+        nofsimage_close(&image);
+        return 1;
+    }
+
+    if (argc == 3) {
+        long trip = atol(argv[2]);
+        if ((trip < 1) || (trip > count)) {
+            fprintf(stderr, "%s: no trip %s\n", argv[1], argv[2]);
+            free(sessions);
+            nofsimage_close(&image);
+            return 1;
+        }
+
+        char* text = malloc(NOFSIMAGE_MAX_DECODED);
+        for (uint64_t sector = sessions[trip - 1].first; sector <= sessions[trip - 1].last; sector++) {
+            fwrite(text, 1, nofsimage_decodeSector(&image, sector, text), stdout);
+        }
+        free(text);
+    } else {
+        printf("%4s %10s %10s %19s %19s %8s %10s %10s %11s %11s %9s %6s\n", "trip", "first", "last",
+            "start", "end", "fixes", "south", "north", "west", "east", "km", "state");
+
+        for (long i = 0; i < count; i++) {
+            nofsimage_session_t* session = &sessions[i];
+
+            printf("%4ld %10u %10u", i + 1, session->first, session->last);
+            printTime(session->start);
+            printTime(session->end);
+            printf(" %8u %10.5f %10.5f %11.5f %11.5f %9.3f %6s\n", session->fixes,
+                (double)session->south / NMEA_UNITS_PER_DEGREE, (double)session->north / NMEA_UNITS_PER_DEGREE,
+                (double)session->west / NMEA_UNITS_PER_DEGREE, (double)session->east / NMEA_UNITS_PER_DEGREE,
+                session->distance / 1000.0, session->state == NOFS_SESSION_CLOSED ? "closed" : "open");
+        }
+    }
+
+    free(sessions);
+    nofsimage_close(&image);
+    return 0;
+}
@@ -0,0 +1,234 @@
+/**
+ * \file nofsunpack.c
+ * \brief Host tool which extracts the (decompressed) text of a NoFS image
+ * \author Martin Matysiak
+ *
+ * Usage: nofsunpack [-j threads] [-a] [-l] image > log.nmea
+ *
+ * Sectors are compressed independently of each other, so the image is split
+ * into one range of sectors per thread. The results are written in order.
+ *
+ * With -a, the whole image is searched for sectors with a valid sector
+ * header instead of stopping at the terminal sector. This recovers logs
+ * behind a corrupted region or a lost terminal. Sentences which have been
+ * cut by a missing sector are dropped. With -l, the sessions found in the
+ * image are listed instead of extracting the text, together with the time to
+ * first fix reported by the logger at the start of each session ($PGLTTF).
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nofsimage.h"
+
+/// Work of a single thread
+typedef struct {
+    const nofsimage_t* image;
+    int recover;
+    uint64_t first, last;
+    char* output;
+    size_t length;
+} job_t;
+
+static void* unpack(void* pJob) {
+    job_t* job = pJob;
+    size_t capacity = (job->last - job->first + 1) * NOFS_BUFFER_SIZE * 2 + NOFSIMAGE_MAX_DECODED;
+
+    job->output = malloc(capacity);
+    job->length = 0;
+
+    for (uint64_t sector = job->first; sector <= job->last; sector++) {
+        if (capacity - job->length < NOFSIMAGE_MAX_DECODED) {
+            capacity *= 2;
+            job->output = realloc(job->output, capacity);
+        }
+
+        if (!job->recover) {
+            job->length += nofsimage_decodeSector(job->image, sector, job->output + job->length);
+            continue;
+        }
+
+        // Only sectors which are known to belong to the log are used
+        nofsimage_header_t header, neighbour;
+        if ((sector > 0) && !nofsimage_header(job->image, sector, &header)) {
+            continue;
+        }
+
+        char* output = job->output + job->length;
+        size_t length = nofsimage_decodeSector(job->image, sector, output);
+
+        // Without its predecessor, the sector starts in the middle of a sentence
+        if ((sector > 1) && (!nofsimage_header(job->image, sector - 1, &neighbour)
+            || (neighbour.session != header.session))) {
+            char* start = memchr(output, '$', length);
+            if (!start) {
+                continue;
+            }
+            length -= start - output;
+            memmove(output, start, length);
+        }
+
+        // Without its successor, the sector may end in the middle of a sentence
+        if ((sector + 1 < job->image->sectors) && (sector > 0)
+            && (!nofsimage_header(job->image, sector + 1, &neighbour)
+            || (neighbour.session != header.session))) {
+            while ((length > 0) && (output[length - 1] != '\n')) {
+                length--;
+            }
+        }
+
+        job->length += length;
+    }
+
+    return NULL;
+}
+
+/**
+ * \brief Prints a time of day as stored in the sector headers
+ */
+static void printTime(uint32_t pTime) {
+    if (pTime == NOFS_TIME_UNKNOWN) {
+        printf(" %12s", "-");
+    } else {
+        printf(" %02u:%02u:%02u.%03u", pTime / 3600000, pTime / 60000 % 60,
+            pTime / 1000 % 60, pTime % 1000);
+    }
+}
+
+/// Number of sectors at the start of a session searched for $PGLTTF
+#define TTFF_SECTORS 4
+
+/**
+ * \brief Looks up the time to first fix at the start of a session
+ *
+ * \param pTtff Receives the time to first fix (in seconds) as string, or "-"
+ * if the session doesn't contain a $PGLTTF sentence
+ */
+static void findTtff(const nofsimage_t* pImage, uint64_t pSector, uint64_t pSectors,
+    uint32_t pSession, char* pTtff, size_t pSize) {
+    char* text = malloc(TTFF_SECTORS * NOFSIMAGE_MAX_DECODED + 1);
+    size_t length = 0;
+    nofsimage_header_t header;
+
+    for (uint64_t sector = pSector; (sector < pSector + TTFF_SECTORS) && (sector < pSectors)
+        && nofsimage_header(pImage, sector, &header) && (header.session == pSession); sector++) {
+        length += nofsimage_decodeSector(pImage, sector, text + length);
+    }
+    text[length] = '\0';
+
+    // $PGLTTF,<epochs>,<seconds>,<aided>*hh
+    const char* field = strstr(text, "$PGLTTF,");
+    field = field ? strchr(field + 8, ',') : NULL;
+    if (field) {
+        size_t size = strcspn(++field, ",*\r\n");
+        snprintf(pTtff, pSize, "%.*s", (int)size, field);
+    } else {
+        snprintf(pTtff, pSize, "-");
+    }
+
+    free(text);
+}
+
+/**
+ * \brief Lists the sessions (consecutive sectors of the same session ID)
+ */
+static void list(const nofsimage_t* pImage, uint64_t pFirst, uint64_t pSectors) {
+    nofsimage_header_t header, first, last;
+    char ttff[16];
+    int open = 0;
+
+    printf("%10s %10s %10s %12s %12s %8s\n", "session", "first", "last", "start", "end", "ttff");
+
+    for (uint64_t sector = pFirst > 0 ? pFirst : 1; sector <= pSectors; sector++) {
+        int valid = (sector < pSectors) && nofsimage_header(pImage, sector, &header);
+
+        if (open && (!valid || (header.session != first.session))) {
+            printf("%10u %10u %10u", first.session, first.number, last.number);
+            printTime(first.time);
+            printTime(last.time);
+            printf(" %8s\n", ttff);
+            open = 0;
+        }
+
+        if (valid) {
+            if (!open) {
+                first = header;
+                findTtff(pImage, sector, pSectors, header.session, ttff, sizeof(ttff));
+                open = 1;
+            }
+            last = header;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int recover = 0, sessions = 0;
+    int argument = 1;
+
+    for (; (argument < argc - 1) && (argv[argument][0] == '-'); argument++) {
+        if ((strcmp(argv[argument], "-j") == 0) && (argument < argc - 2)) {
+            threads = atol(argv[++argument]);
+        } else if (strcmp(argv[argument], "-a") == 0) {
+            recover = 1;
+        } else if (strcmp(argv[argument], "-l") == 0) {
+            sessions = 1;
+        } else {
+            break;
+        }
+    }
+
+    if ((argument != argc - 1) || (threads < 1)) {
+        fprintf(stderr, "usage: %s [-j threads] [-a] [-l] image\n", argv[0]);
+        return 1;
+    }
+
+    nofsimage_t image;
+    if (nofsimage_open(&image, argv[argument]) != 0) {
+        return 1;
+    }
+
+    // Reserved regions in front of the data are skipped
+    uint64_t first = nofsimage_firstSector(&image);
+    uint64_t sectors = recover ? image.sectors : nofsimage_lastSector(&image) + 1;
+
+    if (sessions) {
+        list(&image, first, sectors);
+        nofsimage_close(&image);
+        return 0;
+    }
+
+    if (sectors <= first) {
+        nofsimage_close(&image);
+        return 0;
+    }
+
+    if ((uint64_t)threads > sectors - first) {
+        threads = sectors - first;
+    }
+
+    job_t* jobs = calloc(threads, sizeof(job_t));
+    pthread_t* ids = calloc(threads, sizeof(pthread_t));
+
+    for (long i = 0; i < threads; i++) {
+        jobs[i].image = &image;
+        jobs[i].recover = recover;
+        jobs[i].first = first + (sectors - first) * i / threads;
+        jobs[i].last = first + (sectors - first) * (i + 1) / threads - 1;
+        pthread_create(&ids[i], NULL, unpack, &jobs[i]);
+    }
+
+    for (long i = 0; i < threads; i++) {
+        pthread_join(ids[i], NULL);
+        fwrite(jobs[i].output, 1, jobs[i].length, stdout);
+        free(jobs[i].output);
+    }
+
+    free(jobs);
+    free(ids);
+    nofsimage_close(&image);
+    return 0;
+}
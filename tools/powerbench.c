@@ -0,0 +1,209 @@
+/**
+ * \file powerbench.c
+ * \brief Host tool which estimates the energy the logger needs per logged fix
+ * \author Martin Matysiak
+ *
+ * Usage: powerbench [-p profile] [-f hz] [-s hz] [-v volts] [-i state=mA]... capture.nmea
+ *
+ * The valid sentences of the capture are written through the firmware's
+ * NoFS code onto a simulated memory card with the given latency profile (see
+ * sdmmc_host.h). The capture is assumed to have been recorded at the given
+ * update rate (default 1 Hz), an epoch starts with the type of the first
+ * sentence. A fix is an epoch with at least one valid sentence.
+ *
+ * The time of each component is split into its states:
+ *
+ * - GPS-module: tracking continuously or in power save mode (see power.h),
+ *   which the power scheduling only uses up to the rate given with -s
+ *   (POWER_SAVE_FREQUENCY, default 1 Hz)
+ * - memory card: programming a sector or transferring it, otherwise idle
+ *   (left selected by the firmware before the power scheduling) or standby
+ *   (released with eight clocks, see sdmmc.c)
+ * - MCU: active while receiving and processing the bytes and while waiting
+ *   for the card and in the delays of the firmware, otherwise in idle sleep
+ *
+ * With the currents of the states (typical figures by default, the ones of
+ * the actual parts can be given with -i), both schedules are reported as
+ * average current and energy per fix.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdmmc_host.h"
+#include "modules/gps.h"
+
+/// MCU cycles per received byte (interrupt, classification, NoFS buffer)
+#define CYCLES_PER_BYTE 100
+
+/// MCU cycles per byte sent to the card (F_CPU / 2 plus the loop)
+#define CYCLES_PER_SPI_BYTE 24
+
+/// Bytes transferred per sector write (command, dummy clocks, data, CRC, response)
+#define SPI_BYTES_PER_WRITE (7 + 100 + 1 + SDMMC_SECTOR_SIZE + 2 + 2)
+
+/// States of the components
+enum {
+    STATE_GPS, STATE_GPS_SAVE, STATE_CARD_WRITE, STATE_CARD_IDLE, STATE_CARD_STANDBY,
+    STATE_MCU_ACTIVE, STATE_MCU_IDLE, STATE_COUNT
+};
+
+/// Names of the states (as used by -i)
+static const char* fStates[STATE_COUNT] = {
+    "gps", "gps-save", "card-write", "card-idle", "card-standby", "mcu-active", "mcu-idle"
+};
+
+/// Current of each state in mA
+static double fCurrents[STATE_COUNT] = {28.0, 14.0, 35.0, 1.5, 0.2, 3.5, 1.0};
+
+int main(int argc, char** argv) {
+    const char* profile = "none";
+    int frequency = 1;
+    int saveFrequency = 1;
+    double volts = 3.3;
+    int argument = 1;
+
+    for (; (argument < argc - 2) && (argv[argument][0] == '-'); argument += 2) {
+        const char* value = argv[argument + 1];
+
+        if (strcmp(argv[argument], "-p") == 0) {
+            profile = value;
+        } else if (strcmp(argv[argument], "-f") == 0) {
+            frequency = atoi(value);
+        } else if (strcmp(argv[argument], "-s") == 0) {
+            saveFrequency = atoi(value);
+        } else if (strcmp(argv[argument], "-v") == 0) {
+            volts = atof(value);
+        } else if (strcmp(argv[argument], "-i") == 0) {
+            size_t length = strcspn(value, "=");
+            int state = 0;
+            while ((state < STATE_COUNT) && ((strlen(fStates[state]) != length)
+                || strncmp(fStates[state], value, length))) {
+                state++;
+            }
+            if ((state == STATE_COUNT) || !value[length]) {
+                fprintf(stderr, "unknown state: %s\n", value);
+                return 1;
+            }
+            fCurrents[state] = atof(value + length + 1);
+        } else {
+            break;
+        }
+    }
+
+    if ((argument != argc - 1) || (frequency <= 0)) {
+        fprintf(stderr, "usage: %s [-p profile] [-f hz] [-s hz] [-v volts] [-i state=mA]... capture.nmea\n", argv[0]);
+        return 1;
+    }
+
+    FILE* file = fopen(argv[argument], "r");
+    if (!file) {
+        perror(argv[argument]);
+        return 1;
+    }
+
+    // 32 MB, enough for captures of several days
+    sdmmchost_create(1 << 16);
+    if (sdmmchost_setLatency(profile) != 0) {
+        return 1;
+    }
+    nofs_init();
+    double start = hostDelayed();
+
+    char line[256], sentence[256], first[7] = "";
+    unsigned long epochs = 0, fixes = 0, bytes = 0, sentences = 0;
+    int epochValid = FALSE;
+
+    while (fgets(line, sizeof(line), file)) {
+        char* begin = strchr(line, '$');
+        if (!begin) {
+            continue;
+        }
+
+        size_t length = strcspn(begin, "\r\n");
+        snprintf(sentence, sizeof(sentence), "%.*s\r\n", (int)length, begin);
+
+        if (!epochs || (strncmp(sentence, first, 6) == 0)) {
+            if (!epochs) {
+                snprintf(first, sizeof(first), "%.6s", sentence);
+            }
+            fixes += epochValid;
+            epochValid = FALSE;
+            epochs++;
+        }
+
+        bytes += length + 2;
+        sentences++;
+
+        // Invalid sentences are dropped by the main loop
+        if (gps_classifyNMEA(sentence) & GPS_NMEA_VALID) {
+            nofs_writeString(sentence);
+            epochValid = TRUE;
+        }
+    }
+    fixes += epochValid;
+    fclose(file);
+
+    if (fixes == 0) {
+        fprintf(stderr, "%s: no fixes\n", argv[argument]);
+        return 1;
+    }
+
+    // Time of each state in ms
+    unsigned long writes;
+    double busy = sdmmchost_busy(&writes);
+    double duration = epochs * 1000.0 / frequency;
+    double transfer = writes * SPI_BYTES_PER_WRITE * CYCLES_PER_SPI_BYTE * 1000.0 / F_CPU;
+    double active = (hostDelayed() - start) + transfer + bytes * CYCLES_PER_BYTE * 1000.0 / F_CPU;
+    double card = busy + transfer;
+
+    if (active > duration) {
+        fprintf(stderr, "the MCU can't keep up with the capture at %d Hz\n", frequency);
+        return 1;
+    }
+
+    double times[2][STATE_COUNT] = {{0}};
+    const char* schedules[2] = {"continuous", "power-save"};
+
+    times[0][STATE_GPS] = duration;
+    times[0][STATE_CARD_IDLE] = duration - card;
+    times[1][(frequency <= saveFrequency) ? STATE_GPS_SAVE : STATE_GPS] = duration;
+    times[1][STATE_CARD_STANDBY] = duration - card;
+
+    for (int s = 0; s < 2; s++) {
+        times[s][STATE_CARD_WRITE] = card;
+        times[s][STATE_MCU_ACTIVE] = active;
+        times[s][STATE_MCU_IDLE] = duration - active;
+    }
+
+    printf("%lu epochs at %d Hz, %lu fixes, %lu sentences, %lu sector writes (%s)\n\n",
+        epochs, frequency, fixes, sentences, writes, profile);
+
+    printf("%-12s", "state [s]");
+    for (int i = 0; i < STATE_COUNT; i++) {
+        printf(" %12s", fStates[i]);
+    }
+    printf(" %8s %8s\n", "mA", "mJ/fix");
+
+    printf("%-12s", "current [mA]");
+    for (int i = 0; i < STATE_COUNT; i++) {
+        printf(" %12.2f", fCurrents[i]);
+    }
+    printf("\n");
+
+    for (int s = 0; s < 2; s++) {
+        double charge = 0;
+
+        printf("%-12s", schedules[s]);
+        for (int i = 0; i < STATE_COUNT; i++) {
+            printf(" %12.3f", times[s][i] / 1000);
+            charge += fCurrents[i] * times[s][i] / 1000;
+        }
+
+        // mA * s * V = mJ
+        printf(" %8.2f %8.2f\n", charge * 1000 / duration, charge * volts / fixes);
+    }
+
+    return 0;
+}
@@ -0,0 +1,247 @@
+/**
+ * \file sdmmc_host.c
+ * \brief Host implementation of the SDMMC interface (see modules/sdmmc.h)
+ * which keeps the memory card in RAM
+ * \author Martin Matysiak
+ *
+ * This allows running the firmware's NoFS code on the host, e.g. in order to
+ * benchmark it or to produce images for the other tools.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdmmc_host.h"
+
+/// Bytes clocked by a sector write besides the data (see sdmmc.c): dummy
+/// byte, command, response, 100 dummy clocks, start token, CRC16, data
+/// response, end of the busy signal and release
+#define SDMMCHOST_WRITE_OVERHEAD 115
+/// Bytes clocked by a read besides the data: dummy byte, command, response,
+/// access time, start token, CRC16 and release
+#define SDMMCHOST_READ_OVERHEAD 15
+/// Bytes clocked by a command without data
+#define SDMMCHOST_COMMAND_BYTES 10
+
+/// Latency profiles of the writes
+typedef enum {
+    LATENCY_NONE, LATENCY_FIXED, LATENCY_RANDOM, LATENCY_GC, LATENCY_TRACE
+} latency_t;
+
+/// Content of the simulated memory card
+static uint8_t* fCard = NULL;
+/// Number of sectors of the simulated memory card
+static uint32_t fSectors = 0;
+/// The block length which is currently set
+static uint16_t fBlockLength = SDMMC_SECTOR_SIZE;
+
+/// Latency profile of the writes
+static latency_t fLatency = LATENCY_NONE;
+/// Parameters of the profile (in ms, the period of LATENCY_GC in writes)
+static double fParameters[3];
+/// Recorded latencies of LATENCY_TRACE
+static double* fTrace = NULL;
+static size_t fTraceLength = 0;
+/// Number of writes since the profile has been set
+static unsigned long fWrites = 0;
+/// Sum of the latencies since the profile has been set
+static double fBusy = 0;
+/// Time spent clocking the transfers since the profile has been set
+static double fTransfers = 0;
+/// SPI clock of the transfers
+static uint8_t fSpeed = SDMMC_SPEED;
+/// State of the random generator of LATENCY_RANDOM
+static unsigned short fSeed[3];
+
+/**
+ * \brief Reads the latencies of a trace file
+ * \return 0 on success, -1 otherwise
+ */
+static int readTrace(const char* pPath) {
+    FILE* file = fopen(pPath, "r");
+    if (!file) {
+        perror(pPath);
+        return -1;
+    }
+
+    size_t capacity = 256;
+    char line[256];
+
+    free(fTrace);
+    fTrace = malloc(capacity * sizeof(double));
+    fTraceLength = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+        double value;
+        if ((line[0] == '#') || (sscanf(line, "%lf", &value) != 1)) {
+            continue;
+        }
+
+        if (fTraceLength == capacity) {
+            capacity *= 2;
+            fTrace = realloc(fTrace, capacity * sizeof(double));
+        }
+        fTrace[fTraceLength++] = value;
+    }
+
+    fclose(file);
+    if (fTraceLength == 0) {
+        fprintf(stderr, "%s: no latencies\n", pPath);
+        return -1;
+    }
+
+    return 0;
+}
+
+int sdmmchost_setLatency(const char* pProfile) {
+    double* p = fParameters;
+    char end;
+
+    fWrites = 0;
+    fBusy = 0;
+    fTransfers = 0;
+    fSeed[0] = 0x330E;
+    fSeed[1] = 0xABCD;
+    fSeed[2] = 0x1234;
+
+    if (strcmp(pProfile, "none") == 0) {
+        fLatency = LATENCY_NONE;
+    } else if (sscanf(pProfile, "fixed:%lf%c", &p[0], &end) == 1) {
+        fLatency = LATENCY_FIXED;
+    } else if ((sscanf(pProfile, "random:%lf,%lf%c", &p[0], &p[1], &end) == 2) && (p[0] <= p[1])) {
+        fLatency = LATENCY_RANDOM;
+    } else if ((sscanf(pProfile, "gc:%lf,%lf,%lf%c", &p[0], &p[1], &p[2], &end) == 3) && (p[2] >= 1)) {
+        fLatency = LATENCY_GC;
+    } else if (strncmp(pProfile, "trace:", 6) == 0) {
+        if (readTrace(pProfile + 6) != 0) {
+            return -1;
+        }
+        fLatency = LATENCY_TRACE;
+    } else {
+        fprintf(stderr, "invalid latency profile: %s\n", pProfile);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * \brief Returns the latency of the next write according to the profile
+ */
+static double writeLatency() {
+    unsigned long write = fWrites++;
+
+    switch (fLatency) {
+        case LATENCY_FIXED:
+            return fParameters[0];
+        case LATENCY_RANDOM:
+            return fParameters[0] + erand48(fSeed) * (fParameters[1] - fParameters[0]);
+        case LATENCY_GC:
+            return (write % (unsigned long)fParameters[2] == (unsigned long)fParameters[2] - 1)
+                ? fParameters[1] : fParameters[0];
+        case LATENCY_TRACE:
+            return fTrace[write % fTraceLength];
+        default:
+            return 0;
+    }
+}
+
+double sdmmchost_busy(unsigned long* pWrites) {
+    *pWrites = fWrites;
+    return fBusy;
+}
+
+double sdmmchost_transfers() {
+    return fTransfers;
+}
+
+void sdmmchost_setSpeed(uint8_t pSpeed) {
+    fSpeed = pSpeed;
+}
+
+/**
+ * \brief Adds the time the SPI needs for the given number of bytes
+ */
+static void transfer(unsigned long pBytes) {
+    double time = pBytes * 8000.0 * SPI_DIVIDER(fSpeed) / F_CPU;
+
+    fTransfers += time;
+    hostDelay(time);
+}
+
+void sdmmchost_create(uint32_t pSectors) {
+    free(fCard);
+    fCard = calloc(pSectors, SDMMC_SECTOR_SIZE);
+    fSectors = pSectors;
+
+    // A freshly formatted card: header, pointer to sector 0 and terminals
+    memcpy(fCard, NOFS_HEADER, NOFS_HEADER_LENGTH);
+    fCard[NOFS_DATA_START] = NOFS_TERMINAL;
+    fCard[SDMMC_SECTOR_SIZE] = NOFS_TERMINAL;
+}
+
+int sdmmchost_save(const char* pPath) {
+    FILE* file = fopen(pPath, "wb");
+    if (!file) {
+        perror(pPath);
+        return -1;
+    }
+
+    size_t written = fwrite(fCard, SDMMC_SECTOR_SIZE, fSectors, file);
+    fclose(file);
+    return written == fSectors ? 0 : -1;
+}
+
+void sdmmc_init() {
+    if (!fCard) {
+        error(ERROR_SDMMC);
+    }
+
+    fBlockLength = SDMMC_SECTOR_SIZE;
+}
+
+uint8_t sdmmc_writeSector(uint32_t pSectorNum, char* pInput) {
+    if (pSectorNum >= fSectors) {
+        return FALSE;
+    }
+
+    memcpy(fCard + (uint64_t)pSectorNum * SDMMC_SECTOR_SIZE, pInput, fBlockLength);
+    transfer(SDMMCHOST_WRITE_OVERHEAD + fBlockLength);
+
+    double latency = writeLatency();
+    fBusy += latency;
+    hostDelay(latency);
+    return TRUE;
+}
+
+uint8_t sdmmc_writeCommand(uint8_t pCommand, uint32_t pArgument) {
+    transfer(SDMMCHOST_COMMAND_BYTES);
+    return 0;
+}
+
+uint8_t sdmmc_calibrate(uint32_t pSector, char* pBuffer) {
+    // The clock is the one of sdmmchost_setSpeed, the scratch sector is
+    // written like on the card
+    memset(pBuffer, 0, SDMMC_SECTOR_SIZE);
+    return sdmmc_writeSector(pSector, pBuffer);
+}
+
+uint8_t sdmmc_readSector(uint32_t pSectorNum, char* pOutput) {
+    transfer(SDMMCHOST_READ_OVERHEAD + fBlockLength);
+
+    if (pSectorNum >= fSectors) {
+        // Behave like an empty area of the card
+        memset(pOutput, NOFS_TERMINAL, fBlockLength);
+        return FALSE;
+    }
+
+    memcpy(pOutput, fCard + (uint64_t)pSectorNum * SDMMC_SECTOR_SIZE, fBlockLength);
+    return TRUE;
+}
+
+uint8_t sdmmc_changeBlockLength(uint16_t pLength) {
+    transfer(SDMMCHOST_COMMAND_BYTES);
+    fBlockLength = pLength ? pLength : SDMMC_SECTOR_SIZE;
+    return TRUE;
+}
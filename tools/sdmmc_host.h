@@ -0,0 +1,74 @@
+/**
+ * \file sdmmc_host.h
+ * \brief Host implementation of the SDMMC interface (see modules/sdmmc.h)
+ * which keeps the memory card in RAM
+ * \author Martin Matysiak
+ *
+ * Writes can be given a latency in order to simulate the programming time
+ * of a real card. It is added to the simulated time (see hostDelayed), the
+ * calls return immediately. Profiles:
+ *
+ * - none: no latency (default)
+ * - fixed:ms: every write takes the same time
+ * - random:min,max: uniformly distributed between min and max
+ * - gc:ms,spike,period: every period-th write stalls for spike ms (garbage
+ *   collection of the card), the others take ms
+ * - trace:file: latencies recorded from a real card (one value in ms per
+ *   line, '#' starts a comment), replayed cyclically
+ *
+ * Every transfer additionally takes the time the SPI needs to clock the
+ * bytes of sdmmc.c (command, data block, CRC16, dummy clocks) at the
+ * configured SPI speed, reads as well as writes. This time is spent by the
+ * CPU, while the latency is the time the card is busy on its own.
+ */
+
+#ifndef SDMMC_HOST_H
+    #define SDMMC_HOST_H
+
+    #include "modules/nofs.h"
+    #include "modules/sdmmc.h"
+
+    /**
+     * \brief Creates a freshly formatted NoFS memory card
+     * \param pSectors The size of the card in sectors
+     */
+    void sdmmchost_create(uint32_t pSectors);
+
+    /**
+     * \brief Writes the content of the memory card into an image file
+     * \return 0 on success, -1 otherwise
+     */
+    int sdmmchost_save(const char* pPath);
+
+    /**
+     * \brief Sets the latency profile of the writes (see above)
+     *
+     * The random generator is reseeded, so the same profile always produces
+     * the same latencies.
+     *
+     * \return 0 on success, -1 if the profile is invalid (an error message
+     * has been printed)
+     */
+    int sdmmchost_setLatency(const char* pProfile);
+
+    /**
+     * \brief Returns the programming time of the writes since the profile
+     * has been set (the time the card has been busy, without the transfers)
+     * \param pWrites Receives the number of writes
+     * \return The time in milliseconds
+     */
+    double sdmmchost_busy(unsigned long* pWrites);
+
+    /**
+     * \brief Returns the time the SPI has spent clocking the transfers
+     * since the profile has been set
+     * \return The time in milliseconds
+     */
+    double sdmmchost_transfers();
+
+    /**
+     * \brief Sets the SPI clock of the transfers (default: SDMMC_SPEED)
+     * \param pSpeed One of the SPI_SPEED values (see spi.h)
+     */
+    void sdmmchost_setSpeed(uint8_t pSpeed);
+#endif
@@ -0,0 +1,425 @@
+/**
+ * \file spi_host.c
+ * \brief Host model of the registers used by spi.c and sdmmc.c, with a
+ * simulated memory card on the SPI
+ * \author Martin Matysiak
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "global.h"
+#include "protocols/spi.h"
+#include "modules/sdmmc.h"
+
+/// Time from a command to the start token of the data block (bytes)
+#define SPIHOST_ACCESS 2
+
+uint8_t spihost_prr = 0;
+uint8_t spihost_portb = 0;
+uint8_t spihost_ddrb = 0;
+uint8_t spihost_tccr1a = 0;
+
+/// SPCR and SPSR, the copy returned while the SPI is powered down
+static uint8_t fRegisters[2];
+static uint8_t fCopy;
+/// The byte received by the last transfer
+static uint8_t fData = 0xFF;
+
+/// TCCR1B and TIFR1
+static uint8_t fTimer[2];
+/// TCNT1 as returned by the last access, and its exact value
+static uint16_t fCounter = 0;
+static uint16_t fCounterSeen = 0;
+static double fTicks = 0;
+/// Simulated time of the last access to Timer1
+static double fTimerBase = 0;
+static uint8_t fRunning = FALSE;
+
+/// State of the card
+typedef enum {
+    CARD_COMMAND, CARD_TOKEN, CARD_DATA
+} card_state_t;
+
+static uint8_t* fCard = NULL;
+static uint32_t fSectors = 0;
+static uint8_t fMaxSpeed = SPI_SPEED_2;
+static double fBusy = 0;
+
+static card_state_t fState = CARD_COMMAND;
+/// TRUE once CMD0 has switched the card into SPI mode
+static uint8_t fSpiMode = FALSE;
+/// TRUE until CMD1 has finished the initialization
+static uint8_t fIdle = TRUE;
+static uint8_t fInitAttempts = 0;
+static uint8_t fCrc = FALSE;
+static uint16_t fBlockLength = SDMMC_SECTOR_SIZE;
+
+/// The command being received
+static uint8_t fCommand[6];
+static uint8_t fCommandLength = 0;
+/// Byte address of the block being written, the block and its CRC16
+static uint32_t fAddress;
+static uint8_t fBlock[SDMMC_SECTOR_SIZE + 2];
+static uint16_t fBlockIndex;
+static uint8_t fBlockCorrupted;
+
+/// Bytes the card sends next (response, data block)
+static uint8_t fOutput[SDMMC_SECTOR_SIZE + 8];
+static uint16_t fOutputLength = 0;
+static uint16_t fOutputIndex = 0;
+/// Simulated time until which the card programs a block
+static double fBusyUntil = 0;
+
+static spihost_stats_t fStats;
+
+/**
+ * \brief Calculates the CRC7 of a command (shifted left by one)
+ */
+static uint8_t crc7(const uint8_t* pData, uint8_t pLength) {
+    uint8_t crc = 0;
+
+    for (uint8_t i = 0; i < pLength; i++) {
+        for (uint8_t bit = 0x80; bit; bit >>= 1) {
+            uint8_t feedback = ((crc & 0x80) != 0) ^ ((pData[i] & bit) != 0);
+            crc <<= 1;
+            if (feedback) {
+                crc ^= 0x12;
+            }
+        }
+    }
+
+    return crc;
+}
+
+/**
+ * \brief Calculates the CRC16 of a data block
+ */
+static uint16_t crc16(const uint8_t* pData, uint16_t pLength) {
+    uint16_t crc = 0;
+
+    for (uint16_t i = 0; i < pLength; i++) {
+        crc ^= (uint16_t)pData[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+/**
+ * \brief Returns the SPI speed selected by SPCR and SPSR
+ */
+static uint8_t currentSpeed() {
+    // Dividers 4, 16, 64 and 128, SPI2X halves them
+    static const uint8_t speeds[4] = {SPI_SPEED_4, SPI_SPEED_16, SPI_SPEED_64, SPI_SPEED_128};
+    uint8_t speed = speeds[fRegisters[0] & ((1 << SPR1) | (1 << SPR0))];
+
+    return (fRegisters[1] & (1 << SPI2X)) ? speed - 1 : speed;
+}
+
+/**
+ * \brief Queues a byte the card sends
+ */
+static void queue(uint8_t pByte) {
+    fOutput[fOutputLength++] = pByte;
+}
+
+/**
+ * \brief Changes a byte of a data block transferred faster than the card
+ * works reliably
+ */
+static uint8_t distort(uint8_t pByte, uint16_t pIndex, uint8_t pSpeed) {
+    return ((pSpeed < fMaxSpeed) && (pIndex % 64 == 7)) ? pByte ^ 0x10 : pByte;
+}
+
+/**
+ * \brief Executes a received command
+ */
+static void execute(uint8_t pSpeed) {
+    uint8_t command = fCommand[0] & 0x3F;
+    uint32_t argument = ((uint32_t)fCommand[1] << 24) | ((uint32_t)fCommand[2] << 16)
+        | ((uint32_t)fCommand[3] << 8) | fCommand[4];
+
+    fOutputLength = 0;
+    fOutputIndex = 0;
+
+    // The CRC7 of CMD0 is always checked (the card isn't in SPI mode yet)
+    if (((command == SDMMC_GO_IDLE_STATE) || fCrc)
+        && (fCommand[5] != (crc7(fCommand, 5) | 1))) {
+        queue(0xFF);
+        queue(0x08 | fIdle);
+        return;
+    }
+
+    if (!fSpiMode && (command != SDMMC_GO_IDLE_STATE)) {
+        return;
+    }
+
+    uint8_t response = fIdle;
+    uint32_t sector = argument / SDMMC_SECTOR_SIZE;
+    uint16_t offset = argument % SDMMC_SECTOR_SIZE;
+
+    switch (command) {
+        case SDMMC_GO_IDLE_STATE:
+            fSpiMode = TRUE;
+            fIdle = TRUE;
+            fInitAttempts = 0;
+            fCrc = FALSE;
+            response = 0x01;
+            break;
+        case SDMMC_SEND_OP_COND:
+            if (++fInitAttempts >= 3) {
+                fIdle = FALSE;
+            }
+            response = fIdle;
+            break;
+        case SDMMC_CRC_ON_OFF:
+            fCrc = argument & 1;
+            break;
+        case SDMMC_SET_BLOCKLEN:
+            if ((argument == 0) || (argument > SDMMC_SECTOR_SIZE)) {
+                response |= 0x40;
+            } else {
+                fBlockLength = argument;
+            }
+            break;
+        case SDMMC_READ_SINGLE_BLOCK:
+        case SDMMC_WRITE_BLOCK:
+            if (fIdle) {
+                response |= 0x04;
+            } else if ((sector >= fSectors) || (offset + fBlockLength > SDMMC_SECTOR_SIZE)) {
+                response |= 0x20;
+            }
+            break;
+        default:
+            response |= 0x04;
+            break;
+    }
+
+    queue(0xFF);
+    queue(response);
+
+    if (response != 0) {
+        return;
+    }
+
+    if (command == SDMMC_WRITE_BLOCK) {
+        fAddress = argument;
+        fState = CARD_TOKEN;
+    } else if (command == SDMMC_READ_SINGLE_BLOCK) {
+        const uint8_t* block = fCard + (uint64_t)sector * SDMMC_SECTOR_SIZE + offset;
+        uint16_t crc = crc16(block, fBlockLength);
+        uint8_t corrupted = FALSE;
+
+        for (uint8_t i = 0; i < SPIHOST_ACCESS; i++) {
+            queue(0xFF);
+        }
+        queue(0xFE);
+
+        for (uint16_t i = 0; i < fBlockLength; i++) {
+            uint8_t data = distort(block[i], i, pSpeed);
+            corrupted |= (data != block[i]);
+            queue(data);
+        }
+
+        queue(crc >> 8);
+        queue(crc);
+
+        fStats.blocks[pSpeed]++;
+        fStats.corrupted += corrupted;
+        fStats.lastSpeed = pSpeed;
+    }
+}
+
+/**
+ * \brief Stores a received data block
+ */
+static void store(uint8_t pSpeed) {
+    uint16_t received = ((uint16_t)fBlock[fBlockLength] << 8) | fBlock[fBlockLength + 1];
+    uint32_t sector = fAddress / SDMMC_SECTOR_SIZE;
+    uint16_t offset = fAddress % SDMMC_SECTOR_SIZE;
+
+    fOutputLength = 0;
+    fOutputIndex = 0;
+    fStats.blocks[pSpeed]++;
+    fStats.corrupted += fBlockCorrupted;
+    fStats.lastSpeed = pSpeed;
+
+    if (fCrc && (received != crc16(fBlock, fBlockLength))) {
+        fStats.refused++;
+        queue(0x0B);
+        return;
+    }
+
+    memcpy(fCard + (uint64_t)sector * SDMMC_SECTOR_SIZE + offset, fBlock, fBlockLength);
+    queue(0x05);
+    fBusyUntil = hostDelayed() + fBusy;
+}
+
+/**
+ * \brief Exchanges a byte with the card
+ * \return The byte sent by the card
+ */
+static uint8_t exchange(uint8_t pByte, uint8_t pSpeed) {
+    // A deselected card doesn't drive MISO and drops its response
+    if (spihost_portb & (1 << SPI_CS)) {
+        fState = CARD_COMMAND;
+        fCommandLength = 0;
+        fOutputLength = 0;
+        fOutputIndex = 0;
+        return 0xFF;
+    }
+
+    uint8_t output = 0xFF;
+    if (fOutputIndex < fOutputLength) {
+        output = fOutput[fOutputIndex++];
+    } else if (hostDelayed() < fBusyUntil) {
+        output = 0x00;
+    }
+
+    switch (fState) {
+        case CARD_TOKEN:
+            if (pByte == 0xFE) {
+                fState = CARD_DATA;
+                fBlockIndex = 0;
+                fBlockCorrupted = FALSE;
+            }
+            break;
+        case CARD_DATA:
+            if (fBlockIndex < fBlockLength) {
+                uint8_t data = distort(pByte, fBlockIndex, pSpeed);
+                fBlockCorrupted |= (data != pByte);
+                pByte = data;
+            }
+            fBlock[fBlockIndex++] = pByte;
+
+            if (fBlockIndex == fBlockLength + 2) {
+                fState = CARD_COMMAND;
+                store(pSpeed);
+            }
+            break;
+        default:
+            // Commands start with the bits 01
+            if ((fCommandLength == 0) && ((pByte & 0xC0) != 0x40)) {
+                break;
+            }
+
+            fCommand[fCommandLength++] = pByte;
+            if (fCommandLength == 6) {
+                fCommandLength = 0;
+                execute(pSpeed);
+            }
+            break;
+    }
+
+    return output;
+}
+
+uint8_t* spihost_register(uint8_t pRegister) {
+    if (spihost_prr & (1 << PRSPI)) {
+        fStats.ignored++;
+        fCopy = fRegisters[pRegister];
+        return &fCopy;
+    }
+
+    return &fRegisters[pRegister];
+}
+
+uint8_t spihost_data() {
+    fRegisters[1] &= ~(1 << SPIF);
+    return fData;
+}
+
+void spihost_start(uint8_t pByte) {
+    if (spihost_prr & (1 << PRSPI)) {
+        fprintf(stderr, "spi_host: transfer while the SPI is powered down\n");
+        exit(1);
+    }
+
+    if ((fRegisters[0] & ((1 << SPE) | (1 << MSTR))) != ((1 << SPE) | (1 << MSTR))) {
+        fprintf(stderr, "spi_host: transfer while the SPI is not enabled as master\n");
+        exit(1);
+    }
+
+    uint8_t speed = currentSpeed();
+    hostDelay(8000.0 * SPI_DIVIDER(speed) / F_CPU);
+
+    fData = exchange(pByte, speed);
+    fRegisters[1] |= (1 << SPIF);
+}
+
+/**
+ * \brief Advances Timer1 to the simulated time
+ */
+static void advanceTimer() {
+    static const uint16_t prescalers[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+    uint16_t prescaler = prescalers[fTimer[0] & ((1 << CS12) | (1 << CS11) | (1 << CS10))];
+    double now = hostDelayed();
+
+    // A value written since the last access replaces the count
+    if (fCounter != fCounterSeen) {
+        fTicks = fCounter;
+    }
+
+    if (prescaler) {
+        if (!fRunning) {
+            fTimer[1] &= ~(1 << TOV1);
+            fRunning = TRUE;
+        }
+
+        fTicks += (now - fTimerBase) * F_CPU / 1000.0 / prescaler;
+        if (fTicks >= 65536) {
+            fTimer[1] |= (1 << TOV1);
+            fTicks = fmod(fTicks, 65536);
+        }
+    } else {
+        fRunning = FALSE;
+    }
+
+    fTimerBase = now;
+    fCounter = (uint16_t)fTicks;
+    fCounterSeen = fCounter;
+}
+
+uint8_t* spihost_timer(uint8_t pRegister) {
+    advanceTimer();
+    return &fTimer[pRegister];
+}
+
+uint16_t* spihost_counter() {
+    advanceTimer();
+    return &fCounter;
+}
+
+void spihost_create(uint32_t pSectors, uint8_t pMaxSpeed, double pBusy) {
+    free(fCard);
+    fCard = calloc(pSectors, SDMMC_SECTOR_SIZE);
+    fSectors = pSectors;
+    fMaxSpeed = pMaxSpeed;
+    fBusy = pBusy;
+
+    fState = CARD_COMMAND;
+    fSpiMode = FALSE;
+    fIdle = TRUE;
+    fCrc = FALSE;
+    fBlockLength = SDMMC_SECTOR_SIZE;
+    fCommandLength = 0;
+    fOutputLength = 0;
+    fOutputIndex = 0;
+    fBusyUntil = 0;
+
+    spihost_prr = 0;
+    memset(&fStats, 0, sizeof(fStats));
+    fStats.lastSpeed = -1;
+}
+
+spihost_stats_t spihost_takeStats() {
+    spihost_stats_t stats = fStats;
+
+    memset(&fStats, 0, sizeof(fStats));
+    fStats.lastSpeed = stats.lastSpeed;
+    return stats;
+}
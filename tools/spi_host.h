@@ -0,0 +1,126 @@
+/**
+ * \file spi_host.h
+ * \brief Host model of the registers used by spi.c and sdmmc.c, with a
+ * simulated memory card on the SPI
+ * \author Martin Matysiak
+ *
+ * Host builds compiled with -DHOST_IO='"spi_host.h"' include this file
+ * through global.h, so the firmware's SPI and SDMMC code runs unchanged on
+ * the host, in the simulated time of the host build (see hostDelayed):
+ *
+ * - PRR: while PRSPI is set, the SPI ignores writes to SPCR and SPSR (their
+ *   values are kept). A transfer started then ends the program, the
+ *   firmware would wait for it forever. A transfer also needs SPE and MSTR.
+ * - Every transfer takes 8 clocks of the SPI clock selected by SPCR and
+ *   SPSR (SPR1, SPR0, SPI2X).
+ * - Timer1 counts the simulated time with the prescaler selected by
+ *   TCCR1B. TOV1 is set when TCNT1 overflows and cleared when the timer is
+ *   started (the firmware clears it right before).
+ * - The card behind the chip select speaks the SPI mode of SD cards: CMD0,
+ *   CMD1 (idle for two more attempts), CMD16, CMD17, CMD24 and CMD59. The
+ *   CRC7 of CMD0 and, once CMD59 has turned the checks on, of every command
+ *   and the CRC16 of every data block are checked. A write keeps the card
+ *   busy for the given time.
+ * - Data blocks transferred faster than the maximum clock of the card are
+ *   corrupted (in both directions), the commands are not.
+ */
+
+#ifndef SPI_HOST_H
+    #define SPI_HOST_H
+
+    #include <stdint.h>
+
+    /// Power reduction register, only the bits used by the firmware
+    #define PRR spihost_prr
+    #define PRSPI 2
+    #define PRTIM1 3
+
+    /// Port of the SPI pins
+    #define PORTB spihost_portb
+    #define DDRB spihost_ddrb
+    #define PB2 2
+    #define PB3 3
+    #define PB4 4
+    #define PB5 5
+
+    /// SPI registers and their bits
+    #define SPCR (*spihost_register(0))
+    #define SPSR (*spihost_register(1))
+    #define SPDR spihost_data()
+    #define SPI_START(pByte) spihost_start(pByte)
+    #define SPE 6
+    #define MSTR 4
+    #define SPR1 1
+    #define SPR0 0
+    #define SPIF 7
+    #define SPI2X 0
+
+    /// Timer1 registers and their bits
+    #define TCCR1A spihost_tccr1a
+    #define TCCR1B (*spihost_timer(0))
+    #define TIFR1 (*spihost_timer(1))
+    #define TCNT1 (*spihost_counter())
+    #define CS10 0
+    #define CS11 1
+    #define CS12 2
+    #define TOV1 0
+
+    /// Counters of the simulated card
+    typedef struct {
+        /// Data blocks written and read at each SPI speed (see spi.h)
+        unsigned long blocks[7];
+        /// Data blocks which arrived corrupted (clock too fast)
+        unsigned long corrupted;
+        /// Data blocks the card refused because of their CRC16
+        unsigned long refused;
+        /// Accesses to SPCR and SPSR while the SPI was powered down (a
+        /// write among them is lost)
+        unsigned long ignored;
+        /// SPI speed of the last data block (-1: none yet)
+        int lastSpeed;
+    } spihost_stats_t;
+
+    extern uint8_t spihost_prr;
+    extern uint8_t spihost_portb;
+    extern uint8_t spihost_ddrb;
+    extern uint8_t spihost_tccr1a;
+
+    /**
+     * \brief Returns SPCR (0) or SPSR (1), or a copy of it which takes the
+     * lost writes while the SPI is powered down
+     */
+    uint8_t* spihost_register(uint8_t pRegister);
+
+    /**
+     * \brief Returns the byte received by the last transfer (clears SPIF)
+     */
+    uint8_t spihost_data();
+
+    /**
+     * \brief Transfers a byte to the card and back (sets SPIF)
+     */
+    void spihost_start(uint8_t pByte);
+
+    /**
+     * \brief Returns TCCR1B (0) or TIFR1 (1) after advancing Timer1
+     */
+    uint8_t* spihost_timer(uint8_t pRegister);
+
+    /**
+     * \brief Returns TCNT1 after advancing Timer1
+     */
+    uint16_t* spihost_counter();
+
+    /**
+     * \brief Inserts an empty memory card and powers the SPI up
+     * \param pSectors The size of the card in sectors
+     * \param pMaxSpeed The fastest SPI speed the card works at (see spi.h)
+     * \param pBusy The programming time of a write in ms
+     */
+    void spihost_create(uint32_t pSectors, uint8_t pMaxSpeed, double pBusy);
+
+    /**
+     * \brief Returns the counters of the card and resets them
+     */
+    spihost_stats_t spihost_takeStats();
+#endif
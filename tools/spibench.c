@@ -0,0 +1,144 @@
+/**
+ * \file spibench.c
+ * \brief Host tool which runs the firmware's SDMMC code against a simulated
+ * card on the SPI and checks the calibration of the SPI clock
+ * \author Martin Matysiak
+ *
+ * Usage: spibench [-b busy_ms]
+ *
+ * spi.c and sdmmc.c run unchanged on the register model of spi_host.h. For
+ * every maximum clock of the card (F_CPU / 2 to F_CPU / 128), the card is
+ * initialized and calibrated (see sdmmc_calibrate), then sectors are
+ * written and read back. The report gives the divider and throughputs of
+ * $PGLSPD, the time a sector transfer takes in the simulation and the
+ * result of the checks:
+ *
+ * - the calibration has found the fastest clock the card works at,
+ * - every data block after the calibration has been transferred at the
+ *   reported clock,
+ * - no register of the SPI has been accessed while it was powered down
+ *   (such a write is lost, see PRR),
+ * - the sectors have been read back intact.
+ *
+ * The exit status is 1 if a check has failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "modules/sdmmc.h"
+
+/// Size of the simulated card in sectors
+#define CARD_SECTORS 64
+/// Sector used by the calibration
+#define SCRATCH_SECTOR 1
+/// Sectors written and read back after the calibration
+#define TEST_SECTORS 16
+
+/**
+ * \brief Byte i of the test content of a sector
+ */
+static char testByte(uint32_t pSector, uint16_t pIndex) {
+    return (char)(pSector * 37 + pIndex * 11 + (pIndex >> 8));
+}
+
+/**
+ * \brief Calibrates a card with the given maximum clock and checks the result
+ * \return TRUE if all checks have passed
+ */
+static int run(uint8_t pMaxSpeed, double pBusy) {
+    char buffer[SDMMC_SECTOR_SIZE];
+    char report[SDMMC_REPORT_LENGTH];
+    const char* failure = NULL;
+
+    spihost_create(CARD_SECTORS, pMaxSpeed, pBusy);
+    sdmmc_init();
+
+    sdmmc_calibrate(SCRATCH_SECTOR, buffer);
+    sdmmc_report(report);
+    spihost_stats_t calibration = spihost_takeStats();
+
+    unsigned long divider = 0, writeRate = 0, readRate = 0;
+    sscanf(report, "$PGLSPD,%lu,%lu,%lu", &divider, &writeRate, &readRate);
+
+    // Transfers at the calibrated clock
+    double start = hostDelayed();
+    for (uint32_t sector = 0; sector < TEST_SECTORS; sector++) {
+        for (uint16_t i = 0; i < SDMMC_SECTOR_SIZE; i++) {
+            buffer[i] = testByte(sector + SCRATCH_SECTOR + 1, i);
+        }
+        if (!sdmmc_writeSector(sector + SCRATCH_SECTOR + 1, buffer)) {
+            failure = "write failed";
+        }
+    }
+    double writeTime = (hostDelayed() - start) / TEST_SECTORS;
+
+    start = hostDelayed();
+    for (uint32_t sector = 0; sector < TEST_SECTORS; sector++) {
+        if (!sdmmc_readSector(sector + SCRATCH_SECTOR + 1, buffer)) {
+            failure = "read failed";
+        }
+        for (uint16_t i = 0; i < SDMMC_SECTOR_SIZE; i++) {
+            if (buffer[i] != testByte(sector + SCRATCH_SECTOR + 1, i)) {
+                failure = "sector read back corrupted";
+            }
+        }
+    }
+    double readTime = (hostDelayed() - start) / TEST_SECTORS;
+
+    spihost_stats_t transfers = spihost_takeStats();
+    unsigned long atDivider = 0, blocks = 0;
+    for (uint8_t speed = SPI_SPEED_2; speed <= SPI_SPEED_128; speed++) {
+        blocks += transfers.blocks[speed];
+        if (SPI_DIVIDER(speed) == divider) {
+            atDivider += transfers.blocks[speed];
+        }
+    }
+
+    if (calibration.ignored || transfers.ignored) {
+        failure = "SPI registers accessed while powered down";
+    } else if (atDivider != blocks) {
+        failure = "transfers not at the reported clock";
+    } else if (divider != SPI_DIVIDER(pMaxSpeed)) {
+        failure = "calibrated clock isn't the fastest one of the card";
+    }
+
+    printf("%6u %8lu %10lu %10lu %9.2f %9.2f  %s\n", SPI_DIVIDER(pMaxSpeed), divider,
+        writeRate, readRate, writeTime, readTime, failure ? failure : "ok");
+
+    return failure == NULL;
+}
+
+int main(int argc, char** argv) {
+    double busy = 1.0;
+
+    if ((argc == 3) && (strcmp(argv[1], "-b") == 0)) {
+        busy = atof(argv[2]);
+    } else if (argc != 1) {
+        fprintf(stderr, "usage: %s [-b busy_ms]\n", argv[0]);
+        return 1;
+    }
+
+#if SDMMC_BENCHMARK
+    char sentence[SDMMC_BENCHMARK_LENGTH];
+    spihost_create(CARD_SECTORS, SPI_SPEED_2, busy);
+    sdmmc_init();
+    sdmmc_benchmark(sentence);
+    printf("%s\n", sentence);
+#endif
+
+    printf("%6s %8s %10s %10s %9s %9s  %s\n", "card", "divider", "write B/s", "read B/s",
+        "write ms", "read ms", "result");
+
+    int passed = TRUE;
+    for (uint8_t speed = SPI_SPEED_2; speed <= SPI_SPEED_128; speed++) {
+        passed &= run(speed, busy);
+    }
+
+    printf("\ncard: fastest divider of the card's SPI clock (F_CPU / divider)\n");
+    printf("divider, write B/s, read B/s: $PGLSPD after the calibration\n");
+    printf("write ms, read ms: simulated time of a sector transfer afterwards\n");
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,726 @@
+/**
+ * \file st22_host.c
+ * \brief Host implementation of the UART interface (see protocols/uart.h)
+ * with a simulated ST22 GPS-module behind every port
+ * \author Martin Matysiak
+ *
+ * This allows running the firmware's GPS code on the host, e.g. in order to
+ * benchmark the configuration of the module (see gpsbench.c).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "st22_host.h"
+#include "modules/nmea.h"
+
+/// Longest binary message which is parsed (ID and payload)
+#define MAX_MESSAGE 64
+
+/// Longest sentence of a recorded track
+#define MAX_SENTENCE 128
+
+/// States of the parser of binary messages
+typedef enum {
+    PARSE_START1, PARSE_START2, PARSE_LENGTH1, PARSE_LENGTH2, PARSE_BODY,
+    PARSE_CHECKSUM, PARSE_CR, PARSE_LF
+} parse_t;
+
+/// A byte on the line from the module to the firmware
+typedef struct {
+    uint8_t value;
+    /// Time at which the byte has been received completely (ms)
+    double time;
+    /// Baudrate the byte has been sent at
+    uint32_t baudrate;
+} byte_t;
+
+/// A simulated module and the UART port of the firmware connected to it
+typedef struct {
+    // Configuration of the module
+    uint32_t baudrate;
+    uint8_t rate;
+    uint8_t intervals[GPS_NMEA_COUNT];
+
+    // Changes which haven't taken effect yet (0: none)
+    uint32_t nextBaudrate;
+    double baudrateTime;
+    uint8_t nextRate;
+
+    /// The module sends nothing until then (boot, restart)
+    double silentUntil;
+    /// The fixes sent from then on contain a position
+    double fixFrom;
+    /// Time of the next fix and number of fixes sent since the last restart
+    double nextFix;
+    unsigned long epoch;
+
+    // Parser of the binary messages
+    parse_t state;
+    uint16_t length;
+    uint16_t received;
+    uint8_t message[MAX_MESSAGE];
+
+    /// Bytes on the line to the firmware (in the order of their time)
+    byte_t* line;
+    size_t lineHead;
+    size_t lineTail;
+    size_t lineCapacity;
+    /// Time at which the line of the module is free
+    double lineFree;
+
+    // UART of the firmware
+    uint32_t uartBaudrate;
+    /// The receiver is disabled until then (uart_changeBaud)
+    double disabledUntil;
+    /// Time at which the line to the module is free
+    double txFree;
+    char input[UART_INPUT_BUFFER_SIZE];
+    uint16_t inputRead;
+    uint16_t inputWrite;
+
+    st22host_stats_t stats;
+} module_t;
+
+/// Sentences of a fix of a recorded track
+typedef struct {
+    char (*sentences)[MAX_SENTENCE];
+    uint8_t* types;
+    size_t count;
+} epoch_t;
+
+static module_t fModules[UART_PORTS];
+
+/// The recorded track (NULL: synthetic)
+static epoch_t* fTrack = NULL;
+static size_t fTrackLength = 0;
+
+/// Configuration at power-up: GGA, GSA, GSV, RMC and VTG every fix
+static const uint8_t fDefaultIntervals[GPS_NMEA_COUNT] = {1, 1, 1, 0, 1, 1, 0};
+
+/// Baudrates of the GPS_SET_BAUDRATE indices
+static const uint32_t fBaudrates[] = {4800, 9600, 19200, 38400, 57600, 115200};
+
+/**
+ * \brief Returns the time of a byte (start bit, 8 data bits, stop bit) in ms
+ */
+static double byteTime(uint32_t pBaudrate) {
+    return 10000.0 / pBaudrate;
+}
+
+/**
+ * \brief Checks if two UARTs understand each other (the receiver samples in
+ * the middle of the bits, 2 % leave enough margin for ten bits)
+ */
+static uint8_t sameBaudrate(uint32_t pFirst, uint32_t pSecond) {
+    return (pFirst < pSecond ? pSecond - pFirst : pFirst - pSecond) * 50 <= pSecond;
+}
+
+/**
+ * \brief Restores the configuration of the module at power-up (the time to
+ * first fix is the one of a cold start)
+ */
+static void reset(module_t* pModule, double pSilentUntil) {
+    pModule->baudrate = 9600;
+    pModule->rate = 1;
+    memcpy(pModule->intervals, fDefaultIntervals, GPS_NMEA_COUNT);
+    pModule->nextBaudrate = 0;
+    pModule->nextRate = 0;
+    pModule->silentUntil = pSilentUntil;
+    pModule->nextFix = pSilentUntil;
+    pModule->fixFrom = pSilentUntil + ST22HOST_COLD_START;
+    pModule->epoch = 0;
+}
+
+/**
+ * \brief Applies a new baudrate once its time has come
+ */
+static void updateBaudrate(module_t* pModule, double pTime) {
+    if (pModule->nextBaudrate && (pTime >= pModule->baudrateTime)) {
+        pModule->baudrate = pModule->nextBaudrate;
+        pModule->nextBaudrate = 0;
+    }
+}
+
+/**
+ * \brief Puts bytes on the line of the module, starting at the given time
+ * or as soon as the line is free
+ */
+static void send(module_t* pModule, const uint8_t* pData, size_t pLength, double pTime) {
+    double time = (pTime > pModule->lineFree) ? pTime : pModule->lineFree;
+
+    if (pModule->lineTail + pLength > pModule->lineCapacity) {
+        // Drop the bytes which have been delivered before growing
+        memmove(pModule->line, pModule->line + pModule->lineHead,
+            (pModule->lineTail - pModule->lineHead) * sizeof(byte_t));
+        pModule->lineTail -= pModule->lineHead;
+        pModule->lineHead = 0;
+
+        while (pModule->lineTail + pLength > pModule->lineCapacity) {
+            pModule->lineCapacity = pModule->lineCapacity ? pModule->lineCapacity * 2 : 4096;
+        }
+        pModule->line = realloc(pModule->line, pModule->lineCapacity * sizeof(byte_t));
+    }
+
+    for (size_t i = 0; i < pLength; i++) {
+        updateBaudrate(pModule, time);
+        time += byteTime(pModule->baudrate);
+
+        byte_t* byte = &pModule->line[pModule->lineTail++];
+        byte->value = pData[i];
+        byte->time = time;
+        byte->baudrate = pModule->baudrate;
+    }
+
+    pModule->lineFree = time;
+}
+
+/// Position of the synthetic track in degrees (north-east at 10 m/s)
+#define SYNTHETIC_LATITUDE(pSeconds) (52.5 + (pSeconds) * 0.0000636)
+#define SYNTHETIC_LONGITUDE(pSeconds) (13.4 + (pSeconds) * 0.0001045)
+
+/**
+ * \brief Appends a synthetic sentence of the given type to a buffer
+ *
+ * The track heads north-east at 10 m/s, starting at 12:00:00 UTC.
+ *
+ * \param pFixed FALSE for a sentence without position (no fix yet)
+ * \return The number of characters appended
+ */
+static size_t synthesize(char* pOutput, uint8_t pType, double pSeconds, uint8_t pFixed) {
+    double latitude = SYNTHETIC_LATITUDE(pSeconds);
+    double longitude = SYNTHETIC_LONGITUDE(pSeconds);
+    char time[16], position[48];
+    char* start = pOutput;
+
+    unsigned long milliseconds = (unsigned long)(pSeconds * 1000 + 0.5) + 12 * 3600000UL;
+    snprintf(time, sizeof(time), "%02lu%02lu%02lu.%03lu", milliseconds / 3600000 % 24,
+        milliseconds / 60000 % 60, milliseconds / 1000 % 60, milliseconds % 1000);
+    snprintf(position, sizeof(position), "%02d%07.4f,N,%03d%07.4f,E", (int)latitude,
+        (latitude - (int)latitude) * 60, (int)longitude, (longitude - (int)longitude) * 60);
+
+    if (!pFixed && (pType != GPS_NMEA_ZDA)) {
+        switch (pType) {
+            case GPS_NMEA_GGA:
+                sprintf(pOutput, "$GPGGA,%s,,,,,0,00,,,M,,M,,", time);
+                break;
+            case GPS_NMEA_GSA:
+                strcpy(pOutput, "$GPGSA,A,1,,,,,,,,,,,,,,,");
+                break;
+            case GPS_NMEA_GSV:
+                strcpy(pOutput, "$GPGSV,1,1,00");
+                break;
+            case GPS_NMEA_GLL:
+                sprintf(pOutput, "$GPGLL,,,,,%s,V,N", time);
+                break;
+            case GPS_NMEA_RMC:
+                sprintf(pOutput, "$GPRMC,%s,V,,,,,,,180412,,,N", time);
+                break;
+            default:
+                strcpy(pOutput, "$GPVTG,,T,,M,,N,,K,N");
+                break;
+        }
+
+        nmea_appendChecksum(pOutput);
+        return strlen(pOutput);
+    }
+
+    switch (pType) {
+        case GPS_NMEA_GGA:
+            sprintf(pOutput, "$GPGGA,%s,%s,1,08,1.0,35.0,M,40.0,M,,0000", time, position);
+            break;
+        case GPS_NMEA_GSA:
+            strcpy(pOutput, "$GPGSA,A,3,01,02,03,04,05,06,07,08,,,,,1.8,1.0,1.5");
+            break;
+        case GPS_NMEA_GSV:
+            for (int i = 1; i <= 3; i++) {
+                sprintf(pOutput, "$GPGSV,3,%d,12,%02d,40,083,45,%02d,35,140,42,%02d,20,200,38,%02d,10,300,30",
+                    i, 4 * i - 3, 4 * i - 2, 4 * i - 1, 4 * i);
+                nmea_appendChecksum(pOutput);
+                pOutput += strlen(pOutput);
+            }
+            return pOutput - start;
+        case GPS_NMEA_GLL:
+            sprintf(pOutput, "$GPGLL,%s,%s,A,A", position, time);
+            break;
+        case GPS_NMEA_RMC:
+            sprintf(pOutput, "$GPRMC,%s,A,%s,19.4,50.6,180412,,,A", time, position);
+            break;
+        case GPS_NMEA_VTG:
+            strcpy(pOutput, "$GPVTG,50.6,T,,M,19.4,N,36.0,K,A");
+            break;
+        default:
+            sprintf(pOutput, "$GPZDA,%s,18,04,2012,00,00", time);
+            break;
+    }
+
+    nmea_appendChecksum(pOutput);
+    return strlen(pOutput);
+}
+
+/**
+ * \brief Sends the configured message types of the next fix
+ */
+static void sendFix(module_t* pModule) {
+    char buffer[1024];
+    size_t length = 0;
+    double seconds = (double)pModule->epoch / pModule->rate;
+    const epoch_t* recorded = fTrack ? &fTrack[pModule->epoch % fTrackLength] : NULL;
+    uint8_t fixed = (pModule->nextFix >= pModule->fixFrom);
+
+    for (uint8_t i = 0; i < GPS_NMEA_COUNT; i++) {
+        uint8_t interval = pModule->intervals[i];
+        uint8_t type = 2 << i;
+
+        if (!interval || (pModule->epoch % interval)) {
+            continue;
+        }
+
+        if (!recorded || !fixed) {
+            length += synthesize(buffer + length, type, seconds, fixed);
+            pModule->stats.sentences[i] += ((type == GPS_NMEA_GSV) && fixed) ? 3 : 1;
+            continue;
+        }
+
+        for (size_t s = 0; s < recorded->count; s++) {
+            size_t sentence = strlen(recorded->sentences[s]);
+            if ((recorded->types[s] == type) && (length + sentence < sizeof(buffer))) {
+                memcpy(buffer + length, recorded->sentences[s], sentence);
+                length += sentence;
+                pModule->stats.sentences[i]++;
+            }
+        }
+    }
+
+    send(pModule, (const uint8_t*)buffer, length, pModule->nextFix);
+    pModule->stats.fixes++;
+}
+
+/**
+ * \brief Determines the position of the current fix
+ * \return TRUE if it is known, the position is given in 1/100 degrees
+ */
+static uint8_t currentPosition(const module_t* pModule, int32_t* pLatitude, int32_t* pLongitude) {
+    if (!fTrack) {
+        double seconds = (double)pModule->epoch / pModule->rate;
+        *pLatitude = (int32_t)(SYNTHETIC_LATITUDE(seconds) * 100);
+        *pLongitude = (int32_t)(SYNTHETIC_LONGITUDE(seconds) * 100);
+        return TRUE;
+    }
+
+    const epoch_t* recorded = &fTrack[pModule->epoch % fTrackLength];
+    for (size_t s = 0; s < recorded->count; s++) {
+        // Token of the latitude, the longitude follows two tokens later
+        uint8_t token = (recorded->types[s] == GPS_NMEA_GGA) ? 2
+            : (recorded->types[s] == GPS_NMEA_RMC) ? 3
+            : (recorded->types[s] == GPS_NMEA_GLL) ? 1 : 0;
+        if (!token || !(gps_classifyNMEA(recorded->sentences[s]) & GPS_NMEA_VALID)) {
+            continue;
+        }
+
+        const char* latitude = nmea_getToken(recorded->sentences[s], token);
+        *pLatitude = nmea_parseCoordinate(latitude) / (NMEA_UNITS_PER_DEGREE / 100);
+        *pLongitude = nmea_parseCoordinate(nmea_getToken(latitude, 2)) / (NMEA_UNITS_PER_DEGREE / 100);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ * \brief Checks if the payload of a GPS_RESTART allows a hot start
+ */
+static uint8_t hotStart(const module_t* pModule, const uint8_t* pPayload) {
+    int32_t latitude, longitude;
+
+    if ((pPayload[0] != GPS_RESTART_HOT) || !currentPosition(pModule, &latitude, &longitude)) {
+        return FALSE;
+    }
+
+    int32_t aidLatitude = (int16_t)((pPayload[GPS_RESTART_LATITUDE] << 8) | pPayload[GPS_RESTART_LATITUDE + 1]);
+    int32_t aidLongitude = (int16_t)((pPayload[GPS_RESTART_LONGITUDE] << 8) | pPayload[GPS_RESTART_LONGITUDE + 1]);
+
+    return (labs(aidLatitude - latitude) <= ST22HOST_AID_DISTANCE)
+        && (labs(aidLongitude - longitude) <= ST22HOST_AID_DISTANCE);
+}
+
+/**
+ * \brief Sends the fixes which are due until the given time
+ */
+static void generate(module_t* pModule, double pTime) {
+    while (pModule->nextFix <= pTime) {
+        updateBaudrate(pModule, pModule->nextFix);
+
+        if (pModule->nextRate) {
+            pModule->rate = pModule->nextRate;
+            pModule->nextRate = 0;
+        }
+
+        sendFix(pModule);
+        pModule->epoch++;
+        pModule->nextFix += 1000.0 / pModule->rate;
+    }
+}
+
+/**
+ * \brief Executes a complete binary message and answers it
+ * \param pTime The time at which the message has been received
+ */
+static void execute(module_t* pModule, double pTime) {
+    uint8_t id = pModule->message[0];
+    const uint8_t* payload = pModule->message + 1;
+    uint16_t length = pModule->length - 1;
+    double answer = pTime + ST22HOST_RESPONSE;
+    uint8_t valid = TRUE;
+
+    // The fixes before the answer go out first
+    generate(pModule, answer);
+
+    switch (id) {
+        case GPS_SET_BAUDRATE:
+            valid = (length == 3) && (payload[1] < sizeof(fBaudrates) / sizeof(fBaudrates[0]));
+            break;
+        case GPS_SET_NMEA:
+            valid = (length == GPS_NMEA_COUNT + 1);
+            break;
+        case GPS_SET_UPDATE_RATE:
+            valid = (length == 2) && (payload[0] == 1 || payload[0] == 2 || payload[0] == 4
+                || payload[0] == 5 || payload[0] == 8 || payload[0] == 10);
+            break;
+        case GPS_SET_POWER:
+            valid = (length == 2) && (payload[0] <= GPS_POWER_SAVE);
+            break;
+        case GPS_SET_1PPS:
+            valid = (length == 2);
+            break;
+        case GPS_RESTART:
+            valid = (length == GPS_RESTART_LENGTH);
+            break;
+        case GPS_GET_UPDATE_RATE:
+        case GPS_GET_DATE:
+        case GPS_GET_1PPS:
+            valid = (length == 0);
+            break;
+        default:
+            valid = FALSE;
+            break;
+    }
+
+    uint8_t response = valid ? GPS_ACK : GPS_NACK;
+    uint8_t frame[9] = {0xA0, 0xA1, 0x00, 0x02, response, id, response ^ id, CR, LF};
+    send(pModule, frame, sizeof(frame), answer);
+
+    if (!valid) {
+        pModule->stats.nacks++;
+        return;
+    }
+
+    pModule->stats.acks++;
+    pModule->stats.acked[id] = pModule->lineFree;
+
+    // The answer is the last thing sent with the old configuration
+    switch (id) {
+        case GPS_SET_BAUDRATE:
+            pModule->nextBaudrate = fBaudrates[payload[1]];
+            pModule->baudrateTime = pModule->lineFree;
+            break;
+        case GPS_SET_NMEA:
+            memcpy(pModule->intervals, payload, GPS_NMEA_COUNT);
+            break;
+        case GPS_SET_UPDATE_RATE:
+            pModule->nextRate = payload[0];
+            break;
+        case GPS_RESTART: {
+            uint8_t hot = hotStart(pModule, payload);
+            reset(pModule, pModule->lineFree + ST22HOST_RESTART);
+
+            if (hot) {
+                pModule->fixFrom = pModule->silentUntil + ST22HOST_HOT_START;
+                pModule->stats.hotStarts++;
+            }
+            break;
+        }
+    }
+}
+
+/**
+ * \brief Receives a byte from the firmware
+ * \param pTime The time at which it has been received completely
+ */
+static void receive(module_t* pModule, uint8_t pByte, double pTime) {
+    switch (pModule->state) {
+        case PARSE_START1:
+            pModule->state = (pByte == 0xA0) ? PARSE_START2 : PARSE_START1;
+            return;
+        case PARSE_START2:
+            pModule->state = (pByte == 0xA1) ? PARSE_LENGTH1 : PARSE_START1;
+            return;
+        case PARSE_LENGTH1:
+            pModule->length = pByte << 8;
+            pModule->state = PARSE_LENGTH2;
+            return;
+        case PARSE_LENGTH2:
+            pModule->length |= pByte;
+            pModule->received = 0;
+            pModule->state = ((pModule->length > 0) && (pModule->length <= MAX_MESSAGE))
+                ? PARSE_BODY : PARSE_START1;
+            return;
+        case PARSE_BODY:
+            pModule->message[pModule->received++] = pByte;
+            if (pModule->received == pModule->length) {
+                pModule->state = PARSE_CHECKSUM;
+            }
+            return;
+        case PARSE_CHECKSUM: {
+            uint8_t checksum = 0;
+            for (uint16_t i = 0; i < pModule->length; i++) {
+                checksum ^= pModule->message[i];
+            }
+            pModule->state = (checksum == pByte) ? PARSE_CR : PARSE_START1;
+            return;
+        }
+        case PARSE_CR:
+            pModule->state = (pByte == CR) ? PARSE_LF : PARSE_START1;
+            return;
+        case PARSE_LF:
+            pModule->state = PARSE_START1;
+            if (pByte == LF) {
+                execute(pModule, pTime);
+            }
+            return;
+    }
+}
+
+/**
+ * \brief Moves the bytes which have arrived until now into the input buffer
+ */
+static void deliver(module_t* pModule) {
+    double now = hostDelayed();
+    generate(pModule, now);
+
+    while ((pModule->lineHead < pModule->lineTail) && (pModule->line[pModule->lineHead].time <= now)) {
+        const byte_t* byte = &pModule->line[pModule->lineHead++];
+        uint16_t write = (pModule->inputWrite + 1) % UART_INPUT_BUFFER_SIZE;
+
+        if (!sameBaudrate(byte->baudrate, pModule->uartBaudrate) || (byte->time < pModule->disabledUntil)
+            || (write == pModule->inputRead)) {
+            pModule->stats.lostBytes++;
+            continue;
+        }
+
+        pModule->input[write] = byte->value;
+        pModule->inputWrite = write;
+    }
+}
+
+/**
+ * \brief Returns the number of bytes waiting in the output buffer
+ */
+static uint16_t outputWaiting(const module_t* pModule) {
+    double time = byteTime(pModule->uartBaudrate);
+    double ahead = pModule->txFree - hostDelayed();
+
+    // The byte being shifted out has left the buffer
+    return (ahead > time) ? (uint16_t)((ahead - time) / time + 0.999) : 0;
+}
+
+int st22host_create(const char* pTrack) {
+    for (size_t i = 0; i < fTrackLength; i++) {
+        free(fTrack[i].sentences);
+        free(fTrack[i].types);
+    }
+    free(fTrack);
+    fTrack = NULL;
+    fTrackLength = 0;
+
+    if (pTrack) {
+        FILE* file = fopen(pTrack, "r");
+        if (!file) {
+            perror(pTrack);
+            return -1;
+        }
+
+        char line[256], sentence[MAX_SENTENCE], first[7] = "";
+        size_t capacity = 0;
+
+        while (fgets(line, sizeof(line), file)) {
+            char* start = strchr(line, '$');
+            if (!start || (strcspn(start, "\r\n") + 3 > MAX_SENTENCE)) {
+                continue;
+            }
+            snprintf(sentence, sizeof(sentence), "%.*s\r\n", (int)strcspn(start, "\r\n"), start);
+
+            uint8_t type = gps_classifyNMEA(sentence) & GPS_NMEA_TYPEMASK;
+            if (!type) {
+                continue;
+            }
+
+            // Epochs start with the type of the first sentence
+            if (!fTrackLength || (strncmp(sentence, first, 6) == 0)) {
+                if (!fTrackLength) {
+                    snprintf(first, sizeof(first), "%.6s", sentence);
+                }
+                if (fTrackLength == capacity) {
+                    capacity = capacity ? capacity * 2 : 1024;
+                    fTrack = realloc(fTrack, capacity * sizeof(epoch_t));
+                }
+                fTrack[fTrackLength++] = (epoch_t){NULL, NULL, 0};
+            }
+
+            epoch_t* epoch = &fTrack[fTrackLength - 1];
+            epoch->sentences = realloc(epoch->sentences, (epoch->count + 1) * MAX_SENTENCE);
+            epoch->types = realloc(epoch->types, epoch->count + 1);
+            strcpy(epoch->sentences[epoch->count], sentence);
+            epoch->types[epoch->count++] = type;
+        }
+
+        fclose(file);
+        if (!fTrackLength) {
+            fprintf(stderr, "%s: no sentences\n", pTrack);
+            return -1;
+        }
+    }
+
+    double now = hostDelayed();
+    for (uint8_t port = 0; port < UART_PORTS; port++) {
+        module_t* module = &fModules[port];
+        free(module->line);
+        memset(module, 0, sizeof(module_t));
+
+        reset(module, now + ST22HOST_BOOT);
+        module->uartBaudrate = 9600;
+        module->lineFree = now;
+        module->txFree = now;
+        for (int i = 0; i < 256; i++) {
+            module->stats.acked[i] = -1;
+        }
+    }
+
+    return 0;
+}
+
+const st22host_stats_t* st22host_stats(uint8_t pPort) {
+    return &fModules[pPort].stats;
+}
+
+void st22host_config(uint8_t pPort, uint32_t* pBaudrate, uint8_t* pRate) {
+    module_t* module = &fModules[pPort];
+    updateBaudrate(module, hostDelayed());
+
+    *pBaudrate = module->baudrate;
+    *pRate = module->nextRate ? module->nextRate : module->rate;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// UART interface of the firmware
+
+void uart_init(uint8_t pPort, uint8_t pConfig, uint16_t pUbr) {
+    deliver(&fModules[pPort]);
+    fModules[pPort].uartBaudrate = F_CPU / (16UL * (pUbr + 1));
+}
+
+void uart_changeBaud(uint8_t pPort, uint16_t pUbr) {
+    module_t* module = &fModules[pPort];
+
+    // Same as uart.c: wait until the output buffer is empty, then disable
+    // the port for 100 ms
+    while (outputWaiting(module)) {
+        hostDelay(50);
+    }
+
+    deliver(module);
+    module->disabledUntil = hostDelayed() + 100;
+    hostDelay(100);
+    deliver(module);
+
+    module->uartBaudrate = F_CPU / (16UL * (pUbr + 1));
+}
+
+unsigned char uart_getChar(uint8_t pPort) {
+    module_t* module = &fModules[pPort];
+    deliver(module);
+
+    if (module->inputRead == module->inputWrite) {
+        return '\0';
+    }
+
+    module->inputRead = (module->inputRead + 1) % UART_INPUT_BUFFER_SIZE;
+    return module->input[module->inputRead];
+}
+
+uint8_t uart_hasData(uint8_t pPort) {
+    module_t* module = &fModules[pPort];
+    deliver(module);
+
+    if (module->inputRead == module->inputWrite) {
+        // The firmware spins, let time pass until the next byte (at most 1 ms)
+        double next = (module->lineHead < module->lineTail)
+            ? module->line[module->lineHead].time
+            : module->nextFix + byteTime(module->baudrate);
+        double wait = next - hostDelayed();
+
+        hostDelay((wait < 0) ? 0 : (wait > 1) ? 1 : wait);
+        deliver(module);
+    }
+
+    return module->inputRead != module->inputWrite;
+}
+
+uint8_t uart_getString(uint8_t pPort, char* pResult, uint8_t pResultSize) {
+    uint8_t currentChar = 0;
+    while (currentChar < pResultSize) {
+        pResult[currentChar++] = uart_getChar(pPort);
+        if ((!uart_hasData(pPort)) || (pResult[currentChar - 1] == LF)) {
+            break;
+        }
+    }
+
+    pResult[currentChar - 1] = '\0';
+    if ((currentChar > 1) && (pResult[currentChar - 2] == CR)) {
+        pResult[currentChar - 2] = '\0';
+    }
+
+    return currentChar;
+}
+
+void uart_setChar(uint8_t pPort, char pData) {
+    module_t* module = &fModules[pPort];
+    double time = byteTime(module->uartBaudrate);
+
+    // Wait while the buffer is full
+    double wait = module->txFree - UART_OUTPUT_BUFFER_SIZE * time - hostDelayed();
+    if (wait > 0) {
+        hostDelay(wait);
+    }
+
+    double now = hostDelayed();
+    module->txFree = ((module->txFree > now) ? module->txFree : now) + time;
+
+    // The module listens at its own baudrate
+    updateBaudrate(module, module->txFree);
+    if (!sameBaudrate(module->uartBaudrate, module->baudrate)) {
+        if (module->state != PARSE_START1) {
+            module->stats.lostCommands++;
+        }
+        module->state = PARSE_START1;
+        return;
+    }
+
+    receive(module, pData, module->txFree);
+}
+
+void uart_setString(uint8_t pPort, const char* pData) {
+    while (*pData) {
+        uart_setChar(pPort, *pData++);
+    }
+}
+
+uint8_t uart_outputFree(uint8_t pPort) {
+    return UART_OUTPUT_BUFFER_SIZE - 1 - outputWaiting(&fModules[pPort]);
+}
+
+void uart_clearBuf(uint8_t pPort) {
+    deliver(&fModules[pPort]);
+    fModules[pPort].inputRead = fModules[pPort].inputWrite;
+}
@@ -0,0 +1,95 @@
+/**
+ * \file st22_host.h
+ * \brief Host implementation of the UART interface (see protocols/uart.h)
+ * with a simulated ST22 GPS-module behind every port
+ * \author Martin Matysiak
+ *
+ * The module is modelled on the level of bytes on the line, in the
+ * simulated time of the host build (see hostDelayed):
+ *
+ * - The binary messages sent by gps_setParam (0xA0 0xA1, length, ID,
+ *   payload, checksum, CR LF) are parsed as they arrive. After
+ *   ST22HOST_RESPONSE ms, the module answers with ACK (0x83) or NACK (0x84,
+ *   unknown message, wrong length or invalid value), a broken frame is
+ *   ignored.
+ * - A new baudrate takes effect as soon as the ACK has been sent (at the old
+ *   one), a new update rate with the next fix. GPS_RESTART silences the
+ *   module for ST22HOST_RESTART ms and restores the power-up configuration
+ *   (the ST22 has no flash).
+ * - After power-up, the module needs ST22HOST_COLD_START ms for its first
+ *   fix. A GPS_RESTART with a hot start payload whose position is within
+ *   ST22HOST_AID_DISTANCE of the current one cuts this to
+ *   ST22HOST_HOT_START ms (the time of the payload isn't checked). Until
+ *   then, the configured types are sent without a position (RMC status V,
+ *   GGA quality 0), for recorded tracks as well.
+ * - Every fix, the module sends the configured message types (GPS_SET_NMEA
+ *   intervals) at its baudrate. Bytes sent while the UART of the other side
+ *   uses another baudrate are lost (framing errors), as are bytes which
+ *   find the input buffer of the firmware full.
+ *
+ * The firmware side behaves like uart.c: the output buffer holds
+ * UART_OUTPUT_BUFFER_SIZE - 1 bytes (uart_setChar waits for space),
+ * uart_changeBaud waits until it is empty. As the firmware spins while
+ * waiting for data, uart_hasData lets up to 1 ms pass if there is none.
+ */
+
+#ifndef ST22_HOST_H
+    #define ST22_HOST_H
+
+    #include "protocols/uart.h"
+    #include "modules/gps.h"
+
+    /// Time from the end of a message to the start of the answer in ms
+    #define ST22HOST_RESPONSE 10
+    /// Time the module needs after power-up until it sends the first fix in ms
+    #define ST22HOST_BOOT 300
+    /// Time the module is silent after GPS_RESTART in ms
+    #define ST22HOST_RESTART 1000
+    /// Time to first fix after power-up (or GPS_RESTART without aiding) in ms
+    #define ST22HOST_COLD_START 29000
+    /// Time to first fix after GPS_RESTART with a usable position in ms
+    #define ST22HOST_HOT_START 1000
+    /// Largest distance of the position of a hot start in 1/100 degrees
+    #define ST22HOST_AID_DISTANCE 100
+
+    /// Counters of a simulated module
+    typedef struct {
+        /// Messages answered with ACK and with NACK
+        unsigned long acks;
+        unsigned long nacks;
+        /// Frames received while the module listened at another baudrate
+        unsigned long lostCommands;
+        /// Bytes the firmware didn't receive (other baudrate, full buffer)
+        unsigned long lostBytes;
+        /// Fixes sent so far (with or without a position)
+        unsigned long fixes;
+        /// GPS_RESTART messages which have resulted in a hot start
+        unsigned long hotStarts;
+        /// Sentences sent so far of each type (in the order of GPS_NMEA_TABLE)
+        unsigned long sentences[GPS_NMEA_COUNT];
+        /// Time of the last ACK of each message ID (-1: none) in ms
+        double acked[256];
+    } st22host_stats_t;
+
+    /**
+     * \brief Powers up the simulated modules (9600 baud, 1 Hz, GGA, GSA,
+     * GSV, RMC and VTG)
+     *
+     * \param pTrack NMEA capture whose fixes are sent (an epoch starts with
+     * the type of its first sentence, replayed cyclically at the configured
+     * rate, types which it doesn't contain are missing) or NULL for a
+     * synthetic track
+     * \return 0 on success, -1 otherwise (an error message has been printed)
+     */
+    int st22host_create(const char* pTrack);
+
+    /**
+     * \brief Returns the counters of a module (since st22host_create)
+     */
+    const st22host_stats_t* st22host_stats(uint8_t pPort);
+
+    /**
+     * \brief Returns the current baudrate and update rate of a module
+     */
+    void st22host_config(uint8_t pPort, uint32_t* pBaudrate, uint8_t* pRate);
+#endif
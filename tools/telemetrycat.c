@@ -0,0 +1,110 @@
+/**
+ * \file telemetrycat.c
+ * \brief Host tool which prints the live telemetry of the logger
+ * \author Martin Matysiak
+ *
+ * Usage: telemetrycat [-r baud] device
+ *
+ * The device is a serial port tapping the TX line of the logger (or a
+ * recording of it). Every received fix is printed as one line:
+ *
+ * sequence time latitude longitude speed course valid lost
+ *
+ * Frames which have been dropped by the logger (full UART buffer) or
+ * corrupted on the line show up in the lost column.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "telemetryrx.h"
+
+/**
+ * \brief Configures a serial port (raw, 8N1, given baudrate)
+ */
+static void configure(int pFd, int pBaudrate) {
+    if (!isatty(pFd)) {
+        return;
+    }
+
+    speed_t speed;
+    switch (pBaudrate) {
+        case 4800: speed = B4800; break;
+        case 19200: speed = B19200; break;
+        case 38400: speed = B38400; break;
+        case 57600: speed = B57600; break;
+        case 115200: speed = B115200; break;
+        default: speed = B9600; break;
+    }
+
+    struct termios options;
+    if (tcgetattr(pFd, &options) == 0) {
+        cfmakeraw(&options);
+        cfsetispeed(&options, speed);
+        cfsetospeed(&options, speed);
+        options.c_cflag |= CLOCAL | CREAD;
+        tcsetattr(pFd, TCSANOW, &options);
+    }
+}
+
+int main(int argc, char** argv) {
+    int baudrate = 9600;
+    int argument = 1;
+
+    for (; (argument < argc - 1) && (argv[argument][0] == '-'); argument++) {
+        if ((strcmp(argv[argument], "-r") == 0) && (argument < argc - 2)) {
+            baudrate = atoi(argv[++argument]);
+        } else {
+            break;
+        }
+    }
+
+    if (argument != argc - 1) {
+        fprintf(stderr, "usage: %s [-r baud] device\n", argv[0]);
+        return 1;
+    }
+
+    int fd = open(argv[argument], O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+        perror(argv[argument]);
+        return 1;
+    }
+    configure(fd, baudrate);
+
+    telemetryrx_t decoder;
+    telemetryrx_fix_t fix;
+    uint8_t buffer[256];
+    ssize_t length;
+
+    telemetryrx_init(&decoder);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t i = 0; i < length; i++) {
+            if (!telemetryrx_feed(&decoder, buffer[i], &fix)) {
+                continue;
+            }
+
+            printf("%3u ", fix.sequence);
+            if (fix.time < 0) {
+                printf("%10s", "-");
+            } else {
+                printf("%02ld:%02ld:%02ld.%ld", fix.time / 3600000, fix.time / 60000 % 60,
+                    fix.time / 1000 % 60, fix.time / 100 % 10);
+            }
+            printf(" %11.6f %11.6f %6.1f %5.1f %d %u\n", fix.latitude, fix.longitude,
+                fix.speed, fix.course, fix.valid, fix.lost);
+        }
+    }
+
+    if (decoder.corrupt) {
+        fprintf(stderr, "%lu corrupt frames\n", decoder.corrupt);
+    }
+
+    close(fd);
+    return 0;
+}
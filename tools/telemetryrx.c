@@ -0,0 +1,107 @@
+/**
+ * \file telemetryrx.c
+ * \brief Host side decoder of the live telemetry of the logger
+ * \author Martin Matysiak
+ */
+
+#include "telemetryrx.h"
+#include "modules/nmea.h"
+
+/// Length value of a frame which is discarded until the next delimiter
+#define DISCARD ((size_t)-1)
+
+void telemetryrx_init(telemetryrx_t* pDecoder) {
+    pDecoder->length = 0;
+    pDecoder->escape = 0;
+    pDecoder->sequence = -1;
+    pDecoder->corrupt = 0;
+}
+
+/**
+ * \brief Reads a little endian value out of the frame
+ */
+static uint32_t getBytes(const uint8_t* pFrame, int pLength) {
+    uint32_t value = 0;
+
+    while (pLength--) {
+        value = (value << 8) | pFrame[pLength];
+    }
+
+    return value;
+}
+
+/**
+ * \brief Checks and decodes a complete frame
+ */
+static int decode(telemetryrx_t* pDecoder, telemetryrx_fix_t* pFix) {
+    const uint8_t* frame = pDecoder->frame;
+    uint8_t crc = 0;
+
+    for (int i = 0; i < TELEMETRY_FRAME_LENGTH - 1; i++) {
+        crc = telemetry_crc(crc, frame[i]);
+    }
+
+    if ((crc != frame[TELEMETRY_FRAME_LENGTH - 1]) || (frame[0] != TELEMETRY_TYPE_FIX)) {
+        pDecoder->corrupt++;
+        return 0;
+    }
+
+    uint32_t time = getBytes(frame + 2, 3);
+
+    pFix->sequence = frame[1];
+    pFix->time = (time == TELEMETRY_TIME_UNKNOWN) ? -1 : (long)time * 100;
+    pFix->latitude = (int32_t)getBytes(frame + 5, 4) / (double)NMEA_UNITS_PER_DEGREE;
+    pFix->longitude = (int32_t)getBytes(frame + 9, 4) / (double)NMEA_UNITS_PER_DEGREE;
+    pFix->speed = getBytes(frame + 13, 2) / 10.0;
+    pFix->course = getBytes(frame + 15, 2) / 10.0;
+    pFix->valid = frame[17] & TELEMETRY_FLAG_VALID;
+
+    // Gaps in the sequence numbers are frames dropped by the logger or lost
+    // on the line
+    pFix->lost = (pDecoder->sequence < 0) ? 0 : (uint8_t)(frame[1] - pDecoder->sequence - 1);
+    pDecoder->sequence = frame[1];
+
+    return 1;
+}
+
+int telemetryrx_feed(telemetryrx_t* pDecoder, uint8_t pData, telemetryrx_fix_t* pFix) {
+    if (pData == TELEMETRY_END) {
+        int complete = 0;
+
+        if (pDecoder->length == TELEMETRY_FRAME_LENGTH) {
+            complete = decode(pDecoder, pFix);
+        } else if (pDecoder->length != 0) {
+            // Back-to-back delimiters are empty frames, not corrupt ones
+            pDecoder->corrupt++;
+        }
+
+        pDecoder->length = 0;
+        pDecoder->escape = 0;
+        return complete;
+    }
+
+    if (pDecoder->length == DISCARD) {
+        return 0;
+    }
+
+    if (pDecoder->escape) {
+        pDecoder->escape = 0;
+        switch (pData) {
+            case TELEMETRY_ESC_END: pData = TELEMETRY_END; break;
+            case TELEMETRY_ESC_ESC: pData = TELEMETRY_ESC; break;
+            case TELEMETRY_ESC_A0: pData = 0xA0; break;
+            default: pDecoder->length = DISCARD; return 0;
+        }
+    } else if (pData == TELEMETRY_ESC) {
+        pDecoder->escape = 1;
+        return 0;
+    }
+
+    if (pDecoder->length >= TELEMETRY_FRAME_LENGTH) {
+        pDecoder->length = DISCARD;
+        return 0;
+    }
+
+    pDecoder->frame[pDecoder->length++] = pData;
+    return 0;
+}
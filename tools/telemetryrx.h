@@ -0,0 +1,54 @@
+/**
+ * \file telemetryrx.h
+ * \brief Host side decoder of the live telemetry of the logger
+ * \author Martin Matysiak
+ *
+ * The bytes received from the tapped TX line are fed into the decoder one by
+ * one, every complete and intact frame yields a fix (see
+ * modules/telemetry.h for the frame format).
+ */
+
+#ifndef TELEMETRYRX_H
+    #define TELEMETRYRX_H
+
+    #include <stddef.h>
+    #include <stdint.h>
+
+    #include "modules/telemetry.h"
+
+    /// A decoded fix
+    typedef struct {
+        uint8_t sequence;
+        /// UTC time in milliseconds since midnight (-1: unknown)
+        long time;
+        /// Latitude and longitude in degrees
+        double latitude, longitude;
+        /// Speed in knots, course in degrees
+        double speed, course;
+        int valid;
+        /// Frames lost in between (dropped by the logger or corrupted)
+        unsigned lost;
+    } telemetryrx_fix_t;
+
+    /// State of a decoder
+    typedef struct {
+        uint8_t frame[TELEMETRY_FRAME_LENGTH];
+        size_t length;
+        int escape;
+        /// Sequence number of the last frame (-1 before the first frame)
+        int sequence;
+        /// Number of frames with wrong length, escape or CRC
+        unsigned long corrupt;
+    } telemetryrx_t;
+
+    /**
+     * \brief Resets a decoder
+     */
+    void telemetryrx_init(telemetryrx_t* pDecoder);
+
+    /**
+     * \brief Feeds a received byte into the decoder
+     * \return 1 if a fix has been completed (written into pFix), 0 otherwise
+     */
+    int telemetryrx_feed(telemetryrx_t* pDecoder, uint8_t pData, telemetryrx_fix_t* pFix);
+#endif
@@ -0,0 +1,236 @@
+/**
+ * \file trackbench.c
+ * \brief Host tool which measures accuracy versus compression of the track
+ * filter (see modules/track.h) over recorded NMEA logs
+ * \author Martin Matysiak
+ *
+ * Usage: trackbench [-t threshold,threshold,...] [-i interval] log.nmea ...
+ *
+ * Every log is fed through the firmware's track filter once per threshold.
+ * The dropped fixes are compared against the track a reader would
+ * reconstruct from the kept ones (linear interpolation in time), which gives
+ * the error that has been introduced by the simplification. Fixes after the
+ * last kept one can only be compared against this very fix, so the maximum
+ * error also shows what gets lost at the end of a trip.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "modules/gps.h"
+#include "modules/nmea.h"
+#include "modules/track.h"
+
+/// One sentence of the input log
+typedef struct {
+    char text[128];
+    uint8_t type;
+    /// Index of the fix the sentence belongs to (-1 if none yet)
+    int fix;
+} sentence_t;
+
+/// One position epoch of the input log
+typedef struct {
+    double lat, lon;
+    uint32_t time;
+    int kept;
+} fix_t;
+
+static sentence_t* fSentences = NULL;
+static size_t fSentenceCount = 0;
+static fix_t* fFixes = NULL;
+static size_t fFixCount = 0;
+
+/**
+ * \brief Reads all valid sentences of a log and groups them into fixes
+ */
+static void load(const char* pPath) {
+    FILE* file = fopen(pPath, "r");
+    if (!file) {
+        perror(pPath);
+        exit(1);
+    }
+
+    size_t capacity = 0;
+    char line[256];
+    uint32_t epochTime = NMEA_TIME_INVALID;
+
+    fSentenceCount = 0;
+    fFixCount = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+        char* start = strchr(line, '$');
+        if (!start || (strlen(start) >= sizeof(fSentences[0].text))) {
+            continue;
+        }
+
+        uint8_t type = gps_classifyNMEA(start);
+        if (!(type & GPS_NMEA_VALID)) {
+            continue;
+        }
+
+        if (fSentenceCount == capacity) {
+            capacity = capacity ? capacity * 2 : 4096;
+            fSentences = realloc(fSentences, capacity * sizeof(sentence_t));
+            fFixes = realloc(fFixes, capacity * sizeof(fix_t));
+        }
+
+        sentence_t* sentence = &fSentences[fSentenceCount++];
+        strcpy(sentence->text, start);
+        sentence->type = type;
+
+        // Same token layout as used by the track filter
+        int timeToken = 0, latToken = 0;
+        switch (type & GPS_NMEA_TYPEMASK) {
+            case GPS_NMEA_GGA: timeToken = 1; latToken = 2; break;
+            case GPS_NMEA_RMC: timeToken = 1; latToken = 3; break;
+            case GPS_NMEA_GLL: timeToken = 5; latToken = 1; break;
+        }
+
+        if (timeToken) {
+            uint32_t time = nmea_parseTime(nmea_getToken(start, timeToken));
+            if ((time != NMEA_TIME_INVALID) && (time != epochTime)) {
+                const char* lat = nmea_getToken(start, latToken);
+                fix_t* fix = &fFixes[fFixCount++];
+                fix->lat = nmea_parseCoordinate(lat) / (double)NMEA_UNITS_PER_DEGREE;
+                fix->lon = nmea_parseCoordinate(nmea_getToken(lat, 2)) / (double)NMEA_UNITS_PER_DEGREE;
+                fix->time = time;
+                epochTime = time;
+            }
+        }
+
+        sentence->fix = (int)fFixCount - 1;
+    }
+
+    fclose(file);
+}
+
+/**
+ * \brief Difference of two longitudes in degrees, the short way around
+ */
+static double deltaLon(double pFrom, double pTo) {
+    double delta = pTo - pFrom;
+    return delta > 180.0 ? delta - 360.0 : delta < -180.0 ? delta + 360.0 : delta;
+}
+
+/**
+ * \brief Equirectangular distance in meters (sufficient for small distances)
+ */
+static double distance(double pLat1, double pLon1, double pLat2, double pLon2) {
+    double x = deltaLon(pLon1, pLon2) * cos((pLat1 + pLat2) * M_PI / 360.0);
+    double y = pLat2 - pLat1;
+    return sqrt(x * x + y * y) * M_PI / 180.0 * 6371000.0;
+}
+
+/**
+ * \brief Milliseconds between two times of the day (wrap at midnight)
+ */
+static double elapsed(uint32_t pFrom, uint32_t pTo) {
+    return pTo >= pFrom ? pTo - pFrom : pTo + NMEA_MS_PER_DAY - pFrom;
+}
+
+/**
+ * \brief Runs the filter over the loaded log and prints one result line
+ */
+static void run(unsigned pThreshold, unsigned pInterval) {
+    size_t bytesTotal = 0, bytesKept = 0, fixesKept = 0;
+
+    track_init(pThreshold, pInterval);
+    for (size_t i = 0; i < fFixCount; i++) {
+        fFixes[i].kept = 0;
+    }
+
+    for (size_t i = 0; i < fSentenceCount; i++) {
+        size_t length = strlen(fSentences[i].text);
+        bytesTotal += length;
+
+        if (track_filter(fSentences[i].text, fSentences[i].type)) {
+            bytesKept += length;
+            if ((fSentences[i].fix >= 0) && !fFixes[fSentences[i].fix].kept) {
+                fFixes[fSentences[i].fix].kept = 1;
+                fixesKept++;
+            }
+        }
+    }
+
+    // Compare every fix with the track reconstructed from the kept ones
+    double errorMax = 0, errorSum = 0;
+    size_t previous = 0, next = 0;
+
+    for (size_t i = 0; i < fFixCount; i++) {
+        if (fFixes[i].kept) {
+            previous = i;
+            continue;
+        }
+
+        if (next <= i) {
+            for (next = i + 1; (next < fFixCount) && !fFixes[next].kept; next++);
+        }
+
+        double lat = fFixes[previous].lat, lon = fFixes[previous].lon;
+        if ((next < fFixCount) && fFixes[previous].kept) {
+            double total = elapsed(fFixes[previous].time, fFixes[next].time);
+            double part = elapsed(fFixes[previous].time, fFixes[i].time);
+            double ratio = total > 0 ? part / total : 0;
+            lat += (fFixes[next].lat - lat) * ratio;
+            lon += deltaLon(lon, fFixes[next].lon) * ratio;
+        }
+
+        double error = distance(fFixes[i].lat, fFixes[i].lon, lat, lon);
+        errorSum += error;
+        if (error > errorMax) {
+            errorMax = error;
+        }
+    }
+
+    printf("%9u %10zu %10zu %7.1f%% %7.1f%% %9.2f %9.2f\n", pThreshold,
+        fFixCount, fixesKept,
+        fFixCount ? 100.0 * fixesKept / fFixCount : 0.0,
+        bytesTotal ? 100.0 * bytesKept / bytesTotal : 0.0,
+        fFixCount ? errorSum / fFixCount : 0.0, errorMax);
+}
+
+int main(int argc, char** argv) {
+    char thresholds[256] = "0,1,2,5,10,20,50";
+    unsigned interval = 30;
+    int argument = 1;
+
+    for (; (argument < argc - 1) && (argv[argument][0] == '-'); argument += 2) {
+        if (strcmp(argv[argument], "-t") == 0) {
+            snprintf(thresholds, sizeof(thresholds), "%s", argv[argument + 1]);
+        } else if (strcmp(argv[argument], "-i") == 0) {
+            interval = atoi(argv[argument + 1]);
+        } else {
+            break;
+        }
+    }
+
+    if (argument >= argc) {
+        fprintf(stderr, "usage: %s [-t threshold,...] [-i interval] log.nmea ...\n", argv[0]);
+        return 1;
+    }
+
+    // Same as track_init, whose parameter is an uint8_t
+    if (interval > TRACK_MAX_INTERVAL_LIMIT) {
+        interval = TRACK_MAX_INTERVAL_LIMIT;
+    }
+
+    for (; argument < argc; argument++) {
+        load(argv[argument]);
+        printf("%s (max. interval %us)\n", argv[argument], interval);
+        printf("threshold      fixes       kept   fixes%%   bytes%%  mean err   max err\n");
+
+        char list[256];
+        strcpy(list, thresholds);
+        for (char* value = strtok(list, ","); value; value = strtok(NULL, ",")) {
+            run(atoi(value), interval);
+        }
+        printf("\n");
+    }
+
+    free(fSentences);
+    free(fFixes);
+    return 0;
+}